@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+import sys
+import time
+
+from bson import ObjectId
+from bson.raw_bson import RawBSONDocument
+from pymongo import MongoClient
+
+# mirrors projections in src/mongo/subscribers_manager.cpp
+AUTH_PROJECTION = {'email': 1, 'exp_date': 1, 'status': 1, 'password': 1, 'devices': 1}
+
+
+def user_streams_projection(sid):
+    return {'streams': {'$elemMatch': {'sid': sid}}, 'vods': {'$elemMatch': {'sid': sid}},
+            'catchups': {'$elemMatch': {'sid': sid}}}
+
+
+def measure(subscribers, query, projection, iterations):
+    total_bytes = 0
+    start = time.perf_counter()
+    for _ in range(iterations):
+        doc = subscribers.find_one(query, projection)
+        if doc is None:
+            return 0, 0
+        total_bytes += len(doc.raw)
+    elapsed = time.perf_counter() - start
+    return total_bytes / iterations, elapsed * 1000000 / iterations
+
+
+def report(name, subscribers, query, projection, iterations):
+    full_bytes, full_us = measure(subscribers, query, None, iterations)
+    proj_bytes, proj_us = measure(subscribers, query, projection, iterations)
+    print('{0}: full {1:.0f} bytes {2:.0f} us/call, projected {3:.0f} bytes {4:.0f} us/call'.format(
+        name, full_bytes, full_us, proj_bytes, proj_us))
+
+
+def print_usage():
+    print("Usage:\n"
+          "[required] argv[1] mongodb url\n"
+          "[required] argv[2] subscriber email\n"
+          "[optional] argv[3] stream id\n"
+          "[optional] argv[4] iterations\n")
+
+
+if __name__ == "__main__":
+    argc = len(sys.argv)
+
+    if argc > 2:
+        url = sys.argv[1]
+        email = sys.argv[2]
+    else:
+        print_usage()
+        sys.exit(1)
+
+    sid = None
+    if argc > 3:
+        sid = ObjectId(sys.argv[3])
+
+    iterations = 1000
+    if argc > 4:
+        iterations = int(sys.argv[4])
+
+    client = MongoClient(url, document_class=RawBSONDocument)
+    subscribers = client.get_default_database()['subscribers']
+    query = {'email': email}
+    report('login/activate', subscribers, query, AUTH_PROJECTION, iterations)
+    if sid:
+        report('http directory', subscribers, query, user_streams_projection(sid), iterations)
+        for field in ['streams', 'vods', 'catchups']:
+            report('find ' + field, subscribers, {'email': email, field + '.sid': sid},
+                   {field: {'$elemMatch': {'sid': sid}}}, iterations)
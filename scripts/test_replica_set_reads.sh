@@ -0,0 +1,109 @@
+#!/bin/bash
+# Local three-member replica set for checking where the service sends its reads.
+#
+#   start            start members on ports 27117-27119, print the config lines for the service
+#   check            print state, replication lag and query counters of every member
+#   stall <port>     stop replication to a secondary, it goes stale for max staleness tests
+#   resume <port>    resume replication to a secondary
+#   stop             stop members and remove their data
+#
+# Catalog reads (channels, streams, series, content requests) should raise the query counters of the
+# secondaries with mongodb_catalog_read_preference=nearest or secondary, logins only those of the primary.
+# A stalled secondary stops getting catalog reads once it is mongodb_max_staleness behind.
+
+set -e
+
+REPLICA_SET=rs0
+PORTS="27117 27118 27119"
+ROOT_DIR=${REPLICA_SET_DIR:-/tmp/fastocloud_replica_set}
+
+if command -v mongosh >/dev/null 2>&1; then
+  SHELL_BIN=mongosh
+else
+  SHELL_BIN=mongo
+fi
+
+eval_js() {
+  $SHELL_BIN --quiet --port "$1" --eval "$2"
+}
+
+mongodb_url() {
+  local hosts=""
+  for port in $PORTS; do
+    hosts="$hosts${hosts:+,}localhost:$port"
+  done
+  echo "mongodb://$hosts/?replicaSet=$REPLICA_SET"
+}
+
+start() {
+  local members=""
+  local id=0
+  for port in $PORTS; do
+    mkdir -p "$ROOT_DIR/$port"
+    mongod --replSet "$REPLICA_SET" --port "$port" --bind_ip localhost --dbpath "$ROOT_DIR/$port" \
+      --logpath "$ROOT_DIR/$port.log" --fork --setParameter enableTestCommands=1 >/dev/null
+    members="$members${members:+,}{_id: $id, host: 'localhost:$port'}"
+    id=$((id + 1))
+  done
+
+  local primary_port=${PORTS%% *}
+  eval_js "$primary_port" "rs.initiate({_id: '$REPLICA_SET', members: [$members]})" >/dev/null
+  for _ in $(seq 1 60); do
+    if [ "$(eval_js "$primary_port" "db.hello().isWritablePrimary")" = "true" ]; then
+      break
+    fi
+    sleep 1
+  done
+
+  echo "mongodb_url=$(mongodb_url)"
+  echo "mongodb_catalog_read_preference=nearest"
+  echo "mongodb_user_read_preference=primary"
+  echo "mongodb_max_staleness=90"
+}
+
+check() {
+  for port in $PORTS; do
+    eval_js "$port" "
+      const status = db.serverStatus();
+      const hello = db.hello();
+      const state = hello.isWritablePrimary ? 'PRIMARY' : (hello.secondary ? 'SECONDARY' : 'OTHER');
+      let lag = 0;
+      if (hello.secondary) {
+        const rs_status = rs.status();
+        const primary = rs_status.members.find(m => m.stateStr === 'PRIMARY');
+        const self = rs_status.members.find(m => m.self);
+        if (primary && self) {
+          lag = (primary.optimeDate - self.optimeDate) / 1000;
+        }
+      }
+      print('localhost:$port ' + state + ' lag ' + lag + 's query ' + status.opcounters.query +
+            ' getmore ' + status.opcounters.getmore + ' update ' + status.opcounters.update);"
+  done
+}
+
+stall() {
+  eval_js "$1" "db.adminCommand({configureFailPoint: 'stopReplProducer', mode: 'alwaysOn'})" >/dev/null
+}
+
+resume() {
+  eval_js "$1" "db.adminCommand({configureFailPoint: 'stopReplProducer', mode: 'off'})" >/dev/null
+}
+
+stop() {
+  for port in $PORTS; do
+    eval_js "$port" "db.getSiblingDB('admin').shutdownServer({force: true})" >/dev/null 2>&1 || true
+  done
+  rm -rf "$ROOT_DIR"
+}
+
+case "$1" in
+  start) start ;;
+  check) check ;;
+  stall) stall "$2" ;;
+  resume) resume "$2" ;;
+  stop) stop ;;
+  *)
+    echo "Usage: $0 start|check|stall <port>|resume <port>|stop"
+    exit 1
+    ;;
+esac
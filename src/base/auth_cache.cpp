@@ -0,0 +1,171 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "base/auth_cache.h"
+
+#include <iterator>
+
+#include <common/time.h>
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+namespace {
+std::string MakeKey(const std::string& password, const fastotv::device_id_t& device) {
+  return password + "/" + device;
+}
+}  // namespace
+
+AuthCache::AuthCache(size_t max_entries, time_t max_age_sec)
+    : max_entries_(max_entries),
+      max_age_msec_(max_age_sec * 1000),
+      mutex_(),
+      entries_(),
+      index_(),
+      enabled_(false),
+      generation_(0),
+      stats_() {}
+
+bool AuthCache::Find(const fastotv::user_id_t& uid,
+                     const std::string& password,
+                     const fastotv::device_id_t& device,
+                     ServerDBAuthInfo* auth) {
+  if (!auth) {
+    return false;
+  }
+
+  const fastotv::timestamp_t now = common::time::current_utc_mstime();
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto user = index_.find(uid);
+  if (user == index_.end()) {
+    stats_.misses++;
+    return false;
+  }
+
+  const auto it = user->second.find(MakeKey(password, device));
+  if (it == user->second.end()) {
+    stats_.misses++;
+    return false;
+  }
+
+  const entries_t::iterator entry = it->second;
+  if (now - entry->created > max_age_msec_ || now > entry->auth.GetExpiredDate()) {
+    EraseLocked(entry);
+    stats_.misses++;
+    return false;
+  }
+
+  entries_.splice(entries_.begin(), entries_, entry);
+  stats_.hits++;
+  *auth = entry->auth;
+  return true;
+}
+
+void AuthCache::Insert(const fastotv::user_id_t& uid,
+                       const std::string& password,
+                       const fastotv::device_id_t& device,
+                       const ServerDBAuthInfo& auth,
+                       generation_t generation) {
+  if (max_entries_ == 0) {
+    return;
+  }
+
+  const fastotv::timestamp_t now = common::time::current_utc_mstime();
+  const std::string key = MakeKey(password, device);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!enabled_ || generation_ != generation) {
+    return;
+  }
+
+  user_entries_t& user = index_[uid];
+  const auto it = user.find(key);
+  if (it != user.end()) {
+    EraseLocked(it->second);
+  }
+
+  entries_.push_front({uid, key, auth, now});
+  index_[uid][key] = entries_.begin();
+  while (entries_.size() > max_entries_) {
+    EraseLocked(std::prev(entries_.end()));
+  }
+}
+
+AuthCache::generation_t AuthCache::GetGeneration() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return generation_;
+}
+
+void AuthCache::RemoveUser(const fastotv::user_id_t& uid) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  generation_++;
+  const auto user = index_.find(uid);
+  if (user == index_.end()) {
+    return;
+  }
+
+  for (const auto& it : user->second) {
+    entries_.erase(it.second);
+  }
+  index_.erase(user);
+}
+
+void AuthCache::Clear() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ClearLocked();
+}
+
+void AuthCache::SetEnabled(bool enabled) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (enabled_ == enabled) {
+    return;
+  }
+
+  enabled_ = enabled;
+  ClearLocked();
+}
+
+bool AuthCache::IsEnabled() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return enabled_;
+}
+
+CacheStats AuthCache::GetStats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  CacheStats stats = stats_;
+  stats.entries = entries_.size();
+  return stats;
+}
+
+void AuthCache::EraseLocked(entries_t::iterator it) {
+  const auto user = index_.find(it->uid);
+  if (user != index_.end()) {
+    user->second.erase(it->key);
+    if (user->second.empty()) {
+      index_.erase(user);
+    }
+  }
+  entries_.erase(it);
+}
+
+void AuthCache::ClearLocked() {
+  generation_++;
+  entries_.clear();
+  index_.clear();
+}
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,86 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "base/server_auth_info.h"
+#include "base/subscribers_manager_stats.h"
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+// Successful logins by (user id, password hash, device id), HLS players open new connections all the time and each
+// one would fetch the subscriber document again. Entries of a user are dropped when the account changes (status,
+// password, expiration, devices) and are served only while that invalidation works, see SetEnabled.
+// Bounded by entries count and age, least recently used entries are evicted first.
+class AuthCache {
+ public:
+  enum { default_max_entries = 100000, default_max_age_sec = 60 };
+  typedef uint64_t generation_t;
+
+  AuthCache(size_t max_entries, time_t max_age_sec);
+
+  bool Find(const fastotv::user_id_t& uid,
+            const std::string& password,
+            const fastotv::device_id_t& device,
+            ServerDBAuthInfo* auth);
+  // generation should be taken before the login was checked, logins raced by an invalidation are not cached
+  void Insert(const fastotv::user_id_t& uid,
+              const std::string& password,
+              const fastotv::device_id_t& device,
+              const ServerDBAuthInfo& auth,
+              generation_t generation);
+  generation_t GetGeneration() const;
+
+  void RemoveUser(const fastotv::user_id_t& uid);
+  void Clear();
+  void SetEnabled(bool enabled);
+  bool IsEnabled() const;
+
+  CacheStats GetStats() const;
+
+ private:
+  struct Entry {
+    fastotv::user_id_t uid;
+    std::string key;
+    ServerDBAuthInfo auth;
+    fastotv::timestamp_t created;
+  };
+  typedef std::list<Entry> entries_t;
+  typedef std::unordered_map<std::string, entries_t::iterator> user_entries_t;
+
+  void EraseLocked(entries_t::iterator it);
+  void ClearLocked();
+
+  const size_t max_entries_;
+  const fastotv::timestamp_t max_age_msec_;
+
+  mutable std::mutex mutex_;
+  entries_t entries_;  // most recently used first
+  std::unordered_map<fastotv::user_id_t, user_entries_t> index_;
+  bool enabled_;
+  generation_t generation_;
+  CacheStats stats_;
+};
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,110 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "base/db_worker_pool.h"
+
+#include <utility>
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+DbWorkerPool::DbWorkerPool(size_t workers, size_t max_queue_size)
+    : workers_count_(workers ? workers : 1),
+      max_queue_size_(max_queue_size ? max_queue_size : 1),
+      queue_mutex_(),
+      queue_cond_(),
+      queue_(),
+      stop_(false),
+      workers_() {}
+
+DbWorkerPool::~DbWorkerPool() {
+  Stop();
+}
+
+void DbWorkerPool::Start() {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  if (!workers_.empty()) {
+    return;
+  }
+
+  stop_ = false;
+  for (size_t i = 0; i < workers_count_; ++i) {
+    workers_.push_back(std::thread([this] { WorkerRoutine(); }));
+  }
+}
+
+void DbWorkerPool::Stop() {
+  std::vector<std::thread> workers;
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    stop_ = true;
+    queue_.clear();
+    workers.swap(workers_);
+  }
+  queue_cond_.notify_all();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+common::Error DbWorkerPool::Post(task_t task) {
+  if (!task) {
+    return common::make_error_inval();
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    if (stop_ || workers_.empty()) {
+      return common::make_error("Database workers not started");
+    }
+
+    if (queue_.size() >= max_queue_size_) {
+      return common::make_error("Database workers queue is full");
+    }
+
+    queue_.push_back(std::move(task));
+  }
+  queue_cond_.notify_one();
+  return common::Error();
+}
+
+size_t DbWorkerPool::GetQueueSize() const {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  return queue_.size();
+}
+
+void DbWorkerPool::WorkerRoutine() {
+  while (true) {
+    task_t task;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      queue_cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (stop_) {
+        return;
+      }
+
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    task();
+  }
+}
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,99 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <common/error.h>
+#include <common/libev/io_loop.h>
+
+#include "base/subscriber_info.h"
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+// Runs database bound work off the libev loops, so one slow query doesn't stall every socket of a loop.
+// The queue is bounded, Post fails instead of piling up work when the database can't keep up.
+class DbWorkerPool {
+ public:
+  enum { default_workers = 4, default_queue_size = 1024 };
+  typedef std::function<void()> task_t;
+
+  DbWorkerPool(size_t workers, size_t max_queue_size);
+  ~DbWorkerPool();
+
+  void Start();
+  // not started tasks are dropped
+  void Stop();
+
+  common::Error Post(task_t task) WARN_UNUSED_RESULT;
+
+  // task runs on a worker and returns a completion, the completion runs on the loop thread serving the client when it
+  // completes, only if the client is still connected; Client provides GetServingLoop() and GetLifeToken() of
+  // SubscriberInfo
+  template <typename Client>
+  common::Error PostForClient(Client* client,
+                              std::function<std::function<void(Client*)>()> task) WARN_UNUSED_RESULT;
+
+  size_t GetQueueSize() const;
+
+ private:
+  void WorkerRoutine();
+
+  const size_t workers_count_;
+  const size_t max_queue_size_;
+
+  mutable std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+  std::deque<task_t> queue_;
+  bool stop_;
+
+  std::vector<std::thread> workers_;
+};
+
+template <typename Client>
+common::Error DbWorkerPool::PostForClient(Client* client, std::function<std::function<void(Client*)>()> task) {
+  if (!client || !task) {
+    return common::make_error_inval();
+  }
+
+  const SubscriberInfo::serving_loop_t serving = client->GetServingLoop();
+  const SubscriberInfo::life_token_t token = client->GetLifeToken();
+  return Post([serving, token, client, task]() {
+    const std::function<void(Client*)> done = task();
+    if (!done) {
+      return;
+    }
+
+    // not the loop of the post, the client may have been handed out to another loop meanwhile
+    serving->Exec([token, client, done]() {
+      if (token.expired()) {  // closed while the request was in flight
+        return;
+      }
+      done(client);
+    });
+  });
+}
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
@@ -24,6 +24,10 @@ bool CatchupEndpointInfo::IsValid() const {
   return catchups_host.IsValid() && catchups_http_root.IsValid();
 }
 
+bool ChannelsVersion::Equals(const ChannelsVersion& other) const {
+  return user == other.user && catalog == other.catalog && subscribers == other.subscribers;
+}
+
 ISubscribersManager::ISubscribersManager(ISubscribersObserver* observer) : observer_(observer) {}
 
 common::Error ISubscribersManager::RegisterInnerConnectionByHost(SubscriberInfo* client, const ServerDBAuthInfo& info) {
@@ -51,6 +55,16 @@ common::Error ISubscribersManager::UnRegisterInnerConnectionByHost(SubscriberInf
   return common::Error();
 }
 
+bool ISubscribersManager::GetChannelsVersion(const fastotv::user_id_t& uid, ChannelsVersion* version) const {
+  UNUSED(uid);
+  UNUSED(version);
+  return false;
+}
+
+SubscribersManagerStats ISubscribersManager::GetStats() const {
+  return SubscribersManagerStats();
+}
+
 ISubscribersManager::~ISubscribersManager() {}
 
 }  // namespace base
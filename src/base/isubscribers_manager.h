@@ -33,6 +33,7 @@
 #include <fastotv/commands_info/vods_info.h>
 
 #include "base/subscriber_info.h"
+#include "base/subscribers_manager_stats.h"
 
 namespace fastocloud {
 namespace server {
@@ -45,6 +46,23 @@ struct CatchupEndpointInfo {
   common::file_system::ascii_directory_string_path catchups_http_root;
 };
 
+// get_channels payload of a user is valid while both counters are unchanged
+struct ChannelsVersion {
+  bool Equals(const ChannelsVersion& other) const;
+
+  uint64_t user = 0;
+  uint64_t catalog = 0;
+  uint64_t subscribers = 0;  // bumped when changes of users were possibly missed
+};
+
+inline bool operator==(const ChannelsVersion& left, const ChannelsVersion& right) {
+  return left.Equals(right);
+}
+
+inline bool operator!=(const ChannelsVersion& left, const ChannelsVersion& right) {
+  return !(left == right);
+}
+
 class ISubscribersObserver;
 
 class ISubscribersManager {
@@ -67,14 +85,21 @@ class ISubscribersManager {
   virtual common::Error CheckIsLoginClient(SubscriberInfo* client, ServerDBAuthInfo* ser) const WARN_UNUSED_RESULT = 0;
 
   virtual size_t GetAndUpdateOnlineUserByStreamID(fastotv::stream_id_t sid) = 0;
+  // false if changes of the user channels can't be tracked, payload shouldn't be cached;
+  // take the version before the database is read, a concurrent change then makes the stored entry stale
+  virtual bool GetChannelsVersion(const fastotv::user_id_t& uid, ChannelsVersion* version) const;
 
+  // peer_host is the address the credentials come from, failing logins are throttled per host
   virtual common::Error ClientActivate(const fastotv::commands_info::LoginInfo& uauth,
+                                       const std::string& peer_host,
                                        fastotv::commands_info::DevicesInfo* dev) WARN_UNUSED_RESULT = 0;
   virtual common::Error ClientLogin(fastotv::user_id_t uid,
                                     const std::string& password,
                                     fastotv::device_id_t dev,
+                                    const std::string& peer_host,
                                     ServerDBAuthInfo* ser) = 0;
   virtual common::Error ClientLogin(const fastotv::commands_info::AuthInfo& uauth,
+                                    const std::string& peer_host,
                                     ServerDBAuthInfo* ser) WARN_UNUSED_RESULT = 0;
   virtual common::Error ClientGetChannels(const fastotv::commands_info::AuthInfo& auth,
                                           fastotv::commands_info::ChannelsInfo* chans,
@@ -85,7 +110,7 @@ class ISubscribersManager {
                                           fastotv::commands_info::SeriesInfo* series,
                                           fastotv::commands_info::ContentRequestsInfo* content_requests)
       WARN_UNUSED_RESULT = 0;
-  virtual common::Error ClientFindHttpDirectoryOrUrlForChannel(const fastotv::commands_info::AuthInfo& auth,
+  virtual common::Error ClientFindHttpDirectoryOrUrlForChannel(const base::ServerDBAuthInfo& auth,
                                                                fastotv::stream_id_t sid,
                                                                fastotv::channel_id_t cid,
                                                                http_directory_t* directory,
@@ -139,6 +164,8 @@ class ISubscribersManager {
   virtual common::Error AddUserCatchup(const base::ServerDBAuthInfo& auth,
                                        fastotv::stream_id_t sid) WARN_UNUSED_RESULT = 0;
 
+  virtual SubscribersManagerStats GetStats() const;
+
   virtual ~ISubscribersManager();
 
  private:
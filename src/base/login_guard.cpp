@@ -0,0 +1,198 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "base/login_guard.h"
+
+#include <algorithm>
+
+#include <common/logger.h>
+#include <common/time.h>
+
+#define TOO_MANY_FAILURES_ERROR "Too many failed logins, try again later"
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+namespace {
+std::string MakeKey(const std::string& identity, const std::string& password) {
+  return identity + "\n" + password;
+}
+}  // namespace
+
+LoginGuard::LoginGuard(size_t max_entries,
+                       uint32_t negative_ttl_msec,
+                       size_t free_failures,
+                       uint32_t backoff_msec,
+                       uint32_t max_backoff_msec,
+                       size_t address_failures,
+                       uint32_t address_window_msec,
+                       now_t now)
+    : max_entries_(max_entries),
+      negative_ttl_msec_(negative_ttl_msec),
+      free_failures_(free_failures),
+      backoff_msec_(backoff_msec),
+      max_backoff_msec_(max_backoff_msec),
+      address_failures_(address_failures),
+      address_window_msec_(address_window_msec),
+      now_(now ? now : []() { return common::time::current_utc_mstime(); }),
+      mutex_(),
+      negative_(),
+      identities_(),
+      addresses_(),
+      stats_() {}
+
+LoginGuard::Identity LoginGuard::MakeIdentity(const std::string& address,
+                                              const std::string& login,
+                                              const std::string& device) {
+  return {address, login + "/" + device + "@" + address};
+}
+
+common::Error LoginGuard::Check(const Identity& identity, const std::string& password) {
+  const fastotv::timestamp_t now = now_();
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto address = addresses_.find(identity.address);
+  if (address != addresses_.end() && now < address->second.window_end &&
+      address->second.failures >= address_failures_) {
+    stats_.rejected_address++;
+    return common::make_error(TOO_MANY_FAILURES_ERROR);
+  }
+
+  const auto state = identities_.find(identity.key);
+  if (state != identities_.end() && now < state->second.blocked_until) {
+    stats_.rejected_backoff++;
+    return common::make_error(TOO_MANY_FAILURES_ERROR);
+  }
+
+  const auto entry = negative_.find(MakeKey(identity.key, password));
+  if (entry == negative_.end()) {
+    return common::Error();
+  }
+
+  if (now >= entry->second.expires) {
+    negative_.erase(entry);
+    return common::Error();
+  }
+
+  stats_.rejected_cached++;
+  return common::make_error(entry->second.error);
+}
+
+common::Error LoginGuard::Reject(const Identity& identity, const std::string& password, common::Error err) {
+  if (!err || max_entries_ == 0) {
+    return err;
+  }
+
+  const fastotv::timestamp_t now = now_();
+  std::unique_lock<std::mutex> lock(mutex_);
+  stats_.failures++;
+  if (negative_.size() >= max_entries_ || identities_.size() >= max_entries_ || addresses_.size() >= max_entries_) {
+    PurgeLocked(now);
+  }
+
+  if (negative_ttl_msec_ && negative_.size() < max_entries_) {
+    negative_[MakeKey(identity.key, password)] = {err->GetDescription(), now + negative_ttl_msec_};
+  }
+
+  if (address_failures_ && !identity.address.empty()) {
+    auto address = addresses_.find(identity.address);
+    if (address == addresses_.end() && addresses_.size() < max_entries_) {
+      address = addresses_.insert({identity.address, {0, now + address_window_msec_}}).first;
+    } else if (address != addresses_.end() && now >= address->second.window_end) {
+      address->second = {0, now + address_window_msec_};
+    }
+
+    if (address != addresses_.end() && ++address->second.failures == address_failures_) {
+      WARNING_LOG() << "Logins from " << identity.address << " blocked after " << address_failures_
+                    << " failures, last error: " << err->GetDescription();
+    }
+  }
+
+  auto state = identities_.find(identity.key);
+  if (state == identities_.end()) {
+    if (identities_.size() >= max_entries_) {
+      return err;
+    }
+    state = identities_.insert({identity.key, {0, now, 0}}).first;
+  } else if (IsForgotten(state->second, now)) {
+    state->second = {0, now, 0};
+  }
+
+  IdentityState& failed = state->second;
+  failed.failures++;
+  failed.last_attempt = now;
+  if (failed.failures > free_failures_) {
+    const size_t doublings = std::min<size_t>(failed.failures - free_failures_ - 1, 30);
+    const fastotv::timestamp_t backoff = std::min(backoff_msec_ << doublings, max_backoff_msec_);
+    failed.blocked_until = now + backoff;
+    failed.last_attempt = failed.blocked_until;
+    if (failed.failures == free_failures_ + 1) {
+      WARNING_LOG() << "Logins of " << identity.key << " blocked after " << failed.failures
+                    << " failures, last error: " << err->GetDescription();
+    }
+  }
+  return err;
+}
+
+void LoginGuard::Accept(const Identity& identity) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  identities_.erase(identity.key);
+}
+
+LoginGuardStats LoginGuard::GetStats() const {
+  const fastotv::timestamp_t now = now_();
+  std::unique_lock<std::mutex> lock(mutex_);
+  LoginGuardStats stats = stats_;
+  stats.negative_entries = negative_.size();
+  for (const auto& state : identities_) {
+    if (now < state.second.blocked_until) {
+      stats.blocked_identities++;
+    }
+  }
+  return stats;
+}
+
+void LoginGuard::PurgeLocked(fastotv::timestamp_t now) {
+  for (auto it = negative_.begin(); it != negative_.end();) {
+    if (now >= it->second.expires) {
+      it = negative_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (auto it = identities_.begin(); it != identities_.end();) {
+    if (IsForgotten(it->second, now)) {
+      it = identities_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (auto it = addresses_.begin(); it != addresses_.end();) {
+    if (now >= it->second.window_end) {
+      it = addresses_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool LoginGuard::IsForgotten(const IdentityState& state, fastotv::timestamp_t now) const {
+  return now - state.last_attempt >= max_backoff_msec_;
+}
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
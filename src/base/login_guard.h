@@ -0,0 +1,116 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <common/error.h>
+
+#include <fastotv/types.h>
+
+#include "base/subscribers_manager_stats.h"
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+// Logins that keep failing (unknown emails, wrong passwords, removed devices of set-top boxes in retry loops) are
+// rejected from memory. Failed credentials are answered with their error for negative_ttl_msec, an identity failing
+// more than free_failures times in a row is blocked for a backoff doubling with every further failure. Identities are
+// login/device pairs seen from one peer host: a stale device doesn't lock the other devices of its user out, and
+// failures sent from another host don't lock the owner out. Failures of an identity are forgotten after
+// max_backoff_msec without attempts. A peer host that failed address_failures logins of any identities within
+// address_window_msec is rejected until the window ends, which slows credential stuffing over many logins.
+class LoginGuard {
+ public:
+  enum {
+    default_max_entries = 100000,
+    default_negative_ttl_msec = 10000,
+    default_free_failures = 3,
+    default_backoff_msec = 1000,
+    default_max_backoff_msec = 300000,
+    default_address_failures = 30,
+    default_address_window_msec = 60000
+  };
+
+  // msec clock of the windows, the current utc time if empty
+  typedef std::function<fastotv::timestamp_t()> now_t;
+
+  struct Identity {
+    std::string address;  // peer host of the client, empty if unknown
+    std::string key;
+  };
+
+  LoginGuard(size_t max_entries,
+             uint32_t negative_ttl_msec,
+             size_t free_failures,
+             uint32_t backoff_msec,
+             uint32_t max_backoff_msec,
+             size_t address_failures,
+             uint32_t address_window_msec,
+             now_t now = now_t());
+
+  static Identity MakeIdentity(const std::string& address, const std::string& login, const std::string& device);
+
+  // error to answer without a database lookup, null if the login should be checked
+  common::Error Check(const Identity& identity, const std::string& password);
+  // credentials were rejected by the user document or there is none, returns err
+  common::Error Reject(const Identity& identity, const std::string& password, common::Error err);
+  void Accept(const Identity& identity);
+
+  LoginGuardStats GetStats() const;
+
+ private:
+  struct NegativeEntry {
+    std::string error;
+    fastotv::timestamp_t expires;
+  };
+  struct IdentityState {
+    size_t failures;
+    fastotv::timestamp_t last_attempt;  // last failure or end of the backoff
+    fastotv::timestamp_t blocked_until;
+  };
+  struct AddressState {
+    size_t failures;
+    fastotv::timestamp_t window_end;
+  };
+
+  void PurgeLocked(fastotv::timestamp_t now);
+  bool IsForgotten(const IdentityState& state, fastotv::timestamp_t now) const;
+
+  const size_t max_entries_;
+  const fastotv::timestamp_t negative_ttl_msec_;
+  const size_t free_failures_;
+  const fastotv::timestamp_t backoff_msec_;
+  const fastotv::timestamp_t max_backoff_msec_;
+  const size_t address_failures_;
+  const fastotv::timestamp_t address_window_msec_;
+  const now_t now_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, NegativeEntry> negative_;
+  std::unordered_map<std::string, IdentityState> identities_;
+  std::unordered_map<std::string, AddressState> addresses_;
+  LoginGuardStats stats_;
+};
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
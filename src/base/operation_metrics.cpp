@@ -0,0 +1,162 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "base/operation_metrics.h"
+
+#include <math.h>
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+namespace {
+size_t HighestBit(uint64_t value) {
+  return 63 - __builtin_clzll(value);
+}
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : count_(0), max_(0) {
+  for (size_t i = 0; i < bucket_count; ++i) {
+    buckets_[i] = 0;
+  }
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+  buckets_[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+  return max_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+  // buckets are summed instead of reading count_, concurrent records can't make the rank unreachable
+  uint64_t counts[bucket_count];
+  uint64_t total = 0;
+  for (size_t i = 0; i < bucket_count; ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t rank = static_cast<uint64_t>(ceil(percentile / 100 * total));
+  if (rank == 0) {
+    rank = 1;
+  } else if (rank > total) {
+    rank = total;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < bucket_count; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      const uint64_t upper = GetBucketUpperBound(i);
+      const uint64_t max = GetMax();
+      return upper < max ? upper : max;
+    }
+  }
+  return GetMax();
+}
+
+size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+  if (value < sub_bucket_count) {
+    return value;
+  }
+
+  const size_t exponent = HighestBit(value);
+  const size_t sub_bucket = (value >> (exponent - sub_bucket_bits)) & (sub_bucket_count - 1);
+  return (exponent - sub_bucket_bits + 1) * sub_bucket_count + sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+  if (index < sub_bucket_count) {
+    return index;
+  }
+
+  const size_t shift = index / sub_bucket_count - 1;
+  const uint64_t sub_bucket = index % sub_bucket_count;
+  const uint64_t lower = (sub_bucket_count + sub_bucket) << shift;
+  return lower + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+OperationMetrics::OperationMetrics() : mutex_(), operations_() {}
+
+void OperationMetrics::Record(const std::string& operation, const Sample& sample) {
+  Operation* op = GetOperation(operation);
+  op->latency.Record(sample.usec);
+  if (sample.error) {
+    op->errors.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (sample.slow) {
+    op->slow.fetch_add(1, std::memory_order_relaxed);
+  }
+  op->documents.fetch_add(sample.documents, std::memory_order_relaxed);
+  op->bytes.fetch_add(sample.bytes, std::memory_order_relaxed);
+}
+
+bool OperationMetrics::TryAcquireDiagnostics(const std::string& operation,
+                                             uint64_t now_msec,
+                                             uint64_t interval_msec) {
+  Operation* op = GetOperation(operation);
+  uint64_t last = op->diagnostics_msec.load(std::memory_order_relaxed);
+  if (last != 0 && now_msec - last < interval_msec) {
+    return false;
+  }
+  return op->diagnostics_msec.compare_exchange_strong(last, now_msec, std::memory_order_relaxed);
+}
+
+std::vector<OperationStats> OperationMetrics::GetStats() const {
+  std::vector<OperationStats> result;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& it : operations_) {
+    const Operation* op = it.second.get();
+    OperationStats stats;
+    stats.name = it.first;
+    stats.calls = op->latency.GetCount();
+    stats.errors = op->errors.load(std::memory_order_relaxed);
+    stats.slow = op->slow.load(std::memory_order_relaxed);
+    stats.documents = op->documents.load(std::memory_order_relaxed);
+    stats.bytes = op->bytes.load(std::memory_order_relaxed);
+    stats.p50_usec = op->latency.GetPercentile(50);
+    stats.p90_usec = op->latency.GetPercentile(90);
+    stats.p99_usec = op->latency.GetPercentile(99);
+    stats.max_usec = op->latency.GetMax();
+    result.push_back(stats);
+  }
+  return result;
+}
+
+OperationMetrics::Operation* OperationMetrics::GetOperation(const std::string& operation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<Operation>& op = operations_[operation];
+  if (!op) {
+    op.reset(new Operation);
+  }
+  return op.get();
+}
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
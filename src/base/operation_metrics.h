@@ -0,0 +1,96 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "base/subscribers_manager_stats.h"
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+// HDR-style log-linear histogram: every power of two is split into 8 linear sub-buckets, so a recorded value is
+// known within 12.5% over the whole 64-bit range with a fixed 4 KB of counters. Recording is lock free.
+class LatencyHistogram {
+ public:
+  enum { sub_bucket_bits = 3, sub_bucket_count = 1 << sub_bucket_bits, bucket_count = (64 - 2) * sub_bucket_count };
+
+  LatencyHistogram();
+
+  void Record(uint64_t value);
+
+  uint64_t GetCount() const;
+  uint64_t GetMax() const;
+  // upper bound of the bucket holding the given percentile (0-100], 0 if nothing was recorded
+  uint64_t GetPercentile(double percentile) const;
+
+  static size_t GetBucketIndex(uint64_t value);
+  static uint64_t GetBucketUpperBound(size_t index);
+
+ private:
+  std::atomic<uint64_t> buckets_[bucket_count];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> max_;
+};
+
+// Per-operation latency histograms and counters, operations are registered on first use by name.
+class OperationMetrics {
+ public:
+  struct Sample {
+    uint64_t usec = 0;
+    uint64_t documents = 0;
+    uint64_t bytes = 0;
+    bool error = false;
+    bool slow = false;
+  };
+
+  OperationMetrics();
+
+  void Record(const std::string& operation, const Sample& sample);
+  // true once per interval for an operation, rate limits expensive diagnostics of slow operations
+  bool TryAcquireDiagnostics(const std::string& operation, uint64_t now_msec, uint64_t interval_msec);
+
+  // sorted by name
+  std::vector<OperationStats> GetStats() const;
+
+ private:
+  struct Operation {
+    LatencyHistogram latency;
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> slow{0};
+    std::atomic<uint64_t> documents{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> diagnostics_msec{0};
+  };
+
+  Operation* GetOperation(const std::string& operation);
+
+  mutable std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<Operation>> operations_;
+};
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,102 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <common/error.h>
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+struct SingleFlightStats {
+  size_t executions = 0;
+  size_t shared = 0;  // calls that waited for the execution of another caller
+  size_t in_flight = 0;
+};
+
+// Concurrent calls with the same key share one execution of their work: the first caller runs it, the others wait
+// and get its error and result. Nothing is kept once the work finished, later calls run the work again.
+template <typename T>
+class SingleFlight {
+ public:
+  typedef std::function<common::Error(T* result)> work_t;
+
+  SingleFlight() : mutex_(), calls_(), stats_() {}
+
+  // leader is true for the caller whose work ran
+  common::Error Do(const std::string& key, work_t work, T* result, bool* leader) {
+    if (!work || !result || !leader) {
+      return common::make_error_inval();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = calls_.find(key);
+    if (it != calls_.end()) {
+      const std::shared_ptr<Call> call = it->second;
+      stats_.shared++;
+      call->done_cond.wait(lock, [call]() { return call->done; });
+      *result = call->result;
+      *leader = false;
+      return call->err;
+    }
+
+    const std::shared_ptr<Call> call = std::make_shared<Call>();
+    calls_[key] = call;
+    stats_.executions++;
+    stats_.in_flight++;
+    lock.unlock();
+
+    common::Error err = work(&call->result);
+
+    lock.lock();
+    call->err = err;
+    call->done = true;
+    calls_.erase(key);
+    stats_.in_flight--;
+    call->done_cond.notify_all();
+    *result = call->result;
+    *leader = true;
+    return err;
+  }
+
+  SingleFlightStats GetStats() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  struct Call {
+    std::condition_variable done_cond;
+    bool done = false;
+    common::Error err;
+    T result;
+  };
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Call>> calls_;
+  SingleFlightStats stats_;
+};
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
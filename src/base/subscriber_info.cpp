@@ -18,21 +18,105 @@ namespace fastocloud {
 namespace server {
 namespace base {
 
-SubscriberInfo::SubscriberInfo() : login_(), current_stream_id_(fastotv::invalid_stream_id) {}
+ServingLoop::ServingLoop() : mutex_(), loop_(nullptr), exec_(), parked_() {}
+
+void ServingLoop::Leave() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  loop_ = nullptr;
+  exec_ = exec_t();
+}
+
+void ServingLoop::SetLoop(const void* loop, exec_t exec) {
+  std::vector<task_t> parked;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    loop_ = loop;
+    exec_ = exec;
+    parked.swap(parked_);
+  }
+
+  for (size_t i = 0; i < parked.size(); ++i) {
+    Dispatch(loop, exec, parked[i]);
+  }
+}
+
+void ServingLoop::Exec(task_t task) {
+  const void* loop = nullptr;
+  exec_t exec;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!loop_) {
+      parked_.push_back(task);
+      return;
+    }
+    loop = loop_;
+    exec = exec_;
+  }
+
+  Dispatch(loop, exec, task);
+}
+
+void ServingLoop::Dispatch(const void* loop, exec_t exec, task_t task) {
+  const std::shared_ptr<ServingLoop> self = shared_from_this();
+  exec([self, loop, task]() { self->RunOn(loop, task); });
+}
+
+void ServingLoop::RunOn(const void* loop, task_t task) {
+  const void* next = nullptr;
+  exec_t exec;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (loop_ != loop) {  // the connection left the loop while the task was queued
+      if (!loop_) {
+        parked_.push_back(task);
+        return;
+      }
+      next = loop_;
+      exec = exec_;
+    }
+  }
+
+  if (next) {
+    Dispatch(next, exec, task);
+    return;
+  }
+
+  // only the thread of this loop moves the connection away, it stays here while the task runs
+  task();
+}
+
+SubscriberInfo::SubscriberInfo()
+    : mutex_(),
+      login_(),
+      current_stream_id_(fastotv::invalid_stream_id),
+      life_(std::make_shared<const bool>(true)),
+      serving_loop_(std::make_shared<ServingLoop>()) {}
+
+SubscriberInfo::life_token_t SubscriberInfo::GetLifeToken() const {
+  return life_;
+}
+
+SubscriberInfo::serving_loop_t SubscriberInfo::GetServingLoop() const {
+  return serving_loop_;
+}
 
 void SubscriberInfo::SetCurrentStreamID(fastotv::stream_id_t sid) {
+  std::unique_lock<std::mutex> lock(mutex_);
   current_stream_id_ = sid;
 }
 
 fastotv::stream_id_t SubscriberInfo::GetCurrentStreamID() const {
+  std::unique_lock<std::mutex> lock(mutex_);
   return current_stream_id_;
 }
 
 void SubscriberInfo::SetLogin(login_t login) {
+  std::unique_lock<std::mutex> lock(mutex_);
   login_ = login;
 }
 
 SubscriberInfo::login_t SubscriberInfo::GetLogin() const {
+  std::unique_lock<std::mutex> lock(mutex_);
   return login_;
 }
 
@@ -14,6 +14,11 @@
 
 #pragma once
 
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include <fastotv/commands_info/notification_text_info.h>
 
 #include "base/front_subscriber_info.h"
@@ -23,12 +28,53 @@ namespace fastocloud {
 namespace server {
 namespace base {
 
+// Loop thread a connection is served on, followed by the tasks other threads post for the connection. A connection
+// moving between loops has none for a while, what's posted meanwhile waits for the loop it arrives at. A task never
+// runs on a loop the connection has left, so it doesn't race the new loop over the connection.
+class ServingLoop : public std::enable_shared_from_this<ServingLoop> {
+ public:
+  typedef std::function<void()> task_t;
+
+  ServingLoop();
+
+  // Loop provides ExecInLoopThread, called on its thread once the connection is registered there
+  template <typename Loop>
+  void Arrive(Loop* loop) {
+    SetLoop(loop, [loop](task_t task) { loop->ExecInLoopThread(task); });
+  }
+  // called on the thread of the current loop before the connection is unregistered from it
+  void Leave();
+
+  // task runs on the thread of the loop serving the connection when the task runs
+  void Exec(task_t task);
+
+ private:
+  typedef std::function<void(task_t)> exec_t;
+
+  void SetLoop(const void* loop, exec_t exec);
+  void Dispatch(const void* loop, exec_t exec, task_t task);
+  void RunOn(const void* loop, task_t task);
+
+  std::mutex mutex_;
+  const void* loop_;
+  exec_t exec_;
+  std::vector<task_t> parked_;
+};
+
+// login and stream are read from the loops of other connections and the database workers
 class SubscriberInfo {
  public:
   typedef common::Optional<ServerDBAuthInfo> login_t;
+  // expires when the connection is deleted
+  typedef std::weak_ptr<const void> life_token_t;
+  typedef std::shared_ptr<ServingLoop> serving_loop_t;
 
   SubscriberInfo();
 
+  life_token_t GetLifeToken() const;
+  // completions and notifications for the connection go through it, it outlives the connection
+  serving_loop_t GetServingLoop() const;
+
   void SetCurrentStreamID(fastotv::stream_id_t sid);
   fastotv::stream_id_t GetCurrentStreamID() const;
 
@@ -39,8 +85,11 @@ class SubscriberInfo {
   virtual common::ErrnoError SendNotification(const fastotv::commands_info::NotificationTextInfo& notify) = 0;
 
  private:
+  mutable std::mutex mutex_;
   login_t login_;
   fastotv::stream_id_t current_stream_id_;
+  const std::shared_ptr<const bool> life_;
+  const serving_loop_t serving_loop_;
 };
 
 }  // namespace base
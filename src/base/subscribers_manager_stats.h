@@ -0,0 +1,137 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+struct CacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t entries = 0;
+};
+
+struct PoolStats {
+  size_t size = 0;
+  size_t in_use = 0;
+  size_t peak_in_use = 0;
+  size_t checkouts = 0;
+  size_t timeouts = 0;
+  uint64_t wait_total_usec = 0;
+  uint64_t wait_max_usec = 0;
+};
+
+struct ChannelsCacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t entries = 0;
+  size_t evictions = 0;
+  uint64_t bytes = 0;
+  uint64_t bytes_saved = 0;
+};
+
+// channels_update requests sent to clients on changes of their channels instead of them polling get_channels
+struct ChannelsPushStats {
+  uint64_t get_channels = 0;  // get_channels requests of clients
+  uint64_t updates = 0;
+  uint64_t changes = 0;    // added, updated and removed entries sent
+  uint64_t unchanged = 0;  // version changes without a change of the client lists
+  uint64_t failures = 0;
+};
+
+struct WriteBufferStats {
+  size_t pending = 0;
+  size_t writes = 0;
+  size_t flushed = 0;
+  size_t flushes = 0;
+  size_t failed_flushes = 0;  // batches put back for the next flush
+};
+
+struct ViewCountersStats {
+  uint64_t increments = 0;
+  uint64_t flushed = 0;  // streams written
+  size_t flushes = 0;
+  size_t failed_flushes = 0;
+};
+
+struct LoginGuardStats {
+  uint64_t failures = 0;          // logins rejected after a database lookup
+  uint64_t rejected_cached = 0;   // repeated failed credentials answered from memory
+  uint64_t rejected_backoff = 0;  // logins of identities blocked after failures in a row
+  uint64_t rejected_address = 0;  // logins from peer hosts with too many failures of any identities
+  size_t negative_entries = 0;
+  size_t blocked_identities = 0;
+};
+
+// latencies of one kind of database operation, percentiles are bucket upper bounds (within 12.5%)
+struct OperationStats {
+  std::string name;
+  uint64_t calls = 0;
+  uint64_t errors = 0;
+  uint64_t slow = 0;
+  uint64_t documents = 0;  // returned by finds, matched or inserted by writes
+  uint64_t bytes = 0;      // bson bytes returned by finds
+  uint64_t p50_usec = 0;
+  uint64_t p90_usec = 0;
+  uint64_t p99_usec = 0;
+  uint64_t max_usec = 0;
+};
+
+// lookup of the service checked at startup: the index serving it and the plan the database chose
+struct QueryPlanStats {
+  std::string operation;
+  std::string collection;
+  std::string index;
+  std::string index_state;  // exists, created, missing, no_permission or error
+  std::string plan;         // stages of the winning plan, empty if it couldn't be explained
+  bool collection_scan = false;
+};
+
+// caches loading at startup, before the subscribers and http servers listen
+struct WarmUpStats {
+  bool complete = false;  // every collection was read within the time budget
+  uint64_t duration_msec = 0;
+  size_t subscribers = 0;  // active subscribers read
+  size_t devices = 0;      // logins put into the auth cache
+  size_t streams = 0;
+  size_t series = 0;
+  uint64_t bytes = 0;  // bson bytes read
+};
+
+struct SubscribersManagerStats {
+  CacheStats streams_cache;
+  PoolStats pool;
+  ChannelsCacheStats channels_cache;
+  ChannelsPushStats channels_push;
+  WriteBufferStats write_buffer;
+  ViewCountersStats view_counters;
+  CacheStats auth_cache;
+  CacheStats paths_cache;
+  LoginGuardStats login_guard;
+  size_t unknown_stream_classes = 0;  // stream documents skipped for an unknown _cls
+  std::vector<OperationStats> operations;
+  std::vector<QueryPlanStats> query_plans;
+};
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
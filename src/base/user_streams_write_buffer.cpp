@@ -0,0 +1,290 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "base/user_streams_write_buffer.h"
+
+#include <chrono>
+#include <utility>
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+void UserStreamsWriteBuffer::Update::Merge(const Update& newer) {
+  if (newer.fields & FAVORITE_FIELD) {
+    favorite = newer.favorite;
+  }
+  if (newer.fields & RECENT_FIELD) {
+    recent = newer.recent;
+  }
+  if (newer.fields & INTERRUPTION_TIME_FIELD) {
+    interruption_time = newer.interruption_time;
+  }
+  fields |= newer.fields;
+  array = newer.array;
+}
+
+UserStreamsWriteBuffer::UserStreamsWriteBuffer(uint32_t flush_interval_msec, size_t max_pending)
+    : flush_interval_msec_(flush_interval_msec ? flush_interval_msec : 1),
+      max_pending_(max_pending ? max_pending : 1),
+      mutex_(),
+      flush_cond_(),
+      pending_(),
+      pending_count_(0),
+      flushing_(),
+      flush_running_(false),
+      flush_done_cond_(),
+      flush_(),
+      stop_(false),
+      flush_thread_(),
+      stats_() {}
+
+UserStreamsWriteBuffer::~UserStreamsWriteBuffer() {
+  Stop();
+}
+
+void UserStreamsWriteBuffer::Start(flush_t flush) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (flush_thread_.joinable()) {
+    return;
+  }
+
+  flush_ = flush;
+  stop_ = false;
+  flush_thread_ = std::thread([this] { FlushRoutine(); });
+}
+
+void UserStreamsWriteBuffer::Stop() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!flush_thread_.joinable()) {
+      return;
+    }
+    stop_ = true;
+  }
+  flush_cond_.notify_all();
+  flush_thread_.join();
+}
+
+void UserStreamsWriteBuffer::SetFavorite(const fastotv::user_id_t& uid,
+                                         const fastotv::stream_id_t& sid,
+                                         UserArray array,
+                                         bool favorite) {
+  Update update;
+  update.uid = uid;
+  update.sid = sid;
+  update.array = array;
+  update.fields = FAVORITE_FIELD;
+  update.favorite = favorite;
+  Put(update);
+}
+
+void UserStreamsWriteBuffer::SetRecent(const fastotv::user_id_t& uid,
+                                       const fastotv::stream_id_t& sid,
+                                       UserArray array,
+                                       fastotv::timestamp_t recent) {
+  Update update;
+  update.uid = uid;
+  update.sid = sid;
+  update.array = array;
+  update.fields = RECENT_FIELD;
+  update.recent = recent;
+  Put(update);
+}
+
+void UserStreamsWriteBuffer::SetInterruptTime(const fastotv::user_id_t& uid,
+                                              const fastotv::stream_id_t& sid,
+                                              UserArray array,
+                                              fastotv::timestamp_t interruption_time) {
+  Update update;
+  update.uid = uid;
+  update.sid = sid;
+  update.array = array;
+  update.fields = INTERRUPTION_TIME_FIELD;
+  update.interruption_time = interruption_time;
+  Put(update);
+}
+
+bool UserStreamsWriteBuffer::Find(const fastotv::user_id_t& uid,
+                                  const fastotv::stream_id_t& sid,
+                                  Update* update) const {
+  if (!update) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool found = false;
+  Update result;
+  for (const updates_by_user_t* updates : {&flushing_, &pending_}) {
+    const auto user = updates->find(uid);
+    if (user == updates->end()) {
+      continue;
+    }
+
+    const auto it = user->second.find(sid);
+    if (it == user->second.end()) {
+      continue;
+    }
+
+    if (found) {
+      result.Merge(it->second);
+    } else {
+      result = it->second;
+      found = true;
+    }
+  }
+
+  if (found) {
+    *update = result;
+  }
+  return found;
+}
+
+bool UserStreamsWriteBuffer::FindUser(const fastotv::user_id_t& uid, updates_t* updates) const {
+  if (!updates) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  user_updates_t merged;
+  for (const updates_by_user_t* buffered : {&flushing_, &pending_}) {
+    const auto user = buffered->find(uid);
+    if (user == buffered->end()) {
+      continue;
+    }
+
+    for (const auto& it : user->second) {
+      const auto mit = merged.find(it.first);
+      if (mit == merged.end()) {
+        merged.insert(it);
+      } else {
+        mit->second.Merge(it.second);
+      }
+    }
+  }
+
+  if (merged.empty()) {
+    return false;
+  }
+
+  updates_t result;
+  result.reserve(merged.size());
+  for (const auto& it : merged) {
+    result.push_back(it.second);
+  }
+  *updates = result;
+  return true;
+}
+
+void UserStreamsWriteBuffer::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  FlushLocked(&lock);
+}
+
+WriteBufferStats UserStreamsWriteBuffer::GetStats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  WriteBufferStats stats = stats_;
+  stats.pending = pending_count_;
+  return stats;
+}
+
+void UserStreamsWriteBuffer::Put(const Update& update) {
+  bool need_flush = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stats_.writes++;
+    user_updates_t& user = pending_[update.uid];
+    const auto it = user.find(update.sid);
+    if (it == user.end()) {
+      user.insert(std::make_pair(update.sid, update));
+      pending_count_++;
+      need_flush = pending_count_ >= max_pending_;
+    } else {
+      it->second.Merge(update);
+    }
+  }
+
+  if (need_flush) {
+    flush_cond_.notify_all();
+  }
+}
+
+void UserStreamsWriteBuffer::FlushRoutine() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    flush_cond_.wait_for(lock, std::chrono::milliseconds(flush_interval_msec_),
+                         [this] { return stop_ || pending_count_ >= max_pending_; });
+    FlushLocked(&lock);
+  }
+  FlushLocked(&lock);
+}
+
+void UserStreamsWriteBuffer::FlushLocked(std::unique_lock<std::mutex>* lock) {
+  flush_done_cond_.wait(*lock, [this] { return !flush_running_; });
+  if (!flush_ || pending_.empty()) {
+    return;
+  }
+
+  updates_t updates;
+  updates.reserve(pending_count_);
+  for (const auto& user : pending_) {
+    for (const auto& it : user.second) {
+      updates.push_back(it.second);
+    }
+  }
+  flushing_.swap(pending_);
+  pending_.clear();
+  pending_count_ = 0;
+  flush_running_ = true;
+  stats_.flushes++;
+
+  const flush_t flush = flush_;
+  lock->unlock();
+  const bool flushed = flush(updates);
+  lock->lock();
+
+  if (flushed) {
+    stats_.flushed += updates.size();
+  } else {
+    stats_.failed_flushes++;
+    RequeueFlushingLocked();
+  }
+  flushing_.clear();
+  flush_running_ = false;
+  flush_done_cond_.notify_all();
+}
+
+void UserStreamsWriteBuffer::RequeueFlushingLocked() {
+  for (const auto& user : flushing_) {
+    user_updates_t& pending_user = pending_[user.first];
+    for (const auto& it : user.second) {
+      const auto pit = pending_user.find(it.first);
+      if (pit == pending_user.end()) {
+        pending_user.insert(it);
+        pending_count_++;
+        continue;
+      }
+
+      // fields written during the flush stay the latest
+      Update update = it.second;
+      update.Merge(pit->second);
+      pit->second = update;
+    }
+  }
+}
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,113 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fastotv/types.h>
+
+#include "base/subscribers_manager_stats.h"
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+// Write-behind buffer for the per user stream flags players update while zapping (favorite, recent, interruption
+// time). Only the latest value of every field is kept per (user, stream), pending updates are flushed in one batch
+// on a timer or when too many are pending, and on Stop. Readers merge Find results over the database values so a
+// session always sees its own writes, including the ones of the batch being flushed. A failed batch goes back under
+// the values written meanwhile and is retried with the next flush.
+class UserStreamsWriteBuffer {
+ public:
+  enum { default_flush_interval_msec = 1000, default_max_pending = 4096 };
+  enum UserArray { USER_STREAMS = 0, USER_VODS = 1, USER_CATCHUPS = 2 };
+  enum Field { FAVORITE_FIELD = 1 << 0, RECENT_FIELD = 1 << 1, INTERRUPTION_TIME_FIELD = 1 << 2 };
+
+  struct Update {
+    fastotv::user_id_t uid;
+    fastotv::stream_id_t sid;
+    UserArray array = USER_STREAMS;
+    int fields = 0;  // set of Field
+    bool favorite = false;
+    fastotv::timestamp_t recent = 0;
+    fastotv::timestamp_t interruption_time = 0;
+
+    void Merge(const Update& newer);
+  };
+
+  typedef std::vector<Update> updates_t;
+  // false if the batch wasn't written, $set updates can be written again
+  typedef std::function<bool(const updates_t& updates)> flush_t;
+
+  UserStreamsWriteBuffer(uint32_t flush_interval_msec, size_t max_pending);
+  ~UserStreamsWriteBuffer();
+
+  void Start(flush_t flush);
+  // flushes everything still pending
+  void Stop();
+
+  void SetFavorite(const fastotv::user_id_t& uid, const fastotv::stream_id_t& sid, UserArray array, bool favorite);
+  void SetRecent(const fastotv::user_id_t& uid,
+                 const fastotv::stream_id_t& sid,
+                 UserArray array,
+                 fastotv::timestamp_t recent);
+  void SetInterruptTime(const fastotv::user_id_t& uid,
+                        const fastotv::stream_id_t& sid,
+                        UserArray array,
+                        fastotv::timestamp_t interruption_time);
+
+  bool Find(const fastotv::user_id_t& uid, const fastotv::stream_id_t& sid, Update* update) const;
+  // all not yet persisted updates of the user
+  bool FindUser(const fastotv::user_id_t& uid, updates_t* updates) const;
+
+  void Flush();
+
+  WriteBufferStats GetStats() const;
+
+ private:
+  typedef std::unordered_map<fastotv::stream_id_t, Update> user_updates_t;
+  typedef std::unordered_map<fastotv::user_id_t, user_updates_t> updates_by_user_t;
+
+  void Put(const Update& update);
+  void FlushRoutine();
+  void FlushLocked(std::unique_lock<std::mutex>* lock);
+  void RequeueFlushingLocked();
+
+  const uint32_t flush_interval_msec_;
+  const size_t max_pending_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable flush_cond_;
+  updates_by_user_t pending_;
+  size_t pending_count_;
+  updates_by_user_t flushing_;  // taken by the running flush, still visible to readers
+  bool flush_running_;
+  std::condition_variable flush_done_cond_;
+  flush_t flush_;
+  bool stop_;
+  std::thread flush_thread_;
+
+  WriteBufferStats stats_;
+};
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,296 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "base/view_counters.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+
+#include <common/logger.h>
+#include <common/time.h>
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+ViewCounters::ViewCounters(size_t shards, uint32_t flush_interval_msec)
+    : flush_interval_msec_(flush_interval_msec ? flush_interval_msec : 1),
+      shards_(),
+      flush_mutex_(),
+      flushing_mutex_(),
+      flushing_(),
+      flush_(),
+      journal_path_(),
+      batch_prefix_(),
+      batches_seq_(0),
+      stats_(),
+      increments_(0),
+      stop_mutex_(),
+      stop_cond_(),
+      stop_(false),
+      flush_thread_() {
+  for (size_t i = 0; i < (shards ? shards : 1); ++i) {
+    shards_.push_back(std::unique_ptr<Shard>(new Shard));
+  }
+}
+
+ViewCounters::~ViewCounters() {
+  Stop();
+}
+
+void ViewCounters::Start(const std::string& journal_path, flush_t flush) {
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  if (flush_thread_.joinable()) {
+    return;
+  }
+
+  journal_path_ = journal_path;
+  batch_prefix_ = std::to_string(common::time::current_utc_mstime()) + "-" + std::to_string(getpid());
+  batches_seq_ = 0;
+  batches_t replayed;
+  common::ErrnoError err = ReadJournal(&replayed);
+  if (err) {
+    DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_WARNING);
+  }
+
+  if (!replayed.empty()) {
+    std::unique_lock<std::mutex> flushing_lock(flushing_mutex_);
+    for (auto& batch : replayed) {
+      if (batch.id.empty()) {
+        batch.id = MakeBatchID();
+      }
+      flushing_.push_back(batch);
+    }
+    INFO_LOG() << "Replayed view counters journal, batches: " << replayed.size();
+  }
+
+  flush_ = flush;
+  stop_ = false;
+  flush_thread_ = std::thread([this] { FlushRoutine(); });
+}
+
+void ViewCounters::Stop() {
+  {
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    if (!flush_thread_.joinable()) {
+      return;
+    }
+    stop_ = true;
+  }
+  stop_cond_.notify_all();
+  flush_thread_.join();
+}
+
+void ViewCounters::Increment(const fastotv::stream_id_t& sid) {
+  Shard* shard = GetShard(sid);
+  std::unique_lock<std::mutex> lock(shard->mutex);
+  shard->deltas[sid]++;
+  increments_++;
+}
+
+ViewCounters::delta_t ViewCounters::GetPending(const fastotv::stream_id_t& sid) const {
+  delta_t pending = 0;
+  {
+    std::unique_lock<std::mutex> lock(flushing_mutex_);
+    for (const auto& batch : flushing_) {
+      const auto it = batch.deltas.find(sid);
+      if (it != batch.deltas.end()) {
+        pending += it->second;
+      }
+    }
+  }
+
+  Shard* shard = GetShard(sid);
+  std::unique_lock<std::mutex> lock(shard->mutex);
+  const auto it = shard->deltas.find(sid);
+  if (it != shard->deltas.end()) {
+    pending += it->second;
+  }
+  return pending;
+}
+
+void ViewCounters::Flush() {
+  std::unique_lock<std::mutex> flush_lock(flush_mutex_);
+  if (!flush_) {
+    return;
+  }
+
+  batches_t batches;
+  {
+    // moved under flushing_mutex_ so readers never see an increment twice or not at all,
+    // a batch that was sent keeps its content and new increments go to the next one
+    std::unique_lock<std::mutex> flushing_lock(flushing_mutex_);
+    if (flushing_.empty() || flushing_.back().sent) {
+      flushing_.push_back(Batch{MakeBatchID(), deltas_t(), false});
+    }
+    deltas_t& deltas = flushing_.back().deltas;
+    for (const auto& shard : shards_) {
+      std::unique_lock<std::mutex> lock(shard->mutex);
+      for (const auto& delta : shard->deltas) {
+        deltas[delta.first] += delta.second;
+      }
+      shard->deltas.clear();
+    }
+    if (deltas.empty()) {
+      flushing_.pop_back();
+    }
+    batches = flushing_;
+  }
+
+  if (batches.empty()) {
+    return;
+  }
+
+  common::ErrnoError err = WriteJournal(batches);
+  if (err) {
+    DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_WARNING);
+  }
+
+  // in order, a later batch isn't sent while an earlier one may be applied in part
+  for (const auto& batch : batches) {
+    {
+      std::unique_lock<std::mutex> flushing_lock(flushing_mutex_);
+      flushing_.front().sent = true;
+    }
+
+    const bool written = flush_(batch.id, batch.deltas);
+    std::unique_lock<std::mutex> flushing_lock(flushing_mutex_);
+    stats_.flushes++;
+    if (!written) {
+      stats_.failed_flushes++;
+      return;
+    }
+
+    stats_.flushed += batch.deltas.size();
+    flushing_.pop_front();
+    if (flushing_.empty()) {
+      RemoveJournal();
+    } else {
+      err = WriteJournal(flushing_);
+      if (err) {
+        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_WARNING);
+      }
+    }
+  }
+}
+
+ViewCountersStats ViewCounters::GetStats() const {
+  std::unique_lock<std::mutex> lock(flushing_mutex_);
+  ViewCountersStats stats = stats_;
+  stats.increments = increments_;
+  return stats;
+}
+
+ViewCounters::Shard* ViewCounters::GetShard(const fastotv::stream_id_t& sid) const {
+  return shards_[std::hash<fastotv::stream_id_t>()(sid) % shards_.size()].get();
+}
+
+std::string ViewCounters::MakeBatchID() {
+  return batch_prefix_ + "-" + std::to_string(++batches_seq_);
+}
+
+void ViewCounters::FlushRoutine() {
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_) {
+    stop_cond_.wait_for(lock, std::chrono::milliseconds(flush_interval_msec_), [this] { return stop_; });
+    lock.unlock();
+    Flush();
+    lock.lock();
+  }
+  lock.unlock();
+  Flush();
+}
+
+common::ErrnoError ViewCounters::ReadJournal(batches_t* batches) const {
+  if (journal_path_.empty()) {
+    return common::ErrnoError();
+  }
+
+  std::ifstream journal(journal_path_);
+  if (!journal.is_open()) {
+    if (errno == ENOENT) {
+      return common::ErrnoError();
+    }
+    return common::make_errno_error("Failed to open view counters journal", errno);
+  }
+
+  // line per batch: batch <id>, followed by a line per stream: <stream id> <delta>
+  batches_t result;
+  std::string key;
+  std::string value;
+  while (journal >> key >> value) {
+    if (key == "batch") {
+      result.push_back(Batch{value, deltas_t(), true});
+      continue;
+    }
+
+    if (result.empty()) {  // stream lines without a batch line get an id on Start
+      result.push_back(Batch{std::string(), deltas_t(), true});
+    }
+    result.back().deltas[key] += strtoull(value.c_str(), nullptr, 10);
+  }
+
+  *batches = result;
+  return common::ErrnoError();
+}
+
+common::ErrnoError ViewCounters::WriteJournal(const batches_t& batches) const {
+  if (journal_path_.empty()) {
+    return common::ErrnoError();
+  }
+
+  // replaced atomically, a crash while writing leaves the previous journal in place
+  const std::string tmp_path = journal_path_ + ".tmp";
+  FILE* journal = fopen(tmp_path.c_str(), "w");
+  if (!journal) {
+    return common::make_errno_error("Failed to create view counters journal", errno);
+  }
+
+  for (const auto& batch : batches) {
+    fprintf(journal, "batch %s\n", batch.id.c_str());
+    for (const auto& delta : batch.deltas) {
+      fprintf(journal, "%s %llu\n", delta.first.c_str(), static_cast<unsigned long long>(delta.second));
+    }
+  }
+
+  const bool synced = fflush(journal) == 0 && fsync(fileno(journal)) == 0;
+  const int sync_errno = errno;
+  fclose(journal);
+  if (!synced) {
+    return common::make_errno_error("Failed to write view counters journal", sync_errno);
+  }
+
+  if (rename(tmp_path.c_str(), journal_path_.c_str()) != 0) {
+    return common::make_errno_error("Failed to replace view counters journal", errno);
+  }
+  return common::ErrnoError();
+}
+
+void ViewCounters::RemoveJournal() const {
+  if (journal_path_.empty()) {
+    return;
+  }
+
+  unlink(journal_path_.c_str());
+}
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,109 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <common/error.h>
+
+#include <fastotv/types.h>
+
+#include "base/subscribers_manager_stats.h"
+
+namespace fastocloud {
+namespace server {
+namespace base {
+
+// View counter increments kept in memory and written as one batch per flush interval, instead of an $inc per event on
+// hot stream documents. Counters are sharded by stream id, increments of different streams don't share a lock.
+// Every batch has an id, a batch that failed or was cut short is retried as is under the same id and the database
+// side adds a batch to a stream only once. With a journal path the batches are persisted before they are written and
+// replayed with their ids on Start, a crash loses at most one interval of increments and never counts one twice.
+class ViewCounters {
+ public:
+  enum { default_shards = 16, default_flush_interval_msec = 5000 };
+  typedef uint64_t delta_t;
+  typedef std::unordered_map<fastotv::stream_id_t, delta_t> deltas_t;
+  // returns false if the batch wasn't written or only partly, it is retried with the same id
+  typedef std::function<bool(const std::string& batch_id, const deltas_t& deltas)> flush_t;
+
+  ViewCounters(size_t shards, uint32_t flush_interval_msec);
+  ~ViewCounters();
+
+  // empty journal path disables the journal
+  void Start(const std::string& journal_path, flush_t flush);
+  // flushes everything still pending
+  void Stop();
+
+  void Increment(const fastotv::stream_id_t& sid);
+  // increments not yet written to the database
+  delta_t GetPending(const fastotv::stream_id_t& sid) const;
+
+  void Flush();
+
+  ViewCountersStats GetStats() const;
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    deltas_t deltas;
+  };
+
+  struct Batch {
+    std::string id;
+    deltas_t deltas;
+    bool sent;  // possibly applied in part, its content is frozen
+  };
+  typedef std::deque<Batch> batches_t;
+
+  Shard* GetShard(const fastotv::stream_id_t& sid) const;
+  void FlushRoutine();
+  std::string MakeBatchID();
+  common::ErrnoError ReadJournal(batches_t* batches) const WARN_UNUSED_RESULT;
+  common::ErrnoError WriteJournal(const batches_t& batches) const WARN_UNUSED_RESULT;
+  void RemoveJournal() const;
+
+  const uint32_t flush_interval_msec_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::mutex flush_mutex_;  // one flush at a time
+  mutable std::mutex flushing_mutex_;
+  batches_t flushing_;  // batches being written or failed to write, oldest first
+  flush_t flush_;
+  std::string journal_path_;
+  std::string batch_prefix_;  // unique per run
+  uint64_t batches_seq_;
+  ViewCountersStats stats_;
+  std::atomic<uint64_t> increments_;
+
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cond_;
+  bool stop_;
+  std::thread flush_thread_;
+};
+
+}  // namespace base
+}  // namespace server
+}  // namespace fastocloud
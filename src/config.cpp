@@ -27,6 +27,19 @@
 #define SERVICE_HTTP_HOST_FIELD "http_host"
 #define SERVICE_SUBSCRIBERS_HOST_FIELD "subscribers_host"
 #define SERVICE_MONGODB_URL_FIELD "mongodb_url"
+#define SERVICE_MONGODB_POOL_SIZE_FIELD "mongodb_pool_size"
+#define SERVICE_MONGODB_POOL_WAIT_TIMEOUT_FIELD "mongodb_pool_wait_timeout"
+#define SERVICE_MONGODB_SLOW_QUERY_FIELD "mongodb_slow_query"
+#define SERVICE_MONGODB_CATALOG_READ_PREFERENCE_FIELD "mongodb_catalog_read_preference"
+#define SERVICE_MONGODB_USER_READ_PREFERENCE_FIELD "mongodb_user_read_preference"
+#define SERVICE_MONGODB_MAX_STALENESS_FIELD "mongodb_max_staleness"
+#define SERVICE_MONGODB_INDEXES_FIELD "mongodb_indexes"
+#define SERVICE_DB_WORKERS_FIELD "db_workers"
+#define SERVICE_SUBSCRIBERS_LOOPS_FIELD "subscribers_loops"
+#define SERVICE_VIEW_COUNTERS_JOURNAL_FIELD "view_counters_journal"
+#define SERVICE_SUBSCRIBERS_BACKEND_FIELD "subscribers_backend"
+#define SERVICE_SUBSCRIBERS_SNAPSHOT_FIELD "subscribers_snapshot"
+#define SERVICE_WARM_UP_BUDGET_FIELD "warm_up_budget"
 #define SERVICE_EPG_URL_FIELD "epg_url"
 #define SERVICE_LOCKED_STREAM_TEXT_FIELD "locked_stream_text"
 #define SERVICE_LICENSE_KEY_FIELD "license_key"
@@ -34,6 +47,15 @@
 
 #define DUMMY_LOG_FILE_PATH "/dev/null"
 #define REPORT_NODE_STATS 10
+#define MONGODB_POOL_SIZE 8
+#define MONGODB_POOL_WAIT_TIMEOUT_MSEC 5000
+#define MONGODB_SLOW_QUERY_MSEC 100
+#define MONGODB_READ_PREFERENCE "primary"
+#define MONGODB_MAX_STALENESS_SEC -1
+#define MONGODB_INDEXES "create"
+#define DB_WORKERS 4
+#define SUBSCRIBERS_LOOPS 0
+#define WARM_UP_BUDGET_MSEC 30000
 
 namespace {
 std::pair<std::string, std::string> GetKeyValue(const std::string& line, char separator) {
@@ -77,6 +99,53 @@ common::ErrnoError ReadConfigFile(const std::string& path, common::HashValue** a
       options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
     } else if (pair.first == SERVICE_MONGODB_URL_FIELD) {
       options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
+    } else if (pair.first == SERVICE_MONGODB_POOL_SIZE_FIELD) {
+      int pool_size;
+      if (common::ConvertFromString(pair.second, &pool_size)) {
+        options->Insert(pair.first, common::Value::CreateIntegerValue(pool_size));
+      }
+    } else if (pair.first == SERVICE_MONGODB_POOL_WAIT_TIMEOUT_FIELD) {
+      int wait_timeout;
+      if (common::ConvertFromString(pair.second, &wait_timeout)) {
+        options->Insert(pair.first, common::Value::CreateIntegerValue(wait_timeout));
+      }
+    } else if (pair.first == SERVICE_MONGODB_SLOW_QUERY_FIELD) {
+      int slow_query;
+      if (common::ConvertFromString(pair.second, &slow_query)) {
+        options->Insert(pair.first, common::Value::CreateIntegerValue(slow_query));
+      }
+    } else if (pair.first == SERVICE_MONGODB_CATALOG_READ_PREFERENCE_FIELD) {
+      options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
+    } else if (pair.first == SERVICE_MONGODB_USER_READ_PREFERENCE_FIELD) {
+      options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
+    } else if (pair.first == SERVICE_MONGODB_MAX_STALENESS_FIELD) {
+      int max_staleness;
+      if (common::ConvertFromString(pair.second, &max_staleness)) {
+        options->Insert(pair.first, common::Value::CreateIntegerValue(max_staleness));
+      }
+    } else if (pair.first == SERVICE_MONGODB_INDEXES_FIELD) {
+      options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
+    } else if (pair.first == SERVICE_DB_WORKERS_FIELD) {
+      int workers;
+      if (common::ConvertFromString(pair.second, &workers)) {
+        options->Insert(pair.first, common::Value::CreateIntegerValue(workers));
+      }
+    } else if (pair.first == SERVICE_SUBSCRIBERS_LOOPS_FIELD) {
+      int loops;
+      if (common::ConvertFromString(pair.second, &loops)) {
+        options->Insert(pair.first, common::Value::CreateIntegerValue(loops));
+      }
+    } else if (pair.first == SERVICE_VIEW_COUNTERS_JOURNAL_FIELD) {
+      options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
+    } else if (pair.first == SERVICE_SUBSCRIBERS_BACKEND_FIELD) {
+      options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
+    } else if (pair.first == SERVICE_SUBSCRIBERS_SNAPSHOT_FIELD) {
+      options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
+    } else if (pair.first == SERVICE_WARM_UP_BUDGET_FIELD) {
+      int budget;
+      if (common::ConvertFromString(pair.second, &budget)) {
+        options->Insert(pair.first, common::Value::CreateIntegerValue(budget));
+      }
     } else if (pair.first == SERVICE_EPG_URL_FIELD) {
       options->Insert(pair.first, common::Value::CreateStringValueFromBasicString(pair.second));
     } else if (pair.first == SERVICE_LOCKED_STREAM_TEXT_FIELD) {
@@ -105,6 +174,19 @@ Config::Config()
       log_path(DUMMY_LOG_FILE_PATH),
       log_level(common::logging::LOG_LEVEL_INFO),
       mongodb_url(MONGODB_URL),
+      mongodb_pool_size(MONGODB_POOL_SIZE),
+      mongodb_pool_wait_timeout(MONGODB_POOL_WAIT_TIMEOUT_MSEC),
+      mongodb_slow_query(MONGODB_SLOW_QUERY_MSEC),
+      mongodb_catalog_read_preference(MONGODB_READ_PREFERENCE),
+      mongodb_user_read_preference(MONGODB_READ_PREFERENCE),
+      mongodb_max_staleness(MONGODB_MAX_STALENESS_SEC),
+      mongodb_indexes(MONGODB_INDEXES),
+      db_workers(DB_WORKERS),
+      subscribers_loops(SUBSCRIBERS_LOOPS),
+      view_counters_journal(),
+      subscribers_backend(SUBSCRIBERS_BACKEND_MONGODB),
+      subscribers_snapshot(),
+      warm_up_budget(WARM_UP_BUDGET_MSEC),
       epg_url(EPG_URL),
       license_key(),
       report_node(REPORT_NODE_STATS) {}
@@ -173,6 +255,83 @@ common::ErrnoError load_config_from_file(const std::string& config_absolute_path
     lconfig.mongodb_url = MONGODB_URL;
   }
 
+  int pool_size = 0;
+  common::Value* pool_size_field = slave_config_args->Find(SERVICE_MONGODB_POOL_SIZE_FIELD);
+  if (pool_size_field && pool_size_field->GetAsInteger(&pool_size) && pool_size > 0) {
+    lconfig.mongodb_pool_size = pool_size;
+  }
+
+  int wait_timeout = 0;
+  common::Value* wait_timeout_field = slave_config_args->Find(SERVICE_MONGODB_POOL_WAIT_TIMEOUT_FIELD);
+  if (wait_timeout_field && wait_timeout_field->GetAsInteger(&wait_timeout) && wait_timeout > 0) {
+    lconfig.mongodb_pool_wait_timeout = wait_timeout;
+  }
+
+  int slow_query = 0;
+  common::Value* slow_query_field = slave_config_args->Find(SERVICE_MONGODB_SLOW_QUERY_FIELD);
+  if (slow_query_field && slow_query_field->GetAsInteger(&slow_query) && slow_query >= 0) {
+    lconfig.mongodb_slow_query = slow_query;
+  }
+
+  common::Value* catalog_read_field = slave_config_args->Find(SERVICE_MONGODB_CATALOG_READ_PREFERENCE_FIELD);
+  if (!catalog_read_field || !catalog_read_field->GetAsBasicString(&lconfig.mongodb_catalog_read_preference) ||
+      lconfig.mongodb_catalog_read_preference.empty()) {
+    lconfig.mongodb_catalog_read_preference = MONGODB_READ_PREFERENCE;
+  }
+
+  common::Value* user_read_field = slave_config_args->Find(SERVICE_MONGODB_USER_READ_PREFERENCE_FIELD);
+  if (!user_read_field || !user_read_field->GetAsBasicString(&lconfig.mongodb_user_read_preference) ||
+      lconfig.mongodb_user_read_preference.empty()) {
+    lconfig.mongodb_user_read_preference = MONGODB_READ_PREFERENCE;
+  }
+
+  int max_staleness = 0;
+  common::Value* max_staleness_field = slave_config_args->Find(SERVICE_MONGODB_MAX_STALENESS_FIELD);
+  if (max_staleness_field && max_staleness_field->GetAsInteger(&max_staleness)) {
+    lconfig.mongodb_max_staleness = max_staleness;
+  }
+
+  common::Value* indexes_field = slave_config_args->Find(SERVICE_MONGODB_INDEXES_FIELD);
+  if (!indexes_field || !indexes_field->GetAsBasicString(&lconfig.mongodb_indexes) || lconfig.mongodb_indexes.empty()) {
+    lconfig.mongodb_indexes = MONGODB_INDEXES;
+  }
+
+  int db_workers = 0;
+  common::Value* db_workers_field = slave_config_args->Find(SERVICE_DB_WORKERS_FIELD);
+  if (db_workers_field && db_workers_field->GetAsInteger(&db_workers) && db_workers > 0) {
+    lconfig.db_workers = db_workers;
+  }
+
+  int subscribers_loops = 0;
+  common::Value* subscribers_loops_field = slave_config_args->Find(SERVICE_SUBSCRIBERS_LOOPS_FIELD);
+  if (subscribers_loops_field && subscribers_loops_field->GetAsInteger(&subscribers_loops) && subscribers_loops > 0) {
+    lconfig.subscribers_loops = subscribers_loops;
+  }
+
+  common::Value* view_counters_journal_field = slave_config_args->Find(SERVICE_VIEW_COUNTERS_JOURNAL_FIELD);
+  if (!view_counters_journal_field ||
+      !view_counters_journal_field->GetAsBasicString(&lconfig.view_counters_journal)) {
+    lconfig.view_counters_journal = std::string();
+  }
+
+  common::Value* subscribers_backend_field = slave_config_args->Find(SERVICE_SUBSCRIBERS_BACKEND_FIELD);
+  if (!subscribers_backend_field || !subscribers_backend_field->GetAsBasicString(&lconfig.subscribers_backend) ||
+      lconfig.subscribers_backend != SUBSCRIBERS_BACKEND_SNAPSHOT) {
+    lconfig.subscribers_backend = SUBSCRIBERS_BACKEND_MONGODB;
+  }
+
+  common::Value* subscribers_snapshot_field = slave_config_args->Find(SERVICE_SUBSCRIBERS_SNAPSHOT_FIELD);
+  if (!subscribers_snapshot_field ||
+      !subscribers_snapshot_field->GetAsBasicString(&lconfig.subscribers_snapshot)) {
+    lconfig.subscribers_snapshot = std::string();
+  }
+
+  int warm_up_budget = 0;
+  common::Value* warm_up_budget_field = slave_config_args->Find(SERVICE_WARM_UP_BUDGET_FIELD);
+  if (warm_up_budget_field && warm_up_budget_field->GetAsInteger(&warm_up_budget) && warm_up_budget >= 0) {
+    lconfig.warm_up_budget = warm_up_budget;
+  }
+
   common::Value* http_host_field = slave_config_args->Find(SERVICE_HTTP_HOST_FIELD);
   std::string http_host_str;
   if (!http_host_field || !http_host_field->GetAsBasicString(&http_host_str) ||
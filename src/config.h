@@ -21,11 +21,18 @@
 #include <common/net/types.h>
 #include <common/uri/gurl.h>
 
+#define SUBSCRIBERS_BACKEND_MONGODB "mongodb"
+#define SUBSCRIBERS_BACKEND_SNAPSHOT "snapshot"
+
 namespace fastocloud {
 namespace server {
 
 struct Config {
   typedef time_t report_node_stats_t;
+  typedef uint32_t pool_wait_timeout_t;  // msec
+  typedef uint32_t slow_query_t;         // msec
+  typedef int64_t max_staleness_t;       // seconds
+  typedef uint32_t warm_up_budget_t;      // msec
 
   typedef common::Optional<common::license::expire_key_t> license_t;
 
@@ -41,6 +48,19 @@ struct Config {
   common::logging::LOG_LEVEL log_level;
   common::net::HostAndPort http_host;
   std::string mongodb_url;
+  size_t mongodb_pool_size;
+  pool_wait_timeout_t mongodb_pool_wait_timeout;
+  slow_query_t mongodb_slow_query;  // 0 disables the slow query log
+  std::string mongodb_catalog_read_preference;
+  std::string mongodb_user_read_preference;
+  max_staleness_t mongodb_max_staleness;  // <= 0 unbounded
+  std::string mongodb_indexes;            // check, create or require the indexes of the lookups
+  size_t db_workers;
+  size_t subscribers_loops;           // loops serving subscribers, 0 one per core
+  std::string view_counters_journal;  // empty disables
+  std::string subscribers_backend;    // SUBSCRIBERS_BACKEND_MONGODB or SUBSCRIBERS_BACKEND_SNAPSHOT
+  std::string subscribers_snapshot;   // snapshot file of the snapshot backend
+  warm_up_budget_t warm_up_budget;    // caches loading before listening, 0 disables
   common::uri::GURL epg_url;
   std::string locked_stream_text;
   license_t license_key;
@@ -150,6 +150,17 @@ common::ErrnoError ProtocoledDaemonClient::GetLogServiceSuccess(fastotv::protoco
   return WriteResponse(resp);
 }
 
+common::ErrnoError ProtocoledDaemonClient::GetDbStatsServiceSuccess(fastotv::protocol::sequance_id_t id,
+                                                                    const std::string& stats) {
+  fastotv::protocol::response_t resp;
+  common::Error err_ser = GetDbStatsServiceResponseSuccess(id, stats, &resp);
+  if (err_ser) {
+    return common::make_errno_error(err_ser->GetDescription(), EAGAIN);
+  }
+
+  return WriteResponse(resp);
+}
+
 common::ErrnoError ProtocoledDaemonClient::SendSubscriberMessageFail(fastotv::protocol::sequance_id_t id,
                                                                      common::Error err) {
   const std::string error_str = err->GetDescription();
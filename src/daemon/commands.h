@@ -31,6 +31,7 @@
 #define DAEMON_PREPARE_SERVICE "prepare_service"
 #define DAEMON_SYNC_SERVICE "sync_service"
 #define DAEMON_GET_LOG_SERVICE "get_log_service"
+#define DAEMON_GET_DB_STATS_SERVICE "get_db_stats_service"  // local or activated clients
 
 // subscriber
 #define DAEMON_SERVER_PING "ping_client"
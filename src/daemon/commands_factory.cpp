@@ -187,6 +187,18 @@ common::Error GetLogServiceResponseSuccess(fastotv::protocol::sequance_id_t id,
   return common::Error();
 }
 
+common::Error GetDbStatsServiceResponseSuccess(fastotv::protocol::sequance_id_t id,
+                                               const std::string& stats,
+                                               fastotv::protocol::response_t* resp) {
+  if (!resp) {
+    return common::make_error_inval();
+  }
+
+  *resp = fastotv::protocol::response_t::MakeMessage(
+      id, common::protocols::json_rpc::JsonRPCMessage::MakeSuccessMessage(stats));
+  return common::Error();
+}
+
 common::Error SendSubscriberMessageResponseFail(fastotv::protocol::sequance_id_t id,
                                                 const std::string& error_text,
                                                 fastotv::protocol::response_t* resp) {
@@ -65,6 +65,10 @@ common::Error GetLogServiceResponseFail(fastotv::protocol::sequance_id_t id,
                                         fastotv::protocol::response_t* resp);
 common::Error GetLogServiceResponseSuccess(fastotv::protocol::sequance_id_t id, fastotv::protocol::response_t* resp);
 
+common::Error GetDbStatsServiceResponseSuccess(fastotv::protocol::sequance_id_t id,
+                                               const std::string& stats,
+                                               fastotv::protocol::response_t* resp);
+
 common::Error SendSubscriberMessageResponseFail(fastotv::protocol::sequance_id_t id,
                                                 const std::string& error_text,
                                                 fastotv::protocol::response_t* resp);
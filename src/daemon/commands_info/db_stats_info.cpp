@@ -0,0 +1,632 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "daemon/commands_info/db_stats_info.h"
+
+#include <string>
+#include <vector>
+
+#define STREAMS_CACHE_FIELD "streams_cache"
+#define POOL_FIELD "pool"
+#define CHANNELS_CACHE_FIELD "channels_cache"
+#define CHANNELS_PUSH_FIELD "channels_push"
+#define WRITE_BUFFER_FIELD "write_buffer"
+#define VIEW_COUNTERS_FIELD "view_counters"
+#define AUTH_CACHE_FIELD "auth_cache"
+#define PATHS_CACHE_FIELD "paths_cache"
+#define LOGIN_GUARD_FIELD "login_guard"
+#define UNKNOWN_STREAM_CLASSES_FIELD "unknown_stream_classes"
+#define OPERATIONS_FIELD "operations"
+#define QUERY_PLANS_FIELD "query_plans"
+
+#define CACHE_HITS_FIELD "hits"
+#define CACHE_MISSES_FIELD "misses"
+#define CACHE_ENTRIES_FIELD "entries"
+
+#define CACHE_EVICTIONS_FIELD "evictions"
+#define CACHE_BYTES_FIELD "bytes"
+#define CACHE_BYTES_SAVED_FIELD "bytes_saved"
+#define CACHE_HIT_RATIO_FIELD "hit_ratio"
+
+#define POOL_SIZE_FIELD "size"
+#define POOL_IN_USE_FIELD "in_use"
+#define POOL_PEAK_IN_USE_FIELD "peak_in_use"
+#define POOL_CHECKOUTS_FIELD "checkouts"
+#define POOL_TIMEOUTS_FIELD "timeouts"
+#define POOL_WAIT_TOTAL_FIELD "wait_total_usec"
+#define POOL_WAIT_MAX_FIELD "wait_max_usec"
+#define POOL_UTILIZATION_FIELD "utilization"
+
+#define WRITE_BUFFER_PENDING_FIELD "pending"
+#define WRITE_BUFFER_WRITES_FIELD "writes"
+#define WRITE_BUFFER_FLUSHED_FIELD "flushed"
+#define WRITE_BUFFER_FLUSHES_FIELD "flushes"
+#define WRITE_BUFFER_FAILED_FLUSHES_FIELD "failed_flushes"
+
+#define VIEW_COUNTERS_INCREMENTS_FIELD "increments"
+#define VIEW_COUNTERS_FLUSHED_FIELD "flushed"
+#define VIEW_COUNTERS_FLUSHES_FIELD "flushes"
+#define VIEW_COUNTERS_FAILED_FLUSHES_FIELD "failed_flushes"
+
+#define CHANNELS_PUSH_GET_CHANNELS_FIELD "get_channels"
+#define CHANNELS_PUSH_UPDATES_FIELD "updates"
+#define CHANNELS_PUSH_CHANGES_FIELD "changes"
+#define CHANNELS_PUSH_UNCHANGED_FIELD "unchanged"
+#define CHANNELS_PUSH_FAILURES_FIELD "failures"
+
+#define LOGIN_GUARD_FAILURES_FIELD "failures"
+#define LOGIN_GUARD_REJECTED_CACHED_FIELD "rejected_cached"
+#define LOGIN_GUARD_REJECTED_BACKOFF_FIELD "rejected_backoff"
+#define LOGIN_GUARD_REJECTED_ADDRESS_FIELD "rejected_address"
+#define LOGIN_GUARD_NEGATIVE_ENTRIES_FIELD "negative_entries"
+#define LOGIN_GUARD_BLOCKED_IDENTITIES_FIELD "blocked_identities"
+
+#define OPERATION_NAME_FIELD "name"
+#define OPERATION_CALLS_FIELD "calls"
+#define OPERATION_ERRORS_FIELD "errors"
+#define OPERATION_SLOW_FIELD "slow"
+#define OPERATION_DOCUMENTS_FIELD "documents"
+#define OPERATION_BYTES_FIELD "bytes"
+#define OPERATION_P50_FIELD "p50_usec"
+#define OPERATION_P90_FIELD "p90_usec"
+#define OPERATION_P99_FIELD "p99_usec"
+#define OPERATION_MAX_FIELD "max_usec"
+
+#define QUERY_PLAN_OPERATION_FIELD "operation"
+#define QUERY_PLAN_COLLECTION_FIELD "collection"
+#define QUERY_PLAN_INDEX_FIELD "index"
+#define QUERY_PLAN_INDEX_STATE_FIELD "index_state"
+#define QUERY_PLAN_PLAN_FIELD "plan"
+#define QUERY_PLAN_COLLECTION_SCAN_FIELD "collection_scan"
+
+namespace fastocloud {
+namespace server {
+namespace service {
+
+namespace {
+
+json_object* MakeCacheStatsJson(const base::CacheStats& stats) {
+  json_object* jcache = json_object_new_object();
+  json_object_object_add(jcache, CACHE_HITS_FIELD, json_object_new_int64(stats.hits));
+  json_object_object_add(jcache, CACHE_MISSES_FIELD, json_object_new_int64(stats.misses));
+  json_object_object_add(jcache, CACHE_ENTRIES_FIELD, json_object_new_int64(stats.entries));
+  const size_t requests = stats.hits + stats.misses;
+  const double hit_ratio = requests ? static_cast<double>(stats.hits) / requests : 0;
+  json_object_object_add(jcache, CACHE_HIT_RATIO_FIELD, json_object_new_double(hit_ratio));
+  return jcache;
+}
+
+base::CacheStats MakeCacheStatsFromJson(json_object* jcache) {
+  base::CacheStats stats;
+  json_object* jhits = nullptr;
+  json_bool jhits_exists = json_object_object_get_ex(jcache, CACHE_HITS_FIELD, &jhits);
+  if (jhits_exists) {
+    stats.hits = json_object_get_int64(jhits);
+  }
+
+  json_object* jmisses = nullptr;
+  json_bool jmisses_exists = json_object_object_get_ex(jcache, CACHE_MISSES_FIELD, &jmisses);
+  if (jmisses_exists) {
+    stats.misses = json_object_get_int64(jmisses);
+  }
+
+  json_object* jentries = nullptr;
+  json_bool jentries_exists = json_object_object_get_ex(jcache, CACHE_ENTRIES_FIELD, &jentries);
+  if (jentries_exists) {
+    stats.entries = json_object_get_int64(jentries);
+  }
+  return stats;
+}
+
+json_object* MakePoolStatsJson(const base::PoolStats& stats) {
+  json_object* jpool = json_object_new_object();
+  json_object_object_add(jpool, POOL_SIZE_FIELD, json_object_new_int64(stats.size));
+  json_object_object_add(jpool, POOL_IN_USE_FIELD, json_object_new_int64(stats.in_use));
+  json_object_object_add(jpool, POOL_PEAK_IN_USE_FIELD, json_object_new_int64(stats.peak_in_use));
+  json_object_object_add(jpool, POOL_CHECKOUTS_FIELD, json_object_new_int64(stats.checkouts));
+  json_object_object_add(jpool, POOL_TIMEOUTS_FIELD, json_object_new_int64(stats.timeouts));
+  json_object_object_add(jpool, POOL_WAIT_TOTAL_FIELD, json_object_new_int64(stats.wait_total_usec));
+  json_object_object_add(jpool, POOL_WAIT_MAX_FIELD, json_object_new_int64(stats.wait_max_usec));
+  const double utilization = stats.size ? static_cast<double>(stats.in_use) / stats.size : 0;
+  json_object_object_add(jpool, POOL_UTILIZATION_FIELD, json_object_new_double(utilization));
+  return jpool;
+}
+
+base::PoolStats MakePoolStatsFromJson(json_object* jpool) {
+  base::PoolStats stats;
+  json_object* jsize = nullptr;
+  json_bool jsize_exists = json_object_object_get_ex(jpool, POOL_SIZE_FIELD, &jsize);
+  if (jsize_exists) {
+    stats.size = json_object_get_int64(jsize);
+  }
+
+  json_object* jin_use = nullptr;
+  json_bool jin_use_exists = json_object_object_get_ex(jpool, POOL_IN_USE_FIELD, &jin_use);
+  if (jin_use_exists) {
+    stats.in_use = json_object_get_int64(jin_use);
+  }
+
+  json_object* jpeak_in_use = nullptr;
+  json_bool jpeak_in_use_exists = json_object_object_get_ex(jpool, POOL_PEAK_IN_USE_FIELD, &jpeak_in_use);
+  if (jpeak_in_use_exists) {
+    stats.peak_in_use = json_object_get_int64(jpeak_in_use);
+  }
+
+  json_object* jcheckouts = nullptr;
+  json_bool jcheckouts_exists = json_object_object_get_ex(jpool, POOL_CHECKOUTS_FIELD, &jcheckouts);
+  if (jcheckouts_exists) {
+    stats.checkouts = json_object_get_int64(jcheckouts);
+  }
+
+  json_object* jtimeouts = nullptr;
+  json_bool jtimeouts_exists = json_object_object_get_ex(jpool, POOL_TIMEOUTS_FIELD, &jtimeouts);
+  if (jtimeouts_exists) {
+    stats.timeouts = json_object_get_int64(jtimeouts);
+  }
+
+  json_object* jwait_total = nullptr;
+  json_bool jwait_total_exists = json_object_object_get_ex(jpool, POOL_WAIT_TOTAL_FIELD, &jwait_total);
+  if (jwait_total_exists) {
+    stats.wait_total_usec = json_object_get_int64(jwait_total);
+  }
+
+  json_object* jwait_max = nullptr;
+  json_bool jwait_max_exists = json_object_object_get_ex(jpool, POOL_WAIT_MAX_FIELD, &jwait_max);
+  if (jwait_max_exists) {
+    stats.wait_max_usec = json_object_get_int64(jwait_max);
+  }
+  return stats;
+}
+
+json_object* MakeChannelsCacheStatsJson(const base::ChannelsCacheStats& stats) {
+  json_object* jcache = json_object_new_object();
+  json_object_object_add(jcache, CACHE_HITS_FIELD, json_object_new_int64(stats.hits));
+  json_object_object_add(jcache, CACHE_MISSES_FIELD, json_object_new_int64(stats.misses));
+  json_object_object_add(jcache, CACHE_ENTRIES_FIELD, json_object_new_int64(stats.entries));
+  json_object_object_add(jcache, CACHE_EVICTIONS_FIELD, json_object_new_int64(stats.evictions));
+  json_object_object_add(jcache, CACHE_BYTES_FIELD, json_object_new_int64(stats.bytes));
+  json_object_object_add(jcache, CACHE_BYTES_SAVED_FIELD, json_object_new_int64(stats.bytes_saved));
+  const size_t requests = stats.hits + stats.misses;
+  const double hit_ratio = requests ? static_cast<double>(stats.hits) / requests : 0;
+  json_object_object_add(jcache, CACHE_HIT_RATIO_FIELD, json_object_new_double(hit_ratio));
+  return jcache;
+}
+
+base::ChannelsCacheStats MakeChannelsCacheStatsFromJson(json_object* jcache) {
+  base::ChannelsCacheStats stats;
+  json_object* jhits = nullptr;
+  json_bool jhits_exists = json_object_object_get_ex(jcache, CACHE_HITS_FIELD, &jhits);
+  if (jhits_exists) {
+    stats.hits = json_object_get_int64(jhits);
+  }
+
+  json_object* jmisses = nullptr;
+  json_bool jmisses_exists = json_object_object_get_ex(jcache, CACHE_MISSES_FIELD, &jmisses);
+  if (jmisses_exists) {
+    stats.misses = json_object_get_int64(jmisses);
+  }
+
+  json_object* jentries = nullptr;
+  json_bool jentries_exists = json_object_object_get_ex(jcache, CACHE_ENTRIES_FIELD, &jentries);
+  if (jentries_exists) {
+    stats.entries = json_object_get_int64(jentries);
+  }
+
+  json_object* jevictions = nullptr;
+  json_bool jevictions_exists = json_object_object_get_ex(jcache, CACHE_EVICTIONS_FIELD, &jevictions);
+  if (jevictions_exists) {
+    stats.evictions = json_object_get_int64(jevictions);
+  }
+
+  json_object* jbytes = nullptr;
+  json_bool jbytes_exists = json_object_object_get_ex(jcache, CACHE_BYTES_FIELD, &jbytes);
+  if (jbytes_exists) {
+    stats.bytes = json_object_get_int64(jbytes);
+  }
+
+  json_object* jbytes_saved = nullptr;
+  json_bool jbytes_saved_exists = json_object_object_get_ex(jcache, CACHE_BYTES_SAVED_FIELD, &jbytes_saved);
+  if (jbytes_saved_exists) {
+    stats.bytes_saved = json_object_get_int64(jbytes_saved);
+  }
+  return stats;
+}
+
+json_object* MakeWriteBufferStatsJson(const base::WriteBufferStats& stats) {
+  json_object* jbuffer = json_object_new_object();
+  json_object_object_add(jbuffer, WRITE_BUFFER_PENDING_FIELD, json_object_new_int64(stats.pending));
+  json_object_object_add(jbuffer, WRITE_BUFFER_WRITES_FIELD, json_object_new_int64(stats.writes));
+  json_object_object_add(jbuffer, WRITE_BUFFER_FLUSHED_FIELD, json_object_new_int64(stats.flushed));
+  json_object_object_add(jbuffer, WRITE_BUFFER_FLUSHES_FIELD, json_object_new_int64(stats.flushes));
+  json_object_object_add(jbuffer, WRITE_BUFFER_FAILED_FLUSHES_FIELD, json_object_new_int64(stats.failed_flushes));
+  return jbuffer;
+}
+
+base::WriteBufferStats MakeWriteBufferStatsFromJson(json_object* jbuffer) {
+  base::WriteBufferStats stats;
+  json_object* jpending = nullptr;
+  json_bool jpending_exists = json_object_object_get_ex(jbuffer, WRITE_BUFFER_PENDING_FIELD, &jpending);
+  if (jpending_exists) {
+    stats.pending = json_object_get_int64(jpending);
+  }
+
+  json_object* jwrites = nullptr;
+  json_bool jwrites_exists = json_object_object_get_ex(jbuffer, WRITE_BUFFER_WRITES_FIELD, &jwrites);
+  if (jwrites_exists) {
+    stats.writes = json_object_get_int64(jwrites);
+  }
+
+  json_object* jflushed = nullptr;
+  json_bool jflushed_exists = json_object_object_get_ex(jbuffer, WRITE_BUFFER_FLUSHED_FIELD, &jflushed);
+  if (jflushed_exists) {
+    stats.flushed = json_object_get_int64(jflushed);
+  }
+
+  json_object* jflushes = nullptr;
+  json_bool jflushes_exists = json_object_object_get_ex(jbuffer, WRITE_BUFFER_FLUSHES_FIELD, &jflushes);
+  if (jflushes_exists) {
+    stats.flushes = json_object_get_int64(jflushes);
+  }
+
+  json_object* jfailed = nullptr;
+  json_bool jfailed_exists = json_object_object_get_ex(jbuffer, WRITE_BUFFER_FAILED_FLUSHES_FIELD, &jfailed);
+  if (jfailed_exists) {
+    stats.failed_flushes = json_object_get_int64(jfailed);
+  }
+  return stats;
+}
+
+json_object* MakeViewCountersStatsJson(const base::ViewCountersStats& stats) {
+  json_object* jcounters = json_object_new_object();
+  json_object_object_add(jcounters, VIEW_COUNTERS_INCREMENTS_FIELD, json_object_new_int64(stats.increments));
+  json_object_object_add(jcounters, VIEW_COUNTERS_FLUSHED_FIELD, json_object_new_int64(stats.flushed));
+  json_object_object_add(jcounters, VIEW_COUNTERS_FLUSHES_FIELD, json_object_new_int64(stats.flushes));
+  json_object_object_add(jcounters, VIEW_COUNTERS_FAILED_FLUSHES_FIELD, json_object_new_int64(stats.failed_flushes));
+  return jcounters;
+}
+
+base::ViewCountersStats MakeViewCountersStatsFromJson(json_object* jcounters) {
+  base::ViewCountersStats stats;
+  json_object* jincrements = nullptr;
+  json_bool jincrements_exists = json_object_object_get_ex(jcounters, VIEW_COUNTERS_INCREMENTS_FIELD, &jincrements);
+  if (jincrements_exists) {
+    stats.increments = json_object_get_int64(jincrements);
+  }
+
+  json_object* jflushed = nullptr;
+  json_bool jflushed_exists = json_object_object_get_ex(jcounters, VIEW_COUNTERS_FLUSHED_FIELD, &jflushed);
+  if (jflushed_exists) {
+    stats.flushed = json_object_get_int64(jflushed);
+  }
+
+  json_object* jflushes = nullptr;
+  json_bool jflushes_exists = json_object_object_get_ex(jcounters, VIEW_COUNTERS_FLUSHES_FIELD, &jflushes);
+  if (jflushes_exists) {
+    stats.flushes = json_object_get_int64(jflushes);
+  }
+
+  json_object* jfailed = nullptr;
+  json_bool jfailed_exists = json_object_object_get_ex(jcounters, VIEW_COUNTERS_FAILED_FLUSHES_FIELD, &jfailed);
+  if (jfailed_exists) {
+    stats.failed_flushes = json_object_get_int64(jfailed);
+  }
+  return stats;
+}
+
+json_object* MakeChannelsPushStatsJson(const base::ChannelsPushStats& stats) {
+  json_object* jpush = json_object_new_object();
+  json_object_object_add(jpush, CHANNELS_PUSH_GET_CHANNELS_FIELD, json_object_new_int64(stats.get_channels));
+  json_object_object_add(jpush, CHANNELS_PUSH_UPDATES_FIELD, json_object_new_int64(stats.updates));
+  json_object_object_add(jpush, CHANNELS_PUSH_CHANGES_FIELD, json_object_new_int64(stats.changes));
+  json_object_object_add(jpush, CHANNELS_PUSH_UNCHANGED_FIELD, json_object_new_int64(stats.unchanged));
+  json_object_object_add(jpush, CHANNELS_PUSH_FAILURES_FIELD, json_object_new_int64(stats.failures));
+  return jpush;
+}
+
+base::ChannelsPushStats MakeChannelsPushStatsFromJson(json_object* jpush) {
+  base::ChannelsPushStats stats;
+  json_object* jget_channels = nullptr;
+  json_bool jget_channels_exists = json_object_object_get_ex(jpush, CHANNELS_PUSH_GET_CHANNELS_FIELD, &jget_channels);
+  if (jget_channels_exists) {
+    stats.get_channels = json_object_get_int64(jget_channels);
+  }
+
+  json_object* jupdates = nullptr;
+  json_bool jupdates_exists = json_object_object_get_ex(jpush, CHANNELS_PUSH_UPDATES_FIELD, &jupdates);
+  if (jupdates_exists) {
+    stats.updates = json_object_get_int64(jupdates);
+  }
+
+  json_object* jchanges = nullptr;
+  json_bool jchanges_exists = json_object_object_get_ex(jpush, CHANNELS_PUSH_CHANGES_FIELD, &jchanges);
+  if (jchanges_exists) {
+    stats.changes = json_object_get_int64(jchanges);
+  }
+
+  json_object* junchanged = nullptr;
+  json_bool junchanged_exists = json_object_object_get_ex(jpush, CHANNELS_PUSH_UNCHANGED_FIELD, &junchanged);
+  if (junchanged_exists) {
+    stats.unchanged = json_object_get_int64(junchanged);
+  }
+
+  json_object* jfailures = nullptr;
+  json_bool jfailures_exists = json_object_object_get_ex(jpush, CHANNELS_PUSH_FAILURES_FIELD, &jfailures);
+  if (jfailures_exists) {
+    stats.failures = json_object_get_int64(jfailures);
+  }
+  return stats;
+}
+
+json_object* MakeLoginGuardStatsJson(const base::LoginGuardStats& stats) {
+  json_object* jguard = json_object_new_object();
+  json_object_object_add(jguard, LOGIN_GUARD_FAILURES_FIELD, json_object_new_int64(stats.failures));
+  json_object_object_add(jguard, LOGIN_GUARD_REJECTED_CACHED_FIELD, json_object_new_int64(stats.rejected_cached));
+  json_object_object_add(jguard, LOGIN_GUARD_REJECTED_BACKOFF_FIELD, json_object_new_int64(stats.rejected_backoff));
+  json_object_object_add(jguard, LOGIN_GUARD_REJECTED_ADDRESS_FIELD, json_object_new_int64(stats.rejected_address));
+  json_object_object_add(jguard, LOGIN_GUARD_NEGATIVE_ENTRIES_FIELD, json_object_new_int64(stats.negative_entries));
+  json_object_object_add(jguard, LOGIN_GUARD_BLOCKED_IDENTITIES_FIELD,
+                         json_object_new_int64(stats.blocked_identities));
+  return jguard;
+}
+
+base::LoginGuardStats MakeLoginGuardStatsFromJson(json_object* jguard) {
+  base::LoginGuardStats stats;
+  json_object* jfailures = nullptr;
+  json_bool jfailures_exists = json_object_object_get_ex(jguard, LOGIN_GUARD_FAILURES_FIELD, &jfailures);
+  if (jfailures_exists) {
+    stats.failures = json_object_get_int64(jfailures);
+  }
+
+  json_object* jcached = nullptr;
+  json_bool jcached_exists = json_object_object_get_ex(jguard, LOGIN_GUARD_REJECTED_CACHED_FIELD, &jcached);
+  if (jcached_exists) {
+    stats.rejected_cached = json_object_get_int64(jcached);
+  }
+
+  json_object* jbackoff = nullptr;
+  json_bool jbackoff_exists = json_object_object_get_ex(jguard, LOGIN_GUARD_REJECTED_BACKOFF_FIELD, &jbackoff);
+  if (jbackoff_exists) {
+    stats.rejected_backoff = json_object_get_int64(jbackoff);
+  }
+
+  json_object* jaddress = nullptr;
+  json_bool jaddress_exists = json_object_object_get_ex(jguard, LOGIN_GUARD_REJECTED_ADDRESS_FIELD, &jaddress);
+  if (jaddress_exists) {
+    stats.rejected_address = json_object_get_int64(jaddress);
+  }
+
+  json_object* jentries = nullptr;
+  json_bool jentries_exists = json_object_object_get_ex(jguard, LOGIN_GUARD_NEGATIVE_ENTRIES_FIELD, &jentries);
+  if (jentries_exists) {
+    stats.negative_entries = json_object_get_int64(jentries);
+  }
+
+  json_object* jblocked = nullptr;
+  json_bool jblocked_exists = json_object_object_get_ex(jguard, LOGIN_GUARD_BLOCKED_IDENTITIES_FIELD, &jblocked);
+  if (jblocked_exists) {
+    stats.blocked_identities = json_object_get_int64(jblocked);
+  }
+  return stats;
+}
+
+json_object* MakeOperationsStatsJson(const std::vector<base::OperationStats>& operations) {
+  json_object* joperations = json_object_new_array();
+  for (const base::OperationStats& stats : operations) {
+    json_object* joperation = json_object_new_object();
+    json_object_object_add(joperation, OPERATION_NAME_FIELD, json_object_new_string(stats.name.c_str()));
+    json_object_object_add(joperation, OPERATION_CALLS_FIELD, json_object_new_int64(stats.calls));
+    json_object_object_add(joperation, OPERATION_ERRORS_FIELD, json_object_new_int64(stats.errors));
+    json_object_object_add(joperation, OPERATION_SLOW_FIELD, json_object_new_int64(stats.slow));
+    json_object_object_add(joperation, OPERATION_DOCUMENTS_FIELD, json_object_new_int64(stats.documents));
+    json_object_object_add(joperation, OPERATION_BYTES_FIELD, json_object_new_int64(stats.bytes));
+    json_object_object_add(joperation, OPERATION_P50_FIELD, json_object_new_int64(stats.p50_usec));
+    json_object_object_add(joperation, OPERATION_P90_FIELD, json_object_new_int64(stats.p90_usec));
+    json_object_object_add(joperation, OPERATION_P99_FIELD, json_object_new_int64(stats.p99_usec));
+    json_object_object_add(joperation, OPERATION_MAX_FIELD, json_object_new_int64(stats.max_usec));
+    json_object_array_add(joperations, joperation);
+  }
+  return joperations;
+}
+
+uint64_t GetUint64Field(json_object* jobj, const char* field) {
+  json_object* jfield = nullptr;
+  json_bool jfield_exists = json_object_object_get_ex(jobj, field, &jfield);
+  if (jfield_exists) {
+    return json_object_get_int64(jfield);
+  }
+  return 0;
+}
+
+std::vector<base::OperationStats> MakeOperationsStatsFromJson(json_object* joperations) {
+  std::vector<base::OperationStats> operations;
+  const size_t len = json_object_array_length(joperations);
+  for (size_t i = 0; i < len; ++i) {
+    json_object* joperation = json_object_array_get_idx(joperations, i);
+    base::OperationStats stats;
+    json_object* jname = nullptr;
+    json_bool jname_exists = json_object_object_get_ex(joperation, OPERATION_NAME_FIELD, &jname);
+    if (!jname_exists) {
+      continue;
+    }
+    stats.name = json_object_get_string(jname);
+    stats.calls = GetUint64Field(joperation, OPERATION_CALLS_FIELD);
+    stats.errors = GetUint64Field(joperation, OPERATION_ERRORS_FIELD);
+    stats.slow = GetUint64Field(joperation, OPERATION_SLOW_FIELD);
+    stats.documents = GetUint64Field(joperation, OPERATION_DOCUMENTS_FIELD);
+    stats.bytes = GetUint64Field(joperation, OPERATION_BYTES_FIELD);
+    stats.p50_usec = GetUint64Field(joperation, OPERATION_P50_FIELD);
+    stats.p90_usec = GetUint64Field(joperation, OPERATION_P90_FIELD);
+    stats.p99_usec = GetUint64Field(joperation, OPERATION_P99_FIELD);
+    stats.max_usec = GetUint64Field(joperation, OPERATION_MAX_FIELD);
+    operations.push_back(stats);
+  }
+  return operations;
+}
+
+json_object* MakeQueryPlansStatsJson(const std::vector<base::QueryPlanStats>& plans) {
+  json_object* jplans = json_object_new_array();
+  for (const base::QueryPlanStats& stats : plans) {
+    json_object* jplan = json_object_new_object();
+    json_object_object_add(jplan, QUERY_PLAN_OPERATION_FIELD, json_object_new_string(stats.operation.c_str()));
+    json_object_object_add(jplan, QUERY_PLAN_COLLECTION_FIELD, json_object_new_string(stats.collection.c_str()));
+    json_object_object_add(jplan, QUERY_PLAN_INDEX_FIELD, json_object_new_string(stats.index.c_str()));
+    json_object_object_add(jplan, QUERY_PLAN_INDEX_STATE_FIELD, json_object_new_string(stats.index_state.c_str()));
+    json_object_object_add(jplan, QUERY_PLAN_PLAN_FIELD, json_object_new_string(stats.plan.c_str()));
+    json_object_object_add(jplan, QUERY_PLAN_COLLECTION_SCAN_FIELD, json_object_new_boolean(stats.collection_scan));
+    json_object_array_add(jplans, jplan);
+  }
+  return jplans;
+}
+
+std::string GetStringField(json_object* jobj, const char* field) {
+  json_object* jfield = nullptr;
+  json_bool jfield_exists = json_object_object_get_ex(jobj, field, &jfield);
+  if (jfield_exists) {
+    return json_object_get_string(jfield);
+  }
+  return std::string();
+}
+
+std::vector<base::QueryPlanStats> MakeQueryPlansStatsFromJson(json_object* jplans) {
+  std::vector<base::QueryPlanStats> plans;
+  const size_t len = json_object_array_length(jplans);
+  for (size_t i = 0; i < len; ++i) {
+    json_object* jplan = json_object_array_get_idx(jplans, i);
+    base::QueryPlanStats stats;
+    stats.operation = GetStringField(jplan, QUERY_PLAN_OPERATION_FIELD);
+    if (stats.operation.empty()) {
+      continue;
+    }
+    stats.collection = GetStringField(jplan, QUERY_PLAN_COLLECTION_FIELD);
+    stats.index = GetStringField(jplan, QUERY_PLAN_INDEX_FIELD);
+    stats.index_state = GetStringField(jplan, QUERY_PLAN_INDEX_STATE_FIELD);
+    stats.plan = GetStringField(jplan, QUERY_PLAN_PLAN_FIELD);
+    json_object* jscan = nullptr;
+    json_bool jscan_exists = json_object_object_get_ex(jplan, QUERY_PLAN_COLLECTION_SCAN_FIELD, &jscan);
+    if (jscan_exists) {
+      stats.collection_scan = json_object_get_boolean(jscan);
+    }
+    plans.push_back(stats);
+  }
+  return plans;
+}
+
+}  // namespace
+
+DbStatsInfo::DbStatsInfo() : DbStatsInfo(base::SubscribersManagerStats()) {}
+
+DbStatsInfo::DbStatsInfo(const base::SubscribersManagerStats& stats) : base_class(), stats_(stats) {}
+
+base::SubscribersManagerStats DbStatsInfo::GetStats() const {
+  return stats_;
+}
+
+common::Error DbStatsInfo::DoDeSerialize(json_object* serialized) {
+  base::SubscribersManagerStats stats;
+  json_object* jstreams_cache = nullptr;
+  json_bool jstreams_cache_exists = json_object_object_get_ex(serialized, STREAMS_CACHE_FIELD, &jstreams_cache);
+  if (jstreams_cache_exists) {
+    stats.streams_cache = MakeCacheStatsFromJson(jstreams_cache);
+  }
+
+  json_object* jpool = nullptr;
+  json_bool jpool_exists = json_object_object_get_ex(serialized, POOL_FIELD, &jpool);
+  if (jpool_exists) {
+    stats.pool = MakePoolStatsFromJson(jpool);
+  }
+
+  json_object* jchannels_cache = nullptr;
+  json_bool jchannels_cache_exists = json_object_object_get_ex(serialized, CHANNELS_CACHE_FIELD, &jchannels_cache);
+  if (jchannels_cache_exists) {
+    stats.channels_cache = MakeChannelsCacheStatsFromJson(jchannels_cache);
+  }
+
+  json_object* jwrite_buffer = nullptr;
+  json_bool jwrite_buffer_exists = json_object_object_get_ex(serialized, WRITE_BUFFER_FIELD, &jwrite_buffer);
+  if (jwrite_buffer_exists) {
+    stats.write_buffer = MakeWriteBufferStatsFromJson(jwrite_buffer);
+  }
+
+  json_object* jview_counters = nullptr;
+  json_bool jview_counters_exists = json_object_object_get_ex(serialized, VIEW_COUNTERS_FIELD, &jview_counters);
+  if (jview_counters_exists) {
+    stats.view_counters = MakeViewCountersStatsFromJson(jview_counters);
+  }
+
+  json_object* jauth_cache = nullptr;
+  json_bool jauth_cache_exists = json_object_object_get_ex(serialized, AUTH_CACHE_FIELD, &jauth_cache);
+  if (jauth_cache_exists) {
+    stats.auth_cache = MakeCacheStatsFromJson(jauth_cache);
+  }
+
+  json_object* jpaths_cache = nullptr;
+  json_bool jpaths_cache_exists = json_object_object_get_ex(serialized, PATHS_CACHE_FIELD, &jpaths_cache);
+  if (jpaths_cache_exists) {
+    stats.paths_cache = MakeCacheStatsFromJson(jpaths_cache);
+  }
+
+  json_object* jchannels_push = nullptr;
+  json_bool jchannels_push_exists = json_object_object_get_ex(serialized, CHANNELS_PUSH_FIELD, &jchannels_push);
+  if (jchannels_push_exists) {
+    stats.channels_push = MakeChannelsPushStatsFromJson(jchannels_push);
+  }
+
+  json_object* jlogin_guard = nullptr;
+  json_bool jlogin_guard_exists = json_object_object_get_ex(serialized, LOGIN_GUARD_FIELD, &jlogin_guard);
+  if (jlogin_guard_exists) {
+    stats.login_guard = MakeLoginGuardStatsFromJson(jlogin_guard);
+  }
+
+  json_object* junknown_classes = nullptr;
+  json_bool junknown_classes_exists =
+      json_object_object_get_ex(serialized, UNKNOWN_STREAM_CLASSES_FIELD, &junknown_classes);
+  if (junknown_classes_exists) {
+    stats.unknown_stream_classes = json_object_get_int64(junknown_classes);
+  }
+
+  json_object* joperations = nullptr;
+  json_bool joperations_exists = json_object_object_get_ex(serialized, OPERATIONS_FIELD, &joperations);
+  if (joperations_exists && json_object_is_type(joperations, json_type_array)) {
+    stats.operations = MakeOperationsStatsFromJson(joperations);
+  }
+
+  json_object* jquery_plans = nullptr;
+  json_bool jquery_plans_exists = json_object_object_get_ex(serialized, QUERY_PLANS_FIELD, &jquery_plans);
+  if (jquery_plans_exists && json_object_is_type(jquery_plans, json_type_array)) {
+    stats.query_plans = MakeQueryPlansStatsFromJson(jquery_plans);
+  }
+
+  *this = DbStatsInfo(stats);
+  return common::Error();
+}
+
+common::Error DbStatsInfo::SerializeFields(json_object* out) const {
+  json_object_object_add(out, STREAMS_CACHE_FIELD, MakeCacheStatsJson(stats_.streams_cache));
+  json_object_object_add(out, POOL_FIELD, MakePoolStatsJson(stats_.pool));
+  json_object_object_add(out, CHANNELS_CACHE_FIELD, MakeChannelsCacheStatsJson(stats_.channels_cache));
+  json_object_object_add(out, CHANNELS_PUSH_FIELD, MakeChannelsPushStatsJson(stats_.channels_push));
+  json_object_object_add(out, WRITE_BUFFER_FIELD, MakeWriteBufferStatsJson(stats_.write_buffer));
+  json_object_object_add(out, VIEW_COUNTERS_FIELD, MakeViewCountersStatsJson(stats_.view_counters));
+  json_object_object_add(out, AUTH_CACHE_FIELD, MakeCacheStatsJson(stats_.auth_cache));
+  json_object_object_add(out, PATHS_CACHE_FIELD, MakeCacheStatsJson(stats_.paths_cache));
+  json_object_object_add(out, LOGIN_GUARD_FIELD, MakeLoginGuardStatsJson(stats_.login_guard));
+  json_object_object_add(out, UNKNOWN_STREAM_CLASSES_FIELD, json_object_new_int64(stats_.unknown_stream_classes));
+  json_object_object_add(out, OPERATIONS_FIELD, MakeOperationsStatsJson(stats_.operations));
+  json_object_object_add(out, QUERY_PLANS_FIELD, MakeQueryPlansStatsJson(stats_.query_plans));
+  return common::Error();
+}
+
+}  // namespace service
+}  // namespace server
+}  // namespace fastocloud
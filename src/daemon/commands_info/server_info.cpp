@@ -15,6 +15,7 @@
 #include "daemon/commands_info/server_info.h"
 
 #define ONLINE_USERS_FIELD "online_users"
+#define DB_STATS_FIELD "db_stats"
 
 #define OS_FIELD "os"
 #define VERSION_FIELD "version"
@@ -66,7 +67,7 @@ common::Error OnlineUsers::SerializeFields(json_object* out) const {
   return common::Error();
 }
 
-ServerInfo::ServerInfo() : base_class(), online_users_() {}
+ServerInfo::ServerInfo() : base_class(), online_users_(), db_stats_() {}
 
 ServerInfo::ServerInfo(cpu_load_t cpu_load,
                        gpu_load_t gpu_load,
@@ -95,7 +96,8 @@ ServerInfo::ServerInfo(cpu_load_t cpu_load,
                  timestamp,
                  net_total_bytes_recv,
                  net_total_bytes_send),
-      online_users_(online_users) {}
+      online_users_(online_users),
+      db_stats_() {}
 
 common::Error ServerInfo::SerializeFields(json_object* out) const {
   common::Error err = base_class::SerializeFields(out);
@@ -110,6 +112,14 @@ common::Error ServerInfo::SerializeFields(json_object* out) const {
   }
 
   json_object_object_add(out, ONLINE_USERS_FIELD, obj);
+
+  json_object* jdb_stats = nullptr;
+  err = db_stats_.Serialize(&jdb_stats);
+  if (err) {
+    return err;
+  }
+
+  json_object_object_add(out, DB_STATS_FIELD, jdb_stats);
   return common::Error();
 }
 
@@ -129,6 +139,15 @@ common::Error ServerInfo::DoDeSerialize(json_object* serialized) {
     }
   }
 
+  json_object* jdb_stats = nullptr;
+  json_bool jdb_stats_exists = json_object_object_get_ex(serialized, DB_STATS_FIELD, &jdb_stats);
+  if (jdb_stats_exists) {
+    common::Error err = inf.db_stats_.DeSerialize(jdb_stats);
+    if (err) {
+      return err;
+    }
+  }
+
   *this = inf;
   return common::Error();
 }
@@ -137,6 +156,14 @@ OnlineUsers ServerInfo::GetOnlineUsers() const {
   return online_users_;
 }
 
+DbStatsInfo ServerInfo::GetDbStats() const {
+  return db_stats_;
+}
+
+void ServerInfo::SetDbStats(const DbStatsInfo& stats) {
+  db_stats_ = stats;
+}
+
 FullServiceInfo::FullServiceInfo()
     : base_class(),
       http_host_(),
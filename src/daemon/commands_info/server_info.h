@@ -16,6 +16,8 @@
 
 #include <fastotv/commands_info/machine_info.h>
 
+#include "daemon/commands_info/db_stats_info.h"
+
 namespace fastocloud {
 namespace server {
 namespace service {
@@ -57,12 +59,16 @@ class ServerInfo : public fastotv::commands_info::MachineInfo {
 
   OnlineUsers GetOnlineUsers() const;
 
+  DbStatsInfo GetDbStats() const;
+  void SetDbStats(const DbStatsInfo& stats);
+
  protected:
   common::Error DoDeSerialize(json_object* serialized) override;
   common::Error SerializeFields(json_object* out) const override;
 
  private:
   OnlineUsers online_users_;
+  DbStatsInfo db_stats_;
 };
 
 class FullServiceInfo : public ServerInfo {
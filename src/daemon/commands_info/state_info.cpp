@@ -15,12 +15,22 @@
 #include "daemon/commands_info/state_info.h"
 
 #define CLIENTS_FIELD "online_clients"
+#define READY_FIELD "ready"
+#define WARM_UP_FIELD "warm_up"
+
+#define WARM_UP_COMPLETE_FIELD "complete"
+#define WARM_UP_DURATION_FIELD "duration_msec"
+#define WARM_UP_SUBSCRIBERS_FIELD "subscribers"
+#define WARM_UP_DEVICES_FIELD "devices"
+#define WARM_UP_STREAMS_FIELD "streams"
+#define WARM_UP_SERIES_FIELD "series"
+#define WARM_UP_BYTES_FIELD "bytes"
 
 namespace fastocloud {
 namespace server {
 namespace service {
 
-StateInfo::StateInfo() : base_class(), clients_() {}
+StateInfo::StateInfo() : base_class(), clients_(), ready_(false), warm_up_() {}
 
 void StateInfo::SetOnlineClients(const online_clients_t& clients) {
   clients_ = clients;
@@ -30,6 +40,22 @@ StateInfo::online_clients_t StateInfo::GetOnlineClients() const {
   return clients_;
 }
 
+void StateInfo::SetReady(bool ready) {
+  ready_ = ready;
+}
+
+bool StateInfo::IsReady() const {
+  return ready_;
+}
+
+void StateInfo::SetWarmUp(const base::WarmUpStats& warm_up) {
+  warm_up_ = warm_up;
+}
+
+base::WarmUpStats StateInfo::GetWarmUp() const {
+  return warm_up_;
+}
+
 common::Error StateInfo::SerializeFields(json_object* deserialized) const {
   json_object* jclients = json_object_new_array();
   for (auto client : clients_) {
@@ -41,6 +67,17 @@ common::Error StateInfo::SerializeFields(json_object* deserialized) const {
     json_object_array_add(jclients, jclient);
   }
   json_object_object_add(deserialized, CLIENTS_FIELD, jclients);
+  json_object_object_add(deserialized, READY_FIELD, json_object_new_boolean(ready_));
+
+  json_object* jwarm_up = json_object_new_object();
+  json_object_object_add(jwarm_up, WARM_UP_COMPLETE_FIELD, json_object_new_boolean(warm_up_.complete));
+  json_object_object_add(jwarm_up, WARM_UP_DURATION_FIELD, json_object_new_int64(warm_up_.duration_msec));
+  json_object_object_add(jwarm_up, WARM_UP_SUBSCRIBERS_FIELD, json_object_new_int64(warm_up_.subscribers));
+  json_object_object_add(jwarm_up, WARM_UP_DEVICES_FIELD, json_object_new_int64(warm_up_.devices));
+  json_object_object_add(jwarm_up, WARM_UP_STREAMS_FIELD, json_object_new_int64(warm_up_.streams));
+  json_object_object_add(jwarm_up, WARM_UP_SERIES_FIELD, json_object_new_int64(warm_up_.series));
+  json_object_object_add(jwarm_up, WARM_UP_BYTES_FIELD, json_object_new_int64(warm_up_.bytes));
+  json_object_object_add(deserialized, WARM_UP_FIELD, jwarm_up);
   return common::Error();
 }
 
@@ -65,6 +102,39 @@ common::Error StateInfo::DoDeSerialize(json_object* serialized) {
     inf.clients_ = clients;
   }
 
+  json_object* jready = nullptr;
+  json_bool jready_exists = json_object_object_get_ex(serialized, READY_FIELD, &jready);
+  if (jready_exists) {
+    inf.ready_ = json_object_get_boolean(jready);
+  }
+
+  json_object* jwarm_up = nullptr;
+  json_bool jwarm_up_exists = json_object_object_get_ex(serialized, WARM_UP_FIELD, &jwarm_up);
+  if (jwarm_up_exists) {
+    json_object* jfield = nullptr;
+    if (json_object_object_get_ex(jwarm_up, WARM_UP_COMPLETE_FIELD, &jfield)) {
+      inf.warm_up_.complete = json_object_get_boolean(jfield);
+    }
+    if (json_object_object_get_ex(jwarm_up, WARM_UP_DURATION_FIELD, &jfield)) {
+      inf.warm_up_.duration_msec = json_object_get_int64(jfield);
+    }
+    if (json_object_object_get_ex(jwarm_up, WARM_UP_SUBSCRIBERS_FIELD, &jfield)) {
+      inf.warm_up_.subscribers = json_object_get_int64(jfield);
+    }
+    if (json_object_object_get_ex(jwarm_up, WARM_UP_DEVICES_FIELD, &jfield)) {
+      inf.warm_up_.devices = json_object_get_int64(jfield);
+    }
+    if (json_object_object_get_ex(jwarm_up, WARM_UP_STREAMS_FIELD, &jfield)) {
+      inf.warm_up_.streams = json_object_get_int64(jfield);
+    }
+    if (json_object_object_get_ex(jwarm_up, WARM_UP_SERIES_FIELD, &jfield)) {
+      inf.warm_up_.series = json_object_get_int64(jfield);
+    }
+    if (json_object_object_get_ex(jwarm_up, WARM_UP_BYTES_FIELD, &jfield)) {
+      inf.warm_up_.bytes = json_object_get_int64(jfield);
+    }
+  }
+
   *this = inf;
   return common::Error();
 }
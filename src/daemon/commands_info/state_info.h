@@ -20,6 +20,7 @@
 #include <common/serializer/json_serializer.h>
 
 #include "base/front_subscriber_info.h"
+#include "base/subscribers_manager_stats.h"
 
 namespace fastocloud {
 namespace server {
@@ -35,12 +36,20 @@ class StateInfo : public common::serializer::JsonSerializer<StateInfo> {
   void SetOnlineClients(const online_clients_t& clients);
   online_clients_t GetOnlineClients() const;
 
+  // subscribers and http servers listen once the warm-up finished
+  void SetReady(bool ready);
+  bool IsReady() const;
+  void SetWarmUp(const base::WarmUpStats& warm_up);
+  base::WarmUpStats GetWarmUp() const;
+
  protected:
   common::Error DoDeSerialize(json_object* serialized) override;
   common::Error SerializeFields(json_object* deserialized) const override;
 
  private:
   online_clients_t clients_;
+  bool ready_;
+  base::WarmUpStats warm_up_;
 };
 
 }  // namespace service
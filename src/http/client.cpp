@@ -14,12 +14,20 @@
 
 #include "http/client.h"
 
+#include <common/libev/io_loop.h>
+
 namespace fastocloud {
 namespace server {
 namespace http {
 
 HttpClient::HttpClient(common::libev::IoLoop* server, const common::net::socket_info& info)
-    : base_class(server, info), is_verified_(false) {}
+    : base_class(server, info),
+      is_verified_(false),
+      request_pending_(false),
+      draining_requests_(false),
+      queued_requests_() {
+  GetServingLoop()->Arrive(server);
+}
 
 bool HttpClient::IsVerified() const {
   return is_verified_;
@@ -29,6 +37,41 @@ void HttpClient::SetVerified(bool verified) {
   is_verified_ = verified;
 }
 
+bool HttpClient::IsRequestPending() const {
+  return request_pending_;
+}
+
+void HttpClient::SetRequestPending(bool pending) {
+  request_pending_ = pending;
+}
+
+bool HttpClient::QueueRequest(const std::string& request) {
+  if (queued_requests_.size() >= max_queued_requests) {
+    return false;
+  }
+
+  queued_requests_.push_back(request);
+  return true;
+}
+
+bool HttpClient::PopQueuedRequest(std::string* request) {
+  if (!request || queued_requests_.empty()) {
+    return false;
+  }
+
+  *request = queued_requests_.front();
+  queued_requests_.pop_front();
+  return true;
+}
+
+bool HttpClient::IsDrainingRequests() const {
+  return draining_requests_;
+}
+
+void HttpClient::SetDrainingRequests(bool draining) {
+  draining_requests_ = draining;
+}
+
 common::Optional<base::FrontSubscriberInfo> HttpClient::MakeFrontSubscriberInfo() const {
   const auto login = GetLogin();
   if (!login) {
@@ -14,6 +14,9 @@
 
 #pragma once
 
+#include <deque>
+#include <string>
+
 #include <common/libev/http/http_client.h>
 
 #include "base/subscriber_info.h"
@@ -25,12 +28,23 @@ namespace http {
 class HttpClient : public common::libev::http::HttpClient, public base::SubscriberInfo {
  public:
   typedef common::libev::http::HttpClient base_class;
+  enum { max_queued_requests = 16 };
 
   HttpClient(common::libev::IoLoop* server, const common::net::socket_info& info);
 
   bool IsVerified() const;
   void SetVerified(bool verified);
 
+  // requests of a keep-alive connection are answered in order, one at a time,
+  // the ones read while a request is on a database worker wait here
+  bool IsRequestPending() const;
+  void SetRequestPending(bool pending);
+  bool QueueRequest(const std::string& request) WARN_UNUSED_RESULT;
+  bool PopQueuedRequest(std::string* request);
+  // queued requests are being answered by a loop of the handler
+  bool IsDrainingRequests() const;
+  void SetDrainingRequests(bool draining);
+
   common::Optional<base::FrontSubscriberInfo> MakeFrontSubscriberInfo() const override;
 
   common::ErrnoError SendNotification(const fastotv::commands_info::NotificationTextInfo& notify) override;
@@ -39,6 +53,9 @@ class HttpClient : public common::libev::http::HttpClient, public base::Subscrib
 
  private:
   bool is_verified_;
+  bool request_pending_;
+  bool draining_requests_;
+  std::deque<std::string> queued_requests_;
 };
 
 }  // namespace http
@@ -24,15 +24,31 @@
 
 #include <common/convert2string.h>
 
+#include "base/db_worker_pool.h"
 #include "base/isubscribers_manager.h"
 
 #include "http/client.h"
 
+namespace {
+const common::libev::http::HttpServerInfo& GetHttpServerInfo() {
+  static const common::libev::http::HttpServerInfo hinf(PROJECT_NAME_TITLE, PROJECT_DOMAIN);
+  return hinf;
+}
+
+common::http::headers_t MakeExtraHeaders() {
+  return {{"Access-Control-Allow-Origin", "*"}};
+}
+}  // namespace
+
 namespace fastocloud {
 namespace server {
 namespace http {
 
-HttpHandler::HttpHandler(base::ISubscribersManager* manager) : base_class(), manager_(manager) {}
+HttpHandler::HttpHandler(base::ISubscribersManager* manager, base::DbWorkerPool* db_workers)
+    : base_class(),
+      manager_(manager),
+      db_workers_(db_workers),
+      paths_cache_(PathsCache::default_max_entries, PathsCache::default_max_age_sec) {}
 
 void HttpHandler::PreLooped(common::libev::IoLoop* server) {
   UNUSED(server);
@@ -88,6 +104,15 @@ void HttpHandler::DataReceived(common::libev::IoClient* client) {
   }
 
   HttpClient* hclient = static_cast<HttpClient*>(client);
+  if (hclient->IsRequestPending()) {
+    if (!hclient->QueueRequest(std::string(buff, nread))) {
+      WARNING_LOG() << "Too many pipelined requests, closing client[" << client->GetFormatedName() << "]";
+      ignore_result(client->Close());
+      delete client;
+    }
+    return;
+  }
+
   ProcessReceived(hclient, buff, nread);
 }
 
@@ -100,13 +125,13 @@ void HttpHandler::PostLooped(common::libev::IoLoop* server) {
 }
 
 void HttpHandler::ProcessReceived(HttpClient* hclient, const char* request, size_t req_len) {
-  static const common::libev::http::HttpServerInfo hinf(PROJECT_NAME_TITLE, PROJECT_DOMAIN);
+  const common::libev::http::HttpServerInfo& hinf = GetHttpServerInfo();
   common::http::HttpRequest hrequest;
   std::string request_str(request, req_len);
   std::pair<common::http::http_status, common::Error> result = common::http::parse_http_request(request_str, &hrequest);
   DEBUG_LOG() << "Http request:\n" << request;
 
-  common::http::headers_t extra_headers = {{"Access-Control-Allow-Origin", "*"}};
+  common::http::headers_t extra_headers = MakeExtraHeaders();
   if (result.second) {
     const std::string error_text = result.second->GetDescription();
     DEBUG_MSG_ERROR(result.second, common::logging::LOG_LEVEL_ERR);
@@ -149,28 +174,10 @@ void HttpHandler::ProcessReceived(HttpClient* hclient, const char* request, size
       goto finish;
     }
 
-    base::ServerDBAuthInfo maybe_auth;
-    common::Error cerr = manager_->CheckIsLoginClient(hclient, &maybe_auth);
-    if (cerr) {
-      // user_id/password_hash/device_id/stream_id/channel_id/file
-      const fastotv::user_id_t user_uid = tokens[0];
-      const std::string password = tokens[1];
-      const fastotv::device_id_t dev = tokens[2];
-      // try to check login
-      cerr = manager_->ClientLogin(user_uid, password, dev, &maybe_auth);
-      if (cerr) {
-        const std::string err_desc = cerr->GetDescription();
-        common::ErrnoError errn = hclient->SendError(protocol, common::http::HS_NOT_FOUND, extra_headers,
-                                                     err_desc.c_str(), IsKeepAlive, hinf);
-        if (errn) {
-          DEBUG_MSG_ERROR(errn, common::logging::LOG_LEVEL_ERR);
-        }
-        goto finish;
-      }
-      cerr = manager_->RegisterInnerConnectionByHost(hclient, maybe_auth);
-      DCHECK(!cerr) << "Register inner connection error: " << cerr->GetDescription();
-    }
-
+    // user_id/password_hash/device_id/stream_id/channel_id/file
+    const fastotv::user_id_t user_uid = tokens[0];
+    const std::string password = tokens[1];
+    const fastotv::device_id_t dev = tokens[2];
     const fastotv::stream_id_t sid = tokens[3];
     fastotv::channel_id_t cid;
     const std::string file_name = tokens[5];
@@ -183,104 +190,212 @@ void HttpHandler::ProcessReceived(HttpClient* hclient, const char* request, size
       goto finish;
     }
 
-    base::ISubscribersManager::http_directory_t directory;
-    common::uri::GURL url_for_channel;
-    cerr = manager_->ClientFindHttpDirectoryOrUrlForChannel(maybe_auth, sid, cid, &directory, &url_for_channel);
-    if (cerr) {
-      const std::string err_desc = cerr->GetDescription();
-      common::ErrnoError errn =
-          hclient->SendError(protocol, common::http::HS_NOT_FOUND, extra_headers, err_desc.c_str(), IsKeepAlive, hinf);
+    base::ServerDBAuthInfo maybe_auth;
+    const bool need_login = manager_->CheckIsLoginClient(hclient, &maybe_auth) ? true : false;
+    const bool is_get = hrequest.GetMethod() == common::http::http_method::HM_GET;
+    const std::string peer_host = hclient->GetInfo().host();
+    common::Error post_err = db_workers_->PostForClient<HttpClient>(
+        hclient,
+        [this, need_login, maybe_auth, user_uid, password, dev, peer_host, sid, cid, file_name, url_request, protocol,
+         is_get, IsKeepAlive]() -> db_completion_t {
+          base::ServerDBAuthInfo auth = maybe_auth;
+          if (need_login) {
+            // try to check login
+            common::Error cerr = manager_->ClientLogin(user_uid, password, dev, peer_host, &auth);
+            if (cerr) {
+              return [this, cerr, protocol, IsKeepAlive](HttpClient* hclient) {
+                SendErrorAndFinish(hclient, protocol, common::http::HS_NOT_FOUND, cerr->GetDescription(), IsKeepAlive);
+              };
+            }
+          }
+
+          ResolvedPath path;
+          common::Error cerr = FindHttpDirectoryOrUrlForChannel(auth, sid, cid, &path);
+          return [this, need_login, auth, cerr, path, sid, file_name, url_request, protocol, is_get,
+                  IsKeepAlive](HttpClient* hclient) {
+            if (need_login && !hclient->GetLogin()) {
+              common::Error reg_err = manager_->RegisterInnerConnectionByHost(hclient, auth);
+              if (reg_err) {
+                SendErrorAndFinish(hclient, protocol, common::http::HS_NOT_FOUND, reg_err->GetDescription(),
+                                   IsKeepAlive);
+                return;
+              }
+            }
+
+            if (cerr) {
+              SendErrorAndFinish(hclient, protocol, common::http::HS_NOT_FOUND, cerr->GetDescription(), IsKeepAlive);
+              return;
+            }
+
+            SendChannelContent(hclient, protocol, url_request, sid, file_name, path.directory, path.url, is_get,
+                               IsKeepAlive);
+          };
+        });
+    if (post_err) {
+      const std::string err_desc = post_err->GetDescription();
+      common::ErrnoError errn = hclient->SendError(protocol, common::http::HS_SERVICE_UNAVAILABLE, extra_headers,
+                                                   err_desc.c_str(), IsKeepAlive, hinf);
       if (errn) {
         DEBUG_MSG_ERROR(errn, common::logging::LOG_LEVEL_ERR);
       }
       goto finish;
     }
 
-    if (!directory.IsValid()) {
-      DCHECK(url_for_channel.is_valid());
-      const std::string url_str = url_for_channel.spec();
-      extra_headers.push_back({"Location", url_str});
-      common::ErrnoError err = hclient->SendHeaders(protocol, common::http::HS_PERMANENT_REDIRECT, extra_headers,
-                                                    nullptr, nullptr, nullptr, IsKeepAlive, hinf);
-      if (err) {
-        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
-      } else {
-        DEBUG_LOG() << "Sent redirect to: " << url_str;
-        hclient->SetCurrentStreamID(sid);
-      }
-      goto finish;
-    }
+    // response will be sent from the db completion, next requests wait for it
+    hclient->SetRequestPending(true);
+    return;
+  }
 
-    auto file_path = directory.MakeFileStringPath(file_name);
-    if (!file_path) {
-      common::ErrnoError err =
-          hclient->SendError(protocol, common::http::HS_NOT_FOUND, extra_headers, "File not found.", IsKeepAlive, hinf);
-      if (err) {
-        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
-      }
-      goto finish;
-    }
+finish:
+  FinishRequest(hclient, IsKeepAlive);
+}
 
-    const std::string file_path_str = file_path->GetPath();
-    int open_flags = O_RDONLY;
-    struct stat sb;
-    if (stat(file_path_str.c_str(), &sb) < 0) {
-      common::ErrnoError err =
-          hclient->SendError(protocol, common::http::HS_NOT_FOUND, extra_headers, "File not found.", IsKeepAlive, hinf);
-      WARNING_LOG() << "File path: " << file_path_str << ", not found";
-      if (err) {
-        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
-      }
-      goto finish;
-    }
+common::Error HttpHandler::FindHttpDirectoryOrUrlForChannel(const base::ServerDBAuthInfo& auth,
+                                                            fastotv::stream_id_t sid,
+                                                            fastotv::channel_id_t cid,
+                                                            ResolvedPath* path) {
+  if (!path) {
+    return common::make_error_inval();
+  }
 
-    if (S_ISDIR(sb.st_mode)) {
-      common::ErrnoError err =
-          hclient->SendError(protocol, common::http::HS_BAD_REQUEST, extra_headers, "Bad filename.", IsKeepAlive, hinf);
-      if (err) {
-        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
-      }
-      goto finish;
-    }
+  const fastotv::user_id_t uid = auth.GetUserID();
+  base::ChannelsVersion version;
+  const bool cacheable = manager_->GetChannelsVersion(uid, &version);
+  if (cacheable && paths_cache_.Find(uid, sid, cid, version, path)) {
+    return common::Error();
+  }
 
-    int file = open(file_path_str.c_str(), open_flags);
-    if (file == INVALID_DESCRIPTOR) { /* open the file for reading */
-      common::ErrnoError err = hclient->SendError(protocol, common::http::HS_FORBIDDEN, extra_headers,
-                                                  "File is protected.", IsKeepAlive, hinf);
-      if (err) {
-        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
-      }
-      goto finish;
-    }
+  ResolvedPath lpath;
+  common::Error err = manager_->ClientFindHttpDirectoryOrUrlForChannel(auth, sid, cid, &lpath.directory, &lpath.url);
+  if (err) {
+    return err;
+  }
+
+  if (cacheable) {
+    paths_cache_.Insert(uid, sid, cid, version, lpath);
+  }
+  *path = lpath;
+  return common::Error();
+}
 
-    const std::string fileName = url_request.ExtractFileName();
-    const char* mime = common::http::MimeTypes::GetType(fileName.c_str());
-    common::ErrnoError err = hclient->SendHeaders(protocol, common::http::HS_OK, extra_headers, mime, &sb.st_size,
-                                                  &sb.st_mtime, IsKeepAlive, hinf);
+base::CacheStats HttpHandler::GetPathsCacheStats() const {
+  return paths_cache_.GetStats();
+}
+
+void HttpHandler::SendChannelContent(HttpClient* hclient,
+                                     common::http::http_protocol protocol,
+                                     const common::uri::GURL& url_request,
+                                     fastotv::stream_id_t sid,
+                                     const std::string& file_name,
+                                     const base::ISubscribersManager::http_directory_t& directory,
+                                     const common::uri::GURL& url_for_channel,
+                                     bool is_get,
+                                     bool IsKeepAlive) {
+  const common::libev::http::HttpServerInfo& hinf = GetHttpServerInfo();
+  common::http::headers_t extra_headers = MakeExtraHeaders();
+  if (!directory.IsValid()) {
+    DCHECK(url_for_channel.is_valid());
+    const std::string url_str = url_for_channel.spec();
+    extra_headers.push_back({"Location", url_str});
+    common::ErrnoError err = hclient->SendHeaders(protocol, common::http::HS_PERMANENT_REDIRECT, extra_headers,
+                                                  nullptr, nullptr, nullptr, IsKeepAlive, hinf);
     if (err) {
       DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
-      ::close(file);
-      goto finish;
+    } else {
+      DEBUG_LOG() << "Sent redirect to: " << url_str;
+      hclient->SetCurrentStreamID(sid);
     }
+    FinishRequest(hclient, IsKeepAlive);
+    return;
+  }
 
-    if (hrequest.GetMethod() == common::http::http_method::HM_GET) {
-      common::ErrnoError err = hclient->SendFileByFd(protocol, file, sb.st_size);
-      if (err) {
-        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
-      } else {
-        DEBUG_LOG() << "Sent file path: " << file_path_str << ", size: " << sb.st_size;
-        hclient->SetCurrentStreamID(sid);
-      }
-    }
+  auto file_path = directory.MakeFileStringPath(file_name);
+  if (!file_path) {
+    SendErrorAndFinish(hclient, protocol, common::http::HS_NOT_FOUND, "File not found.", IsKeepAlive);
+    return;
+  }
+
+  const std::string file_path_str = file_path->GetPath();
+  int open_flags = O_RDONLY;
+  struct stat sb;
+  if (stat(file_path_str.c_str(), &sb) < 0) {
+    WARNING_LOG() << "File path: " << file_path_str << ", not found";
+    SendErrorAndFinish(hclient, protocol, common::http::HS_NOT_FOUND, "File not found.", IsKeepAlive);
+    return;
+  }
+
+  if (S_ISDIR(sb.st_mode)) {
+    SendErrorAndFinish(hclient, protocol, common::http::HS_BAD_REQUEST, "Bad filename.", IsKeepAlive);
+    return;
+  }
 
+  int file = open(file_path_str.c_str(), open_flags);
+  if (file == INVALID_DESCRIPTOR) { /* open the file for reading */
+    SendErrorAndFinish(hclient, protocol, common::http::HS_FORBIDDEN, "File is protected.", IsKeepAlive);
+    return;
+  }
+
+  const std::string fileName = url_request.ExtractFileName();
+  const char* mime = common::http::MimeTypes::GetType(fileName.c_str());
+  common::ErrnoError err = hclient->SendHeaders(protocol, common::http::HS_OK, extra_headers, mime, &sb.st_size,
+                                                &sb.st_mtime, IsKeepAlive, hinf);
+  if (err) {
+    DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
     ::close(file);
+    FinishRequest(hclient, IsKeepAlive);
+    return;
   }
 
-finish:
+  if (is_get) {  // HEAD gets the headers only
+    common::ErrnoError err = hclient->SendFileByFd(protocol, file, sb.st_size);
+    if (err) {
+      DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+    } else {
+      DEBUG_LOG() << "Sent file path: " << file_path_str << ", size: " << sb.st_size;
+      hclient->SetCurrentStreamID(sid);
+    }
+  }
+
+  ::close(file);
+  FinishRequest(hclient, IsKeepAlive);
+}
+
+void HttpHandler::SendErrorAndFinish(HttpClient* hclient,
+                                     common::http::http_protocol protocol,
+                                     common::http::http_status status,
+                                     const std::string& text,
+                                     bool IsKeepAlive) {
+  common::ErrnoError err =
+      hclient->SendError(protocol, status, MakeExtraHeaders(), text.c_str(), IsKeepAlive, GetHttpServerInfo());
+  if (err) {
+    DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+  }
+  FinishRequest(hclient, IsKeepAlive);
+}
+
+void HttpHandler::FinishRequest(HttpClient* hclient, bool IsKeepAlive) {
   if (!IsKeepAlive) {
     ignore_result(hclient->Close());
     delete hclient;
+    return;
+  }
+
+  hclient->SetRequestPending(false);
+  if (hclient->IsDrainingRequests()) {  // answered inside the loop below, it goes on with the next request
+    return;
+  }
+
+  // requests answered without the database finish right away, a loop instead of a stack frame per request
+  const base::SubscriberInfo::life_token_t token = hclient->GetLifeToken();
+  hclient->SetDrainingRequests(true);
+  std::string next;
+  while (!hclient->IsRequestPending() && hclient->PopQueuedRequest(&next)) {
+    ProcessReceived(hclient, next.data(), next.size());
+    if (token.expired()) {  // closed by the request
+      return;
+    }
   }
+  hclient->SetDrainingRequests(false);
 }
 
 }  // namespace http
@@ -14,12 +14,20 @@
 
 #pragma once
 
+#include <functional>
+#include <string>
+
+#include <common/http/http.h>
+
 #include "base/iserver_handler.h"
+#include "base/isubscribers_manager.h"
+
+#include "http/paths_cache.h"
 
 namespace fastocloud {
 namespace server {
 namespace base {
-class ISubscribersManager;
+class DbWorkerPool;
 }
 namespace http {
 
@@ -29,7 +37,9 @@ class HttpHandler : public base::IServerHandler {
  public:
   enum { BUF_SIZE = 4096 };
   typedef base::IServerHandler base_class;
-  explicit HttpHandler(base::ISubscribersManager* manager);
+  typedef std::function<void(HttpClient* client)> db_completion_t;
+
+  HttpHandler(base::ISubscribersManager* manager, base::DbWorkerPool* db_workers);
 
   void PreLooped(common::libev::IoLoop* server) override;
 
@@ -46,10 +56,34 @@ class HttpHandler : public base::IServerHandler {
 
   void PostLooped(common::libev::IoLoop* server) override;
 
+  // resolves the channel of a segment request through the paths cache, runs on a db worker
+  common::Error FindHttpDirectoryOrUrlForChannel(const base::ServerDBAuthInfo& auth,
+                                                 fastotv::stream_id_t sid,
+                                                 fastotv::channel_id_t cid,
+                                                 ResolvedPath* path) WARN_UNUSED_RESULT;
+  base::CacheStats GetPathsCacheStats() const;
+
  private:
   void ProcessReceived(HttpClient* hclient, const char* request, size_t req_len);
+  void SendChannelContent(HttpClient* hclient,
+                          common::http::http_protocol protocol,
+                          const common::uri::GURL& url_request,
+                          fastotv::stream_id_t sid,
+                          const std::string& file_name,
+                          const base::ISubscribersManager::http_directory_t& directory,
+                          const common::uri::GURL& url_for_channel,
+                          bool is_get,
+                          bool IsKeepAlive);
+  void SendErrorAndFinish(HttpClient* hclient,
+                          common::http::http_protocol protocol,
+                          common::http::http_status status,
+                          const std::string& text,
+                          bool IsKeepAlive);
+  void FinishRequest(HttpClient* hclient, bool IsKeepAlive);
 
   base::ISubscribersManager* const manager_;
+  base::DbWorkerPool* const db_workers_;
+  PathsCache paths_cache_;
 };
 
 }  // namespace http
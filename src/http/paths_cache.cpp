@@ -0,0 +1,105 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "http/paths_cache.h"
+
+#include <iterator>
+
+#include <common/convert2string.h>
+#include <common/time.h>
+
+namespace fastocloud {
+namespace server {
+namespace http {
+
+namespace {
+std::string MakeKey(const fastotv::user_id_t& uid, fastotv::stream_id_t sid, fastotv::channel_id_t cid) {
+  return uid + "/" + sid + "/" + common::ConvertToString(cid);
+}
+}  // namespace
+
+PathsCache::PathsCache(size_t max_entries, time_t max_age_sec)
+    : max_entries_(max_entries), max_age_msec_(max_age_sec * 1000), mutex_(), entries_(), index_(), stats_() {}
+
+bool PathsCache::Find(const fastotv::user_id_t& uid,
+                      fastotv::stream_id_t sid,
+                      fastotv::channel_id_t cid,
+                      const base::ChannelsVersion& version,
+                      ResolvedPath* path) {
+  if (!path) {
+    return false;
+  }
+
+  const std::string key = MakeKey(uid, sid, cid);
+  const fastotv::timestamp_t now = common::time::current_utc_mstime();
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto it = index_.find(key);
+  if (it == index_.end()) {
+    stats_.misses++;
+    return false;
+  }
+
+  const entries_t::iterator entry = it->second;
+  if (entry->version != version || now - entry->created > max_age_msec_) {
+    EraseLocked(entry);
+    stats_.misses++;
+    return false;
+  }
+
+  entries_.splice(entries_.begin(), entries_, entry);
+  stats_.hits++;
+  *path = entry->path;
+  return true;
+}
+
+void PathsCache::Insert(const fastotv::user_id_t& uid,
+                        fastotv::stream_id_t sid,
+                        fastotv::channel_id_t cid,
+                        const base::ChannelsVersion& version,
+                        const ResolvedPath& path) {
+  if (max_entries_ == 0) {
+    return;
+  }
+
+  const std::string key = MakeKey(uid, sid, cid);
+  const fastotv::timestamp_t now = common::time::current_utc_mstime();
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto it = index_.find(key);
+  if (it != index_.end()) {
+    EraseLocked(it->second);
+  }
+
+  entries_.push_front({key, version, path, now});
+  index_[key] = entries_.begin();
+  while (entries_.size() > max_entries_) {
+    EraseLocked(std::prev(entries_.end()));
+  }
+}
+
+base::CacheStats PathsCache::GetStats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  base::CacheStats stats = stats_;
+  stats.entries = entries_.size();
+  return stats;
+}
+
+void PathsCache::EraseLocked(entries_t::iterator it) {
+  index_.erase(it->key);
+  entries_.erase(it);
+}
+
+}  // namespace http
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,79 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "base/isubscribers_manager.h"
+
+namespace fastocloud {
+namespace server {
+namespace http {
+
+// channel output an HLS request of the user resolves to, either a local http root or a redirect url
+struct ResolvedPath {
+  base::ISubscribersManager::http_directory_t directory;
+  common::uri::GURL url;
+};
+
+// Resolved (user, stream, channel) paths, an entry is served only while the user channels version is unchanged, so
+// removed entitlements and catalog updates drop it. Age is bounded too, local http roots come and go with streams.
+// Bounded by entries count, least recently used entries are evicted first.
+class PathsCache {
+ public:
+  enum { default_max_entries = 100000, default_max_age_sec = 10 };
+
+  PathsCache(size_t max_entries, time_t max_age_sec);
+
+  bool Find(const fastotv::user_id_t& uid,
+            fastotv::stream_id_t sid,
+            fastotv::channel_id_t cid,
+            const base::ChannelsVersion& version,
+            ResolvedPath* path);
+  void Insert(const fastotv::user_id_t& uid,
+              fastotv::stream_id_t sid,
+              fastotv::channel_id_t cid,
+              const base::ChannelsVersion& version,
+              const ResolvedPath& path);
+
+  base::CacheStats GetStats() const;
+
+ private:
+  struct Entry {
+    std::string key;
+    base::ChannelsVersion version;
+    ResolvedPath path;
+    fastotv::timestamp_t created;
+  };
+  typedef std::list<Entry> entries_t;
+
+  void EraseLocked(entries_t::iterator it);
+
+  const size_t max_entries_;
+  const fastotv::timestamp_t max_age_msec_;
+
+  mutable std::mutex mutex_;
+  entries_t entries_;  // most recently used first
+  std::unordered_map<std::string, entries_t::iterator> index_;
+  base::CacheStats stats_;
+};
+
+}  // namespace http
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,150 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/change_stream_watcher.h"
+
+#include <chrono>
+#include <memory>
+
+#include <common/logger.h>
+
+#include "mongo/mongo_engine.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+ChangeStreamWatcher::ChangeStreamWatcher() : watch_thread_(), stop_watch_(false) {}
+
+ChangeStreamWatcher::~ChangeStreamWatcher() {
+  Stop();
+}
+
+common::ErrnoError ChangeStreamWatcher::Start(const std::string& mongodb_url,
+                                              const std::string& db_name,
+                                              const std::string& collection,
+                                              event_callback_t on_event,
+                                              health_callback_t on_health) {
+  if (db_name.empty() || collection.empty() || !on_event || !on_health) {
+    return common::make_errno_error_inval();
+  }
+
+  if (watch_thread_.joinable()) {
+    return common::make_errno_error("Change stream already watching", EINVAL);
+  }
+
+  mongoc_client_t* client = nullptr;
+  common::ErrnoError err = MongoEngine::GetInstance().Connect(mongodb_url, true, &client);
+  if (err) {
+    return err;
+  }
+
+  stop_watch_ = false;
+  watch_thread_ = std::thread([this, client, db_name, collection, on_event, on_health] {
+    WatchRoutine(client, db_name, collection, on_event, on_health);
+  });
+  return common::ErrnoError();
+}
+
+void ChangeStreamWatcher::Stop() {
+  stop_watch_ = true;
+  if (watch_thread_.joinable()) {
+    watch_thread_.join();
+  }
+}
+
+void ChangeStreamWatcher::WatchRoutine(mongoc_client_t* client,
+                                       const std::string& db_name,
+                                       const std::string& collection,
+                                       event_callback_t on_event,
+                                       health_callback_t on_health) {
+  mongoc_collection_t* watched = mongoc_client_get_collection(client, db_name.c_str(), collection.c_str());
+  while (!stop_watch_) {
+    const std::unique_ptr<bson_t, MongoQueryDeleter> pipeline(bson_new());
+    const std::unique_ptr<bson_t, MongoQueryDeleter> opts(BCON_NEW("maxAwaitTimeMS", BCON_INT64(await_msec)));
+    mongoc_change_stream_t* change_stream = mongoc_collection_watch(watched, pipeline.get(), opts.get());
+    bool healthy = true;
+    while (!stop_watch_ && healthy) {
+      const bson_t* event;
+      if (mongoc_change_stream_next(change_stream, &event)) {
+        healthy = on_event(event);
+        continue;
+      }
+
+      bson_error_t error;
+      const bson_t* reply;
+      if (mongoc_change_stream_error_document(change_stream, &error, &reply)) {
+        WARNING_LOG() << "Change stream on " << collection << " error: " << error.message;
+        healthy = false;
+        break;
+      }
+      on_health(true);
+    }
+    mongoc_change_stream_destroy(change_stream);
+    on_health(false);
+
+    for (int waited = 0; !stop_watch_ && waited < retry_msec; waited += await_msec) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(await_msec));
+    }
+  }
+
+  mongoc_collection_destroy(watched);
+  mongoc_client_destroy(client);
+}
+
+bool GetChangedFields(const bson_t* event, std::vector<std::string>* fields) {
+  if (!event || !fields) {
+    return false;
+  }
+
+  bson_iter_t iter;
+  bson_iter_t bupdated;
+  if (!bson_iter_init(&iter, event) ||
+      !bson_iter_find_descendant(&iter, CHANGE_EVENT_UPDATED_FIELDS_FIELD, &bupdated) ||
+      !BSON_ITER_HOLDS_DOCUMENT(&bupdated)) {
+    return false;
+  }
+
+  bson_iter_t bremoved;
+  if (!bson_iter_init(&iter, event) ||
+      !bson_iter_find_descendant(&iter, CHANGE_EVENT_REMOVED_FIELDS_FIELD, &bremoved) ||
+      !BSON_ITER_HOLDS_ARRAY(&bremoved)) {
+    return false;
+  }
+
+  std::vector<std::string> changed;
+  bson_iter_t bupdated_fields;
+  if (bson_iter_recurse(&bupdated, &bupdated_fields)) {
+    while (bson_iter_next(&bupdated_fields)) {
+      changed.push_back(bson_iter_key(&bupdated_fields));
+    }
+  }
+
+  bson_iter_t bremoved_fields;
+  if (bson_iter_recurse(&bremoved, &bremoved_fields)) {
+    while (bson_iter_next(&bremoved_fields)) {
+      if (BSON_ITER_HOLDS_UTF8(&bremoved_fields)) {
+        changed.push_back(bson_iter_utf8(&bremoved_fields, NULL));
+      }
+    }
+  }
+
+  *fields = changed;
+  return true;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,72 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mongoc.h>
+
+#include <common/error.h>
+
+#define CHANGE_EVENT_OPERATION_TYPE_FIELD "operationType"
+#define CHANGE_EVENT_DOCUMENT_KEY_FIELD "documentKey"
+#define CHANGE_EVENT_UPDATED_FIELDS_FIELD "updateDescription.updatedFields"
+#define CHANGE_EVENT_REMOVED_FIELDS_FIELD "updateDescription.removedFields"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Follows the change stream of one collection on its own client and thread, the stream is reopened after errors.
+class ChangeStreamWatcher {
+ public:
+  enum { await_msec = 1000, retry_msec = 5000 };
+  // returns false if the stream was closed by the server and should be reopened
+  typedef std::function<bool(const bson_t* event)> event_callback_t;
+  // healthy once the stream is open and drained, not healthy after an error
+  typedef std::function<void(bool healthy)> health_callback_t;
+
+  ChangeStreamWatcher();
+  ~ChangeStreamWatcher();
+
+  common::ErrnoError Start(const std::string& mongodb_url,
+                           const std::string& db_name,
+                           const std::string& collection,
+                           event_callback_t on_event,
+                           health_callback_t on_health) WARN_UNUSED_RESULT;
+  void Stop();
+
+ private:
+  void WatchRoutine(mongoc_client_t* client,
+                    const std::string& db_name,
+                    const std::string& collection,
+                    event_callback_t on_event,
+                    health_callback_t on_health);
+
+  std::thread watch_thread_;
+  std::atomic<bool> stop_watch_;
+};
+
+// updated and removed field paths of an update event
+bool GetChangedFields(const bson_t* event, std::vector<std::string>* fields);
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,204 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/client_pool.h"
+
+#include <string.h>
+
+#include <chrono>
+
+#include "mongo/mongo_engine.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+ClientPool::Client::Client(ClientPool* pool, mongoc_client_t* client, const std::string& db_name)
+    : pool_(pool), client_(client), db_name_(db_name), collections_() {}
+
+ClientPool::Client::~Client() {
+  for (auto& collection : collections_) {
+    mongoc_collection_destroy(collection.second);
+  }
+}
+
+mongoc_client_t* ClientPool::Client::GetClient() const {
+  return client_;
+}
+
+mongoc_collection_t* ClientPool::Client::GetCollection(const char* name) {
+  for (const auto& collection : collections_) {
+    if (collection.first == name) {
+      return collection.second;
+    }
+  }
+
+  mongoc_collection_t* collection = mongoc_client_get_collection(client_, db_name_.c_str(), name);
+  if (collection) {
+    collections_.push_back(std::make_pair(name, collection));
+  }
+  return collection;
+}
+
+common::Error ClientPool::Client::IsTransactionsSupported(bool* supported) {
+  return pool_->IsTransactionsSupported(client_, supported);
+}
+
+ClientPool::Releaser::Releaser(ClientPool* pool) : pool_(pool) {}
+
+void ClientPool::Releaser::operator()(Client* client) const {
+  if (client && pool_) {
+    pool_->Push(client);
+  }
+}
+
+ClientPool::ClientPool(mongoc_client_pool_t* pool,
+                       const std::string& db_name,
+                       size_t size,
+                       uint32_t wait_timeout_msec)
+    : pool_(pool),
+      db_name_(db_name),
+      size_(size),
+      wait_timeout_msec_(wait_timeout_msec),
+      mutex_(),
+      free_cond_(),
+      free_(),
+      stats_(),
+      topology_mutex_(),
+      topology_known_(false),
+      transactions_supported_(false) {
+  stats_.size = size;
+}
+
+ClientPool::~ClientPool() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (Client* client : free_) {
+    mongoc_client_t* mclient = client->GetClient();
+    delete client;
+    mongoc_client_pool_push(pool_, mclient);
+  }
+  free_.clear();
+  mongoc_client_pool_destroy(pool_);
+}
+
+common::ErrnoError ClientPool::Create(const std::string& mongodb_url,
+                                      const std::string& db_name,
+                                      bool lazy,
+                                      size_t size,
+                                      uint32_t wait_timeout_msec,
+                                      ClientPool** pool) {
+  if (db_name.empty() || size == 0 || !pool) {
+    return common::make_errno_error_inval();
+  }
+
+  mongoc_client_pool_t* mpool = nullptr;
+  common::ErrnoError err = MongoEngine::GetInstance().ConnectPool(mongodb_url, lazy, size, &mpool);
+  if (err) {
+    return err;
+  }
+
+  *pool = new ClientPool(mpool, db_name, size, wait_timeout_msec);
+  return common::ErrnoError();
+}
+
+common::Error ClientPool::Pop(client_t* client) {
+  if (!client) {
+    return common::make_error_inval();
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(mutex_);
+  const bool have_slot = free_cond_.wait_for(lock, std::chrono::milliseconds(wait_timeout_msec_),
+                                             [this] { return stats_.in_use < size_; });
+  const uint64_t waited =
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  stats_.wait_total_usec += waited;
+  if (waited > stats_.wait_max_usec) {
+    stats_.wait_max_usec = waited;
+  }
+  if (!have_slot) {
+    stats_.timeouts++;
+    return common::make_error("Database pool wait timeout");
+  }
+
+  stats_.in_use++;
+  stats_.checkouts++;
+  if (stats_.in_use > stats_.peak_in_use) {
+    stats_.peak_in_use = stats_.in_use;
+  }
+
+  Client* lclient = nullptr;
+  if (!free_.empty()) {
+    lclient = free_.back();
+    free_.pop_back();
+  }
+  lock.unlock();
+
+  if (!lclient) {
+    // never blocks, in_use is bounded by the pool max size
+    lclient = new Client(this, mongoc_client_pool_pop(pool_), db_name_);
+  }
+
+  *client = client_t(lclient, Releaser(this));
+  return common::Error();
+}
+
+void ClientPool::Push(Client* client) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    free_.push_back(client);
+    stats_.in_use--;
+  }
+  free_cond_.notify_one();
+}
+
+common::Error ClientPool::IsTransactionsSupported(mongoc_client_t* client, bool* supported) {
+  if (!client || !supported) {
+    return common::make_error_inval();
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(topology_mutex_);
+    if (topology_known_) {
+      *supported = transactions_supported_;
+      return common::Error();
+    }
+  }
+
+  // waits up to the server selection timeout, outside of the lock
+  bson_error_t error;
+  mongoc_server_description_t* server = mongoc_client_select_server(client, true, NULL, &error);
+  if (!server) {
+    return common::make_error(std::string("Database topology unknown: ") + error.message);
+  }
+
+  const char* type = mongoc_server_description_type(server);
+  const bool transactions = strcmp(type, "RSPrimary") == 0 || strcmp(type, "Mongos") == 0;
+  mongoc_server_description_destroy(server);
+
+  std::unique_lock<std::mutex> lock(topology_mutex_);
+  topology_known_ = true;
+  transactions_supported_ = transactions;
+  *supported = transactions;
+  return common::Error();
+}
+
+base::PoolStats ClientPool::GetStats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
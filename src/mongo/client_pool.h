@@ -0,0 +1,107 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mongoc.h>
+
+#include <common/error.h>
+
+#include "base/subscribers_manager_stats.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// mongoc_client_t is not thread-safe, every database operation checks out its own client from the pool.
+// Clients keep their collection handles between checkouts.
+class ClientPool {
+ public:
+  enum { default_size = 8, default_wait_timeout_msec = 5000 };
+
+  class Client {
+   public:
+    Client(ClientPool* pool, mongoc_client_t* client, const std::string& db_name);
+    ~Client();
+
+    mongoc_client_t* GetClient() const;
+    mongoc_collection_t* GetCollection(const char* name);
+
+    // transactions need a replica set or a sharded cluster, see ClientPool::IsTransactionsSupported
+    common::Error IsTransactionsSupported(bool* supported) WARN_UNUSED_RESULT;
+
+   private:
+    ClientPool* const pool_;
+    mongoc_client_t* const client_;
+    const std::string db_name_;
+    std::vector<std::pair<std::string, mongoc_collection_t*>> collections_;
+  };
+
+  class Releaser {
+   public:
+    explicit Releaser(ClientPool* pool = nullptr);
+    void operator()(Client* client) const;
+
+   private:
+    ClientPool* pool_;
+  };
+
+  typedef std::unique_ptr<Client, Releaser> client_t;
+
+  ~ClientPool();
+
+  static common::ErrnoError Create(const std::string& mongodb_url,
+                                   const std::string& db_name,
+                                   bool lazy,
+                                   size_t size,
+                                   uint32_t wait_timeout_msec,
+                                   ClientPool** pool) WARN_UNUSED_RESULT;
+
+  common::Error Pop(client_t* client) WARN_UNUSED_RESULT;
+
+  base::PoolStats GetStats() const;
+
+ private:
+  ClientPool(mongoc_client_pool_t* pool, const std::string& db_name, size_t size, uint32_t wait_timeout_msec);
+
+  void Push(Client* client);
+  // the topology is detected once, by the first client reaching a server, every call before fails if the client
+  // can't select a server
+  common::Error IsTransactionsSupported(mongoc_client_t* client, bool* supported) WARN_UNUSED_RESULT;
+
+  mongoc_client_pool_t* const pool_;
+  const std::string db_name_;
+  const size_t size_;
+  const uint32_t wait_timeout_msec_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable free_cond_;
+  std::vector<Client*> free_;
+  base::PoolStats stats_;
+
+  std::mutex topology_mutex_;
+  bool topology_known_;
+  bool transactions_supported_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,42 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <algorithm>
+
+#define FIND_BY_IDS_BATCH_SIZE 1000
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Calls find(begin, end) for each range of at most batch_size of count ids, one {"_id": {"$in": [...]}} query
+// per range. A range whose find returns false is skipped and the others are still read, returns the skipped count.
+template <typename Find>
+size_t ForEachIDsBatch(size_t count, size_t batch_size, Find find) {
+  size_t skipped = 0;
+  for (size_t offset = 0; offset < count; offset += batch_size) {
+    if (!find(offset, std::min(count, offset + batch_size))) {
+      skipped++;
+    }
+  }
+  return skipped;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -14,6 +14,8 @@
 
 #include "mongo/mongo2info.h"
 
+#include <string.h>
+
 #include <string>
 #include <vector>
 
@@ -34,604 +36,545 @@ std::vector<common::uri::GURL> MakeUrlsFromOutput(const std::vector<fastotv::Out
 }
 }  // namespace details
 
-bool MakeVodInfo(const bson_t* sdoc,
-                 fastotv::StreamType st,
-                 const UserStreamInfo& uinfo,
-                 fastotv::commands_info::VodInfo* cinf,
-                 bool* visible) {
-  if (!sdoc || !cinf || !visible) {
+namespace {
+
+// Keys of stream and serial documents decoded by the Make*Info functions, one bit each in keys_mask_t.
+enum StreamKey {
+  KEY_ID = 0,
+  KEY_GROUPS,
+  KEY_IARC,
+  KEY_VIEW_COUNT,
+  KEY_NAME,
+  KEY_DESCRIPTION,
+  KEY_TVG_LOGO,
+  KEY_OUTPUT,
+  KEY_HAVE_AUDIO,
+  KEY_HAVE_VIDEO,
+  KEY_PARTS,
+  KEY_META,
+  KEY_TRAILER_URL,
+  KEY_USER_SCORE,
+  KEY_PRIME_DATE,
+  KEY_COUNTRY,
+  KEY_DURATION,
+  KEY_VOD_TYPE,
+  KEY_VISIBLE,
+  KEY_TVG_ID,
+  KEY_START,
+  KEY_STOP,
+  KEY_ICON,
+  KEY_SEASON,
+  KEY_EPISODES,
+  KEY_COUNT
+};
+
+typedef uint32_t keys_mask_t;
+
+constexpr keys_mask_t KeyBit(StreamKey key) {
+  return static_cast<keys_mask_t>(1) << key;
+}
+
+struct KeyDescriptor {
+  const char* name;
+  size_t size;
+};
+
+#define KEY_DESCRIPTOR(NAME) \
+  { NAME, sizeof(NAME) - 1 }
+
+// indexed by StreamKey
+constexpr KeyDescriptor kStreamKeys[] = {
+    KEY_DESCRIPTOR(STREAM_ID_FIELD),          KEY_DESCRIPTOR(STREAM_GROUPS_FIELD),
+    KEY_DESCRIPTOR(STREAM_IARC_FIELD),        KEY_DESCRIPTOR(STREAM_VIEW_COUNT_FIELD),
+    KEY_DESCRIPTOR(STREAM_NAME_FIELD),        KEY_DESCRIPTOR(VOD_DESCRIPTION_FIELD),
+    KEY_DESCRIPTOR(CHANNEL_TVG_LOGO_FIELD),   KEY_DESCRIPTOR(STREAM_OUTPUT_FIELD),
+    KEY_DESCRIPTOR(STREAM_HAVE_AUDIO_FIELD),  KEY_DESCRIPTOR(STREAM_HAVE_VIDEO_FIELD),
+    KEY_DESCRIPTOR(STREAM_PARTS_FIELD),       KEY_DESCRIPTOR(STREAM_META_URLS_FIELD),
+    KEY_DESCRIPTOR(VOD_TRAILER_URL_FIELD),    KEY_DESCRIPTOR(VOD_USER_SCORE_FIELD),
+    KEY_DESCRIPTOR(VOD_PRIME_DATE_FIELD),     KEY_DESCRIPTOR(VOD_COUNTRY_FIELD),
+    KEY_DESCRIPTOR(VOD_DURATION_FIELD),       KEY_DESCRIPTOR(VOD_TYPE_FIELD),
+    KEY_DESCRIPTOR(STREAM_VISIBLE_FIELD),     KEY_DESCRIPTOR(CHANNEL_TVG_ID_FIELD),
+    KEY_DESCRIPTOR(CATCHUP_START_FIELD),      KEY_DESCRIPTOR(CATCHUP_STOP_FIELD),
+    KEY_DESCRIPTOR(SERIAL_ICON_FIELD),        KEY_DESCRIPTOR(SERIAL_SEASON_FIELD),
+    KEY_DESCRIPTOR(SERIAL_EPISODES_FIELD)};
+static_assert(sizeof(kStreamKeys) / sizeof(kStreamKeys[0]) == KEY_COUNT, "descriptor for each StreamKey");
+static_assert(KEY_COUNT <= sizeof(keys_mask_t) * 8, "keys_mask_t too small");
+
+// Perfect hash over kStreamKeys: length, first and middle character; checked at compile time below.
+#define KEY_SLOTS_COUNT 64
+
+constexpr size_t KeySlot(const char* key, size_t size) {
+  return (size + static_cast<unsigned char>(key[0]) * 12 + static_cast<unsigned char>(key[size / 2]) * 31) %
+         KEY_SLOTS_COUNT;
+}
+
+struct KeySlots {
+  int8_t keys[KEY_SLOTS_COUNT];  // StreamKey or -1
+  bool perfect;
+};
+
+constexpr KeySlots MakeKeySlots() {
+  KeySlots result = {{0}, true};
+  for (size_t i = 0; i < KEY_SLOTS_COUNT; ++i) {
+    result.keys[i] = -1;
+  }
+  for (size_t i = 0; i < KEY_COUNT; ++i) {
+    const size_t slot = KeySlot(kStreamKeys[i].name, kStreamKeys[i].size);
+    if (result.keys[slot] != -1) {
+      result.perfect = false;
+    }
+    result.keys[slot] = static_cast<int8_t>(i);
+  }
+  return result;
+}
+
+constexpr KeySlots kKeySlots = MakeKeySlots();
+static_assert(kKeySlots.perfect, "stream keys collide, change KeySlot");
+
+// one slot lookup and one compare to reject keys the decoders do not read
+bool FindStreamKey(const char* key, StreamKey* out) {
+  const size_t size = strlen(key);
+  if (size == 0) {
     return false;
   }
 
-  bson_iter_t iter;
-  if (!bson_iter_init(&iter, sdoc)) {
+  const int8_t index = kKeySlots.keys[KeySlot(key, size)];
+  if (index < 0) {
     return false;
   }
 
-#define CHECK_SUM_VOD 16
+  const KeyDescriptor& desc = kStreamKeys[index];
+  if (desc.size != size || memcmp(desc.name, key, size) != 0) {
+    return false;
+  }
 
-  std::string sid_str;
-  std::string group;
-  int iarc = fastotv::commands_info::StreamBaseInfo::DEFAULT_IARC;
-  fastotv::commands_info::StreamBaseInfo::view_count_t view_count = 0;
-  fastotv::commands_info::MovieInfo mov;
-  fastotv::commands_info::StreamBaseInfo::parts_t parts;
+  *out = static_cast<StreamKey>(index);
+  return true;
+}
+
+std::string GetKeysNames(keys_mask_t keys) {
+  std::string result;
+  for (size_t i = 0; i < KEY_COUNT; ++i) {
+    if (keys & KeyBit(static_cast<StreamKey>(i))) {
+      if (!result.empty()) {
+        result += ",";
+      }
+      result += kStreamKeys[i].name;
+    }
+  }
+  return result;
+}
+
+// Values of one document, strings point into the document buffer.
+struct StreamDocument {
+  keys_mask_t keys = 0;  // decoded keys
+  const bson_oid_t* id = nullptr;
   fastotv::commands_info::StreamBaseInfo::groups_t groups;
-  int check_sum = 0;
+  int iarc = fastotv::commands_info::StreamBaseInfo::DEFAULT_IARC;
+  int32_t view_count = 0;
+  const char* name = nullptr;
+  const char* description = nullptr;
+  const char* tvg_logo = nullptr;
+  std::vector<fastotv::OutputUri> output;
   bool have_audio = true;
   bool have_video = true;
+  fastotv::commands_info::StreamBaseInfo::parts_t parts;
   fastotv::commands_info::StreamBaseInfo::meta_urls_t meta;
-  while (bson_iter_next(&iter)) {
-    const char* key = bson_iter_key(&iter);
-    if (strcmp(key, STREAM_ID_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_OID(&iter)) {
-        return false;
-      }
-      const bson_oid_t* oid = bson_iter_oid(&iter);
-      sid_str = common::ConvertToString(oid);
-      check_sum++;
-    } else if (strcmp(key, STREAM_GROUPS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
-      uint32_t array_len;
-      const uint8_t* array = nullptr;
-      bson_iter_array(&iter, &array_len, &array);
-      bson_t array_doc;
-      if (bson_init_static(&array_doc, array, array_len)) {
-        bson_iter_t it;
-        if (bson_iter_init(&it, &array_doc)) {
-          while (bson_iter_next(&it)) {
-            const char* group_data = bson_iter_utf8(&it, NULL);
-            if (group_data) {
-              groups.push_back(group_data);
-            }
-          }
-        }
-      }
+  const char* trailer_url = nullptr;
+  double user_score = 0;
+  fastotv::timestamp_t prime_date = 0;
+  const char* country = nullptr;
+  int32_t duration = 0;
+  int32_t vod_type = 0;
+  bool visible = true;
+  const char* tvg_id = nullptr;
+  fastotv::timestamp_t start = 0;
+  fastotv::timestamp_t stop = 0;
+  const char* icon = nullptr;
+  int32_t season = 0;
+  fastotv::commands_info::SerialInfo::episodes_t episodes;
 
-      check_sum++;
-    } else if (strcmp(key, STREAM_IARC_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      iarc = bson_iter_int32(&iter);
-      check_sum++;
-    } else if (strcmp(key, STREAM_VIEW_COUNT_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      view_count = bson_iter_int32(&iter);
-      check_sum++;
-    } else if (strcmp(key, STREAM_NAME_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      mov.SetName(bson_iter_utf8(&iter, NULL));
-      check_sum++;
-    } else if (strcmp(key, VOD_DESCRIPTION_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      mov.SetDescription(bson_iter_utf8(&iter, NULL));
-      check_sum++;
-    } else if (strcmp(key, VOD_PRVIEW_ICON_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      const char* data = bson_iter_utf8(&iter, NULL);
-      if (data) {
-        mov.SetPreviewIcon(common::uri::GURL(data));
-      }
-      check_sum++;
-    } else if (strcmp(key, STREAM_OUTPUT_FIELD) == 0) {
-      std::vector<fastotv::OutputUri> urls;
-      if (!GetOutputUrlData(&iter, &urls)) {
-        return false;
-      }
+  std::string GetID() const { return id ? common::ConvertToString(id) : std::string(); }
+};
 
-      mov.SetUrls(details::MakeUrlsFromOutput(urls));
-      check_sum++;
-    } else if (strcmp(key, STREAM_HAVE_AUDIO_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      have_audio = bson_iter_bool(&iter);
-      check_sum++;
-    } else if (strcmp(key, STREAM_PARTS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
+template <typename T>
+bool GetStringArray(bson_iter_t* iter, T* out) {
+  if (!BSON_ITER_HOLDS_ARRAY(iter)) {
+    return false;
+  }
 
-      bson_iter_t bparts;
-      if (!bson_iter_recurse(&iter, &bparts)) {
-        return false;
-      }
+  bson_iter_t it;
+  if (!bson_iter_recurse(iter, &it)) {
+    return false;
+  }
 
-      while (bson_iter_next(&bparts)) {
-        const bson_oid_t* oid = bson_iter_oid(&bparts);
-        std::string part_str = common::ConvertToString(oid);
-        parts.push_back(part_str);
-      }
-    } else if (strcmp(key, STREAM_META_URLS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
+  while (bson_iter_next(&it)) {
+    const char* data = bson_iter_utf8(&it, NULL);
+    if (data) {
+      out->push_back(data);
+    }
+  }
+  return true;
+}
 
-      bson_iter_t bmetas;
-      if (!bson_iter_recurse(&iter, &bmetas)) {
-        return false;
-      }
+template <typename T>
+bool GetOidArray(bson_iter_t* iter, T* out) {
+  if (!BSON_ITER_HOLDS_ARRAY(iter)) {
+    return false;
+  }
 
-      while (bson_iter_next(&bmetas)) {
-        if (BSON_ITER_HOLDS_DOCUMENT(&bmetas)) {
-          uint32_t len;
-          const uint8_t* buf;
-          bson_iter_document(&bmetas, &len, &buf);
-          bson_t rec;
-          bson_init_static(&rec, buf, len);
-          {
-            bson_iter_t iter;
-            bson_iter_init(&iter, &rec);
-            fastotv::MetaUrl url;
-            if (bson_iter_find(&iter, NAME_FIELD)) {
-              const char* name = bson_iter_utf8(&iter, NULL);
-              if (name) {
-                url.SetName(name);
-              }
-            }
-            if (bson_iter_find(&iter, URL_FIELD)) {
-              const char* uri = bson_iter_utf8(&iter, NULL);
-              if (uri) {
-                url.SetUrl(common::uri::GURL(uri));
-              }
-            }
-            if (url.IsValid()) {
-              meta.Add(url);
-            }
-          }
-          bson_destroy(&rec);
-        }
-      }
-    } else if (strcmp(key, STREAM_HAVE_VIDEO_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      have_video = bson_iter_bool(&iter);
-      check_sum++;
-    } else if (strcmp(key, VOD_TRAILER_URL_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      mov.SetTrailerUrl(common::uri::GURL(bson_iter_utf8(&iter, NULL)));
-      check_sum++;
-    } else if (strcmp(key, VOD_USER_SCORE_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_DOUBLE(&iter)) {
-        return false;
-      }
-      mov.SetUserScore(bson_iter_double(&iter));
-      check_sum++;
-    } else if (strcmp(key, VOD_PRIME_DATE_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_DATE_TIME(&iter)) {
-        return false;
-      }
-      mov.SetPrimeDate(bson_iter_date_time(&iter));
-      check_sum++;
-    } else if (strcmp(key, VOD_COUNTRY_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      mov.SetCountry(bson_iter_utf8(&iter, NULL));
-      check_sum++;
-    } else if (strcmp(key, VOD_DURATION_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      mov.SetDuration(bson_iter_int32(&iter));
-      check_sum++;
-    } else if (strcmp(key, VOD_TYPE_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      mov.SetType(static_cast<fastotv::commands_info::MovieInfo::Type>(bson_iter_int32(&iter)));
-      check_sum++;
-    } else if (strcmp(key, STREAM_VISIBLE_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      *visible = bson_iter_bool(&iter);
-    }
+  bson_iter_t it;
+  if (!bson_iter_recurse(iter, &it)) {
+    return false;
   }
 
-  if (check_sum != CHECK_SUM_VOD) {
-    bool is_proxy_valid = st == fastotv::VOD_PROXY && check_sum == CHECK_SUM_VOD - 2;
-    if (!is_proxy_valid) {
-      WARNING_LOG() << "Skipped type: " << st << ", check_sum: " << check_sum << ", id: " << sid_str;
-      return false;
+  while (bson_iter_next(&it)) {
+    if (BSON_ITER_HOLDS_OID(&it)) {
+      out->push_back(common::ConvertToString(bson_iter_oid(&it)));
     }
   }
-
-  *cinf = fastotv::commands_info::VodInfo(sid_str, groups, iarc, uinfo.favorite, uinfo.recent, uinfo.interruption_time,
-                                          mov, have_video, have_audio, parts, view_count, uinfo.locked, meta);
   return true;
-}  // namespace mongo
+}
 
-bool MakeCatchupInfo(const bson_t* sdoc,
-                     fastotv::StreamType st,
-                     const UserStreamInfo& uinfo,
-                     fastotv::commands_info::CatchupInfo* cinf,
-                     bool* visible) {
-  if (!sdoc || !cinf || !visible) {
+bool GetMetaUrls(bson_iter_t* iter, fastotv::commands_info::StreamBaseInfo::meta_urls_t* meta) {
+  if (!BSON_ITER_HOLDS_ARRAY(iter)) {
     return false;
   }
 
-  bson_iter_t iter;
-  if (!bson_iter_init(&iter, sdoc)) {
+  bson_iter_t bmetas;
+  if (!bson_iter_recurse(iter, &bmetas)) {
     return false;
   }
 
-#define CHECK_SUM_CATCHUP 12
+  while (bson_iter_next(&bmetas)) {
+    bson_iter_t it;
+    if (!BSON_ITER_HOLDS_DOCUMENT(&bmetas) || !bson_iter_recurse(&bmetas, &it)) {
+      continue;
+    }
 
-  std::string sid_str;
-  std::string group;
-  fastotv::commands_info::EpgInfo epg;
-  fastotv::commands_info::StreamBaseInfo::parts_t parts;
-  fastotv::commands_info::StreamBaseInfo::groups_t groups;
-  fastotv::commands_info::StreamBaseInfo::meta_urls_t meta;
-  fastotv::timestamp_t start;
-  fastotv::timestamp_t stop;
-  int check_sum = 0;
-  int iarc = fastotv::commands_info::StreamBaseInfo::DEFAULT_IARC;
-  fastotv::commands_info::StreamBaseInfo::view_count_t view_count = 0;
-  bool have_audio = true;
-  bool have_video = true;
-  while (bson_iter_next(&iter)) {
-    const char* key = bson_iter_key(&iter);
-    if (strcmp(key, STREAM_ID_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_OID(&iter)) {
-        return false;
+    fastotv::MetaUrl url;
+    if (bson_iter_find(&it, NAME_FIELD)) {
+      const char* name = bson_iter_utf8(&it, NULL);
+      if (name) {
+        url.SetName(name);
       }
-      const bson_oid_t* oid = bson_iter_oid(&iter);
-      sid_str = common::ConvertToString(oid);
-      check_sum++;
-    } else if (strcmp(key, STREAM_GROUPS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
+    }
+    if (bson_iter_find(&it, URL_FIELD)) {
+      const char* uri = bson_iter_utf8(&it, NULL);
+      if (uri) {
+        url.SetUrl(common::uri::GURL(uri));
       }
-      uint32_t array_len;
-      const uint8_t* array = nullptr;
-      bson_iter_array(&iter, &array_len, &array);
-      bson_t array_doc;
-      if (bson_init_static(&array_doc, array, array_len)) {
-        bson_iter_t it;
-        if (bson_iter_init(&it, &array_doc)) {
-          while (bson_iter_next(&it)) {
-            const char* group_data = bson_iter_utf8(&it, NULL);
-            if (group_data) {
-              groups.push_back(group_data);
-            }
-          }
+    }
+    if (url.IsValid()) {
+      meta->Add(url);
+    }
+  }
+  return true;
+}
+
+// Single pass over the document, keys outside of wanted are skipped without looking at their values.
+bool DecodeStreamDocument(const bson_t* sdoc, keys_mask_t wanted, StreamDocument* doc) {
+  bson_iter_t iter;
+  if (!bson_iter_init(&iter, sdoc)) {
+    return false;
+  }
+
+  while (bson_iter_next(&iter)) {
+    StreamKey key;
+    if (!FindStreamKey(bson_iter_key(&iter), &key) || !(wanted & KeyBit(key))) {
+      continue;
+    }
+
+    switch (key) {
+      case KEY_ID:
+        if (!BSON_ITER_HOLDS_OID(&iter)) {
+          return false;
         }
-      }
-      check_sum++;
-    } else if (strcmp(key, STREAM_IARC_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      iarc = bson_iter_int32(&iter);
-      check_sum++;
-    } else if (strcmp(key, STREAM_VIEW_COUNT_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      view_count = bson_iter_int32(&iter);
-      check_sum++;
-    } else if (strcmp(key, CHANNEL_TVG_ID_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      epg.SetTvgID(bson_iter_utf8(&iter, NULL));
-      check_sum++;
-    } else if (strcmp(key, STREAM_NAME_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      epg.SetDisplayName(bson_iter_utf8(&iter, NULL));
-      check_sum++;
-    } else if (strcmp(key, STREAM_HAVE_AUDIO_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      have_audio = bson_iter_bool(&iter);
-      check_sum++;
-    } else if (strcmp(key, STREAM_PARTS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
+        doc->id = bson_iter_oid(&iter);
+        break;
+      case KEY_GROUPS:
+        if (!GetStringArray(&iter, &doc->groups)) {
+          return false;
+        }
+        break;
+      case KEY_IARC:
+        if (!BSON_ITER_HOLDS_INT32(&iter)) {
+          return false;
+        }
+        doc->iarc = bson_iter_int32(&iter);
+        break;
+      case KEY_VIEW_COUNT:
+        if (!BSON_ITER_HOLDS_INT32(&iter)) {
+          return false;
+        }
+        doc->view_count = bson_iter_int32(&iter);
+        break;
+      case KEY_NAME:
+        if (!BSON_ITER_HOLDS_UTF8(&iter)) {
+          return false;
+        }
+        doc->name = bson_iter_utf8(&iter, NULL);
+        break;
+      case KEY_DESCRIPTION:
+        if (!BSON_ITER_HOLDS_UTF8(&iter)) {
+          return false;
+        }
+        doc->description = bson_iter_utf8(&iter, NULL);
+        break;
+      case KEY_TVG_LOGO:
+        if (!BSON_ITER_HOLDS_UTF8(&iter)) {
+          return false;
+        }
+        doc->tvg_logo = bson_iter_utf8(&iter, NULL);
+        break;
+      case KEY_OUTPUT:
+        if (!GetOutputUrlData(&iter, &doc->output)) {
+          return false;
+        }
+        break;
+      case KEY_HAVE_AUDIO:
+        if (!BSON_ITER_HOLDS_BOOL(&iter)) {
+          return false;
+        }
+        doc->have_audio = bson_iter_bool(&iter);
+        break;
+      case KEY_HAVE_VIDEO:
+        if (!BSON_ITER_HOLDS_BOOL(&iter)) {
+          return false;
+        }
+        doc->have_video = bson_iter_bool(&iter);
+        break;
+      case KEY_PARTS:
+        if (!GetOidArray(&iter, &doc->parts)) {
+          return false;
+        }
+        break;
+      case KEY_META:
+        if (!GetMetaUrls(&iter, &doc->meta)) {
+          return false;
+        }
+        break;
+      case KEY_TRAILER_URL:
+        if (!BSON_ITER_HOLDS_UTF8(&iter)) {
+          return false;
+        }
+        doc->trailer_url = bson_iter_utf8(&iter, NULL);
+        break;
+      case KEY_USER_SCORE:
+        if (!BSON_ITER_HOLDS_DOUBLE(&iter)) {
+          return false;
+        }
+        doc->user_score = bson_iter_double(&iter);
+        break;
+      case KEY_PRIME_DATE:
+        if (!BSON_ITER_HOLDS_DATE_TIME(&iter)) {
+          return false;
+        }
+        doc->prime_date = bson_iter_date_time(&iter);
+        break;
+      case KEY_COUNTRY:
+        if (!BSON_ITER_HOLDS_UTF8(&iter)) {
+          return false;
+        }
+        doc->country = bson_iter_utf8(&iter, NULL);
+        break;
+      case KEY_DURATION:
+        if (!BSON_ITER_HOLDS_INT32(&iter)) {
+          return false;
+        }
+        doc->duration = bson_iter_int32(&iter);
+        break;
+      case KEY_VOD_TYPE:
+        if (!BSON_ITER_HOLDS_INT32(&iter)) {
+          return false;
+        }
+        doc->vod_type = bson_iter_int32(&iter);
+        break;
+      case KEY_VISIBLE:
+        if (!BSON_ITER_HOLDS_BOOL(&iter)) {
+          return false;
+        }
+        doc->visible = bson_iter_bool(&iter);
+        break;
+      case KEY_TVG_ID:
+        if (!BSON_ITER_HOLDS_UTF8(&iter)) {
+          return false;
+        }
+        doc->tvg_id = bson_iter_utf8(&iter, NULL);
+        break;
+      case KEY_START:
+        if (!BSON_ITER_HOLDS_DATE_TIME(&iter)) {
+          return false;
+        }
+        doc->start = bson_iter_date_time(&iter);
+        break;
+      case KEY_STOP:
+        if (!BSON_ITER_HOLDS_DATE_TIME(&iter)) {
+          return false;
+        }
+        doc->stop = bson_iter_date_time(&iter);
+        break;
+      case KEY_ICON:
+        if (!BSON_ITER_HOLDS_UTF8(&iter)) {
+          return false;
+        }
+        doc->icon = bson_iter_utf8(&iter, NULL);
+        break;
+      case KEY_SEASON:
+        if (!BSON_ITER_HOLDS_INT32(&iter)) {
+          return false;
+        }
+        doc->season = bson_iter_int32(&iter);
+        break;
+      case KEY_EPISODES:
+        if (!GetOidArray(&iter, &doc->episodes)) {
+          return false;
+        }
+        break;
+      case KEY_COUNT:
         return false;
-      }
+    }
+    doc->keys |= KeyBit(key);
+  }
 
-      bson_iter_t bparts;
-      if (!bson_iter_recurse(&iter, &bparts)) {
-        return false;
-      }
+  return true;
+}
 
-      while (bson_iter_next(&bparts)) {
-        const bson_oid_t* oid = bson_iter_oid(&bparts);
-        std::string part_str = common::ConvertToString(oid);
-        parts.push_back(part_str);
-      }
-    } else if (strcmp(key, STREAM_META_URLS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
+// keys every stream document has, proxies have no have_audio/have_video
+constexpr keys_mask_t kStreamBaseRequiredKeys = KeyBit(KEY_ID) | KeyBit(KEY_GROUPS) | KeyBit(KEY_IARC) |
+                                                KeyBit(KEY_VIEW_COUNT) | KeyBit(KEY_NAME) | KeyBit(KEY_TVG_LOGO) |
+                                                KeyBit(KEY_OUTPUT);
+constexpr keys_mask_t kHardwareRequiredKeys = KeyBit(KEY_HAVE_AUDIO) | KeyBit(KEY_HAVE_VIDEO);
+constexpr keys_mask_t kStreamBaseOptionalKeys = KeyBit(KEY_PARTS) | KeyBit(KEY_META) | KeyBit(KEY_VISIBLE);
+
+constexpr keys_mask_t kVodRequiredKeys = kStreamBaseRequiredKeys | kHardwareRequiredKeys | KeyBit(KEY_DESCRIPTION) |
+                                         KeyBit(KEY_TRAILER_URL) | KeyBit(KEY_USER_SCORE) | KeyBit(KEY_PRIME_DATE) |
+                                         KeyBit(KEY_COUNTRY) | KeyBit(KEY_DURATION) | KeyBit(KEY_VOD_TYPE);
+constexpr keys_mask_t kChannelRequiredKeys = kStreamBaseRequiredKeys | kHardwareRequiredKeys | KeyBit(KEY_TVG_ID);
+constexpr keys_mask_t kCatchupRequiredKeys = kChannelRequiredKeys | KeyBit(KEY_START) | KeyBit(KEY_STOP);
+constexpr keys_mask_t kSerialRequiredKeys = KeyBit(KEY_ID) | KeyBit(KEY_GROUPS) | KeyBit(KEY_SEASON) |
+                                            KeyBit(KEY_NAME) | KeyBit(KEY_ICON) | KeyBit(KEY_DESCRIPTION);
+
+bool HasRequiredKeys(const StreamDocument& doc, fastotv::StreamType st, keys_mask_t required, bool proxy) {
+  if (proxy) {
+    required &= ~kHardwareRequiredKeys;
+  }
+
+  const keys_mask_t missing = required & ~doc.keys;
+  if (missing) {
+    WARNING_LOG() << "Skipped type: " << st << ", missing: " << GetKeysNames(missing) << ", id: " << doc.GetID();
+    return false;
+  }
+  return true;
+}
 
-      bson_iter_t bmetas;
-      if (!bson_iter_recurse(&iter, &bmetas)) {
-        return false;
-      }
+fastotv::commands_info::EpgInfo MakeEpgInfo(const StreamDocument& doc) {
+  fastotv::commands_info::EpgInfo epg;
+  epg.SetTvgID(doc.tvg_id);
+  epg.SetDisplayName(doc.name);
+  epg.SetIconUrl(common::uri::GURL(doc.tvg_logo));
+  epg.SetUrls(details::MakeUrlsFromOutput(doc.output));
+  return epg;
+}
 
-      while (bson_iter_next(&bmetas)) {
-        if (BSON_ITER_HOLDS_DOCUMENT(&bmetas)) {
-          uint32_t len;
-          const uint8_t* buf;
-          bson_iter_document(&bmetas, &len, &buf);
-          bson_t rec;
-          bson_init_static(&rec, buf, len);
-          {
-            bson_iter_t iter;
-            bson_iter_init(&iter, &rec);
-            fastotv::MetaUrl url;
-            if (bson_iter_find(&iter, NAME_FIELD)) {
-              const char* name = bson_iter_utf8(&iter, NULL);
-              if (name) {
-                url.SetName(name);
-              }
-            }
-            if (bson_iter_find(&iter, URL_FIELD)) {
-              const char* uri = bson_iter_utf8(&iter, NULL);
-              if (uri) {
-                url.SetUrl(common::uri::GURL(uri));
-              }
-            }
-            if (url.IsValid()) {
-              meta.Add(url);
-            }
-          }
-          bson_destroy(&rec);
-        }
-      }
-    } else if (strcmp(key, STREAM_HAVE_VIDEO_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      have_video = bson_iter_bool(&iter);
-      check_sum++;
+}  // namespace
 
-    } else if (strcmp(key, CATCHUP_START_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_DATE_TIME(&iter)) {
-        return false;
-      }
-      start = bson_iter_date_time(&iter);
-      check_sum++;
-    } else if (strcmp(key, CATCHUP_STOP_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_DATE_TIME(&iter)) {
-        return false;
-      }
-      stop = bson_iter_date_time(&iter);
-      check_sum++;
-    } else if (strcmp(key, CHANNEL_TVG_LOGO_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      const char* url_data = bson_iter_utf8(&iter, NULL);
-      if (url_data) {
-        epg.SetIconUrl(common::uri::GURL(url_data));
-      }
-      check_sum++;
-    } else if (strcmp(key, STREAM_OUTPUT_FIELD) == 0) {
-      std::vector<fastotv::OutputUri> urls;
-      if (!GetOutputUrlData(&iter, &urls)) {
-        return false;
-      }
-      epg.SetUrls(details::MakeUrlsFromOutput(urls));
-      check_sum++;
-    } else if (strcmp(key, STREAM_VISIBLE_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      *visible = bson_iter_bool(&iter);
-    }
+bool MakeVodInfo(const bson_t* sdoc,
+                 fastotv::StreamType st,
+                 const UserStreamInfo& uinfo,
+                 fastotv::commands_info::VodInfo* cinf,
+                 bool* visible) {
+  if (!sdoc || !cinf || !visible) {
+    return false;
+  }
+
+  StreamDocument doc;
+  if (!DecodeStreamDocument(sdoc, kVodRequiredKeys | kStreamBaseOptionalKeys, &doc)) {
+    return false;
   }
 
-  if (check_sum != CHECK_SUM_CATCHUP) {
-    WARNING_LOG() << "Skipped type: " << st << ", check_sum: " << check_sum << ", id: " << sid_str;
+  if (!HasRequiredKeys(doc, st, kVodRequiredKeys, st == fastotv::VOD_PROXY)) {
     return false;
   }
 
-  *cinf = fastotv::commands_info::CatchupInfo(sid_str, groups, iarc, uinfo.favorite, uinfo.recent,
-                                              uinfo.interruption_time, epg, have_video, have_audio, parts, view_count,
-                                              uinfo.locked, meta, start, stop);
+  fastotv::commands_info::MovieInfo mov;
+  mov.SetName(doc.name);
+  mov.SetDescription(doc.description);
+  mov.SetPreviewIcon(common::uri::GURL(doc.tvg_logo));
+  mov.SetUrls(details::MakeUrlsFromOutput(doc.output));
+  mov.SetTrailerUrl(common::uri::GURL(doc.trailer_url));
+  mov.SetUserScore(doc.user_score);
+  mov.SetPrimeDate(doc.prime_date);
+  mov.SetCountry(doc.country);
+  mov.SetDuration(doc.duration);
+  mov.SetType(static_cast<fastotv::commands_info::MovieInfo::Type>(doc.vod_type));
+  if (doc.keys & KeyBit(KEY_VISIBLE)) {
+    *visible = doc.visible;
+  }
+
+  const fastotv::commands_info::StreamBaseInfo::view_count_t view_count = uinfo.pending_views + doc.view_count;
+  *cinf = fastotv::commands_info::VodInfo(doc.GetID(), doc.groups, doc.iarc, uinfo.favorite, uinfo.recent,
+                                          uinfo.interruption_time, mov, doc.have_video, doc.have_audio, doc.parts,
+                                          view_count, uinfo.locked, doc.meta);
   return true;
 }
 
-bool MakeChannelInfo(const bson_t* sdoc,
+bool MakeCatchupInfo(const bson_t* sdoc,
                      fastotv::StreamType st,
                      const UserStreamInfo& uinfo,
-                     fastotv::commands_info::ChannelInfo* cinf,
+                     fastotv::commands_info::CatchupInfo* cinf,
                      bool* visible) {
   if (!sdoc || !cinf || !visible) {
     return false;
   }
 
-  bson_iter_t iter;
-  if (!bson_iter_init(&iter, sdoc)) {
+  StreamDocument doc;
+  if (!DecodeStreamDocument(sdoc, kCatchupRequiredKeys | kStreamBaseOptionalKeys, &doc)) {
     return false;
   }
 
-#define CHECK_SUM_CHANNEL 10
+  if (!HasRequiredKeys(doc, st, kCatchupRequiredKeys, false)) {
+    return false;
+  }
 
-  std::string sid_str;
-  std::string group;
-  fastotv::commands_info::EpgInfo epg;
-  fastotv::commands_info::StreamBaseInfo::parts_t parts;
-  fastotv::commands_info::StreamBaseInfo::groups_t groups;
-  fastotv::commands_info::StreamBaseInfo::meta_urls_t meta;
-  int check_sum = 0;
-  int iarc = fastotv::commands_info::StreamBaseInfo::DEFAULT_IARC;
-  fastotv::commands_info::StreamBaseInfo::view_count_t view_count = 0;
-  bool have_audio = true;
-  bool have_video = true;
-  while (bson_iter_next(&iter)) {
-    const char* key = bson_iter_key(&iter);
-    if (strcmp(key, STREAM_ID_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_OID(&iter)) {
-        return false;
-      }
-      const bson_oid_t* oid = bson_iter_oid(&iter);
-      sid_str = common::ConvertToString(oid);
-      check_sum++;
-    } else if (strcmp(key, STREAM_GROUPS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
-      uint32_t array_len;
-      const uint8_t* array = nullptr;
-      bson_iter_array(&iter, &array_len, &array);
-      bson_t array_doc;
-      if (bson_init_static(&array_doc, array, array_len)) {
-        bson_iter_t it;
-        if (bson_iter_init(&it, &array_doc)) {
-          while (bson_iter_next(&it)) {
-            const char* group_data = bson_iter_utf8(&it, NULL);
-            if (group_data) {
-              groups.push_back(group_data);
-            }
-          }
-        }
-      }
-      check_sum++;
-    } else if (strcmp(key, STREAM_IARC_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      iarc = bson_iter_int32(&iter);
-      check_sum++;
-    } else if (strcmp(key, STREAM_VIEW_COUNT_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      view_count = bson_iter_int32(&iter);
-      check_sum++;
-    } else if (strcmp(key, CHANNEL_TVG_ID_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      epg.SetTvgID(bson_iter_utf8(&iter, NULL));
-      check_sum++;
-    } else if (strcmp(key, STREAM_NAME_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      epg.SetDisplayName(bson_iter_utf8(&iter, NULL));
-      check_sum++;
-    } else if (strcmp(key, STREAM_HAVE_AUDIO_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      have_audio = bson_iter_bool(&iter);
-      check_sum++;
-    } else if (strcmp(key, STREAM_PARTS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
+  if (doc.keys & KeyBit(KEY_VISIBLE)) {
+    *visible = doc.visible;
+  }
 
-      bson_iter_t bparts;
-      if (!bson_iter_recurse(&iter, &bparts)) {
-        return false;
-      }
+  const fastotv::commands_info::StreamBaseInfo::view_count_t view_count = uinfo.pending_views + doc.view_count;
+  *cinf = fastotv::commands_info::CatchupInfo(doc.GetID(), doc.groups, doc.iarc, uinfo.favorite, uinfo.recent,
+                                              uinfo.interruption_time, MakeEpgInfo(doc), doc.have_video,
+                                              doc.have_audio, doc.parts, view_count, uinfo.locked, doc.meta, doc.start,
+                                              doc.stop);
+  return true;
+}
 
-      while (bson_iter_next(&bparts)) {
-        const bson_oid_t* oid = bson_iter_oid(&bparts);
-        std::string part_str = common::ConvertToString(oid);
-        parts.push_back(part_str);
-      }
-    } else if (strcmp(key, STREAM_META_URLS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
+bool MakeChannelInfo(const bson_t* sdoc,
+                     fastotv::StreamType st,
+                     const UserStreamInfo& uinfo,
+                     fastotv::commands_info::ChannelInfo* cinf,
+                     bool* visible) {
+  if (!sdoc || !cinf || !visible) {
+    return false;
+  }
 
-      bson_iter_t bmetas;
-      if (!bson_iter_recurse(&iter, &bmetas)) {
-        return false;
-      }
+  StreamDocument doc;
+  if (!DecodeStreamDocument(sdoc, kChannelRequiredKeys | kStreamBaseOptionalKeys, &doc)) {
+    return false;
+  }
 
-      while (bson_iter_next(&bmetas)) {
-        if (BSON_ITER_HOLDS_DOCUMENT(&bmetas)) {
-          uint32_t len;
-          const uint8_t* buf;
-          bson_iter_document(&bmetas, &len, &buf);
-          bson_t rec;
-          bson_init_static(&rec, buf, len);
-          {
-            bson_iter_t iter;
-            bson_iter_init(&iter, &rec);
-            fastotv::MetaUrl url;
-            if (bson_iter_find(&iter, NAME_FIELD)) {
-              const char* name = bson_iter_utf8(&iter, NULL);
-              if (name) {
-                url.SetName(name);
-              }
-            }
-            if (bson_iter_find(&iter, URL_FIELD)) {
-              const char* uri = bson_iter_utf8(&iter, NULL);
-              if (uri) {
-                url.SetUrl(common::uri::GURL(uri));
-              }
-            }
-            if (url.IsValid()) {
-              meta.Add(url);
-            }
-          }
-          bson_destroy(&rec);
-        }
-      }
-    } else if (strcmp(key, STREAM_HAVE_VIDEO_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      have_video = bson_iter_bool(&iter);
-      check_sum++;
-    } else if (strcmp(key, CHANNEL_TVG_LOGO_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      epg.SetIconUrl(common::uri::GURL(bson_iter_utf8(&iter, NULL)));
-      check_sum++;
-    } else if (strcmp(key, STREAM_OUTPUT_FIELD) == 0) {
-      std::vector<fastotv::OutputUri> urls;
-      if (!GetOutputUrlData(&iter, &urls)) {
-        return false;
-      }
-      epg.SetUrls(details::MakeUrlsFromOutput(urls));
-      check_sum++;
-    } else if (strcmp(key, STREAM_VISIBLE_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      *visible = bson_iter_bool(&iter);
-    }
+  if (!HasRequiredKeys(doc, st, kChannelRequiredKeys, st == fastotv::PROXY)) {
+    return false;
   }
 
-  if (check_sum != CHECK_SUM_CHANNEL) {
-    bool is_proxy_valid = st == fastotv::PROXY && check_sum == CHECK_SUM_CHANNEL - 2;
-    if (!is_proxy_valid) {
-      WARNING_LOG() << "Skipped type: " << st << ", check_sum: " << check_sum << ", id: " << sid_str;
-      return false;
-    }
+  if (doc.keys & KeyBit(KEY_VISIBLE)) {
+    *visible = doc.visible;
   }
 
-  *cinf =
-      fastotv::commands_info::ChannelInfo(sid_str, groups, iarc, uinfo.favorite, uinfo.recent, uinfo.interruption_time,
-                                          epg, have_video, have_audio, parts, view_count, uinfo.locked, meta);
+  const fastotv::commands_info::StreamBaseInfo::view_count_t view_count = uinfo.pending_views + doc.view_count;
+  *cinf = fastotv::commands_info::ChannelInfo(doc.GetID(), doc.groups, doc.iarc, uinfo.favorite, uinfo.recent,
+                                              uinfo.interruption_time, MakeEpgInfo(doc), doc.have_video,
+                                              doc.have_audio, doc.parts, view_count, uinfo.locked, doc.meta);
   return true;
 }
 
@@ -640,107 +583,46 @@ bool MakeSerialInfo(const bson_t* sdoc, fastotv::commands_info::SerialInfo* sinf
     return false;
   }
 
-  bson_iter_t iter;
-  if (!bson_iter_init(&iter, sdoc)) {
+  StreamDocument doc;
+  if (!DecodeStreamDocument(sdoc, kSerialRequiredKeys | KeyBit(KEY_EPISODES) | KeyBit(KEY_VISIBLE), &doc)) {
     return false;
   }
 
-#define CHECK_SUM_SERIAL 6
+  const keys_mask_t missing = kSerialRequiredKeys & ~doc.keys;
+  if (missing) {
+    WARNING_LOG() << "Skipped serial missing: " << GetKeysNames(missing) << ", id: " << doc.GetID();
+    return false;
+  }
 
-  std::string sid_str;
-  fastotv::commands_info::SerialInfo::view_count_t view_count = 0;
-  fastotv::commands_info::SerialInfo::groups_t groups;
-  fastotv::commands_info::SerialInfo::episodes_t episodes;
-  common::uri::GURL icon;
-  std::string name;
-  std::string description;
-  size_t season;
+  if (doc.keys & KeyBit(KEY_VISIBLE)) {
+    *visible = doc.visible;
+  }
 
-  int check_sum = 0;
-  while (bson_iter_next(&iter)) {
-    const char* key = bson_iter_key(&iter);
-    if (strcmp(key, SERIAL_ID_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_OID(&iter)) {
-        return false;
-      }
-      const bson_oid_t* oid = bson_iter_oid(&iter);
-      sid_str = common::ConvertToString(oid);
-      check_sum++;
-    } else if (strcmp(key, SERIAL_GROUPS_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
-      uint32_t array_len;
-      const uint8_t* array = nullptr;
-      bson_iter_array(&iter, &array_len, &array);
-      bson_t array_doc;
-      if (bson_init_static(&array_doc, array, array_len)) {
-        bson_iter_t it;
-        if (bson_iter_init(&it, &array_doc)) {
-          while (bson_iter_next(&it)) {
-            const char* group_data = bson_iter_utf8(&it, NULL);
-            if (group_data) {
-              groups.push_back(group_data);
-            }
-          }
-        }
-      }
+  *sinf = fastotv::commands_info::SerialInfo(doc.GetID(), doc.name, common::uri::GURL(doc.icon), doc.groups,
+                                             doc.description, doc.season, doc.episodes, 0);
+  return true;
+}
 
-      check_sum++;
-    } else if (strcmp(key, SERIAL_SEASON_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_INT32(&iter)) {
-        return false;
-      }
-      season = bson_iter_int32(&iter);
-      check_sum++;
-    } else if (strcmp(key, SERIAL_NAME_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      name = bson_iter_utf8(&iter, NULL);
-      check_sum++;
-    } else if (strcmp(key, SERIAL_ICON_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      icon = common::uri::GURL(bson_iter_utf8(&iter, NULL));
-      check_sum++;
-    } else if (strcmp(key, SERIAL_DESCRIPTION_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_UTF8(&iter)) {
-        return false;
-      }
-      description = bson_iter_utf8(&iter, NULL);
-      check_sum++;
-    } else if (strcmp(key, SERIAL_EPISODES_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_ARRAY(&iter)) {
-        return false;
-      }
+void AddEpisodeViews(const fastotv::commands_info::VodInfo& vod, episodes_views_t* views) {
+  if (!views || !vod.IsSerial()) {
+    return;
+  }
 
-      bson_iter_t bparts;
-      if (!bson_iter_recurse(&iter, &bparts)) {
-        return false;
-      }
+  // the first vod with this id wins
+  views->emplace(vod.GetStreamID(), vod.GetViewCount());
+}
 
-      while (bson_iter_next(&bparts)) {
-        const bson_oid_t* oid = bson_iter_oid(&bparts);
-        std::string part_str = common::ConvertToString(oid);
-        episodes.push_back(part_str);
-      }
-    } else if (strcmp(key, STREAM_VISIBLE_FIELD) == 0) {
-      if (!BSON_ITER_HOLDS_BOOL(&iter)) {
-        return false;
-      }
-      *visible = bson_iter_bool(&iter);
+fastotv::commands_info::SerialInfo::view_count_t GetSerialViews(const fastotv::commands_info::SerialInfo& serial,
+                                                                 const episodes_views_t& views) {
+  fastotv::commands_info::SerialInfo::view_count_t result = 0;
+  const fastotv::commands_info::SerialInfo::episodes_t& episodes = serial.GetEpisodes();
+  for (const auto& episode : episodes) {
+    const auto it = views.find(episode);
+    if (it != views.end()) {
+      result += it->second;
     }
   }
-
-  if (check_sum != CHECK_SUM_SERIAL) {
-    WARNING_LOG() << "Skipped serial check_sum: " << check_sum << ", id: " << sid_str;
-    return false;
-  }
-
-  *sinf = fastotv::commands_info::SerialInfo(sid_str, name, icon, groups, description, season, episodes, view_count);
-  return true;
+  return result;
 }
 
 bool MakeContentRequestInfo(const bson_t* sdoc, fastotv::commands_info::ContentRequestInfo* cont) {
@@ -920,6 +802,39 @@ bool GetOutputUrlData(bson_iter_t* iter, std::vector<fastotv::OutputUri>* urls)
   return true;
 }
 
+bool MakeFindCatchupInPartsQuery(const fastotv::commands_info::StreamBaseInfo::parts_t& parts,
+                                 const std::string& title,
+                                 fastotv::timestamp_t start,
+                                 fastotv::timestamp_t stop,
+                                 bson_t* query) {
+  if (!query) {
+    return false;
+  }
+
+  bson_t id;
+  bson_t in;
+  BSON_APPEND_DOCUMENT_BEGIN(query, STREAM_ID_FIELD, &id);
+  BSON_APPEND_ARRAY_BEGIN(&id, "$in", &in);
+  uint32_t count = 0;
+  char buf[16];
+  for (const auto& part : parts) {
+    bson_oid_t oid;
+    if (!common::ConvertFromString(part, &oid)) {
+      continue;
+    }
+
+    const char* key;
+    size_t keylen = bson_uint32_to_string(count++, &key, buf, sizeof(buf));
+    bson_append_oid(&in, key, keylen, &oid);
+  }
+  bson_append_array_end(&id, &in);
+  bson_append_document_end(query, &id);
+  BSON_APPEND_UTF8(query, STREAM_NAME_FIELD, title.c_str());
+  BSON_APPEND_DATE_TIME(query, CATCHUP_START_FIELD, start);
+  BSON_APPEND_DATE_TIME(query, CATCHUP_STOP_FIELD, stop);
+  return count != 0;
+}
+
 }  // namespace mongo
 }  // namespace server
 }  // namespace fastocloud
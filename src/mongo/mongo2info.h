@@ -17,6 +17,7 @@
 #include <bson.h>
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <common/file_system/path.h>
@@ -112,6 +113,7 @@ struct UserStreamInfo {
   fastotv::timestamp_t interruption_time = 0;
   bool priv = false;
   bool locked = false;
+  size_t pending_views = 0;  // view counter increments not yet written to the stream document
 };
 
 bool MakeVodInfo(const bson_t* sdoc,
@@ -130,6 +132,13 @@ bool MakeCatchupInfo(const bson_t* sdoc,
                      fastotv::commands_info::CatchupInfo* cinf,
                      bool* visible);
 bool MakeSerialInfo(const bson_t* sdoc, fastotv::commands_info::SerialInfo* sinf, bool* visible);
+
+// view counts of serial vods by stream id, built once per catalog so series totals are a lookup per episode
+typedef std::unordered_map<fastotv::stream_id_t, fastotv::commands_info::StreamBaseInfo::view_count_t>
+    episodes_views_t;
+void AddEpisodeViews(const fastotv::commands_info::VodInfo& vod, episodes_views_t* views);
+fastotv::commands_info::SerialInfo::view_count_t GetSerialViews(const fastotv::commands_info::SerialInfo& serial,
+                                                                 const episodes_views_t& views);
 bool MakeContentRequestInfo(const bson_t* sdoc, fastotv::commands_info::ContentRequestInfo* cont);
 bool GetHttpRootFromStream(const bson_t* sdoc,
                            fastotv::StreamType st,
@@ -139,6 +148,14 @@ bool GetUrlFromStream(const bson_t* sdoc, fastotv::StreamType st, fastotv::chann
 
 bool GetOutputUrlData(bson_iter_t* iter, std::vector<fastotv::OutputUri>* urls);
 
+// Query for a catchup among the parts of a stream with the same title and time range, one round trip whatever the
+// number of parts, served by the _id index.
+bool MakeFindCatchupInPartsQuery(const fastotv::commands_info::StreamBaseInfo::parts_t& parts,
+                                 const std::string& title,
+                                 fastotv::timestamp_t start,
+                                 fastotv::timestamp_t stop,
+                                 bson_t* query);
+
 }  // namespace mongo
 }  // namespace server
 }  // namespace fastocloud
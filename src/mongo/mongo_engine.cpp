@@ -44,7 +44,55 @@ common::ErrnoError MongoEngine::Connect(const std::string& url, bool lazy, mongo
   return common::ErrnoError();
 }
 
-MongoEngine::MongoEngine() {
+common::ErrnoError MongoEngine::ConnectPool(const std::string& url,
+                                            bool lazy,
+                                            size_t max_size,
+                                            mongoc_client_pool_t** pool) {
+  if (url.empty() || max_size == 0 || !pool) {
+    return common::make_errno_error_inval();
+  }
+
+  mongoc_uri_t* uri = mongoc_uri_new(url.c_str());
+  if (!uri) {
+    return common::make_errno_error("Invalid uri", EINVAL);
+  }
+
+  mongoc_client_pool_t* lpool = mongoc_client_pool_new(uri);
+  mongoc_uri_destroy(uri);
+  if (!lpool) {
+    return common::make_errno_error("Can't create client pool", EINVAL);
+  }
+
+  mongoc_client_pool_max_size(lpool, max_size);
+  if (!lazy) {
+    mongoc_client_t* cl = mongoc_client_pool_pop(lpool);
+    bson_t reply;
+    bson_error_t error;
+    bool is_ok = mongoc_client_get_server_status(cl, nullptr, &reply, &error);
+    mongoc_client_pool_push(lpool, cl);
+    if (!is_ok) {
+      mongoc_client_pool_destroy(lpool);
+      return common::make_errno_error(error.message, EAGAIN);
+    }
+    bson_destroy(&reply);
+  }
+  *pool = lpool;
+  return common::ErrnoError();
+}
+
+base::OperationMetrics* MongoEngine::GetOperationMetrics() {
+  return &metrics_;
+}
+
+void MongoEngine::SetSlowOperationThreshold(uint32_t msec) {
+  slow_operation_msec_ = msec;
+}
+
+uint32_t MongoEngine::GetSlowOperationThreshold() const {
+  return slow_operation_msec_;
+}
+
+MongoEngine::MongoEngine() : metrics_(), slow_operation_msec_(0) {
   mongoc_init();
 }
 
@@ -64,6 +112,20 @@ void MongoCursorDeleter::operator()(mongoc_cursor_t* cursor) const {
   }
 }
 
+void MongoBulkDeleter::operator()(mongoc_bulk_operation_t* bulk) const {
+  if (bulk) {
+    mongoc_bulk_operation_destroy(bulk);
+  }
+}
+
+size_t BsonOidHash::operator()(const bson_oid_t& oid) const {
+  return bson_oid_hash(&oid);
+}
+
+bool BsonOidEqual::operator()(const bson_oid_t& lhs, const bson_oid_t& rhs) const {
+  return bson_oid_equal(&lhs, &rhs);
+}
+
 }  // namespace mongo
 }  // namespace server
 }  // namespace fastocloud
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
 
 #include <mongoc.h>
@@ -22,6 +23,8 @@
 
 #include <common/error.h>
 
+#include "base/operation_metrics.h"
+
 namespace fastocloud {
 namespace server {
 namespace mongo {
@@ -31,10 +34,19 @@ class MongoEngine : public common::patterns::LazySingleton<MongoEngine> {
   friend class common::patterns::LazySingleton<MongoEngine>;
 
   common::ErrnoError Connect(const std::string& url, bool lazy, mongoc_client_t** connection);
+  common::ErrnoError ConnectPool(const std::string& url, bool lazy, size_t max_size, mongoc_client_pool_t** pool);
+
+  base::OperationMetrics* GetOperationMetrics();
+  // operations slower than the threshold are logged with their filter and query plan, 0 disables
+  void SetSlowOperationThreshold(uint32_t msec);
+  uint32_t GetSlowOperationThreshold() const;
 
  private:
   MongoEngine();
   ~MongoEngine();
+
+  base::OperationMetrics metrics_;
+  std::atomic<uint32_t> slow_operation_msec_;
 };
 
 struct MongoQueryDeleter {
@@ -45,6 +57,18 @@ struct MongoCursorDeleter {
   void operator()(mongoc_cursor_t* cursor) const;
 };
 
+struct MongoBulkDeleter {
+  void operator()(mongoc_bulk_operation_t* bulk) const;
+};
+
+struct BsonOidHash {
+  size_t operator()(const bson_oid_t& oid) const;
+};
+
+struct BsonOidEqual {
+  bool operator()(const bson_oid_t& lhs, const bson_oid_t& rhs) const;
+};
+
 }  // namespace mongo
 }  // namespace server
 }  // namespace fastocloud
@@ -0,0 +1,252 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/query_shapes.h"
+
+#include <string.h>
+
+#include <memory>
+
+#include <common/logger.h>
+
+#include "mongo/mongo_engine.h"
+
+#define EXPLAIN_VERBOSITY "queryPlanner"
+#define EXPLAIN_WINNING_PLAN_FIELD "queryPlanner.winningPlan"
+#define COLLECTION_SCAN_STAGE "COLLSCAN"
+
+#define INDEXES_MODE_CHECK "check"
+#define INDEXES_MODE_CREATE "create"
+#define INDEXES_MODE_REQUIRE "require"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+namespace {
+
+const uint32_t kUnauthorizedCode = 13;
+
+std::string ToJson(const bson_t* doc) {
+  char* json = bson_as_json(doc, NULL);
+  if (!json) {
+    return std::string();
+  }
+  const std::string result(json);
+  bson_free(json);
+  return result;
+}
+
+// index keys are compared by field names, the direction doesn't matter for equality lookups
+bool HasSameFields(bson_iter_t* key, const bson_t* keys) {
+  bson_iter_t iter;
+  if (!bson_iter_init(&iter, keys)) {
+    return false;
+  }
+
+  while (bson_iter_next(&iter)) {
+    if (!bson_iter_next(key) || strcmp(bson_iter_key(key), bson_iter_key(&iter)) != 0) {
+      return false;
+    }
+  }
+  return !bson_iter_next(key);
+}
+
+// plan documents are nested through inputStage(s), queryPlan on the slot based engine and shards of mongos
+void CollectStages(bson_iter_t* plan, std::vector<std::string>* stages) {
+  size_t own = stages->size();
+  while (bson_iter_next(plan)) {
+    const char* key = bson_iter_key(plan);
+    bson_iter_t child;
+    if (strcmp(key, "stage") == 0 && BSON_ITER_HOLDS_UTF8(plan)) {
+      own = stages->size();
+      stages->push_back(bson_iter_utf8(plan, NULL));
+    } else if (strcmp(key, "indexName") == 0 && BSON_ITER_HOLDS_UTF8(plan) && own < stages->size()) {
+      (*stages)[own] += std::string(" ") + bson_iter_utf8(plan, NULL);
+    } else if ((strcmp(key, "inputStage") == 0 || strcmp(key, "queryPlan") == 0) && BSON_ITER_HOLDS_DOCUMENT(plan) &&
+               bson_iter_recurse(plan, &child)) {
+      CollectStages(&child, stages);
+    } else if (strcmp(key, "inputStages") == 0 && BSON_ITER_HOLDS_ARRAY(plan) && bson_iter_recurse(plan, &child)) {
+      while (bson_iter_next(&child)) {
+        bson_iter_t stage;
+        if (BSON_ITER_HOLDS_DOCUMENT(&child) && bson_iter_recurse(&child, &stage)) {
+          CollectStages(&stage, stages);
+        }
+      }
+    } else if (strcmp(key, "shards") == 0 && BSON_ITER_HOLDS_ARRAY(plan) && bson_iter_recurse(plan, &child)) {
+      while (bson_iter_next(&child)) {
+        bson_iter_t shard;
+        bson_iter_t shard_plan;
+        if (BSON_ITER_HOLDS_DOCUMENT(&child) && bson_iter_recurse(&child, &shard) &&
+            bson_iter_find(&shard, "winningPlan") && BSON_ITER_HOLDS_DOCUMENT(&shard) &&
+            bson_iter_recurse(&shard, &shard_plan)) {
+          CollectStages(&shard_plan, stages);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+QueryShapeChecker::Mode QueryShapeChecker::ParseMode(const std::string& mode) {
+  if (mode == INDEXES_MODE_CHECK) {
+    return CHECK;
+  } else if (mode == INDEXES_MODE_REQUIRE) {
+    return REQUIRE;
+  } else if (mode != INDEXES_MODE_CREATE) {
+    WARNING_LOG() << "Unknown indexes mode: " << mode << ", missing indexes are created";
+  }
+  return CREATE;
+}
+
+QueryShapeChecker::QueryShapeChecker(Mode mode) : mode_(mode) {}
+
+base::QueryPlanStats QueryShapeChecker::Check(mongoc_collection_t* collection, const QueryShape& shape) const {
+  base::QueryPlanStats stats;
+  stats.operation = shape.operation;
+  stats.collection = mongoc_collection_get_name(collection);
+  stats.index = shape.index;
+  stats.index_state = shape.index_keys ? EnsureIndex(collection, shape, &stats.index) : INDEX_STATE_EXISTS;
+
+  bson_t command;
+  bson_t find;
+  bson_init(&command);
+  BSON_APPEND_DOCUMENT_BEGIN(&command, "explain", &find);
+  BSON_APPEND_UTF8(&find, "find", stats.collection.c_str());
+  BSON_APPEND_DOCUMENT(&find, "filter", shape.filter);
+  BSON_APPEND_INT32(&find, "limit", 1);
+  bson_append_document_end(&command, &find);
+  BSON_APPEND_UTF8(&command, "verbosity", EXPLAIN_VERBOSITY);
+
+  bson_t reply;
+  bson_error_t error;
+  const bool is_ok = mongoc_collection_command_simple(collection, &command, shape.read_prefs, &reply, &error);
+  bson_destroy(&command);
+  if (!is_ok) {
+    WARNING_LOG() << "Can't explain database operation " << shape.operation << ", error: " << error.message;
+    bson_destroy(&reply);
+    return stats;
+  }
+
+  const std::vector<std::string> stages = GetWinningPlanStages(&reply);
+  bson_destroy(&reply);
+  for (const std::string& stage : stages) {
+    if (!stats.plan.empty()) {
+      stats.plan += " > ";
+    }
+    stats.plan += stage;
+    if (stage == COLLECTION_SCAN_STAGE) {
+      stats.collection_scan = true;
+    }
+  }
+
+  if (stats.collection_scan) {
+    WARNING_LOG() << "Database operation " << shape.operation << " scans the whole " << stats.collection
+                  << " collection, query plan: " << stats.plan;
+  }
+  return stats;
+}
+
+bool QueryShapeChecker::IsUnserved(const base::QueryPlanStats& stats) {
+  return stats.collection_scan || stats.index_state == INDEX_STATE_MISSING ||
+         stats.index_state == INDEX_STATE_NO_PERMISSION;
+}
+
+std::vector<std::string> QueryShapeChecker::GetWinningPlanStages(const bson_t* explain_reply) {
+  std::vector<std::string> stages;
+  bson_iter_t iter;
+  bson_iter_t bplan;
+  bson_iter_t plan;
+  if (explain_reply && bson_iter_init(&iter, explain_reply) &&
+      bson_iter_find_descendant(&iter, EXPLAIN_WINNING_PLAN_FIELD, &bplan) && BSON_ITER_HOLDS_DOCUMENT(&bplan) &&
+      bson_iter_recurse(&bplan, &plan)) {
+    CollectStages(&plan, &stages);
+  }
+  return stages;
+}
+
+std::string QueryShapeChecker::EnsureIndex(mongoc_collection_t* collection,
+                                           const QueryShape& shape,
+                                           std::string* name) const {
+  const char* collection_name = mongoc_collection_get_name(collection);
+  bson_error_t error;
+  std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> indexes(mongoc_collection_find_indexes(collection, &error));
+  if (!indexes) {
+    WARNING_LOG() << "Can't list indexes of " << collection_name << ", error: " << error.message;
+    return INDEX_STATE_ERROR;
+  }
+
+  // an index with the same keys under another name serves the lookup as well
+  const bson_t* index;
+  while (mongoc_cursor_next(indexes.get(), &index)) {
+    bson_iter_t iter;
+    bson_iter_t key;
+    if (!bson_iter_init_find(&iter, index, "key") || !BSON_ITER_HOLDS_DOCUMENT(&iter) ||
+        !bson_iter_recurse(&iter, &key) || !HasSameFields(&key, shape.index_keys)) {
+      continue;
+    }
+
+    if (bson_iter_init_find(&iter, index, "name") && BSON_ITER_HOLDS_UTF8(&iter)) {
+      *name = bson_iter_utf8(&iter, NULL);
+    }
+    return INDEX_STATE_EXISTS;
+  }
+  if (mongoc_cursor_error(indexes.get(), &error)) {
+    WARNING_LOG() << "Can't list indexes of " << collection_name << ", error: " << error.message;
+    return INDEX_STATE_ERROR;
+  }
+
+  const std::string keys = ToJson(shape.index_keys);
+  if (mode_ == CHECK) {
+    WARNING_LOG() << "Index " << shape.index << " " << keys << " of " << collection_name << " is missing";
+    return INDEX_STATE_MISSING;
+  }
+
+  bson_t command;
+  bson_t array;
+  bson_t spec;
+  bson_init(&command);
+  BSON_APPEND_UTF8(&command, "createIndexes", collection_name);
+  BSON_APPEND_ARRAY_BEGIN(&command, "indexes", &array);
+  BSON_APPEND_DOCUMENT_BEGIN(&array, "0", &spec);
+  BSON_APPEND_DOCUMENT(&spec, "key", shape.index_keys);
+  BSON_APPEND_UTF8(&spec, "name", shape.index);
+  if (shape.index_options) {
+    bson_concat(&spec, shape.index_options);
+  }
+  bson_append_document_end(&array, &spec);
+  bson_append_array_end(&command, &array);
+
+  bson_t reply;
+  const bool is_ok = mongoc_collection_command_simple(collection, &command, NULL, &reply, &error);
+  bson_destroy(&reply);
+  bson_destroy(&command);
+  if (!is_ok) {
+    if (error.code == kUnauthorizedCode) {
+      WARNING_LOG() << "No permission to create index " << shape.index << " " << keys << " of " << collection_name
+                    << ", it should be created by the database administrator";
+      return INDEX_STATE_NO_PERMISSION;
+    }
+    WARNING_LOG() << "Can't create index " << shape.index << " of " << collection_name << ", error: " << error.message;
+    return INDEX_STATE_ERROR;
+  }
+
+  INFO_LOG() << "Created index " << shape.index << " " << keys << " of " << collection_name;
+  return INDEX_STATE_CREATED;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,77 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <mongoc.h>
+
+#include "base/subscribers_manager_stats.h"
+
+#define INDEX_STATE_EXISTS "exists"
+#define INDEX_STATE_CREATED "created"
+#define INDEX_STATE_MISSING "missing"
+#define INDEX_STATE_NO_PERMISSION "no_permission"
+#define INDEX_STATE_ERROR "error"
+
+#define ID_INDEX_NAME "_id_"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Lookup of the service and the index serving it. At startup the index is looked up, created when missing and
+// the mode allows it, then the filter is explained; a winning plan with a COLLSCAN stage scans the whole collection
+// on every call.
+struct QueryShape {
+  const char* operation;      // operation name in the metrics
+  const char* index;          // index to provision, ID_INDEX_NAME if the _id index serves the lookup
+  const bson_t* index_keys;   // nullptr for the _id index
+  const bson_t* filter;       // filter of the lookup with sample values
+  const mongoc_read_prefs_t* read_prefs;
+  const bson_t* index_options;  // added to the spec of a created index, nullptr for none
+};
+
+class QueryShapeChecker {
+ public:
+  enum Mode {
+    CHECK = 0,  // indexes are only checked
+    CREATE,     // missing indexes are created
+    REQUIRE     // missing indexes are created, the service doesn't start without them
+  };
+
+  // unknown modes create indexes
+  static Mode ParseMode(const std::string& mode);
+
+  explicit QueryShapeChecker(Mode mode);
+
+  base::QueryPlanStats Check(mongoc_collection_t* collection, const QueryShape& shape) const;
+
+  // true if the plan needs an index the database doesn't have or scans the collection
+  static bool IsUnserved(const base::QueryPlanStats& stats);
+
+  // stages of the winning plan from its root, plans of every shard of a sharded collection are included
+  static std::vector<std::string> GetWinningPlanStages(const bson_t* explain_reply);
+
+ private:
+  std::string EnsureIndex(mongoc_collection_t* collection, const QueryShape& shape, std::string* name) const;
+
+  const Mode mode_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
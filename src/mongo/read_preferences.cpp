@@ -0,0 +1,103 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/read_preferences.h"
+
+#include <common/logger.h>
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+ReadPreferences::ReadPreferences() {
+  for (size_t i = 0; i < READ_CLASSES_COUNT; ++i) {
+    prefs_[i] = nullptr;
+    lag_window_msec_[i] = 0;
+  }
+}
+
+ReadPreferences::~ReadPreferences() {
+  for (size_t i = 0; i < READ_CLASSES_COUNT; ++i) {
+    if (prefs_[i]) {
+      mongoc_read_prefs_destroy(prefs_[i]);
+    }
+  }
+}
+
+void ReadPreferences::Setup(ReadClass rclass, const std::string& mode, int64_t max_staleness_seconds) {
+  if (prefs_[rclass]) {
+    mongoc_read_prefs_destroy(prefs_[rclass]);
+    prefs_[rclass] = nullptr;
+  }
+  lag_window_msec_[rclass] = 0;
+
+  mongoc_read_mode_t read_mode = MONGOC_READ_PRIMARY;
+  if (!ParseMode(mode, &read_mode)) {
+    WARNING_LOG() << "Unknown read preference: " << mode << ", reads go to the primary";
+    return;
+  }
+
+  if (rclass == USER_READS && read_mode != MONGOC_READ_PRIMARY && read_mode != MONGOC_READ_PRIMARY_PREFERRED) {
+    WARNING_LOG() << "User reads can't use read preference: " << mode << ", reads go to the primary";
+    return;
+  }
+
+  if (read_mode == MONGOC_READ_PRIMARY) {
+    return;
+  }
+
+  mongoc_read_prefs_t* prefs = mongoc_read_prefs_new(read_mode);
+  int64_t staleness = MONGOC_NO_MAX_STALENESS;
+  if (max_staleness_seconds > 0) {
+    staleness = max_staleness_seconds < min_max_staleness_seconds ? min_max_staleness_seconds : max_staleness_seconds;
+    mongoc_read_prefs_set_max_staleness_seconds(prefs, staleness);
+  }
+  prefs_[rclass] = prefs;
+  // unbounded secondaries are assumed to keep up within the smallest bound the driver accepts
+  lag_window_msec_[rclass] = (staleness == MONGOC_NO_MAX_STALENESS ? min_max_staleness_seconds : staleness) * 1000;
+}
+
+const mongoc_read_prefs_t* ReadPreferences::Get(ReadClass rclass) const {
+  return prefs_[rclass];
+}
+
+uint32_t ReadPreferences::GetLagWindow(ReadClass rclass) const {
+  return lag_window_msec_[rclass];
+}
+
+bool ReadPreferences::ParseMode(const std::string& mode, mongoc_read_mode_t* result) {
+  if (!result) {
+    return false;
+  }
+
+  if (mode == "primary") {
+    *result = MONGOC_READ_PRIMARY;
+  } else if (mode == "primaryPreferred") {
+    *result = MONGOC_READ_PRIMARY_PREFERRED;
+  } else if (mode == "secondary") {
+    *result = MONGOC_READ_SECONDARY;
+  } else if (mode == "secondaryPreferred") {
+    *result = MONGOC_READ_SECONDARY_PREFERRED;
+  } else if (mode == "nearest") {
+    *result = MONGOC_READ_NEAREST;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
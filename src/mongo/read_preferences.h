@@ -0,0 +1,61 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+#include <mongoc.h>
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Read preference of each class of reads, writes always go to the primary.
+// Catalog documents may come from secondaries up to the max staleness behind the primary. User documents gate
+// logins and fill the entitlements index, which change events keep coherent only if reads see the primary's data,
+// so they may only fall back from the primary while there is none.
+class ReadPreferences {
+ public:
+  enum ReadClass {
+    CATALOG_READS = 0,  // streams, series and content requests
+    USER_READS,         // subscribers, servers and reads before writes
+    READ_CLASSES_COUNT
+  };
+  enum { min_max_staleness_seconds = 90 };
+
+  ReadPreferences();
+  ~ReadPreferences();
+
+  // unknown modes read from the primary, max_staleness_seconds <= 0 is unbounded
+  void Setup(ReadClass rclass, const std::string& mode, int64_t max_staleness_seconds);
+
+  // nullptr reads from the primary
+  const mongoc_read_prefs_t* Get(ReadClass rclass) const;
+  // how long after a change documents of the class may still be read in their previous version
+  uint32_t GetLagWindow(ReadClass rclass) const;  // msec
+
+  static bool ParseMode(const std::string& mode, mongoc_read_mode_t* result);
+
+ private:
+  mongoc_read_prefs_t* prefs_[READ_CLASSES_COUNT];
+  uint32_t lag_window_msec_[READ_CLASSES_COUNT];
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,400 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#define SNAPSHOT_MAGIC "FOSNAP1"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_EMAIL_FIELD "email"
+
+namespace {
+
+struct SnapshotSection {
+  uint64_t offset;  // of the index
+  uint64_t count;
+};
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t resume_token_size;
+  uint64_t resume_token_offset;
+  SnapshotSection collections[fastocloud::server::mongo::SNAPSHOT_COLLECTIONS_COUNT];
+  SnapshotSection emails;
+};
+
+// sorted by oid bytes
+struct SnapshotIndexEntry {
+  uint8_t oid[12];
+  uint32_t size;
+  uint64_t offset;
+};
+
+// sorted by hash, position of the user in the subscribers index
+struct SnapshotEmailEntry {
+  uint64_t hash;
+  uint64_t position;
+};
+
+static_assert(sizeof(SnapshotIndexEntry) == 24, "index entries are packed");
+static_assert(sizeof(SnapshotEmailEntry) == 16, "email entries are packed");
+
+const char* kCollectionNames[fastocloud::server::mongo::SNAPSHOT_COLLECTIONS_COUNT] = {"subscribers", "streams",
+                                                                                       "series", "requests"};
+
+// FNV-1a, stable between builds unlike std::hash
+uint64_t HashEmail(const char* email, size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= static_cast<uint8_t>(email[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool GetEmail(const bson_t* doc, const char** email, uint32_t* len) {
+  bson_iter_t bemail;
+  if (!bson_iter_init_find(&bemail, doc, SNAPSHOT_EMAIL_FIELD) || !BSON_ITER_HOLDS_UTF8(&bemail)) {
+    return false;
+  }
+  *email = bson_iter_utf8(&bemail, len);
+  return true;
+}
+
+uint64_t AlignOffset(uint64_t offset) {
+  return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+bool IsSectionValid(const SnapshotSection& section, size_t entry_size, size_t file_size) {
+  return section.offset % 8 == 0 && section.offset <= file_size &&
+         section.count <= (file_size - section.offset) / entry_size;
+}
+
+bool WriteAll(FILE* file, const void* data, size_t size) {
+  return size == 0 || fwrite(data, 1, size, file) == size;
+}
+
+bool WritePadding(FILE* file, uint64_t* offset) {
+  static const char zeros[8] = {0};
+  const uint64_t aligned = AlignOffset(*offset);
+  if (!WriteAll(file, zeros, aligned - *offset)) {
+    return false;
+  }
+  *offset = aligned;
+  return true;
+}
+
+}  // namespace
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+const char* GetSnapshotCollectionName(SnapshotCollection collection) {
+  return kCollectionNames[collection];
+}
+
+bool FindSnapshotCollection(const char* name, SnapshotCollection* collection) {
+  for (size_t i = 0; i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    if (strcmp(name, kCollectionNames[i]) == 0) {
+      *collection = static_cast<SnapshotCollection>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+SnapshotWriter::SnapshotWriter() : documents_(), resume_token_() {}
+
+SnapshotWriter::~SnapshotWriter() {}
+
+bool SnapshotWriter::Add(SnapshotCollection collection, const bson_t* doc) {
+  bson_iter_t bid;
+  if (!bson_iter_init_find(&bid, doc, "_id") || !BSON_ITER_HOLDS_OID(&bid)) {
+    return false;
+  }
+
+  Document document;
+  bson_oid_copy(bson_iter_oid(&bid), &document.id);
+  document.data.assign(reinterpret_cast<const char*>(bson_get_data(doc)), doc->len);
+  documents_[collection].push_back(std::move(document));
+  return true;
+}
+
+void SnapshotWriter::SetResumeToken(const bson_t* token) {
+  if (!token) {
+    resume_token_.clear();
+    return;
+  }
+  resume_token_.assign(reinterpret_cast<const char*>(bson_get_data(token)), token->len);
+}
+
+common::ErrnoError SnapshotWriter::Write(const std::string& path) const {
+  // layout: header, resume token, documents of every collection, indexes aligned to 8 bytes
+  std::vector<const Document*> sorted[SNAPSHOT_COLLECTIONS_COUNT];
+  for (size_t i = 0; i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    for (auto it = documents_[i].rbegin(); it != documents_[i].rend(); ++it) {
+      sorted[i].push_back(&*it);
+    }
+    std::stable_sort(sorted[i].begin(), sorted[i].end(), [](const Document* lhs, const Document* rhs) {
+      return bson_oid_compare(&lhs->id, &rhs->id) < 0;
+    });
+    // reversed before the stable sort, the first of equal ids is the last added
+    sorted[i].erase(std::unique(sorted[i].begin(), sorted[i].end(),
+                                [](const Document* lhs, const Document* rhs) {
+                                  return bson_oid_equal(&lhs->id, &rhs->id);
+                                }),
+                    sorted[i].end());
+  }
+
+  const std::string tmp_path = path + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "w");
+  if (!file) {
+    return common::make_errno_error("Failed to create snapshot", errno);
+  }
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  header.version = SNAPSHOT_VERSION;
+  header.resume_token_size = resume_token_.size();
+  header.resume_token_offset = sizeof(header);
+
+  bool written = WriteAll(file, &header, sizeof(header)) && WriteAll(file, resume_token_.data(), resume_token_.size());
+  uint64_t offset = sizeof(header) + resume_token_.size();
+
+  std::vector<SnapshotIndexEntry> indexes[SNAPSHOT_COLLECTIONS_COUNT];
+  for (size_t i = 0; written && i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    for (const Document* document : sorted[i]) {
+      SnapshotIndexEntry entry;
+      memcpy(entry.oid, document->id.bytes, sizeof(entry.oid));
+      entry.size = document->data.size();
+      entry.offset = offset;
+      indexes[i].push_back(entry);
+      written = written && WriteAll(file, document->data.data(), document->data.size());
+      offset += document->data.size();
+    }
+  }
+
+  for (size_t i = 0; written && i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    written = WritePadding(file, &offset) &&
+              WriteAll(file, indexes[i].data(), indexes[i].size() * sizeof(SnapshotIndexEntry));
+    header.collections[i].offset = offset;
+    header.collections[i].count = indexes[i].size();
+    offset += indexes[i].size() * sizeof(SnapshotIndexEntry);
+  }
+
+  std::vector<SnapshotEmailEntry> emails;
+  const auto& subscribers = sorted[SNAPSHOT_SUBSCRIBERS];
+  for (size_t i = 0; i < subscribers.size(); ++i) {
+    bson_t doc;
+    const char* email;
+    uint32_t len;
+    if (bson_init_static(&doc, reinterpret_cast<const uint8_t*>(subscribers[i]->data.data()),
+                         subscribers[i]->data.size()) &&
+        GetEmail(&doc, &email, &len)) {
+      emails.push_back({HashEmail(email, len), i});
+    }
+  }
+  std::sort(emails.begin(), emails.end(), [](const SnapshotEmailEntry& lhs, const SnapshotEmailEntry& rhs) {
+    return lhs.hash < rhs.hash;
+  });
+  written = written && WritePadding(file, &offset) &&
+            WriteAll(file, emails.data(), emails.size() * sizeof(SnapshotEmailEntry));
+  header.emails.offset = offset;
+  header.emails.count = emails.size();
+
+  // the magic goes last, a file cut short never has a valid header
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  written = written && fseek(file, 0, SEEK_SET) == 0 && WriteAll(file, &header, sizeof(header));
+  const bool synced = written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  const int sync_errno = errno;
+  fclose(file);
+  if (!synced) {
+    unlink(tmp_path.c_str());
+    return common::make_errno_error("Failed to write snapshot", sync_errno);
+  }
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    return common::make_errno_error("Failed to replace snapshot", errno);
+  }
+  return common::ErrnoError();
+}
+
+Snapshot::Snapshot() : data_(nullptr), size_(0) {}
+
+Snapshot::~Snapshot() {
+  Close();
+}
+
+common::ErrnoError Snapshot::Open(const std::string& path) {
+  if (data_) {
+    return common::make_errno_error("Snapshot already open", EINVAL);
+  }
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return common::make_errno_error("Failed to open snapshot", errno);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    const int stat_errno = errno;
+    close(fd);
+    return common::make_errno_error("Failed to open snapshot", stat_errno);
+  }
+
+  const size_t size = st.st_size;
+  if (size < sizeof(SnapshotHeader)) {
+    close(fd);
+    return common::make_errno_error("Invalid snapshot", EINVAL);
+  }
+
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  const int map_errno = errno;
+  close(fd);
+  if (data == MAP_FAILED) {
+    return common::make_errno_error("Failed to map snapshot", map_errno);
+  }
+
+  const SnapshotHeader* header = static_cast<const SnapshotHeader*>(data);
+  bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+               header->version == SNAPSHOT_VERSION && header->resume_token_offset <= size &&
+               header->resume_token_size <= size - header->resume_token_offset &&
+               IsSectionValid(header->emails, sizeof(SnapshotEmailEntry), size);
+  for (size_t i = 0; valid && i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    valid = IsSectionValid(header->collections[i], sizeof(SnapshotIndexEntry), size);
+  }
+  if (!valid) {
+    munmap(data, size);
+    return common::make_errno_error("Invalid snapshot", EINVAL);
+  }
+
+  data_ = static_cast<const uint8_t*>(data);
+  size_ = size;
+  return common::ErrnoError();
+}
+
+void Snapshot::Close() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
+
+bool Snapshot::IsOpen() const {
+  return data_;
+}
+
+bool Snapshot::Find(SnapshotCollection collection, const bson_oid_t& oid, bson_t* doc) const {
+  if (!data_) {
+    return false;
+  }
+
+  const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(data_);
+  const SnapshotSection& section = header->collections[collection];
+  const SnapshotIndexEntry* begin = reinterpret_cast<const SnapshotIndexEntry*>(data_ + section.offset);
+  const SnapshotIndexEntry* end = begin + section.count;
+  const SnapshotIndexEntry* found =
+      std::lower_bound(begin, end, oid, [](const SnapshotIndexEntry& entry, const bson_oid_t& key) {
+        return memcmp(entry.oid, key.bytes, sizeof(entry.oid)) < 0;
+      });
+  if (found == end || memcmp(found->oid, oid.bytes, sizeof(found->oid)) != 0) {
+    return false;
+  }
+  return GetDocument(collection, found - begin, doc);
+}
+
+bool Snapshot::FindUserByEmail(const std::string& email, bson_t* doc) const {
+  if (!data_) {
+    return false;
+  }
+
+  const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(data_);
+  const SnapshotEmailEntry* begin = reinterpret_cast<const SnapshotEmailEntry*>(data_ + header->emails.offset);
+  const SnapshotEmailEntry* end = begin + header->emails.count;
+  const uint64_t hash = HashEmail(email.data(), email.size());
+  const SnapshotEmailEntry* it = std::lower_bound(
+      begin, end, hash, [](const SnapshotEmailEntry& entry, uint64_t key) { return entry.hash < key; });
+  // hash collisions are told apart by the email of the document
+  for (; it != end && it->hash == hash; ++it) {
+    bson_t user;
+    const char* user_email;
+    uint32_t len;
+    if (GetDocument(SNAPSHOT_SUBSCRIBERS, it->position, &user) && GetEmail(&user, &user_email, &len) &&
+        email.size() == len && memcmp(email.data(), user_email, len) == 0) {
+      *doc = user;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Snapshot::GetDocument(SnapshotCollection collection, size_t i, bson_t* doc) const {
+  if (!data_) {
+    return false;
+  }
+
+  const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(data_);
+  const SnapshotSection& section = header->collections[collection];
+  if (i >= section.count) {
+    return false;
+  }
+
+  const SnapshotIndexEntry* entry = reinterpret_cast<const SnapshotIndexEntry*>(data_ + section.offset) + i;
+  if (entry->offset > size_ || entry->size > size_ - entry->offset) {
+    return false;
+  }
+  return bson_init_static(doc, data_ + entry->offset, entry->size);
+}
+
+size_t Snapshot::GetCount(SnapshotCollection collection) const {
+  if (!data_) {
+    return 0;
+  }
+
+  const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(data_);
+  return header->collections[collection].count;
+}
+
+bool Snapshot::GetResumeToken(bson_t* token) const {
+  if (!data_) {
+    return false;
+  }
+
+  const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(data_);
+  if (header->resume_token_size == 0) {
+    return false;
+  }
+  return bson_init_static(token, data_ + header->resume_token_offset, header->resume_token_size);
+}
+
+size_t Snapshot::GetSize() const {
+  return size_;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
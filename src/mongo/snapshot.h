@@ -0,0 +1,95 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <mongoc.h>
+
+#include <common/error.h>
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+enum SnapshotCollection {
+  SNAPSHOT_SUBSCRIBERS = 0,
+  SNAPSHOT_STREAMS,
+  SNAPSHOT_SERIES,
+  SNAPSHOT_REQUESTS,
+  SNAPSHOT_COLLECTIONS_COUNT
+};
+
+const char* GetSnapshotCollectionName(SnapshotCollection collection);
+bool FindSnapshotCollection(const char* name, SnapshotCollection* collection);
+
+// Builds a snapshot file of the collections a node reads: documents sorted by _id behind an offset index per
+// collection, subscribers also indexed by email hash, and the change stream resume token they are current to.
+// The file is read on the node that wrote it, numbers are in host byte order.
+class SnapshotWriter {
+ public:
+  SnapshotWriter();
+  ~SnapshotWriter();
+
+  // documents without an oid _id are skipped, the last added of equal ids is kept
+  bool Add(SnapshotCollection collection, const bson_t* doc);
+  void SetResumeToken(const bson_t* token);
+
+  // replaced atomically, readers of the previous file keep their mapping
+  common::ErrnoError Write(const std::string& path) const WARN_UNUSED_RESULT;
+
+ private:
+  struct Document {
+    bson_oid_t id;
+    std::string data;
+  };
+
+  std::vector<Document> documents_[SNAPSHOT_COLLECTIONS_COUNT];
+  std::string resume_token_;
+};
+
+// Read only mapping of a snapshot file, lookups are binary searches over its indexes.
+class Snapshot {
+ public:
+  Snapshot();
+  ~Snapshot();
+
+  common::ErrnoError Open(const std::string& path) WARN_UNUSED_RESULT;
+  void Close();
+  bool IsOpen() const;
+
+  // doc points into the mapping and stays valid while the snapshot is open
+  bool Find(SnapshotCollection collection, const bson_oid_t& oid, bson_t* doc) const;
+  bool FindUserByEmail(const std::string& email, bson_t* doc) const;
+  // i-th document in _id order
+  bool GetDocument(SnapshotCollection collection, size_t i, bson_t* doc) const;
+  size_t GetCount(SnapshotCollection collection) const;
+  // false if the snapshot has no resume token
+  bool GetResumeToken(bson_t* token) const;
+  size_t GetSize() const;
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,292 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/snapshot_store.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "mongo/change_stream_watcher.h"
+
+#define SNAPSHOT_EMAIL_FIELD "email"
+#define CHANGE_EVENT_FULL_DOCUMENT_FIELD "fullDocument"
+
+namespace {
+
+bool GetEmail(const bson_t* doc, std::string* email) {
+  bson_iter_t bemail;
+  if (!bson_iter_init_find(&bemail, doc, SNAPSHOT_EMAIL_FIELD) || !BSON_ITER_HOLDS_UTF8(&bemail)) {
+    return false;
+  }
+  uint32_t len;
+  const char* value = bson_iter_utf8(&bemail, &len);
+  email->assign(value, len);
+  return true;
+}
+
+}  // namespace
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+SnapshotStore::SnapshotStore() : mutex_(), snapshot_(), changes_(), changed_emails_(), resume_token_() {}
+
+SnapshotStore::~SnapshotStore() {}
+
+common::ErrnoError SnapshotStore::Load(const std::string& path) {
+  std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+  common::ErrnoError err = snapshot->Open(path);
+  if (err) {
+    return err;
+  }
+
+  std::string resume_token;
+  bson_t token;
+  if (snapshot->GetResumeToken(&token)) {
+    resume_token.assign(reinterpret_cast<const char*>(bson_get_data(&token)), token.len);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  snapshot_ = snapshot;
+  for (size_t i = 0; i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    changes_[i].clear();
+  }
+  changed_emails_.clear();
+  resume_token_ = resume_token;
+  return common::ErrnoError();
+}
+
+bool SnapshotStore::IsLoaded() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return snapshot_ != nullptr;
+}
+
+bool SnapshotStore::Find(SnapshotCollection collection, const bson_oid_t& oid, document_t* doc) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return FindLocked(collection, oid, doc);
+}
+
+bool SnapshotStore::FindUserByEmail(const std::string& email, document_t* doc) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!snapshot_) {
+    return false;
+  }
+
+  std::string user_email;
+  const auto changed = changed_emails_.find(email);
+  if (changed != changed_emails_.end() && FindLocked(SNAPSHOT_SUBSCRIBERS, changed->second, doc) &&
+      GetEmail(doc->get(), &user_email) && user_email == email) {
+    return true;
+  }
+
+  bson_t user;
+  bson_iter_t bid;
+  if (!snapshot_->FindUserByEmail(email, &user) || !bson_iter_init_find(&bid, &user, "_id") ||
+      !BSON_ITER_HOLDS_OID(&bid)) {
+    return false;
+  }
+
+  // the user may have changed its email or been removed since the snapshot was written
+  const changes_t& users = changes_[SNAPSHOT_SUBSCRIBERS];
+  const auto user_change = users.find(*bson_iter_oid(&bid));
+  if (user_change != users.end()) {
+    if (!user_change->second || !GetEmail(user_change->second.get(), &user_email) || user_email != email) {
+      return false;
+    }
+    *doc = document_t(bson_copy(user_change->second.get()));
+    return true;
+  }
+
+  *doc = document_t(bson_copy(&user));
+  return true;
+}
+
+SnapshotStore::ApplyResult SnapshotStore::Apply(SnapshotCollection collection,
+                                                const bson_t* event,
+                                                bson_oid_t* oid) {
+  bson_iter_t btype;
+  if (!bson_iter_init_find(&btype, event, CHANGE_EVENT_OPERATION_TYPE_FIELD) || !BSON_ITER_HOLDS_UTF8(&btype)) {
+    return STREAM_ENDED;
+  }
+
+  const char* type = bson_iter_utf8(&btype, NULL);
+  const bool is_delete = strcmp(type, "delete") == 0;
+  if (!is_delete && strcmp(type, "insert") != 0 && strcmp(type, "update") != 0 && strcmp(type, "replace") != 0) {
+    return STREAM_ENDED;
+  }
+
+  bson_iter_t iter;
+  bson_iter_t bid;
+  if (!bson_iter_init(&iter, event) ||
+      !bson_iter_find_descendant(&iter, CHANGE_EVENT_DOCUMENT_KEY_FIELD "._id", &bid) ||
+      !BSON_ITER_HOLDS_OID(&bid)) {
+    return CHANGE_IGNORED;
+  }
+  bson_oid_copy(bson_iter_oid(&bid), oid);
+
+  // fullDocument is null if the document was removed before the update was looked up
+  change_t change;
+  bson_iter_t bdoc;
+  if (!is_delete && bson_iter_init_find(&bdoc, event, CHANGE_EVENT_FULL_DOCUMENT_FIELD) &&
+      BSON_ITER_HOLDS_DOCUMENT(&bdoc)) {
+    const uint8_t* data;
+    uint32_t len;
+    bson_iter_document(&bdoc, &len, &data);
+    change = change_t(bson_new_from_data(data, len), MongoQueryDeleter());
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  changes_[collection][*oid] = change;
+  if (change && collection == SNAPSHOT_SUBSCRIBERS) {
+    IndexEmailLocked(*oid, change.get());
+  }
+  return CHANGE_APPLIED;
+}
+
+void SnapshotStore::SetResumeToken(const bson_t* token) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  resume_token_.assign(reinterpret_cast<const char*>(bson_get_data(token)), token->len);
+}
+
+bool SnapshotStore::GetResumeToken(document_t* token) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (resume_token_.empty()) {
+    return false;
+  }
+  *token = document_t(bson_new_from_data(reinterpret_cast<const uint8_t*>(resume_token_.data()), resume_token_.size()));
+  return token->get();
+}
+
+void SnapshotStore::DropResumeToken() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  resume_token_.clear();
+}
+
+size_t SnapshotStore::GetChangesCount() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t count = 0;
+  for (size_t i = 0; i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    count += changes_[i].size();
+  }
+  return count;
+}
+
+common::ErrnoError SnapshotStore::Compact(const std::string& path) {
+  std::shared_ptr<Snapshot> snapshot;
+  changes_t changes[SNAPSHOT_COLLECTIONS_COUNT];
+  std::string resume_token;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!snapshot_) {
+      return common::make_errno_error("Snapshot not loaded", EINVAL);
+    }
+    snapshot = snapshot_;
+    for (size_t i = 0; i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+      changes[i] = changes_[i];
+    }
+    resume_token = resume_token_;
+  }
+
+  // lookups go on from the mapped snapshot and the changes while the new one is written
+  SnapshotWriter writer;
+  for (size_t i = 0; i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    const SnapshotCollection collection = static_cast<SnapshotCollection>(i);
+    const size_t count = snapshot->GetCount(collection);
+    for (size_t j = 0; j < count; ++j) {
+      bson_t doc;
+      bson_iter_t bid;
+      if (snapshot->GetDocument(collection, j, &doc) && bson_iter_init_find(&bid, &doc, "_id") &&
+          BSON_ITER_HOLDS_OID(&bid) && changes[i].find(*bson_iter_oid(&bid)) == changes[i].end()) {
+        writer.Add(collection, &doc);
+      }
+    }
+    for (const auto& change : changes[i]) {
+      if (change.second) {
+        writer.Add(collection, change.second.get());
+      }
+    }
+  }
+
+  if (!resume_token.empty()) {
+    bson_t token;
+    if (bson_init_static(&token, reinterpret_cast<const uint8_t*>(resume_token.data()), resume_token.size())) {
+      writer.SetResumeToken(&token);
+    }
+  }
+
+  common::ErrnoError err = writer.Write(path);
+  if (err) {
+    return err;
+  }
+
+  std::shared_ptr<Snapshot> compacted = std::make_shared<Snapshot>();
+  err = compacted->Open(path);
+  if (err) {
+    return err;
+  }
+
+  // changes applied while writing stay on top of the new snapshot
+  std::unique_lock<std::mutex> lock(mutex_);
+  snapshot_ = compacted;
+  for (size_t i = 0; i < SNAPSHOT_COLLECTIONS_COUNT; ++i) {
+    for (const auto& change : changes[i]) {
+      const auto it = changes_[i].find(change.first);
+      if (it != changes_[i].end() && it->second == change.second) {
+        changes_[i].erase(it);
+      }
+    }
+  }
+  changed_emails_.clear();
+  for (const auto& change : changes_[SNAPSHOT_SUBSCRIBERS]) {
+    if (change.second) {
+      IndexEmailLocked(change.first, change.second.get());
+    }
+  }
+  return common::ErrnoError();
+}
+
+bool SnapshotStore::FindLocked(SnapshotCollection collection, const bson_oid_t& oid, document_t* doc) const {
+  if (!snapshot_) {
+    return false;
+  }
+
+  const auto change = changes_[collection].find(oid);
+  if (change != changes_[collection].end()) {
+    if (!change->second) {
+      return false;
+    }
+    *doc = document_t(bson_copy(change->second.get()));
+    return true;
+  }
+
+  bson_t found;
+  if (!snapshot_->Find(collection, oid, &found)) {
+    return false;
+  }
+  *doc = document_t(bson_copy(&found));
+  return true;
+}
+
+void SnapshotStore::IndexEmailLocked(const bson_oid_t& oid, const bson_t* user) {
+  std::string email;
+  if (GetEmail(user, &email)) {
+    changed_emails_[email] = oid;
+  }
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
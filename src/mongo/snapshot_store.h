@@ -0,0 +1,83 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <mongoc.h>
+
+#include <common/error.h>
+
+#include "mongo/mongo_engine.h"
+#include "mongo/snapshot.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Snapshot file with the change events applied since it was written. Lookups copy the document out, so the
+// snapshot may be replaced by a compacted one while they are in use.
+class SnapshotStore {
+ public:
+  typedef std::unique_ptr<bson_t, MongoQueryDeleter> document_t;
+
+  SnapshotStore();
+  ~SnapshotStore();
+
+  // maps the snapshot of path, changes applied so far are dropped
+  common::ErrnoError Load(const std::string& path) WARN_UNUSED_RESULT;
+  bool IsLoaded() const;
+
+  bool Find(SnapshotCollection collection, const bson_oid_t& oid, document_t* doc) const;
+  bool FindUserByEmail(const std::string& email, document_t* doc) const;
+
+  enum ApplyResult {
+    CHANGE_APPLIED = 0,  // oid is the changed document
+    CHANGE_IGNORED,      // documents without an oid _id aren't in snapshots
+    STREAM_ENDED         // drop, rename, invalidate: the snapshot should be taken again
+  };
+  // insert, replace, update and delete events with the full document after the change
+  ApplyResult Apply(SnapshotCollection collection, const bson_t* event, bson_oid_t* oid);
+  // position in the change stream the snapshot with the applied changes is current to
+  void SetResumeToken(const bson_t* token);
+  bool GetResumeToken(document_t* token) const;
+  void DropResumeToken();
+  size_t GetChangesCount() const;
+
+  // writes the snapshot with the applied changes to path and maps it
+  common::ErrnoError Compact(const std::string& path) WARN_UNUSED_RESULT;
+
+ private:
+  typedef std::shared_ptr<bson_t> change_t;  // nullptr if removed
+  typedef std::unordered_map<bson_oid_t, change_t, BsonOidHash, BsonOidEqual> changes_t;
+
+  bool FindLocked(SnapshotCollection collection, const bson_oid_t& oid, document_t* doc) const;
+  void IndexEmailLocked(const bson_oid_t& oid, const bson_t* user);
+
+  mutable std::mutex mutex_;
+  std::shared_ptr<Snapshot> snapshot_;
+  changes_t changes_[SNAPSHOT_COLLECTIONS_COUNT];
+  // emails of changed users, checked against the user document on lookup
+  std::unordered_map<std::string, bson_oid_t> changed_emails_;
+  std::string resume_token_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,364 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/snapshot_subscribers_manager.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <memory>
+
+#include <common/logger.h>
+
+#include "mongo/change_stream_watcher.h"
+#include "mongo/mongo2info.h"
+#include "mongo/tracked_operations.h"
+
+#define CHANGE_EVENT_COLLECTION_FIELD "ns.coll"
+#define CHANGE_STREAM_FATAL_ERROR_CODE 280
+#define CHANGE_STREAM_HISTORY_LOST_CODE 286
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+namespace {
+
+typedef std::unique_ptr<bson_t, MongoQueryDeleter> unique_ptr_bson_t;
+
+// one stream over the snapshot collections, events carry the document after the change
+mongoc_change_stream_t* WatchSnapshotCollections(mongoc_database_t* db,
+                                                 const bson_t* resume_token,
+                                                 int64_t await_msec) {
+  const unique_ptr_bson_t pipeline(BCON_NEW("pipeline", "[", "{", "$match", "{", CHANGE_EVENT_COLLECTION_FIELD, "{",
+                                            "$in", "[", BCON_UTF8(GetSnapshotCollectionName(SNAPSHOT_SUBSCRIBERS)),
+                                            BCON_UTF8(GetSnapshotCollectionName(SNAPSHOT_STREAMS)),
+                                            BCON_UTF8(GetSnapshotCollectionName(SNAPSHOT_SERIES)),
+                                            BCON_UTF8(GetSnapshotCollectionName(SNAPSHOT_REQUESTS)), "]", "}", "}",
+                                            "}", "]"));
+  const unique_ptr_bson_t opts(
+      BCON_NEW("fullDocument", BCON_UTF8("updateLookup"), "maxAwaitTimeMS", BCON_INT64(await_msec)));
+  if (resume_token) {
+    BSON_APPEND_DOCUMENT(opts.get(), "resumeAfter", resume_token);
+  }
+  return mongoc_database_watch(db, pipeline.get(), opts.get());
+}
+
+bool FindQueryKey(const bson_t* query, const char* key, bson_iter_t* value) {
+  return bson_iter_init(value, query) && bson_iter_next(value) && strcmp(bson_iter_key(value), key) == 0;
+}
+
+}  // namespace
+
+SnapshotSubscribersManager::SnapshotSubscribersManager(base::ISubscribersObserver* observer)
+    : base_class(observer),
+      path_(),
+      store_(),
+      refresh_thread_(),
+      stop_refresh_(false),
+      written_users_mutex_(),
+      written_users_() {}
+
+SnapshotSubscribersManager::~SnapshotSubscribersManager() {
+  stop_refresh_ = true;
+  if (refresh_thread_.joinable()) {
+    refresh_thread_.join();
+  }
+}
+
+void SnapshotSubscribersManager::SetupSnapshot(const std::string& path) {
+  path_ = path;
+}
+
+common::ErrnoError SnapshotSubscribersManager::ConnectToDatabase(const std::string& mongodb_url,
+                                                                 const std::string& db_name,
+                                                                 bool lazy,
+                                                                 size_t pool_size,
+                                                                 uint32_t pool_wait_timeout_msec) {
+  if (path_.empty()) {
+    return common::make_errno_error("Snapshot path not set", EINVAL);
+  }
+
+  // the last snapshot is served while it is brought up to date
+  common::ErrnoError err = store_.Load(path_);
+  if (err) {
+    WARNING_LOG() << "Snapshot not loaded, reads go to the database until it is taken: " << err->GetDescription();
+  }
+
+  err = base_class::ConnectToDatabase(mongodb_url, db_name, lazy, pool_size, pool_wait_timeout_msec);
+  if (err) {
+    return err;
+  }
+
+  mongoc_client_t* client = nullptr;
+  err = MongoEngine::GetInstance().Connect(mongodb_url, true, &client);
+  if (err) {
+    return err;
+  }
+
+  stop_refresh_ = false;
+  refresh_thread_ = std::thread([this, client, db_name] { RefreshRoutine(client, db_name); });
+  return common::ErrnoError();
+}
+
+common::ErrnoError SnapshotSubscribersManager::Disconnect() {
+  stop_refresh_ = true;
+  if (refresh_thread_.joinable()) {
+    refresh_thread_.join();
+  }
+
+  // the next start resumes from the last applied change
+  if (store_.IsLoaded() && store_.GetChangesCount() != 0) {
+    common::ErrnoError err = store_.Compact(path_);
+    if (err) {
+      WARNING_LOG() << "Failed to write snapshot: " << err->GetDescription();
+    }
+  }
+  return base_class::Disconnect();
+}
+
+common::Error SnapshotSubscribersManager::FindDocument(ClientPool::Client* db,
+                                                       const char* operation,
+                                                       const char* collection,
+                                                       const bson_t* query,
+                                                       const bson_t* fields,
+                                                       ReadPreferences::ReadClass rclass,
+                                                       document_t* doc) const {
+  SnapshotCollection scollection;
+  if (!FindSnapshotCollection(collection, &scollection)) {
+    return base_class::FindDocument(db, operation, collection, query, fields, rclass, doc);
+  }
+
+  // projections aren't applied, callers read the fields they need from the full document
+  document_t found;
+  bson_iter_t key;
+  if (FindQueryKey(query, "_id", &key) && BSON_ITER_HOLDS_OID(&key)) {
+    store_.Find(scollection, *bson_iter_oid(&key), &found);
+  } else if (scollection == SNAPSHOT_SUBSCRIBERS && FindQueryKey(query, "email", &key) && BSON_ITER_HOLDS_UTF8(&key)) {
+    uint32_t len;
+    const char* email = bson_iter_utf8(&key, &len);
+    store_.FindUserByEmail(std::string(email, len), &found);
+  }
+
+  bson_iter_t bid;
+  if (!found || (scollection == SNAPSHOT_SUBSCRIBERS && bson_iter_init_find(&bid, found.get(), "_id") &&
+                 BSON_ITER_HOLDS_OID(&bid) && IsUserWritten(*bson_iter_oid(&bid)))) {
+    return base_class::FindDocument(db, operation, collection, query, fields, rclass, doc);
+  }
+
+  *doc = std::move(found);
+  return common::Error();
+}
+
+common::Error SnapshotSubscribersManager::FindDocumentsByIDs(ClientPool::Client* db,
+                                                             const char* operation,
+                                                             const char* collection,
+                                                             ReadPreferences::ReadClass rclass,
+                                                             const std::vector<bson_oid_t>& oids,
+                                                             documents_by_id_t* docs,
+                                                             size_t* skipped_batches) const {
+  SnapshotCollection scollection;
+  if (!FindSnapshotCollection(collection, &scollection)) {
+    return base_class::FindDocumentsByIDs(db, operation, collection, rclass, oids, docs, skipped_batches);
+  }
+
+  std::vector<bson_oid_t> missed;
+  for (const bson_oid_t& oid : oids) {
+    document_t found;
+    if (store_.Find(scollection, oid, &found)) {
+      (*docs)[oid] = std::move(found);
+    } else {
+      missed.push_back(oid);
+    }
+  }
+
+  if (missed.empty()) {
+    return common::Error();
+  }
+  return base_class::FindDocumentsByIDs(db, operation, collection, rclass, missed, docs, skipped_batches);
+}
+
+void SnapshotSubscribersManager::OnUserWritten(const fastotv::user_id_t& uid) {
+  bson_oid_t oid;
+  if (!common::ConvertFromString(uid, &oid)) {
+    return;
+  }
+
+  const time_point_t now = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(written_users_mutex_);
+  for (auto it = written_users_.begin(); it != written_users_.end();) {
+    if (now - it->second >= std::chrono::milliseconds(written_user_msec)) {
+      it = written_users_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  written_users_[oid] = now;
+}
+
+bool SnapshotSubscribersManager::IsUserWritten(const bson_oid_t& uid) const {
+  std::unique_lock<std::mutex> lock(written_users_mutex_);
+  const auto it = written_users_.find(uid);
+  return it != written_users_.end() &&
+         std::chrono::steady_clock::now() - it->second < std::chrono::milliseconds(written_user_msec);
+}
+
+void SnapshotSubscribersManager::RefreshRoutine(mongoc_client_t* client, const std::string& db_name) {
+  mongoc_database_t* db = mongoc_client_get_database(client, db_name.c_str());
+  time_point_t compacted = std::chrono::steady_clock::now();
+  while (!stop_refresh_) {
+    SnapshotStore::document_t resume_token;
+    const bool resume = store_.GetResumeToken(&resume_token);
+    mongoc_change_stream_t* change_stream = WatchSnapshotCollections(db, resume_token.get(), await_msec);
+    bool healthy = resume || TakeSnapshot(db, change_stream);
+    while (!stop_refresh_ && healthy) {
+      const time_point_t now = std::chrono::steady_clock::now();
+      if (now - compacted >= std::chrono::milliseconds(compact_interval_msec)) {
+        compacted = now;
+        common::ErrnoError err = store_.GetChangesCount() != 0 ? store_.Compact(path_) : common::ErrnoError();
+        if (err) {
+          WARNING_LOG() << "Failed to write snapshot: " << err->GetDescription();
+        }
+      }
+
+      const bson_t* event;
+      if (mongoc_change_stream_next(change_stream, &event)) {
+        if (!ApplyChange(event)) {
+          store_.DropResumeToken();
+          healthy = false;
+          break;
+        }
+        store_.SetResumeToken(mongoc_change_stream_get_resume_token(change_stream));
+        continue;
+      }
+
+      bson_error_t error;
+      const bson_t* reply;
+      if (mongoc_change_stream_error_document(change_stream, &error, &reply)) {
+        WARNING_LOG() << "Snapshot change stream error: " << error.message;
+        if (error.code == CHANGE_STREAM_HISTORY_LOST_CODE || error.code == CHANGE_STREAM_FATAL_ERROR_CODE) {
+          store_.DropResumeToken();
+        }
+        healthy = false;
+        break;
+      }
+
+      // without events the position still moves past changes of other collections
+      const bson_t* token = mongoc_change_stream_get_resume_token(change_stream);
+      if (token) {
+        store_.SetResumeToken(token);
+      }
+    }
+    mongoc_change_stream_destroy(change_stream);
+
+    if (!healthy) {
+      WaitRefresh(retry_msec);
+    }
+  }
+
+  mongoc_database_destroy(db);
+  mongoc_client_destroy(client);
+}
+
+bool SnapshotSubscribersManager::TakeSnapshot(mongoc_database_t* db, mongoc_change_stream_t* change_stream) {
+  bson_error_t error;
+  const bson_t* reply;
+  if (mongoc_change_stream_error_document(change_stream, &error, &reply)) {
+    WARNING_LOG() << "Snapshot change stream error: " << error.message;
+    return false;
+  }
+
+  const bson_t* resume_token = mongoc_change_stream_get_resume_token(change_stream);
+  if (!resume_token) {
+    WARNING_LOG() << "Snapshot change stream has no resume token";
+    return false;
+  }
+
+  SnapshotWriter writer;
+  writer.SetResumeToken(resume_token);
+  const unique_ptr_bson_t query(bson_new());
+  for (size_t i = 0; i < SNAPSHOT_COLLECTIONS_COUNT && !stop_refresh_; ++i) {
+    const SnapshotCollection scollection = static_cast<SnapshotCollection>(i);
+    mongoc_collection_t* collection = mongoc_database_get_collection(db, GetSnapshotCollectionName(scollection));
+    bool failed = false;
+    {
+      // from the primary, documents must not be older than the stream position
+      TrackedCursor cursor("snapshot.copy", collection, query.get(), nullptr, nullptr);
+      const bson_t* doc;
+      while (!stop_refresh_ && cursor.Next(&doc)) {
+        writer.Add(scollection, doc);
+      }
+      failed = cursor.GetError(&error);
+    }
+    mongoc_collection_destroy(collection);
+    if (failed) {
+      WARNING_LOG() << "Failed to copy " << GetSnapshotCollectionName(scollection) << ": " << error.message;
+      return false;
+    }
+  }
+
+  if (stop_refresh_) {
+    return false;
+  }
+
+  common::ErrnoError err = writer.Write(path_);
+  if (err) {
+    WARNING_LOG() << "Failed to write snapshot: " << err->GetDescription();
+    return false;
+  }
+
+  err = store_.Load(path_);
+  if (err) {
+    WARNING_LOG() << "Failed to load snapshot: " << err->GetDescription();
+    return false;
+  }
+
+  INFO_LOG() << "Snapshot taken: " << path_;
+  return true;
+}
+
+bool SnapshotSubscribersManager::ApplyChange(const bson_t* event) {
+  bson_iter_t iter;
+  bson_iter_t bcollection;
+  SnapshotCollection collection;
+  if (!bson_iter_init(&iter, event) || !bson_iter_find_descendant(&iter, CHANGE_EVENT_COLLECTION_FIELD, &bcollection) ||
+      !BSON_ITER_HOLDS_UTF8(&bcollection) || !FindSnapshotCollection(bson_iter_utf8(&bcollection, NULL), &collection)) {
+    return false;
+  }
+
+  bson_oid_t oid;
+  const SnapshotStore::ApplyResult result = store_.Apply(collection, event, &oid);
+  if (result == SnapshotStore::STREAM_ENDED) {
+    return false;
+  }
+
+  // caches filled from earlier reads are dropped once the snapshot has the change
+  if (collection == SNAPSHOT_SUBSCRIBERS) {
+    HandleSubscribersChange(event);
+  } else if (collection == SNAPSHOT_STREAMS && result == SnapshotStore::CHANGE_APPLIED) {
+    InvalidateStream(oid);
+  }
+  return true;
+}
+
+void SnapshotSubscribersManager::WaitRefresh(uint32_t msec) const {
+  for (uint32_t waited = 0; !stop_refresh_ && waited < msec; waited += await_msec) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(await_msec));
+  }
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,99 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mongo/snapshot_store.h"
+#include "mongo/subscribers_manager.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Subscribers manager of edge nodes: subscribers, streams, series and content requests are read from a local
+// snapshot, kept current by one change stream over these collections, so logins and channel lists don't wait
+// for the database. Writes go to the database as in SubscribersManager, favorite/recent/interruption writes and
+// view counts through its write buffers. Documents missing in the snapshot and users this node wrote in the
+// last written_user_msec are read from the database.
+class SnapshotSubscribersManager : public SubscribersManager {
+ public:
+  typedef SubscribersManager base_class;
+  enum {
+    await_msec = 1000,
+    retry_msec = 5000,
+    compact_interval_msec = 5 * 60 * 1000,
+    written_user_msec = 10 * 1000
+  };
+
+  explicit SnapshotSubscribersManager(base::ISubscribersObserver* observer);
+  ~SnapshotSubscribersManager() override;
+
+  // should be called before ConnectToDatabase
+  void SetupSnapshot(const std::string& path);
+
+  common::ErrnoError ConnectToDatabase(const std::string& mongodb_url,
+                                       const std::string& db_name,
+                                       bool lazy,
+                                       size_t pool_size,
+                                       uint32_t pool_wait_timeout_msec) override WARN_UNUSED_RESULT;
+  common::ErrnoError Disconnect() override WARN_UNUSED_RESULT;
+
+ protected:
+  common::Error FindDocument(ClientPool::Client* db,
+                             const char* operation,
+                             const char* collection,
+                             const bson_t* query,
+                             const bson_t* fields,
+                             ReadPreferences::ReadClass rclass,
+                             document_t* doc) const override WARN_UNUSED_RESULT;
+  common::Error FindDocumentsByIDs(ClientPool::Client* db,
+                                   const char* operation,
+                                   const char* collection,
+                                   ReadPreferences::ReadClass rclass,
+                                   const std::vector<bson_oid_t>& oids,
+                                   documents_by_id_t* docs,
+                                   size_t* skipped_batches) const override WARN_UNUSED_RESULT;
+  void OnUserWritten(const fastotv::user_id_t& uid) override;
+
+ private:
+  typedef std::chrono::steady_clock::time_point time_point_t;
+
+  void RefreshRoutine(mongoc_client_t* client, const std::string& db_name);
+  // copies the collections with the stream position they are current to, the stream was opened before
+  bool TakeSnapshot(mongoc_database_t* db, mongoc_change_stream_t* change_stream);
+  bool ApplyChange(const bson_t* event);
+  bool IsUserWritten(const bson_oid_t& uid) const;
+  void WaitRefresh(uint32_t msec) const;
+
+  std::string path_;
+  SnapshotStore store_;
+  std::thread refresh_thread_;
+  std::atomic<bool> stop_refresh_;
+
+  mutable std::mutex written_users_mutex_;
+  std::unordered_map<bson_oid_t, time_point_t, BsonOidHash, BsonOidEqual> written_users_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
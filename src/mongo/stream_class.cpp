@@ -0,0 +1,135 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/stream_class.h"
+
+#include <string.h>
+
+#include <common/logger.h>
+
+#define STREAM_CLASS_PREFIX_SIZE (sizeof(STREAM_CLASS_PREFIX) - 1)
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+namespace {
+
+bool MatchClass(const char* cls, size_t size, const char* expected, size_t expected_size) {
+  return size == expected_size && memcmp(cls, expected, size) == 0;
+}
+
+#define MATCH_CLASS(CLS, SIZE, EXPECTED) MatchClass(CLS, SIZE, EXPECTED, sizeof(EXPECTED) - 1)
+
+// cls is known to start with STREAM_CLASS_PREFIX
+bool ResolveStreamEntryClass(const char* cls, size_t size, fastotv::StreamType* st) {
+  const char first = cls[STREAM_CLASS_PREFIX_SIZE];
+  switch (size - STREAM_CLASS_PREFIX_SIZE) {
+    case 11:  // ProxyStream, RelayStream
+      if (first == 'P' && MATCH_CLASS(cls, size, PROXY_STR)) {
+        *st = fastotv::PROXY;
+        return true;
+      }
+      if (first == 'R' && MATCH_CLASS(cls, size, RELAY_STR)) {
+        *st = fastotv::RELAY;
+        return true;
+      }
+      return false;
+    case 12:  // EncodeStream
+      if (first == 'E' && MATCH_CLASS(cls, size, ENCODE_STR)) {
+        *st = fastotv::ENCODE;
+        return true;
+      }
+      return false;
+    case 13:  // CatchupStream
+      if (first == 'C' && MATCH_CLASS(cls, size, CATCHUP_STR)) {
+        *st = fastotv::CATCHUP;
+        return true;
+      }
+      return false;
+    case 14:  // ProxyVodStream, CodRelayStream, VodRelayStream, TestLifeStream
+      if (first == 'P' && MATCH_CLASS(cls, size, VOD_PROXY_STR)) {
+        *st = fastotv::VOD_PROXY;
+        return true;
+      }
+      if (first == 'C' && MATCH_CLASS(cls, size, COD_RELAY_STR)) {
+        *st = fastotv::COD_RELAY;
+        return true;
+      }
+      if (first == 'V' && MATCH_CLASS(cls, size, VOD_RELAY_STR)) {
+        *st = fastotv::VOD_RELAY;
+        return true;
+      }
+      if (first == 'T' && MATCH_CLASS(cls, size, TEST_LIFE_STR)) {
+        *st = fastotv::TEST_LIFE;
+        return true;
+      }
+      return false;
+    case 15:  // CodEncodeStream, VodEncodeStream
+      if (first == 'C' && MATCH_CLASS(cls, size, COD_ENCODE_STR)) {
+        *st = fastotv::COD_ENCODE;
+        return true;
+      }
+      if (first == 'V' && MATCH_CLASS(cls, size, VOD_ENCODE_STR)) {
+        *st = fastotv::VOD_ENCODE;
+        return true;
+      }
+      return false;
+    case 21:  // TimeshiftPlayerStream
+      if (first == 'T' && MATCH_CLASS(cls, size, TIMESHIFT_PLAYER_STR)) {
+        *st = fastotv::TIMESHIFT_PLAYER;
+        return true;
+      }
+      return false;
+    case 23:  // TimeshiftRecorderStream
+      if (first == 'T' && MATCH_CLASS(cls, size, TIMESHIFT_RECORDER_STR)) {
+        *st = fastotv::TIMESHIFT_RECORDER;
+        return true;
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+StreamClassResolver::StreamClassResolver() : unknown_mutex_(), unknown_classes_(), unknown_count_(0) {}
+
+bool StreamClassResolver::Resolve(const char* cls, size_t size, fastotv::StreamType* st) {
+  if (!cls || !st) {
+    return false;
+  }
+
+  if (size > STREAM_CLASS_PREFIX_SIZE && memcmp(cls, STREAM_CLASS_PREFIX, STREAM_CLASS_PREFIX_SIZE) == 0 &&
+      ResolveStreamEntryClass(cls, size, st)) {
+    return true;
+  }
+
+  unknown_count_++;
+  std::unique_lock<std::mutex> lock(unknown_mutex_);
+  if (unknown_classes_.insert(std::string(cls, size)).second) {
+    WARNING_LOG() << "Unknown stream class: " << std::string(cls, size);
+  }
+  return false;
+}
+
+size_t StreamClassResolver::GetUnknownCount() const {
+  return unknown_count_;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
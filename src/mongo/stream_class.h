@@ -0,0 +1,64 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include <fastotv/types.h>
+
+#define STREAM_CLASS_PREFIX "pyfastocloud_models.stream.entry."
+
+#define PROXY_STR STREAM_CLASS_PREFIX "ProxyStream"
+#define VOD_PROXY_STR STREAM_CLASS_PREFIX "ProxyVodStream"
+#define COD_RELAY_STR STREAM_CLASS_PREFIX "CodRelayStream"
+#define COD_ENCODE_STR STREAM_CLASS_PREFIX "CodEncodeStream"
+#define RELAY_STR STREAM_CLASS_PREFIX "RelayStream"
+#define ENCODE_STR STREAM_CLASS_PREFIX "EncodeStream"
+#define VOD_RELAY_STR STREAM_CLASS_PREFIX "VodRelayStream"
+#define VOD_ENCODE_STR STREAM_CLASS_PREFIX "VodEncodeStream"
+#define TIMESHIFT_RECORDER_STR STREAM_CLASS_PREFIX "TimeshiftRecorderStream"
+#define TIMESHIFT_PLAYER_STR STREAM_CLASS_PREFIX "TimeshiftPlayerStream"
+#define CATCHUP_STR STREAM_CLASS_PREFIX "CatchupStream"
+#define TEST_LIFE_STR STREAM_CLASS_PREFIX "TestLifeStream"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Maps the _cls of stream documents to fastotv::StreamType with a switch on the class name length and the first
+// character after the common prefix, one compare confirms the match.
+// Classes this server does not know are not guessed, they are counted and each one is logged once.
+class StreamClassResolver {
+ public:
+  StreamClassResolver();
+
+  bool Resolve(const char* cls, size_t size, fastotv::StreamType* st);
+  size_t GetUnknownCount() const;
+
+ private:
+  std::mutex unknown_mutex_;
+  std::unordered_set<std::string> unknown_classes_;
+  std::atomic<size_t> unknown_count_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,226 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/streams_cache.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "mongo/mongo2info.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+namespace {
+bool IsViewCountOnlyUpdate(const bson_t* event) {
+  std::vector<std::string> fields;
+  if (!GetChangedFields(event, &fields) || fields.empty()) {
+    return false;
+  }
+
+  for (const auto& field : fields) {
+    if (field != STREAM_VIEW_COUNT_FIELD) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+StreamsCache::StreamsCache()
+    : entries_mutex_(),
+      entries_(),
+      enabled_(false),
+      generation_(0),
+      content_generation_(0),
+      settle_window_(),
+      last_change_(),
+      hits_(0),
+      misses_(0),
+      watcher_() {}
+
+StreamsCache::~StreamsCache() {
+  StopWatch();
+}
+
+common::ErrnoError StreamsCache::StartWatch(const std::string& mongodb_url,
+                                            const std::string& db_name,
+                                            const std::string& collection) {
+  return watcher_.Start(
+      mongodb_url, db_name, collection, [this](const bson_t* event) { return HandleChangeEvent(event); },
+      [this](bool healthy) { SetEnabled(healthy); });
+}
+
+void StreamsCache::StopWatch() {
+  watcher_.Stop();
+  SetEnabled(false);
+}
+
+bool StreamsCache::IsEnabled() const {
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  return enabled_;
+}
+
+void StreamsCache::SetSettleWindow(uint32_t msec) {
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  settle_window_ = std::chrono::milliseconds(msec);
+}
+
+StreamsCache::stream_entry_t StreamsCache::Find(const bson_oid_t& sid) {
+  {
+    std::unique_lock<std::mutex> lock(entries_mutex_);
+    const auto it = entries_.find(sid);
+    if (it != entries_.end()) {
+      hits_++;
+      return it->second;
+    }
+  }
+
+  misses_++;
+  return nullptr;
+}
+
+StreamsCache::stream_entry_t StreamsCache::Insert(const bson_t* sdoc, fastotv::StreamType st, generation_t generation) {
+  if (!sdoc) {
+    return nullptr;
+  }
+
+  bson_iter_t bid;
+  if (!bson_iter_init_find(&bid, sdoc, STREAM_ID_FIELD) || !BSON_ITER_HOLDS_OID(&bid)) {
+    return nullptr;
+  }
+  const bson_oid_t sid = *bson_iter_oid(&bid);
+
+  auto entry = std::make_shared<StreamEntry>();
+  entry->type = st;
+  bson_iter_t bout;
+  if (bson_iter_init_find(&bout, sdoc, STREAM_OUTPUT_FIELD)) {
+    ignore_result(GetOutputUrlData(&bout, &entry->output));
+  }
+  entry->doc.reset(bson_copy(sdoc));
+
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  if (enabled_ && generation_ == generation && IsSettled()) {
+    entries_[sid] = entry;
+  }
+  return entry;
+}
+
+StreamsCache::generation_t StreamsCache::GetGeneration() const {
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  return generation_;
+}
+
+bool StreamsCache::GetContentGeneration(generation_t* generation) const {
+  if (!generation) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  if (!enabled_ || !IsSettled()) {
+    return false;
+  }
+
+  *generation = content_generation_;
+  return true;
+}
+
+void StreamsCache::Remove(const bson_oid_t& sid, bool content_changed) {
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  generation_++;
+  if (content_changed) {
+    content_generation_++;
+    MarkChanged();
+  }
+  entries_.erase(sid);
+}
+
+void StreamsCache::Clear() {
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  generation_++;
+  content_generation_++;
+  MarkChanged();
+  entries_.clear();
+}
+
+base::CacheStats StreamsCache::GetStats() const {
+  base::CacheStats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  stats.entries = entries_.size();
+  return stats;
+}
+
+void StreamsCache::SetEnabled(bool enabled) {
+  std::unique_lock<std::mutex> lock(entries_mutex_);
+  if (enabled_ == enabled) {
+    return;
+  }
+
+  enabled_ = enabled;
+  generation_++;
+  content_generation_++;
+  entries_.clear();
+}
+
+void StreamsCache::MarkChanged() {
+  if (settle_window_ != std::chrono::steady_clock::duration::zero()) {
+    last_change_ = std::chrono::steady_clock::now();
+  }
+}
+
+bool StreamsCache::IsSettled() const {
+  if (settle_window_ == std::chrono::steady_clock::duration::zero()) {
+    return true;
+  }
+  return std::chrono::steady_clock::now() - last_change_ >= settle_window_;
+}
+
+bool StreamsCache::HandleChangeEvent(const bson_t* event) {
+  bson_iter_t btype;
+  if (!bson_iter_init_find(&btype, event, CHANGE_EVENT_OPERATION_TYPE_FIELD) || !BSON_ITER_HOLDS_UTF8(&btype)) {
+    Clear();
+    return true;
+  }
+
+  const char* type = bson_iter_utf8(&btype, NULL);
+  if (strcmp(type, "insert") == 0) {
+    return true;
+  }
+
+  if (strcmp(type, "update") == 0 || strcmp(type, "replace") == 0 || strcmp(type, "delete") == 0) {
+    bson_iter_t iter;
+    bson_iter_t bid;
+    if (bson_iter_init(&iter, event) &&
+        bson_iter_find_descendant(&iter, CHANGE_EVENT_DOCUMENT_KEY_FIELD "." STREAM_ID_FIELD, &bid) &&
+        BSON_ITER_HOLDS_OID(&bid)) {
+      Remove(*bson_iter_oid(&bid), strcmp(type, "update") != 0 || !IsViewCountOnlyUpdate(event));
+    } else {
+      Clear();
+    }
+    return true;
+  }
+
+  // drop, rename, dropDatabase, invalidate: stream is closed by the server
+  Clear();
+  return false;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,99 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fastotv/types.h>
+#include <fastotv/types/output_uri.h>
+
+#include "base/subscribers_manager_stats.h"
+
+#include "mongo/change_stream_watcher.h"
+#include "mongo/mongo_engine.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Decoded streams documents shared by all subscribers, kept coherent by a change stream on the streams collection.
+// While the change stream is not healthy (standalone server, network error) the cache is disabled and every lookup
+// is a miss, so callers always fall back to the database.
+class StreamsCache {
+ public:
+  struct StreamEntry {
+    fastotv::StreamType type;
+    std::vector<fastotv::OutputUri> output;
+    std::unique_ptr<bson_t, MongoQueryDeleter> doc;
+  };
+  typedef std::shared_ptr<const StreamEntry> stream_entry_t;
+  typedef uint64_t generation_t;
+
+  StreamsCache();
+  ~StreamsCache();
+
+  common::ErrnoError StartWatch(const std::string& mongodb_url,
+                                const std::string& db_name,
+                                const std::string& collection) WARN_UNUSED_RESULT;
+  void StopWatch();
+  // false while the change stream isn't healthy, nothing is cached then
+  bool IsEnabled() const;
+  // documents read from secondaries may predate a change event by up to window msec, during it nothing is cached
+  // and the content generation isn't reported
+  void SetSettleWindow(uint32_t msec);
+
+  stream_entry_t Find(const bson_oid_t& sid);
+  // generation should be taken before the document was read, stale documents are not cached
+  stream_entry_t Insert(const bson_t* sdoc, fastotv::StreamType st, generation_t generation);
+  generation_t GetGeneration() const;
+  // changes only when visible catalog data changes, view counter updates don't bump it
+  bool GetContentGeneration(generation_t* generation) const;
+
+  void Remove(const bson_oid_t& sid, bool content_changed);
+  void Clear();
+
+  base::CacheStats GetStats() const;
+
+ private:
+  typedef std::unordered_map<bson_oid_t, stream_entry_t, BsonOidHash, BsonOidEqual> entries_t;
+
+  bool HandleChangeEvent(const bson_t* event);
+  void SetEnabled(bool enabled);
+  void MarkChanged();
+  bool IsSettled() const;
+
+  mutable std::mutex entries_mutex_;
+  entries_t entries_;
+  bool enabled_;
+  generation_t generation_;
+  generation_t content_generation_;
+  std::chrono::steady_clock::duration settle_window_;
+  std::chrono::steady_clock::time_point last_change_;
+
+  std::atomic<size_t> hits_;
+  std::atomic<size_t> misses_;
+
+  ChangeStreamWatcher watcher_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -16,6 +16,8 @@
 
 #include <algorithm>
 #include <memory>
+#include <thread>
+#include <unordered_map>
 
 #include <common/file_system/string_path_utils.h>
 #include <common/sprintf.h>
@@ -25,28 +27,23 @@
 
 #include "base/server_auth_info.h"
 #include "base/subscriber_info.h"
+#include "base/user_streams_write_buffer.h"
+#include "base/view_counters.h"
 
+#include "mongo/ids_batches.h"
 #include "mongo/mongo2info.h"
 #include "mongo/mongo_engine.h"
+#include "mongo/stream_class.h"
+#include "mongo/tracked_operations.h"
+#include "mongo/write_batch.h"
 
 #define SUBSCRIBERS_COLLECTION "subscribers"
 #define SERVERS_COLLECTION "services"
 #define STREAMS_COLLECTION "streams"
 #define SERIES_COLLECTION "series"
 #define REQUESTS_COLLECTION "requests"
+#define VIEW_BATCHES_COLLECTION "view_batches"
 
-#define PROXY_STR "pyfastocloud_models.stream.entry.ProxyStream"
-#define VOD_PROXY_STR "pyfastocloud_models.stream.entry.ProxyVodStream"
-#define COD_RELAY_STR "pyfastocloud_models.stream.entry.CodRelayStream"
-#define COD_ENCODE_STR "pyfastocloud_models.stream.entry.CodEncodeStream"
-#define RELAY_STR "pyfastocloud_models.stream.entry.RelayStream"
-#define ENCODE_STR "pyfastocloud_models.stream.entry.EncodeStream"
-#define VOD_RELAY_STR "pyfastocloud_models.stream.entry.VodRelayStream"
-#define VOD_ENCODE_STR "pyfastocloud_models.stream.entry.VodEncodeStream"
-#define TIMESHIFT_RECORDER_STR "pyfastocloud_models.stream.entry.TimeshiftRecorderStream"
-#define TIMESHIFT_PLAYER_STR "pyfastocloud_models.stream.entry.TimeshiftPlayerStream"
-#define CATCHUP_STR "pyfastocloud_models.stream.entry.CatchupStream"
-#define TEST_LIFE_STR "pyfastocloud_models.stream.entry.TestLifeStream"
 
 #define FAVORITE_FIELD "favorite"
 #define RECENT_FIELD "recent"
@@ -60,8 +57,21 @@
 #define SERIES_FIELD "series"
 #define REQUESTS_FIELD "requests"
 
+#define USER_EMAIL_FIELD "email"
+#define USER_EXP_DATE_FIELD "exp_date"
+#define USER_STATUS_FIELD "status"
+#define USER_PASSWORD_FIELD "password"
+#define USER_DEVICES_FIELD "devices"
+
 #define SERVER_STREAMS_FIELD "streams"
 
+// _id of a view batch is {batch, stream}, one document per stream a view counter batch was added to
+#define VIEW_BATCH_ID_FIELD "batch"
+#define VIEW_BATCH_STREAM_FIELD "stream"
+#define VIEW_BATCH_CREATED_DATE_FIELD "created_date"
+// a batch is retried or replayed long before, the TTL index drops older documents
+#define VIEW_BATCHES_EXPIRE_SEC (30 * 24 * 3600)
+
 #define INPUT_URL_CLS "pyfastocloud_models.common_entries.InputUrl"
 #define OUTPUT_URL_CLS "pyfastocloud_models.common_entries.OutputUrl"
 #define CATCHUP_USER_CLS_VALUE "pyfastocloud_models.subscriber.entry.UserStream"
@@ -73,36 +83,6 @@ namespace {
 enum UserStatus { USER_NOT_ACTIVE = 0, USER_ACTIVE = 1, USER_DELETED = 2 };
 enum DeviceStatus { DEVICE_NOT_ACTIVE = 0, DEVICE_ACTIVE = 1, DEVICE_BANNED = 2 };
 
-fastotv::StreamType MongoStreamType2StreamType(const char* data) {
-  if (strcmp(data, PROXY_STR) == 0) {
-    return fastotv::PROXY;
-  } else if (strcmp(data, VOD_PROXY_STR) == 0) {
-    return fastotv::VOD_PROXY;
-  } else if (strcmp(data, RELAY_STR) == 0) {
-    return fastotv::RELAY;
-  } else if (strcmp(data, ENCODE_STR) == 0) {
-    return fastotv::ENCODE;
-  } else if (strcmp(data, VOD_RELAY_STR) == 0) {
-    return fastotv::VOD_RELAY;
-  } else if (strcmp(data, VOD_ENCODE_STR) == 0) {
-    return fastotv::VOD_ENCODE;
-  } else if (strcmp(data, TIMESHIFT_RECORDER_STR) == 0) {
-    return fastotv::TIMESHIFT_RECORDER;
-  } else if (strcmp(data, TIMESHIFT_PLAYER_STR) == 0) {
-    return fastotv::TIMESHIFT_PLAYER;
-  } else if (strcmp(data, CATCHUP_STR) == 0) {
-    return fastotv::CATCHUP;
-  } else if (strcmp(data, COD_RELAY_STR) == 0) {
-    return fastotv::COD_RELAY;
-  } else if (strcmp(data, COD_ENCODE_STR) == 0) {
-    return fastotv::COD_ENCODE;
-  } else if (strcmp(data, TEST_LIFE_STR) == 0) {
-    return fastotv::TEST_LIFE;
-  }
-
-  return fastotv::PROXY;
-}
-
 bool IsVod(fastotv::StreamType st) {
   return st == fastotv::VOD_RELAY || st == fastotv::VOD_ENCODE || st == fastotv::VOD_PROXY;
 }
@@ -243,33 +223,36 @@ UserStreamInfo makeUserStreamInfo(bson_iter_t* iter) {
   return uinf;
 }
 
-common::Error AddStreamToServer(mongoc_collection_t* servers,
-                                const bson_oid_t* server_oid,
-                                const bson_oid_t* stream_oid) {
-  bson_error_t error;
-  bson_t* server_id = BCON_NEW("_id", BCON_OID(server_oid));
-  bson_t* push_command = BCON_NEW("$push", "{", SERVER_STREAMS_FIELD, BCON_OID(stream_oid), "}");
-  const unique_ptr_bson_t query_server_update(server_id);
-  const unique_ptr_bson_t update_query_server_update(push_command);
-  if (!mongoc_collection_update(servers, MONGOC_UPDATE_NONE, query_server_update.get(),
-                                update_query_server_update.get(), NULL, &error)) {
-    return common::make_error(error.message);
+void AddStreamToServer(WriteBatch* batch, const bson_oid_t* server_oid, const bson_oid_t* stream_oid) {
+  const unique_ptr_bson_t query_server(BCON_NEW("_id", BCON_OID(server_oid)));
+  const unique_ptr_bson_t update_query_server(BCON_NEW("$push", "{", SERVER_STREAMS_FIELD, BCON_OID(stream_oid), "}"));
+  batch->UpdateOne(SERVERS_COLLECTION, query_server.get(), update_query_server.get());
+}
+
+// indexes of the bulk statements that inserted a document, from the upserted array of the bulk reply
+std::vector<size_t> GetUpsertedIndexes(const bson_t* reply) {
+  std::vector<size_t> indexes;
+  bson_iter_t bupserted;
+  bson_iter_t ar;
+  if (!bson_iter_init_find(&bupserted, reply, "upserted") || !BSON_ITER_HOLDS_ARRAY(&bupserted) ||
+      !bson_iter_recurse(&bupserted, &ar)) {
+    return indexes;
   }
 
-  return common::Error();
+  while (bson_iter_next(&ar)) {
+    bson_iter_t bindex;
+    if (BSON_ITER_HOLDS_DOCUMENT(&ar) && bson_iter_recurse(&ar, &bindex) && bson_iter_find(&bindex, "index") &&
+        BSON_ITER_HOLDS_INT(&bindex)) {
+      indexes.push_back(static_cast<size_t>(bson_iter_as_int64(&bindex)));
+    }
+  }
+  return indexes;
 }
 
-common::Error AddContentRequestToUserArray(mongoc_collection_t* subscribers,
-                                           const bson_oid_t* user_oid,
-                                           const bson_oid_t* request_oid) {
-  bson_error_t error;
+void AddContentRequestToUserArray(WriteBatch* batch, const bson_oid_t* user_oid, const bson_oid_t* request_oid) {
   const unique_ptr_bson_t query_user(BCON_NEW("_id", BCON_OID(user_oid)));
   const unique_ptr_bson_t update_query_user(BCON_NEW("$push", "{", REQUESTS_FIELD, BCON_OID(request_oid), "}"));
-  if (!mongoc_collection_update(subscribers, MONGOC_UPDATE_NONE, query_user.get(), update_query_user.get(), NULL,
-                                &error)) {
-    return common::make_error(error.message);
-  }
-  return common::Error();
+  batch->UpdateOne(SUBSCRIBERS_COLLECTION, query_user.get(), update_query_user.get());
 }
 
 common::Error AddStreamToUserStreamsArray(mongoc_collection_t* subscribers,
@@ -281,8 +264,8 @@ common::Error AddStreamToUserStreamsArray(mongoc_collection_t* subscribers,
                                                      BCON_OID(stream_oid), FAVORITE_FIELD, BCON_BOOL(false),
                                                      PRIVATE_FIELD, BCON_BOOL(false), RECENT_FIELD, BCON_DATE_TIME(0),
                                                      INTERRUPTION_TIME_FIELD, BCON_INT32(0), "}", "}"));
-  if (!mongoc_collection_update(subscribers, MONGOC_UPDATE_NONE, query_user.get(), update_query_user.get(), NULL,
-                                &error)) {
+  if (!TrackedUpdate("subscribers.add_stream", subscribers, MONGOC_UPDATE_NONE, query_user.get(),
+                     update_query_user.get(), &error)) {
     return common::make_error(error.message);
   }
   return common::Error();
@@ -297,8 +280,8 @@ common::Error AddStreamToUserVodsArray(mongoc_collection_t* subscribers,
                                                      BCON_OID(stream_oid), FAVORITE_FIELD, BCON_BOOL(false),
                                                      PRIVATE_FIELD, BCON_BOOL(false), RECENT_FIELD, BCON_DATE_TIME(0),
                                                      INTERRUPTION_TIME_FIELD, BCON_INT32(0), "}", "}"));
-  if (!mongoc_collection_update(subscribers, MONGOC_UPDATE_NONE, query_user.get(), update_query_user.get(), NULL,
-                                &error)) {
+  if (!TrackedUpdate("subscribers.add_vod", subscribers, MONGOC_UPDATE_NONE, query_user.get(),
+                     update_query_user.get(), &error)) {
     return common::make_error(error.message);
   }
   return common::Error();
@@ -313,8 +296,8 @@ common::Error AddStreamToUserCatchupsArray(mongoc_collection_t* subscribers,
       BCON_NEW("$push", "{", USER_CATCHUPS_FIELD, "{", USER_STREAM_ID_FIELD, BCON_OID(stream_oid), FAVORITE_FIELD,
                BCON_BOOL(false), PRIVATE_FIELD, BCON_BOOL(false), RECENT_FIELD, BCON_DATE_TIME(0),
                INTERRUPTION_TIME_FIELD, BCON_INT32(0), "_cls", CATCHUP_USER_CLS_VALUE, "}", "}"));
-  if (!mongoc_collection_update(subscribers, MONGOC_UPDATE_NONE, query_user.get(), update_query_user.get(), NULL,
-                                &error)) {
+  if (!TrackedUpdate("subscribers.add_catchup", subscribers, MONGOC_UPDATE_NONE, query_user.get(),
+                     update_query_user.get(), &error)) {
     return common::make_error(error.message);
   }
   return common::Error();
@@ -327,7 +310,8 @@ common::Error RemoveStreamFromUserStreamsArray(mongoc_collection_t* subscribers,
   const unique_ptr_bson_t update_query(
       BCON_NEW("$pull", "{", USER_STREAMS_FIELD, "{", USER_STREAM_ID_FIELD, BCON_OID(stream_oid), "}", "}"));
   bson_error_t error;
-  if (!mongoc_collection_update(subscribers, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
+  if (!TrackedUpdate("subscribers.remove_stream", subscribers, MONGOC_UPDATE_NONE, query.get(),
+                     update_query.get(), &error)) {
     return common::make_error(error.message);
   }
   return common::Error();
@@ -340,7 +324,8 @@ common::Error RemoveStreamFromUserVodsArray(mongoc_collection_t* subscribers,
   const unique_ptr_bson_t update_query(
       BCON_NEW("$pull", "{", USER_VODS_FIELD, "{", USER_STREAM_ID_FIELD, BCON_OID(stream_oid), "}", "}"));
   bson_error_t error;
-  if (!mongoc_collection_update(subscribers, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
+  if (!TrackedUpdate("subscribers.remove_vod", subscribers, MONGOC_UPDATE_NONE, query.get(),
+                     update_query.get(), &error)) {
     return common::make_error(error.message);
   }
   return common::Error();
@@ -353,30 +338,435 @@ common::Error RemoveStreamFromUserCatchupsArray(mongoc_collection_t* subscribers
   const unique_ptr_bson_t update_query(
       BCON_NEW("$pull", "{", USER_CATCHUPS_FIELD, "{", USER_STREAM_ID_FIELD, BCON_OID(stream_oid), "}", "}"));
   bson_error_t error;
-  if (!mongoc_collection_update(subscribers, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
+  if (!TrackedUpdate("subscribers.remove_catchup", subscribers, MONGOC_UPDATE_NONE, query.get(),
+                     update_query.get(), &error)) {
     return common::make_error(error.message);
   }
   return common::Error();
 }
 
+struct UserStreamEntry {
+  bson_oid_t sid;
+  UserStreamInfo uinf;
+};
+
+typedef std::vector<UserStreamEntry> user_streams_t;
+typedef SubscribersManager::documents_by_id_t documents_by_id_t;
+typedef std::unordered_map<bson_oid_t, StreamsCache::stream_entry_t, BsonOidHash, BsonOidEqual> streams_entries_t;
+
+void GetUserStreamsFromArray(const bson_t* doc, const char* field, user_streams_t* streams) {
+  bson_iter_t bstreams;
+  if (!bson_iter_init_find(&bstreams, doc, field) || !BSON_ITER_HOLDS_ARRAY(&bstreams)) {
+    return;
+  }
+
+  bson_iter_t ar;
+  if (!bson_iter_recurse(&bstreams, &ar)) {
+    return;
+  }
+
+  while (bson_iter_next(&ar)) {
+    if (!BSON_ITER_HOLDS_DOCUMENT(&ar)) {
+      continue;
+    }
+
+    bson_iter_t iter;
+    if (bson_iter_recurse(&ar, &iter) && bson_iter_find(&iter, USER_STREAM_ID_FIELD) && BSON_ITER_HOLDS_OID(&iter)) {
+      UserStreamEntry entry;
+      bson_oid_copy(bson_iter_oid(&iter), &entry.sid);
+      entry.uinf = makeUserStreamInfo(&iter);
+      streams->push_back(entry);
+    }
+  }
+}
+
+const char* GetUserArrayField(base::UserStreamsWriteBuffer::UserArray array) {
+  if (array == base::UserStreamsWriteBuffer::USER_VODS) {
+    return USER_VODS_FIELD;
+  } else if (array == base::UserStreamsWriteBuffer::USER_CATCHUPS) {
+    return USER_CATCHUPS_FIELD;
+  }
+  return USER_STREAMS_FIELD;
+}
+
+void ApplyBufferedUpdate(const base::UserStreamsWriteBuffer::Update& update, UserStreamInfo* uinf) {
+  if (update.fields & base::UserStreamsWriteBuffer::FAVORITE_FIELD) {
+    uinf->favorite = update.favorite;
+  }
+  if (update.fields & base::UserStreamsWriteBuffer::RECENT_FIELD) {
+    uinf->recent = update.recent;
+  }
+  if (update.fields & base::UserStreamsWriteBuffer::INTERRUPTION_TIME_FIELD) {
+    uinf->interruption_time = update.interruption_time;
+  }
+}
+
+void ApplyBufferedUpdates(const base::UserStreamsWriteBuffer::updates_t& updates,
+                          base::UserStreamsWriteBuffer::UserArray array,
+                          user_streams_t* streams) {
+  std::unordered_map<fastotv::stream_id_t, const base::UserStreamsWriteBuffer::Update*> by_sid;
+  for (const auto& update : updates) {
+    if (update.array == array) {
+      by_sid[update.sid] = &update;
+    }
+  }
+
+  if (by_sid.empty()) {
+    return;
+  }
+
+  for (auto& entry : *streams) {
+    const auto it = by_sid.find(common::ConvertToString(&entry.sid));
+    if (it != by_sid.end()) {
+      ApplyBufferedUpdate(*it->second, &entry.uinf);
+    }
+  }
+}
+
+// only the fields ClientLogin/ClientActivate read, streams/vods/catchups arrays stay on the server
+bson_t* MakeAuthProjection() {
+  return BCON_NEW(USER_EMAIL_FIELD, BCON_INT32(1), USER_EXP_DATE_FIELD, BCON_INT32(1), USER_STATUS_FIELD,
+                  BCON_INT32(1), USER_PASSWORD_FIELD, BCON_INT32(1), USER_DEVICES_FIELD, BCON_INT32(1));
+}
+
+// only the entries with sid from all user arrays
+bson_t* MakeUserStreamsProjection(const bson_oid_t* sid) {
+  return BCON_NEW(USER_STREAMS_FIELD, "{", "$elemMatch", "{", USER_STREAM_ID_FIELD, BCON_OID(sid), "}", "}",
+                  USER_VODS_FIELD, "{", "$elemMatch", "{", USER_STREAM_ID_FIELD, BCON_OID(sid), "}", "}",
+                  USER_CATCHUPS_FIELD, "{", "$elemMatch", "{", USER_STREAM_ID_FIELD, BCON_OID(sid), "}", "}");
+}
+
+// user arrays for the entitlements index
+bson_t* MakeUserEntitlementsProjection() {
+  return BCON_NEW(USER_STREAMS_FIELD, BCON_INT32(1), USER_VODS_FIELD, BCON_INT32(1), USER_CATCHUPS_FIELD,
+                  BCON_INT32(1));
+}
+
+void AppendEntitlements(const user_streams_t& streams,
+                        UserEntitlements::array_t array,
+                        std::vector<UserEntitlements::Entry>* entries) {
+  for (const auto& stream : streams) {
+    entries->push_back({stream.sid, array, stream.uinf});
+  }
+}
+
+common::Error FindInEntitlements(const UserEntitlements& entitlements,
+                                 const bson_oid_t& sid,
+                                 const std::vector<UserEntitlements::array_t>& arrays,
+                                 UserEntitlements::Entry* entry) {
+  for (const auto array : arrays) {
+    const UserEntitlements::Entry* found = entitlements.Find(sid, array);
+    if (found) {
+      *entry = *found;
+      return common::Error();
+    }
+  }
+  return common::make_error("Stream not found");
+}
+
+// favorite/recent/interruption_time write of the user applied to a loaded entitlements index
+std::function<void(UserEntitlements*)> MakeUserStreamUpdate(fastotv::stream_id_t sid,
+                                                            UserEntitlements::array_t array,
+                                                            std::function<void(UserStreamInfo*)> update) {
+  bson_oid_t bsid;
+  if (!common::ConvertFromString(sid, &bsid)) {
+    return nullptr;
+  }
+
+  return [bsid, array, update](UserEntitlements* entitlements) {
+    UserEntitlements::Entry* entry = entitlements->Find(bsid, array);
+    if (entry) {
+      update(&entry->uinf);
+    }
+  };
+}
+
+const std::vector<UserEntitlements::array_t> kAllUserArrays = {base::UserStreamsWriteBuffer::USER_STREAMS,
+                                                               base::UserStreamsWriteBuffer::USER_VODS,
+                                                               base::UserStreamsWriteBuffer::USER_CATCHUPS};
+
+void GetOidsFromArray(const bson_t* doc, const char* field, std::vector<bson_oid_t>* oids) {
+  bson_iter_t barray;
+  if (!bson_iter_init_find(&barray, doc, field) || !BSON_ITER_HOLDS_ARRAY(&barray)) {
+    return;
+  }
+
+  bson_iter_t ar;
+  if (!bson_iter_recurse(&barray, &ar)) {
+    return;
+  }
+
+  while (bson_iter_next(&ar)) {
+    if (BSON_ITER_HOLDS_OID(&ar)) {
+      oids->push_back(*bson_iter_oid(&ar));
+    }
+  }
+}
+
+const bson_t* FindDocumentByID(const documents_by_id_t& docs, const bson_oid_t& oid) {
+  const auto it = docs.find(oid);
+  if (it == docs.end()) {
+    return nullptr;
+  }
+  return it->second.get();
+}
+
+bool GetUrlFromOutput(const std::vector<fastotv::OutputUri>& output,
+                      fastotv::channel_id_t cid,
+                      common::uri::GURL* url) {
+  for (size_t i = 0; i < output.size(); ++i) {
+    if (output[i].GetID() == cid) {
+      *url = output[i].GetUrl();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GetHttpRootFromOutput(const std::vector<fastotv::OutputUri>& output,
+                           fastotv::channel_id_t cid,
+                           common::file_system::ascii_directory_string_path* dir) {
+  for (size_t i = 0; i < output.size(); ++i) {
+    if (output[i].GetID() == cid) {
+      const auto http_root = output[i].GetHttpRoot();
+      if (!http_root) {
+        return false;
+      }
+      *dir = *http_root;
+      return true;
+    }
+  }
+  return false;
+}
+
+const StreamsCache::StreamEntry* FindStreamEntryByID(const streams_entries_t& entries, const bson_oid_t& oid) {
+  const auto it = entries.find(oid);
+  if (it == entries.end()) {
+    return nullptr;
+  }
+  return it->second.get();
+}
+
+bool GetStreamTypeFromDocument(const bson_t* sdoc, StreamClassResolver* resolver, fastotv::StreamType* st) {
+  bson_iter_t bcls;
+  if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
+    return false;
+  }
+
+  uint32_t cls_len = 0;
+  const char* cls = bson_iter_utf8(&bcls, &cls_len);
+  return resolver->Resolve(cls, cls_len, st);
+}
+
+// [from, to) part of a collection by _id, sides without a bound have no condition
+struct IdRange {
+  bool has_from = false;
+  bson_oid_t from;
+  bool has_to = false;
+  bson_oid_t to;
+};
+
+struct WarmUpTask {
+  const char* collection;
+  unique_ptr_bson_t query;
+};
+
+bson_oid_t MakeOidFromTime(uint64_t seconds) {
+  uint8_t data[12] = {0};
+  data[0] = static_cast<uint8_t>(seconds >> 24);
+  data[1] = static_cast<uint8_t>(seconds >> 16);
+  data[2] = static_cast<uint8_t>(seconds >> 8);
+  data[3] = static_cast<uint8_t>(seconds);
+  bson_oid_t oid;
+  bson_oid_init_from_data(&oid, data);
+  return oid;
+}
+
+// first (order 1) or last (order -1) _id of the collection, false if it is empty
+bool FindEdgeID(mongoc_collection_t* collection, const mongoc_read_prefs_t* read_prefs, int order, bson_oid_t* oid) {
+  const unique_ptr_bson_t query(BCON_NEW("$query", "{", "}", "$orderby", "{", "_id", BCON_INT32(order), "}"));
+  const unique_ptr_bson_t fields(BCON_NEW("_id", BCON_INT32(1)));
+  TrackedCursor cursor("warm_up.find_edge_id", collection, query.get(), fields.get(), read_prefs);
+  const bson_t* doc;
+  bson_iter_t bid;
+  if (!cursor.Next(&doc) || !bson_iter_init_find(&bid, doc, "_id") || !BSON_ITER_HOLDS_OID(&bid)) {
+    return false;
+  }
+
+  bson_oid_copy(bson_iter_oid(&bid), oid);
+  return true;
+}
+
+// up to parts ranges of about equal creation time span, ObjectIds start with their creation time in seconds
+std::vector<IdRange> SplitByCreationTime(mongoc_collection_t* collection,
+                                         const mongoc_read_prefs_t* read_prefs,
+                                         size_t parts) {
+  bson_oid_t first;
+  bson_oid_t last;
+  if (parts < 2 || !FindEdgeID(collection, read_prefs, 1, &first) || !FindEdgeID(collection, read_prefs, -1, &last)) {
+    return std::vector<IdRange>(1);
+  }
+
+  const uint64_t from = bson_oid_get_time_t(&first);
+  const uint64_t span = bson_oid_get_time_t(&last) + 1 - from;
+  std::vector<IdRange> ranges;
+  IdRange range;
+  uint64_t prev = from;
+  for (size_t i = 1; i < parts; ++i) {
+    const uint64_t boundary = from + span * i / parts;
+    if (boundary <= prev) {
+      continue;
+    }
+
+    prev = boundary;
+    range.has_to = true;
+    range.to = MakeOidFromTime(boundary);
+    ranges.push_back(range);
+    range.has_from = true;
+    range.from = range.to;
+  }
+  range.has_to = false;
+  ranges.push_back(range);
+  return ranges;
+}
+
+bson_t* MakeIdRangeQuery(const IdRange& range) {
+  bson_t* query = bson_new();
+  if (!range.has_from && !range.has_to) {
+    return query;
+  }
+
+  bson_t bid;
+  BSON_APPEND_DOCUMENT_BEGIN(query, "_id", &bid);
+  if (range.has_from) {
+    BSON_APPEND_OID(&bid, "$gte", &range.from);
+  }
+  if (range.has_to) {
+    BSON_APPEND_OID(&bid, "$lt", &range.to);
+  }
+  bson_append_document_end(query, &bid);
+  return query;
+}
+
+// logins of the active devices of a not expired subscriber document with the auth projection
+void GetActiveLogins(const bson_t* doc, fastotv::timestamp_t now, std::vector<base::ServerDBAuthInfo>* logins) {
+  bson_iter_t bid;
+  bson_iter_t bemail;
+  bson_iter_t bpassword;
+  bson_iter_t bexp_date;
+  bson_iter_t bdevices;
+  if (!bson_iter_init_find(&bid, doc, "_id") || !BSON_ITER_HOLDS_OID(&bid) ||
+      !bson_iter_init_find(&bemail, doc, USER_EMAIL_FIELD) || !BSON_ITER_HOLDS_UTF8(&bemail) ||
+      !bson_iter_init_find(&bpassword, doc, USER_PASSWORD_FIELD) || !BSON_ITER_HOLDS_UTF8(&bpassword) ||
+      !bson_iter_init_find(&bexp_date, doc, USER_EXP_DATE_FIELD) || !BSON_ITER_HOLDS_DATE_TIME(&bexp_date) ||
+      !bson_iter_init_find(&bdevices, doc, USER_DEVICES_FIELD) || !BSON_ITER_HOLDS_ARRAY(&bdevices)) {
+    return;
+  }
+
+  const fastotv::timestamp_t exp_date = bson_iter_date_time(&bexp_date);
+  if (now > exp_date) {
+    return;
+  }
+
+  bson_iter_t ar;
+  if (!bson_iter_recurse(&bdevices, &ar)) {
+    return;
+  }
+
+  const fastotv::user_id_t uid = common::ConvertToString(bson_iter_oid(&bid));
+  const fastotv::commands_info::LoginInfo login(bson_iter_utf8(&bemail, NULL), bson_iter_utf8(&bpassword, NULL));
+  while (bson_iter_next(&ar)) {
+    bson_iter_t did;
+    bson_iter_t bstatus;
+    if (!BSON_ITER_HOLDS_DOCUMENT(&ar) || !bson_iter_recurse(&ar, &did) || !bson_iter_find(&did, "_id") ||
+        !BSON_ITER_HOLDS_OID(&did)) {
+      continue;
+    }
+
+    // first logins of not active devices activate them, they go to the database
+    if (!bson_iter_recurse(&ar, &bstatus) || !bson_iter_find(&bstatus, "status") || !BSON_ITER_HOLDS_INT32(&bstatus) ||
+        bson_iter_int32(&bstatus) != DEVICE_ACTIVE) {
+      continue;
+    }
+
+    const fastotv::commands_info::AuthInfo auth(login, common::ConvertToString(bson_iter_oid(&did)));
+    logins->push_back(base::ServerDBAuthInfo(uid, fastotv::commands_info::ServerAuthInfo(auth, exp_date)));
+  }
+}
+
 }  // namespace
 
 SubscribersManager::SubscribersManager(base::ISubscribersObserver* observer)
     : base_class(observer),
       connections_mutex_(),
       connections_(),
-      client_(nullptr),
-      subscribers_(nullptr),
-      servers_(nullptr),
-      streams_(nullptr),
-      series_(nullptr),
-      requests_(nullptr),
-      catchup_endpoint_() {}
+      pool_(nullptr),
+      read_prefs_(new ReadPreferences),
+      indexes_mode_(QueryShapeChecker::CREATE),
+      query_plans_(),
+      streams_cache_(new StreamsCache),
+      stream_classes_(new StreamClassResolver),
+      write_buffer_(new base::UserStreamsWriteBuffer(base::UserStreamsWriteBuffer::default_flush_interval_msec,
+                                                     base::UserStreamsWriteBuffer::default_max_pending)),
+      view_counters_(
+          new base::ViewCounters(base::ViewCounters::default_shards, base::ViewCounters::default_flush_interval_msec)),
+      view_counters_journal_(),
+      auth_cache_(new base::AuthCache(base::AuthCache::default_max_entries, base::AuthCache::default_max_age_sec)),
+      login_guard_(new base::LoginGuard(base::LoginGuard::default_max_entries,
+                                        base::LoginGuard::default_negative_ttl_msec,
+                                        base::LoginGuard::default_free_failures,
+                                        base::LoginGuard::default_backoff_msec,
+                                        base::LoginGuard::default_max_backoff_msec,
+                                        base::LoginGuard::default_address_failures,
+                                        base::LoginGuard::default_address_window_msec)),
+      subscribers_watcher_(),
+      channels_versions_mutex_(),
+      channels_versions_(),
+      channels_versions_seq_(0),
+      subscribers_watch_healthy_(false),
+      subscribers_generation_(0),
+      entitlements_(),
+      catchups_flight_(),
+      catchup_endpoint_mutex_(),
+      catchup_endpoint_(),
+      warm_up_cancelled_(false) {}
+
+SubscribersManager::~SubscribersManager() {
+  destroy(&login_guard_);
+  destroy(&auth_cache_);
+  destroy(&view_counters_);
+  destroy(&write_buffer_);
+  destroy(&stream_classes_);
+  destroy(&streams_cache_);
+  destroy(&read_prefs_);
+}
 
 void SubscribersManager::SetupCatchupsEndpoint(const base::CatchupEndpointInfo& info) {
+  std::unique_lock<std::mutex> lock(catchup_endpoint_mutex_);
   catchup_endpoint_ = info;
 }
 
+void SubscribersManager::SetupViewCountersJournal(const std::string& path) {
+  view_counters_journal_ = path;
+}
+
+void SubscribersManager::SetupSlowQueryThreshold(uint32_t msec) {
+  MongoEngine::GetInstance().SetSlowOperationThreshold(msec);
+}
+
+void SubscribersManager::SetupReadPreferences(const std::string& catalog_mode,
+                                              const std::string& user_mode,
+                                              int64_t max_staleness_seconds) {
+  read_prefs_->Setup(ReadPreferences::CATALOG_READS, catalog_mode, max_staleness_seconds);
+  read_prefs_->Setup(ReadPreferences::USER_READS, user_mode, max_staleness_seconds);
+  // a lagging secondary may still return a stream in its version before the last change event
+  streams_cache_->SetSettleWindow(read_prefs_->GetLagWindow(ReadPreferences::CATALOG_READS));
+}
+
+void SubscribersManager::SetupIndexes(const std::string& mode) {
+  indexes_mode_ = QueryShapeChecker::ParseMode(mode);
+}
+
 common::Error SubscribersManager::SendSubscriberNotification(
     const fastotv::user_id_t& uid,
     const fastotv::device_id_t& device,
@@ -400,6 +790,22 @@ common::Error SubscribersManager::SendSubscriberNotification(
   return common::make_error("Device not found");
 }
 
+base::SubscribersManagerStats SubscribersManager::GetStats() const {
+  base::SubscribersManagerStats stats;
+  stats.streams_cache = streams_cache_->GetStats();
+  if (pool_) {
+    stats.pool = pool_->GetStats();
+  }
+  stats.write_buffer = write_buffer_->GetStats();
+  stats.view_counters = view_counters_->GetStats();
+  stats.auth_cache = auth_cache_->GetStats();
+  stats.login_guard = login_guard_->GetStats();
+  stats.unknown_stream_classes = stream_classes_->GetUnknownCount();
+  stats.operations = MongoEngine::GetInstance().GetOperationMetrics()->GetStats();
+  stats.query_plans = query_plans_;
+  return stats;
+}
+
 std::vector<base::FrontSubscriberInfo> SubscribersManager::GetOnlineSubscribers() {
   std::unique_lock<std::mutex> lock(connections_mutex_);
   std::vector<base::FrontSubscriberInfo> result;
@@ -418,218 +824,916 @@ std::vector<base::FrontSubscriberInfo> SubscribersManager::GetOnlineSubscribers(
 
 common::ErrnoError SubscribersManager::ConnectToDatabase(const std::string& mongodb_url,
                                                          const std::string& db_name,
-                                                         bool lazy) {
-  if (db_name.empty()) {
+                                                         bool lazy,
+                                                         size_t pool_size,
+                                                         uint32_t pool_wait_timeout_msec) {
+  if (db_name.empty() || pool_size == 0) {
     return common::make_errno_error_inval();
   }
 
-  mongoc_client_t* client = nullptr;
-  common::ErrnoError err = MongoEngine::GetInstance().Connect(mongodb_url, lazy, &client);
+  ClientPool* pool = nullptr;
+  common::ErrnoError err = ClientPool::Create(mongodb_url, db_name, lazy, pool_size, pool_wait_timeout_msec, &pool);
   if (err) {
     return err;
   }
 
-  const char* db = db_name.c_str();
-  mongoc_collection_t* scollection = mongoc_client_get_collection(client, db, SUBSCRIBERS_COLLECTION);
-  if (!scollection) {
-    mongoc_client_destroy(client);
-    return common::make_errno_error("Can't find " SUBSCRIBERS_COLLECTION " collection.", EAGAIN);
-  }
+  pool_ = pool;
+  {
+    ClientPool::client_t db;
+    common::Error err_pop = PopClient(&db);
+    if (err_pop) {
+      WARNING_LOG() << "Indexes not checked: " << err_pop->GetDescription();
+    } else if (!CheckQueryShapes(db.get())) {
+      db.reset();
+      destroy(&pool_);
+      return common::make_errno_error("Database lookups aren't served by indexes", EINVAL);
+    }
 
-  mongoc_collection_t* sercollection = mongoc_client_get_collection(client, db, SERVERS_COLLECTION);
-  if (!sercollection) {
-    mongoc_collection_destroy(scollection);
-    mongoc_client_destroy(client);
-    return common::make_errno_error("Can't find " SERVERS_COLLECTION " collection.", EAGAIN);
+    // multi-step writes fail until the topology is known, without a server now the first of them detects it
+    bool transactions = false;
+    common::Error err_topology = db ? db->IsTransactionsSupported(&transactions) : common::Error();
+    if (err_topology) {
+      WARNING_LOG() << err_topology->GetDescription();
+    } else if (db && !transactions) {
+      WARNING_LOG() << "Standalone database, multi-step writes aren't atomic";
+    }
   }
 
-  mongoc_collection_t* stcollection = mongoc_client_get_collection(client, db, STREAMS_COLLECTION);
-  if (!stcollection) {
-    mongoc_collection_destroy(sercollection);
-    mongoc_collection_destroy(scollection);
-    mongoc_client_destroy(client);
-    return common::make_errno_error("Can't find " STREAMS_COLLECTION " collection.", EAGAIN);
-  }
+  write_buffer_->Start(
+      [this](const base::UserStreamsWriteBuffer::updates_t& updates) { return FlushUserStreams(updates); });
+  view_counters_->Start(view_counters_journal_,
+                        [this](const std::string& batch_id, const base::ViewCounters::deltas_t& deltas) {
+                          return FlushViewCounts(batch_id, deltas);
+                        });
 
-  mongoc_collection_t* series = mongoc_client_get_collection(client, db, SERIES_COLLECTION);
-  if (!series) {
-    mongoc_collection_destroy(sercollection);
-    mongoc_collection_destroy(scollection);
-    mongoc_client_destroy(client);
-    return common::make_errno_error("Can't find " SERIES_COLLECTION " collection.", EAGAIN);
+  err = streams_cache_->StartWatch(mongodb_url, db_name, STREAMS_COLLECTION);
+  if (err) {
+    WARNING_LOG() << "Streams cache disabled: " << err->GetDescription();
   }
 
-  mongoc_collection_t* requests = mongoc_client_get_collection(client, db, REQUESTS_COLLECTION);
-  if (!requests) {
-    mongoc_collection_destroy(sercollection);
-    mongoc_collection_destroy(scollection);
-    mongoc_collection_destroy(series);
-    mongoc_client_destroy(client);
-    return common::make_errno_error("Can't find " REQUESTS_COLLECTION " collection.", EAGAIN);
+  err = subscribers_watcher_.Start(
+      mongodb_url, db_name, SUBSCRIBERS_COLLECTION,
+      [this](const bson_t* event) { return HandleSubscribersChange(event); },
+      [this](bool healthy) { SetSubscribersWatchHealthy(healthy); });
+  if (err) {
+    WARNING_LOG() << "Auth and paths caches disabled: " << err->GetDescription();
   }
-
-  servers_ = sercollection;
-  streams_ = stcollection;
-  subscribers_ = scollection;
-  series_ = series;
-  requests_ = requests;
-  client_ = client;
   return common::ErrnoError();
 }
 
 common::ErrnoError SubscribersManager::Disconnect() {
-  if (servers_) {
-    mongoc_collection_destroy(servers_);
-    servers_ = nullptr;
-  }
+  write_buffer_->Stop();
+  view_counters_->Stop();
+  streams_cache_->StopWatch();
+  subscribers_watcher_.Stop();
+  SetSubscribersWatchHealthy(false);
+  destroy(&pool_);
+  return common::ErrnoError();
+}
 
-  if (streams_) {
-    mongoc_collection_destroy(streams_);
-    streams_ = nullptr;
-  }
+bool SubscribersManager::CheckQueryShapes(ClientPool::Client* db) {
+  bson_oid_t sample;
+  bson_oid_init(&sample, NULL);
+  fastotv::commands_info::StreamBaseInfo::parts_t parts;
+  parts.push_back(common::ConvertToString(&sample));
+
+  // subscribers.find_activate has the filter of subscribers.find_login, user arrays updates the one of
+  // subscribers.flush_user_streams
+  const unique_ptr_bson_t email_keys(BCON_NEW(USER_EMAIL_FIELD, BCON_INT32(1)));
+  const unique_ptr_bson_t email_filter(BCON_NEW(USER_EMAIL_FIELD, BCON_UTF8("")));
+  const unique_ptr_bson_t user_stream_filter(
+      BCON_NEW("_id", BCON_OID(&sample), USER_STREAMS_FIELD "." USER_STREAM_ID_FIELD, BCON_OID(&sample)));
+  const unique_ptr_bson_t server_streams_keys(BCON_NEW(SERVER_STREAMS_FIELD, BCON_INT32(1)));
+  const unique_ptr_bson_t server_streams_filter(
+      BCON_NEW(SERVER_STREAMS_FIELD, "{", "$elemMatch", "{", "$eq", BCON_OID(&sample), "}", "}"));
+  const unique_ptr_bson_t parts_filter(bson_new());
+  MakeFindCatchupInPartsQuery(parts, std::string(), 0, 0, parts_filter.get());
+  const unique_ptr_bson_t view_batches_keys(BCON_NEW(VIEW_BATCH_CREATED_DATE_FIELD, BCON_INT32(1)));
+  const unique_ptr_bson_t view_batches_filter(
+      BCON_NEW(VIEW_BATCH_CREATED_DATE_FIELD, "{", "$lt", BCON_DATE_TIME(0), "}"));
+  const unique_ptr_bson_t view_batches_options(BCON_NEW("expireAfterSeconds", BCON_INT32(VIEW_BATCHES_EXPIRE_SEC)));
+
+  const mongoc_read_prefs_t* user_reads = read_prefs_->Get(ReadPreferences::USER_READS);
+  const struct {
+    const char* collection;
+    QueryShape shape;
+  } shapes[] = {
+      {SUBSCRIBERS_COLLECTION,
+       {"subscribers.find_login", USER_EMAIL_FIELD "_1", email_keys.get(), email_filter.get(), user_reads, nullptr}},
+      {SUBSCRIBERS_COLLECTION,
+       {"subscribers.flush_user_streams", ID_INDEX_NAME, nullptr, user_stream_filter.get(), nullptr, nullptr}},
+      {SERVERS_COLLECTION,
+       {"servers.find_by_stream", SERVER_STREAMS_FIELD "_1", server_streams_keys.get(), server_streams_filter.get(),
+        user_reads, nullptr}},
+      {STREAMS_COLLECTION,
+       {"streams.find_catchup_parts", ID_INDEX_NAME, nullptr, parts_filter.get(), user_reads, nullptr}},
+      // TTL index, its filter is the one of the expiry
+      {VIEW_BATCHES_COLLECTION,
+       {"view_batches.expire", VIEW_BATCH_CREATED_DATE_FIELD "_1", view_batches_keys.get(), view_batches_filter.get(),
+        nullptr, view_batches_options.get()}}};
+
+  const QueryShapeChecker checker(indexes_mode_);
+  std::vector<base::QueryPlanStats> plans;
+  bool served = true;
+  for (const auto& shape : shapes) {
+    const base::QueryPlanStats stats = checker.Check(db->GetCollection(shape.collection), shape.shape);
+    plans.push_back(stats);
+    if (stats.plan.empty()) {
+      // the database is likely unreachable, each further check would wait for the server selection timeout
+      WARNING_LOG() << "Database lookups after " << stats.operation << " not checked";
+      break;
+    }
 
-  if (subscribers_) {
-    mongoc_collection_destroy(subscribers_);
-    subscribers_ = nullptr;
+    INFO_LOG() << "Database operation " << stats.operation << " index: " << stats.index << " (" << stats.index_state
+               << "), query plan: " << stats.plan;
+    if (QueryShapeChecker::IsUnserved(stats)) {
+      served = false;
+    }
   }
 
-  if (series_) {
-    mongoc_collection_destroy(series_);
-    series_ = nullptr;
-  }
+  query_plans_ = plans;
+  return served || indexes_mode_ != QueryShapeChecker::REQUIRE;
+}
+
+base::WarmUpStats SubscribersManager::WarmUp(size_t connections, uint32_t budget_msec) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto deadline = start + std::chrono::milliseconds(budget_msec);
+  base::WarmUpStats stats;
 
-  if (requests_) {
-    mongoc_collection_destroy(requests_);
-    requests_ = nullptr;
+  // caches take entries only while their change streams are healthy, which they report after the first wait
+  const auto enable_deadline = std::min(deadline, start + std::chrono::milliseconds(warm_up_enable_wait_msec));
+  while ((!auth_cache_->IsEnabled() || !streams_cache_->IsEnabled()) && !warm_up_cancelled_ &&
+         std::chrono::steady_clock::now() < enable_deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(warm_up_poll_msec));
   }
 
-  if (client_) {
-    mongoc_client_destroy(client_);
-    client_ = nullptr;
+  const bool auth_enabled = auth_cache_->IsEnabled();
+  const bool streams_enabled = streams_cache_->IsEnabled();
+  if (!auth_enabled && !streams_enabled) {
+    WARNING_LOG() << "Warm-up skipped, caches are disabled";
+    return stats;
   }
 
-  return common::ErrnoError();
-}
+  std::vector<WarmUpTask> tasks;
+  {
+    ClientPool::client_t db;
+    common::Error err = PopClient(&db);
+    if (err) {
+      WARNING_LOG() << "Warm-up skipped: " << err->GetDescription();
+      return stats;
+    }
 
-common::Error SubscribersManager::RegisterInnerConnectionByHost(base::SubscriberInfo* client,
-                                                                const base::ServerDBAuthInfo& info) {
-  CHECK(info.IsValid());
-  if (!client) {
-    DNOTREACHED();
-    return common::make_error_inval();
-  }
+    if (auth_enabled) {
+      for (const IdRange& range : SplitByCreationTime(db->GetCollection(SUBSCRIBERS_COLLECTION),
+                                                      read_prefs_->Get(ReadPreferences::USER_READS), connections)) {
+        unique_ptr_bson_t query(MakeIdRangeQuery(range));
+        BSON_APPEND_INT32(query.get(), USER_STATUS_FIELD, USER_ACTIVE);
+        tasks.push_back({SUBSCRIBERS_COLLECTION, std::move(query)});
+      }
+    }
+    if (streams_enabled) {
+      for (const IdRange& range : SplitByCreationTime(db->GetCollection(STREAMS_COLLECTION),
+                                                      read_prefs_->Get(ReadPreferences::CATALOG_READS), connections)) {
+        tasks.push_back({STREAMS_COLLECTION, unique_ptr_bson_t(MakeIdRangeQuery(range))});
+      }
+    }
+    tasks.push_back({SERIES_COLLECTION, unique_ptr_bson_t(bson_new())});
+  }
+
+  std::mutex stats_mutex;
+  std::atomic<size_t> next_task(0);
+  std::atomic<size_t> done_tasks(0);
+  std::atomic<bool> stopped(false);
+  std::vector<std::thread> workers;
+  const size_t workers_count = std::max<size_t>(1, std::min(connections, tasks.size()));
+  for (size_t i = 0; i < workers_count; ++i) {
+    workers.emplace_back([&]() {
+      ClientPool::client_t db;
+      common::Error err = PopClient(&db);
+      if (err) {
+        WARNING_LOG() << "Warm-up connection failed: " << err->GetDescription();
+        return;
+      }
 
-  client->SetLogin(info);
-  std::unique_lock<std::mutex> lock(connections_mutex_);
-  connections_[info.GetUserID()].push_back(client);
-  return base_class::RegisterInnerConnectionByHost(client, info);
-}
+      base::WarmUpStats local;
+      for (size_t task = next_task++; task < tasks.size() && !stopped; task = next_task++) {
+        if (!WarmUpCollection(db.get(), tasks[task].collection, tasks[task].query.get(), deadline, &local)) {
+          stopped = true;
+          break;
+        }
+        done_tasks++;
+      }
 
-common::Error SubscribersManager::UnRegisterInnerConnectionByHost(base::SubscriberInfo* client) {
-  if (!client) {
-    DNOTREACHED();
-    return common::make_error_inval();
+      std::unique_lock<std::mutex> lock(stats_mutex);
+      stats.subscribers += local.subscribers;
+      stats.devices += local.devices;
+      stats.streams += local.streams;
+      stats.series += local.series;
+      stats.bytes += local.bytes;
+    });
   }
 
-  const auto sinf = client->GetLogin();
-  if (!sinf) {
-    return common::make_error_inval();
+  for (auto& worker : workers) {
+    worker.join();
   }
 
-  std::unique_lock<std::mutex> lock(connections_mutex_);
-  auto hs = connections_.find(sinf->GetUserID());
-  if (hs == connections_.end()) {
-    return base_class::UnRegisterInnerConnectionByHost(client);
-  }
+  stats.complete = done_tasks == tasks.size();
+  stats.duration_msec =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  INFO_LOG() << "Warm-up " << (stats.complete ? "finished" : "stopped") << " in " << stats.duration_msec
+             << " msec with " << workers_count << " connection(s): " << stats.subscribers << " subscribers, "
+             << stats.devices << " devices, " << stats.streams << " streams, " << stats.series << " series, "
+             << stats.bytes << " bytes";
+  return stats;
+}
 
-  for (auto it = hs->second.begin(); it != hs->second.end(); ++it) {
-    if (*it == client) {
-      hs->second.erase(it);
-      break;
+void SubscribersManager::CancelWarmUp() {
+  warm_up_cancelled_ = true;
+}
+
+bool SubscribersManager::WarmUpCollection(ClientPool::Client* db,
+                                          const char* collection,
+                                          const bson_t* query,
+                                          std::chrono::steady_clock::time_point deadline,
+                                          base::WarmUpStats* stats) {
+  const bool is_subscribers = strcmp(collection, SUBSCRIBERS_COLLECTION) == 0;
+  const bool is_streams = strcmp(collection, STREAMS_COLLECTION) == 0;
+  const char* operation = is_subscribers ? "warm_up.subscribers" : is_streams ? "warm_up.streams" : "warm_up.series";
+  const ReadPreferences::ReadClass rclass =
+      is_subscribers ? ReadPreferences::USER_READS : ReadPreferences::CATALOG_READS;
+  const base::AuthCache::generation_t auth_generation = auth_cache_->GetGeneration();
+  const StreamsCache::generation_t streams_generation = streams_cache_->GetGeneration();
+  const fastotv::timestamp_t now = common::time::current_utc_mstime();
+
+  const unique_ptr_bson_t fields(is_subscribers ? MakeAuthProjection() : nullptr);
+  TrackedCursor cursor(operation, db->GetCollection(collection), query, fields.get(), read_prefs_->Get(rclass));
+  const bson_t* doc;
+  while (cursor.Next(&doc)) {
+    stats->bytes += doc->len;
+    if (is_subscribers) {
+      std::vector<base::ServerDBAuthInfo> logins;
+      GetActiveLogins(doc, now, &logins);
+      for (const auto& login : logins) {
+        auth_cache_->Insert(login.GetUserID(), login.GetPassword(), login.GetDeviceID(), login, auth_generation);
+      }
+      stats->subscribers++;
+      stats->devices += logins.size();
+    } else if (is_streams) {
+      fastotv::StreamType st;
+      if (GetStreamTypeFromDocument(doc, stream_classes_, &st)) {
+        streams_cache_->Insert(doc, st, streams_generation);
+      }
+      stats->streams++;
+    } else {
+      // series have no cache, reading them loads their pages into the database server memory
+      stats->series++;
+    }
+
+    if (warm_up_cancelled_ || std::chrono::steady_clock::now() >= deadline) {
+      return false;
     }
   }
 
-  if (hs->second.empty()) {
-    connections_.erase(hs);
+  bson_error_t error;
+  if (cursor.GetError(&error)) {
+    WARNING_LOG() << "Warm-up of " << collection << " failed: " << error.message;
   }
-  return base_class::UnRegisterInnerConnectionByHost(client);
+  return true;
 }
 
-common::Error SubscribersManager::CheckIsLoginClient(base::SubscriberInfo* client, base::ServerDBAuthInfo* ser) const {
-  if (!client || !ser) {
-    return common::make_error_inval();
+bool SubscribersManager::HandleSubscribersChange(const bson_t* event) {
+  bson_iter_t btype;
+  if (!bson_iter_init_find(&btype, event, CHANGE_EVENT_OPERATION_TYPE_FIELD) || !BSON_ITER_HOLDS_UTF8(&btype)) {
+    ResetSubscribersState();
+    return true;
   }
 
-  const auto login = client->GetLogin();
-  if (!login) {
-    return common::make_error("User not logged");
+  const char* type = bson_iter_utf8(&btype, NULL);
+  if (strcmp(type, "insert") == 0) {
+    return true;
   }
 
-  *ser = *login;
-  return common::Error();
-}
+  if (strcmp(type, "update") == 0 || strcmp(type, "replace") == 0 || strcmp(type, "delete") == 0) {
+    bson_iter_t iter;
+    bson_iter_t bid;
+    if (!bson_iter_init(&iter, event) ||
+        !bson_iter_find_descendant(&iter, CHANGE_EVENT_DOCUMENT_KEY_FIELD "._id", &bid) ||
+        !BSON_ITER_HOLDS_OID(&bid)) {
+      ResetSubscribersState();
+      return true;
+    }
 
-size_t SubscribersManager::GetAndUpdateOnlineUserByStreamID(fastotv::stream_id_t sid) {
-  std::unique_lock<std::mutex> lock(connections_mutex_);
-  size_t total = 0;
-  for (auto clients : connections_) {
-    for (const auto* client : clients.second) {
-      if (client && client->GetCurrentStreamID() == sid) {
-        total++;
+    bool auth_changed = true;
+    bool streams_changed = true;
+    std::vector<std::string> fields;
+    if (strcmp(type, "update") == 0 && GetChangedFields(event, &fields)) {
+      auth_changed = false;
+      streams_changed = false;
+      for (const std::string& field : fields) {
+        const std::string top = field.substr(0, field.find('.'));
+        if (top == USER_EMAIL_FIELD || top == USER_EXP_DATE_FIELD || top == USER_STATUS_FIELD ||
+            top == USER_PASSWORD_FIELD || top == USER_DEVICES_FIELD) {
+          auth_changed = true;
+        } else if (top == USER_STREAMS_FIELD || top == USER_VODS_FIELD || top == USER_CATCHUPS_FIELD) {
+          // recent/favorite/interruption_time writes of this service already bumped the version when buffered
+          const std::string leaf = field.substr(field.rfind('.') + 1);
+          const bool is_leaf_user_field =
+              leaf == FAVORITE_FIELD || leaf == RECENT_FIELD || leaf == INTERRUPTION_TIME_FIELD;
+          const bool is_user_field = std::count(field.begin(), field.end(), '.') == 2 && is_leaf_user_field;
+          streams_changed |= !is_user_field;
+        }
       }
     }
+
+    const fastotv::user_id_t uid = common::ConvertToString(bson_iter_oid(&bid));
+    if (auth_changed) {
+      auth_cache_->RemoveUser(uid);
+    }
+    if (auth_changed || streams_changed) {
+      BumpChannelsVersion(uid);
+    }
+    return true;
   }
 
-  return total;
+  // drop, rename, dropDatabase, invalidate: stream is closed by the server
+  ResetSubscribersState();
+  return false;
 }
 
-common::Error SubscribersManager::ClientActivate(const fastotv::commands_info::LoginInfo& uauth,
-                                                 fastotv::commands_info::DevicesInfo* dev) {
-  if (!uauth.IsValid() || !dev) {
-    return common::make_error_inval();
-  }
+void SubscribersManager::SetSubscribersWatchHealthy(bool healthy) {
+  auth_cache_->SetEnabled(healthy);
+  std::unique_lock<std::mutex> lock(channels_versions_mutex_);
+  subscribers_watch_healthy_ = healthy;
+  subscribers_generation_++;
+}
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
-  }
+void SubscribersManager::ResetSubscribersState() {
+  auth_cache_->Clear();
+  std::unique_lock<std::mutex> lock(channels_versions_mutex_);
+  subscribers_generation_++;
+}
 
-  const std::string login = uauth.GetLogin();
-  const unique_ptr_bson_t query(bson_new());
-  BSON_APPEND_UTF8(query.get(), "email", login.c_str());
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> cursor(
-      mongoc_collection_find(subscribers_, MONGOC_QUERY_NONE, 0, 0, 0, query.get(), NULL, NULL));
-  const bson_t* doc;
-  if (!cursor || !mongoc_cursor_next(cursor.get(), &doc)) {
-    return common::make_error("User not found");
+bool SubscribersManager::GetChannelsVersion(const fastotv::user_id_t& uid, base::ChannelsVersion* version) const {
+  if (!version) {
+    return false;
   }
 
-  bson_iter_t bstatus;
-  if (!bson_iter_init_find(&bstatus, doc, "status") || !BSON_ITER_HOLDS_INT32(&bstatus)) {
-    return common::make_error("Not found status field");
+  base::ChannelsVersion lversion;
+  if (!streams_cache_->GetContentGeneration(&lversion.catalog)) {
+    return false;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(channels_versions_mutex_);
+    if (!subscribers_watch_healthy_) {
+      return false;
+    }
+
+    lversion.subscribers = subscribers_generation_;
+    const auto it = channels_versions_.find(uid);
+    if (it != channels_versions_.end()) {
+      lversion.user = it->second;
+    }
+  }
+
+  *version = lversion;
+  return true;
+}
+
+void SubscribersManager::BumpChannelsVersion(const fastotv::user_id_t& uid) {
+  BumpChannelsVersion(uid, entitlements_update_t());
+}
+
+void SubscribersManager::BumpChannelsVersion(const fastotv::user_id_t& uid, entitlements_update_t update) {
+  std::unique_lock<std::mutex> lock(channels_versions_mutex_);
+  uint64_t& version = channels_versions_[uid];
+  const uint64_t previous = version;
+  version = ++channels_versions_seq_;
+
+  const auto it = entitlements_.find(uid);
+  if (it == entitlements_.end()) {
+    return;
+  }
+
+  // index missed a change of the user, it is loaded again on the next lookup
+  if (!update || it->second.version != previous || it->second.generation != subscribers_generation_) {
+    entitlements_.erase(it);
+    return;
+  }
+
+  update(&it->second.entitlements);
+  it->second.version = version;
+}
+
+common::Error SubscribersManager::FindUserStream(ClientPool::Client* db,
+                                                 const fastotv::user_id_t& uid,
+                                                 const bson_oid_t& sid,
+                                                 const std::vector<UserEntitlements::array_t>& arrays,
+                                                 UserEntitlements::Entry* entry) const {
+  uint64_t versions_seq = 0;
+  uint64_t generation = 0;
+  bool trusted = false;
+  {
+    std::unique_lock<std::mutex> lock(channels_versions_mutex_);
+    trusted = subscribers_watch_healthy_;
+    const auto it = entitlements_.find(uid);
+    if (trusted && it != entitlements_.end()) {
+      const auto version = channels_versions_.find(uid);
+      const uint64_t current = version == channels_versions_.end() ? 0 : version->second;
+      if (it->second.version == current && it->second.generation == subscribers_generation_) {
+        return FindInEntitlements(it->second.entitlements, sid, arrays, entry);
+      }
+    }
+    versions_seq = channels_versions_seq_;
+    generation = subscribers_generation_;
+  }
+
+  if (!trusted) {
+    // changes of users can't be followed, only the requested entries are read
+    UserEntitlements entitlements;
+    common::Error err = LoadUserEntitlements(db, uid, &sid, &entitlements);
+    if (err) {
+      return err;
+    }
+    return FindInEntitlements(entitlements, sid, arrays, entry);
+  }
+
+  UserEntitlements entitlements;
+  common::Error err = LoadUserEntitlements(db, uid, nullptr, &entitlements);
+  if (err) {
+    return err;
+  }
+
+  err = FindInEntitlements(entitlements, sid, arrays, entry);
+  StoreUserEntitlements(uid, versions_seq, generation, std::move(entitlements));
+  return err;
+}
+
+common::Error SubscribersManager::LoadUserEntitlements(ClientPool::Client* db,
+                                                       const fastotv::user_id_t& uid,
+                                                       const bson_oid_t* sid,
+                                                       UserEntitlements* entitlements) const {
+  bson_oid_t oid;
+  if (!common::ConvertFromString(uid, &oid)) {
+    return common::make_error("Invalid user id");
+  }
+
+  const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid)));
+  const unique_ptr_bson_t fields(sid ? MakeUserStreamsProjection(sid) : MakeUserEntitlementsProjection());
+  document_t user;
+  common::Error err = FindDocument(db, "subscribers.find_entitlements", SUBSCRIBERS_COLLECTION, query.get(),
+                                   fields.get(), ReadPreferences::USER_READS, &user);
+  if (err) {
+    return err;
+  }
+
+  if (!user) {
+    return common::make_error("User not found");
+  }
+
+  const bson_t* doc = user.get();
+
+  user_streams_t user_streams;
+  GetUserStreamsFromArray(doc, USER_STREAMS_FIELD, &user_streams);
+  user_streams_t user_vods;
+  GetUserStreamsFromArray(doc, USER_VODS_FIELD, &user_vods);
+  user_streams_t user_catchups;
+  GetUserStreamsFromArray(doc, USER_CATCHUPS_FIELD, &user_catchups);
+
+  std::vector<UserEntitlements::Entry> entries;
+  entries.reserve(user_streams.size() + user_vods.size() + user_catchups.size());
+  AppendEntitlements(user_streams, base::UserStreamsWriteBuffer::USER_STREAMS, &entries);
+  AppendEntitlements(user_vods, base::UserStreamsWriteBuffer::USER_VODS, &entries);
+  AppendEntitlements(user_catchups, base::UserStreamsWriteBuffer::USER_CATCHUPS, &entries);
+  entitlements->Assign(std::move(entries));
+  return common::Error();
+}
+
+void SubscribersManager::StoreUserEntitlements(const fastotv::user_id_t& uid,
+                                               uint64_t versions_seq,
+                                               uint64_t generation,
+                                               UserEntitlements entitlements) const {
+  std::unique_lock<std::mutex> lock(channels_versions_mutex_);
+  if (!subscribers_watch_healthy_ || subscribers_generation_ != generation) {
+    return;
+  }
+
+  const auto version = channels_versions_.find(uid);
+  const uint64_t current = version == channels_versions_.end() ? 0 : version->second;
+  if (current > versions_seq) {
+    return;
+  }
+
+  EntitlementsEntry& entry = entitlements_[uid];
+  entry.version = current;
+  entry.generation = generation;
+  entry.entitlements = std::move(entitlements);
+}
+
+void SubscribersManager::GetEntitlementsStamp(uint64_t* versions_seq, uint64_t* generation) const {
+  std::unique_lock<std::mutex> lock(channels_versions_mutex_);
+  *versions_seq = channels_versions_seq_;
+  *generation = subscribers_generation_;
+}
+
+common::Error SubscribersManager::PopClient(ClientPool::client_t* client) const {
+  if (!pool_) {
+    return common::make_error("Not conencted to DB");
+  }
+
+  return pool_->Pop(client);
+}
+
+common::Error SubscribersManager::FindDocument(ClientPool::Client* db,
+                                               const char* operation,
+                                               const char* collection,
+                                               const bson_t* query,
+                                               const bson_t* fields,
+                                               ReadPreferences::ReadClass rclass,
+                                               document_t* doc) const {
+  TrackedCursor cursor(operation, db->GetCollection(collection), query, fields, read_prefs_->Get(rclass));
+  const bson_t* found;
+  if (!cursor.Next(&found)) {
+    bson_error_t error;
+    if (cursor.GetError(&error)) {
+      return common::make_error(error.message);
+    }
+    return common::Error();
+  }
+
+  *doc = document_t(bson_copy(found));
+  return common::Error();
+}
+
+common::Error SubscribersManager::FindDocumentsByIDs(ClientPool::Client* db,
+                                                     const char* operation,
+                                                     const char* collection,
+                                                     ReadPreferences::ReadClass rclass,
+                                                     const std::vector<bson_oid_t>& oids,
+                                                     documents_by_id_t* docs,
+                                                     size_t* skipped_batches) const {
+  mongoc_collection_t* mcollection = db->GetCollection(collection);
+  const mongoc_read_prefs_t* read_prefs = read_prefs_->Get(rclass);
+  const size_t lskipped = ForEachIDsBatch(oids.size(), FIND_BY_IDS_BATCH_SIZE, [&](size_t offset, size_t end) {
+    char buf[16];
+    const unique_ptr_bson_t query(bson_new());
+    bson_t in_doc;
+    bson_t ids;
+    BSON_APPEND_DOCUMENT_BEGIN(query.get(), "_id", &in_doc);
+    BSON_APPEND_ARRAY_BEGIN(&in_doc, "$in", &ids);
+    for (size_t i = offset; i < end; ++i) {
+      const char* key;
+      size_t keylen = bson_uint32_to_string(i - offset, &key, buf, sizeof(buf));
+      bson_append_oid(&ids, key, keylen, &oids[i]);
+    }
+    bson_append_array_end(&in_doc, &ids);
+    bson_append_document_end(query.get(), &in_doc);
+
+    TrackedCursor cursor(operation, mcollection, query.get(), nullptr, read_prefs);
+
+    const bson_t* doc;
+    while (cursor.Next(&doc)) {
+      bson_iter_t bid;
+      if (bson_iter_init_find(&bid, doc, "_id") && BSON_ITER_HOLDS_OID(&bid)) {
+        (*docs)[*bson_iter_oid(&bid)] = unique_ptr_bson_t(bson_copy(doc));
+      }
+    }
+
+    bson_error_t error;
+    if (cursor.GetError(&error)) {
+      WARNING_LOG() << "Skipped " << end - offset << " ids of " << operation << ": " << error.message;
+      return false;
+    }
+    return true;
+  });
+
+  *skipped_batches += lskipped;
+  return common::Error();
+}
+
+void SubscribersManager::OnUserWritten(const fastotv::user_id_t& uid) {
+  UNUSED(uid);
+}
+
+void SubscribersManager::InvalidateStream(const bson_oid_t& sid) {
+  streams_cache_->Remove(sid, true);
+}
+
+common::Error SubscribersManager::FindUserArray(const base::ServerDBAuthInfo& auth,
+                                                fastotv::stream_id_t sid,
+                                                base::UserStreamsWriteBuffer::UserArray* array) const {
+  bson_oid_t bsid;
+  if (!common::ConvertFromString(sid, &bsid)) {
+    return common::make_error("Invalid stream id");
+  }
+
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
+  }
+
+  UserEntitlements::Entry user_stream;
+  err = FindUserStream(db.get(), auth.GetUserID(), bsid, kAllUserArrays, &user_stream);
+  if (err) {
+    return err;
+  }
+
+  *array = user_stream.array;
+  return common::Error();
+}
+
+bool SubscribersManager::FlushUserStreams(const base::UserStreamsWriteBuffer::updates_t& updates) {
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+    return false;
+  }
+
+  mongoc_collection_t* subscribers = db->GetCollection(SUBSCRIBERS_COLLECTION);
+
+  const std::unique_ptr<mongoc_bulk_operation_t, MongoBulkDeleter> user_bulk(
+      mongoc_collection_create_bulk_operation(subscribers, false, NULL));
+  size_t user_ops = 0;
+  for (const auto& update : updates) {
+    bson_oid_t oid;
+    bson_oid_t sid;
+    if (!common::ConvertFromString(update.uid, &oid) || !common::ConvertFromString(update.sid, &sid)) {
+      continue;
+    }
+
+    // update({"_id": uid, "streams.sid": sid}, {"$set": {"streams.$.recent": ..., ...}})
+    const std::string array = GetUserArrayField(update.array);
+    const std::string sid_field = array + "." USER_STREAM_ID_FIELD;
+    const unique_ptr_bson_t query(bson_new());
+    BSON_APPEND_OID(query.get(), "_id", &oid);
+    BSON_APPEND_OID(query.get(), sid_field.c_str(), &sid);
+
+    const unique_ptr_bson_t update_query(bson_new());
+    bson_t set;
+    BSON_APPEND_DOCUMENT_BEGIN(update_query.get(), "$set", &set);
+    if (update.fields & base::UserStreamsWriteBuffer::FAVORITE_FIELD) {
+      const std::string field = array + ".$." FAVORITE_FIELD;
+      BSON_APPEND_BOOL(&set, field.c_str(), update.favorite);
+    }
+    if (update.fields & base::UserStreamsWriteBuffer::RECENT_FIELD) {
+      const std::string field = array + ".$." RECENT_FIELD;
+      BSON_APPEND_DATE_TIME(&set, field.c_str(), update.recent);
+    }
+    if (update.fields & base::UserStreamsWriteBuffer::INTERRUPTION_TIME_FIELD) {
+      const std::string field = array + ".$." INTERRUPTION_TIME_FIELD;
+      BSON_APPEND_INT32(&set, field.c_str(), update.interruption_time);
+    }
+    bson_append_document_end(update_query.get(), &set);
+
+    mongoc_bulk_operation_update_one(user_bulk.get(), query.get(), update_query.get(), false);
+    user_ops++;
+  }
+
+  bson_error_t error;
+  if (user_ops && !TrackedBulkExecute("subscribers.flush_user_streams", user_bulk.get(), &error)) {
+    WARNING_LOG() << "Failed to flush user streams error: " << error.message;
+    return false;
+  }
+  return true;
+}
+
+bool SubscribersManager::FlushViewCounts(const std::string& batch_id, const base::ViewCounters::deltas_t& deltas) {
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+    return false;
+  }
+
+  std::vector<std::pair<bson_oid_t, int32_t>> increments;
+  for (const auto& delta : deltas) {
+    bson_oid_t sid;
+    if (common::ConvertFromString(delta.first, &sid)) {
+      increments.push_back(std::make_pair(sid, static_cast<int32_t>(delta.second)));
+    }
+  }
+  if (increments.empty()) {
+    return true;
+  }
+
+  // the batch is recorded per stream in its own collection, the stream gets the $inc only if the record is new,
+  // so a retried or replayed batch counts once; both in one transaction, on a standalone server an $inc failing
+  // after its record was written is lost rather than counted twice
+  const int64_t now = common::time::current_utc_mstime();
+  err = RunTransaction(db.get(), [&](mongoc_client_session_t* session, bson_t** reply, bson_error_t* error) {
+    const unique_ptr_bson_t opts(BCON_NEW("ordered", BCON_BOOL(false)));
+    if (session && !mongoc_client_session_append(session, opts.get(), error)) {
+      return false;
+    }
+
+    const std::unique_ptr<mongoc_bulk_operation_t, MongoBulkDeleter> records(
+        mongoc_collection_create_bulk_operation_with_opts(db->GetCollection(VIEW_BATCHES_COLLECTION), opts.get()));
+    for (const auto& increment : increments) {
+      const unique_ptr_bson_t query(BCON_NEW("_id", "{", VIEW_BATCH_ID_FIELD, BCON_UTF8(batch_id.c_str()),
+                                             VIEW_BATCH_STREAM_FIELD, BCON_OID(&increment.first), "}"));
+      const unique_ptr_bson_t update(
+          BCON_NEW("$setOnInsert", "{", VIEW_BATCH_CREATED_DATE_FIELD, BCON_DATE_TIME(now), "}"));
+      mongoc_bulk_operation_update_one(records.get(), query.get(), update.get(), true);
+    }
+
+    bson_t* records_reply = bson_new();
+    if (!TrackedBulkExecute("view_batches.record", records.get(), error, records_reply)) {
+      *reply = records_reply;
+      return false;
+    }
+    const std::vector<size_t> added = GetUpsertedIndexes(records_reply);
+    bson_destroy(records_reply);
+    if (added.empty()) {  // every stream got the batch already
+      return true;
+    }
+
+    const std::unique_ptr<mongoc_bulk_operation_t, MongoBulkDeleter> streams(
+        mongoc_collection_create_bulk_operation_with_opts(db->GetCollection(STREAMS_COLLECTION), opts.get()));
+    for (size_t index : added) {
+      if (index >= increments.size()) {
+        continue;
+      }
+      const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&increments[index].first)));
+      const unique_ptr_bson_t inc_query(
+          BCON_NEW("$inc", "{", STREAM_VIEW_COUNT_FIELD, BCON_INT32(increments[index].second), "}"));
+      mongoc_bulk_operation_update_one(streams.get(), query.get(), inc_query.get(), false);
+    }
+
+    bson_t* streams_reply = bson_new();
+    if (!TrackedBulkExecute("streams.flush_view_counts", streams.get(), error, streams_reply)) {
+      *reply = streams_reply;
+      return false;
+    }
+    bson_destroy(streams_reply);
+    return true;
+  });
+  if (err) {
+    DEBUG_LOG() << "Can't increment view count: " << err->GetDescription();
+    return false;
+  }
+  return true;
+}
+
+common::Error SubscribersManager::RegisterInnerConnectionByHost(base::SubscriberInfo* client,
+                                                                const base::ServerDBAuthInfo& info) {
+  CHECK(info.IsValid());
+  if (!client) {
+    DNOTREACHED();
+    return common::make_error_inval();
+  }
+
+  {
+    // logins of one device run concurrently on the workers, only one of them gets the device
+    std::unique_lock<std::mutex> lock(connections_mutex_);
+    std::vector<base::SubscriberInfo*>& user_connections = connections_[info.GetUserID()];
+    bool registered = false;
+    for (auto connection : user_connections) {
+      if (connection == client) {
+        registered = true;
+        continue;
+      }
+
+      const auto login = connection->GetLogin();
+      if (login && login->GetDeviceID() == info.GetDeviceID()) {
+        return common::make_error("Limit connection reject");
+      }
+    }
+
+    client->SetLogin(info);
+    if (!registered) {
+      user_connections.push_back(client);
+    }
+  }
+  return base_class::RegisterInnerConnectionByHost(client, info);
+}
+
+common::Error SubscribersManager::UnRegisterInnerConnectionByHost(base::SubscriberInfo* client) {
+  if (!client) {
+    DNOTREACHED();
+    return common::make_error_inval();
+  }
+
+  const auto sinf = client->GetLogin();
+  if (!sinf) {
+    return common::make_error_inval();
+  }
+
+  std::unique_lock<std::mutex> lock(connections_mutex_);
+  auto hs = connections_.find(sinf->GetUserID());
+  if (hs == connections_.end()) {
+    return base_class::UnRegisterInnerConnectionByHost(client);
+  }
+
+  for (auto it = hs->second.begin(); it != hs->second.end(); ++it) {
+    if (*it == client) {
+      hs->second.erase(it);
+      break;
+    }
+  }
+
+  if (hs->second.empty()) {
+    connections_.erase(hs);
+    std::unique_lock<std::mutex> versions_lock(channels_versions_mutex_);
+    entitlements_.erase(sinf->GetUserID());
+  }
+  return base_class::UnRegisterInnerConnectionByHost(client);
+}
+
+common::Error SubscribersManager::CheckIsLoginClient(base::SubscriberInfo* client, base::ServerDBAuthInfo* ser) const {
+  if (!client || !ser) {
+    return common::make_error_inval();
+  }
+
+  const auto login = client->GetLogin();
+  if (!login) {
+    return common::make_error("User not logged");
+  }
+
+  *ser = *login;
+  return common::Error();
+}
+
+size_t SubscribersManager::GetAndUpdateOnlineUserByStreamID(fastotv::stream_id_t sid) {
+  std::unique_lock<std::mutex> lock(connections_mutex_);
+  size_t total = 0;
+  for (auto clients : connections_) {
+    for (const auto* client : clients.second) {
+      if (client && client->GetCurrentStreamID() == sid) {
+        total++;
+      }
+    }
+  }
+
+  return total;
+}
+
+common::Error SubscribersManager::ClientActivate(const fastotv::commands_info::LoginInfo& uauth,
+                                                 const std::string& peer_host,
+                                                 fastotv::commands_info::DevicesInfo* dev) {
+  if (!uauth.IsValid() || !dev) {
+    return common::make_error_inval();
+  }
+
+  const std::string login = uauth.GetLogin();
+  const std::string password = uauth.GetPassword();
+  const base::LoginGuard::Identity identity = base::LoginGuard::MakeIdentity(peer_host, login, std::string());
+  common::Error err = login_guard_->Check(identity, password);
+  if (err) {
+    return err;
+  }
+
+  ClientPool::client_t db;
+  err = PopClient(&db);
+  if (err) {
+    return err;
+  }
+
+  const unique_ptr_bson_t query(bson_new());
+  BSON_APPEND_UTF8(query.get(), "email", login.c_str());
+  const unique_ptr_bson_t fields(MakeAuthProjection());
+  document_t user;
+  err = FindDocument(db.get(), "subscribers.find_activate", SUBSCRIBERS_COLLECTION, query.get(), fields.get(),
+                     ReadPreferences::USER_READS, &user);
+  if (err) {
+    return err;
+  }
+
+  if (!user) {
+    return login_guard_->Reject(identity, password, common::make_error("User not found"));
+  }
+
+  const bson_t* doc = user.get();
+
+  bson_iter_t bstatus;
+  if (!bson_iter_init_find(&bstatus, doc, USER_STATUS_FIELD) || !BSON_ITER_HOLDS_INT32(&bstatus)) {
+    return login_guard_->Reject(identity, password, common::make_error("Not found status field"));
   }
 
   UserStatus status = static_cast<UserStatus>(bson_iter_int32(&bstatus));
   if (status == USER_NOT_ACTIVE) {
-    return common::make_error("User not active");
+    return login_guard_->Reject(identity, password, common::make_error("User not active"));
   }
 
   if (status == USER_DELETED) {
-    return common::make_error("User removed");
+    return login_guard_->Reject(identity, password, common::make_error("User removed"));
   }
 
   bson_iter_t bpassword;
-  if (!bson_iter_init_find(&bpassword, doc, "password") || !BSON_ITER_HOLDS_UTF8(&bpassword)) {
-    return common::make_error("Not found password field");
+  if (!bson_iter_init_find(&bpassword, doc, USER_PASSWORD_FIELD) || !BSON_ITER_HOLDS_UTF8(&bpassword)) {
+    return login_guard_->Reject(identity, password, common::make_error("Not found password field"));
   }
 
   const char* password_hash = bson_iter_utf8(&bpassword, NULL);
-  if (uauth.GetPassword() != password_hash) {
-    return common::make_error("Invalid password");
+  if (password != password_hash) {
+    return login_guard_->Reject(identity, password, common::make_error("Invalid password"));
   }
 
   bson_iter_t bdevices;
-  if (!bson_iter_init_find(&bdevices, doc, "devices") || !BSON_ITER_HOLDS_ARRAY(&bdevices)) {
-    return common::make_error("Please create device in your profile page");
+  if (!bson_iter_init_find(&bdevices, doc, USER_DEVICES_FIELD) || !BSON_ITER_HOLDS_ARRAY(&bdevices)) {
+    return login_guard_->Reject(identity, password,
+                                common::make_error("Please create device in your profile page"));
   }
 
   fastotv::commands_info::DevicesInfo devices;
@@ -659,9 +1763,11 @@ common::Error SubscribersManager::ClientActivate(const fastotv::commands_info::L
   }
 
   if (devices.Empty()) {
-    return common::make_error("Please create device in your profile page");
+    return login_guard_->Reject(identity, password,
+                                common::make_error("Please create device in your profile page"));
   }
 
+  login_guard_->Accept(identity);
   *dev = devices;
   return common::Error();
 }
@@ -669,79 +1775,124 @@ common::Error SubscribersManager::ClientActivate(const fastotv::commands_info::L
 common::Error SubscribersManager::ClientLogin(fastotv::user_id_t uid,
                                               const std::string& password,
                                               fastotv::device_id_t dev,
+                                              const std::string& peer_host,
                                               base::ServerDBAuthInfo* ser) {
   if (uid.empty() || password.empty() || dev.empty()) {
     return common::make_error_inval();
   }
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
+  if (auth_cache_->Find(uid, password, dev, ser)) {
+    return CheckDeviceConnection(uid, dev);
+  }
+
+  const base::LoginGuard::Identity identity = base::LoginGuard::MakeIdentity(peer_host, uid, dev);
+  common::Error err = login_guard_->Check(identity, password);
+  if (err) {
+    return err;
+  }
+
+  const base::AuthCache::generation_t generation = auth_cache_->GetGeneration();
+  ClientPool::client_t db;
+  err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
   bson_oid_t oid;
   if (!common::ConvertFromString(uid, &oid)) {
-    return common::make_error("Invalid user id");
+    return login_guard_->Reject(identity, password, common::make_error("Invalid user id"));
   }
 
   const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid)));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> cursor(
-      mongoc_collection_find(subscribers_, MONGOC_QUERY_NONE, 0, 0, 0, query.get(), NULL, NULL));
-  const bson_t* doc;
-  if (!cursor || !mongoc_cursor_next(cursor.get(), &doc)) {
-    return common::make_error("User not found");
+  const unique_ptr_bson_t fields(MakeAuthProjection());
+  document_t user;
+  err = FindDocument(db.get(), "subscribers.find_login_by_id", SUBSCRIBERS_COLLECTION, query.get(), fields.get(),
+                     ReadPreferences::USER_READS, &user);
+  if (err) {
+    return err;
+  }
+
+  if (!user) {
+    return login_guard_->Reject(identity, password, common::make_error("User not found"));
   }
 
+  const bson_t* doc = user.get();
+
   bson_iter_t blogin;
-  if (!bson_iter_init_find(&blogin, doc, "email") || !BSON_ITER_HOLDS_UTF8(&blogin)) {
-    return common::make_error("Not found email field");
+  if (!bson_iter_init_find(&blogin, doc, USER_EMAIL_FIELD) || !BSON_ITER_HOLDS_UTF8(&blogin)) {
+    return login_guard_->Reject(identity, password, common::make_error("Not found email field"));
   }
 
   bson_iter_t bexp_date;
-  if (!bson_iter_init_find(&bexp_date, doc, "exp_date") || !BSON_ITER_HOLDS_DATE_TIME(&bexp_date)) {
-    return common::make_error("Not exp_date field");
+  if (!bson_iter_init_find(&bexp_date, doc, USER_EXP_DATE_FIELD) || !BSON_ITER_HOLDS_DATE_TIME(&bexp_date)) {
+    return login_guard_->Reject(identity, password, common::make_error("Not exp_date field"));
   }
 
   const fastotv::login_t login = bson_iter_utf8(&blogin, NULL);
   const fastotv::timestamp_t exp_date = bson_iter_date_time(&bexp_date);
   fastotv::commands_info::AuthInfo log(fastotv::commands_info::LoginInfo(login, password), dev);
   fastotv::commands_info::ServerAuthInfo uauth(log, exp_date);
-  common::Error err = ClientLoginImpl(uid, uauth, doc);
+  err = ClientLoginImpl(db.get(), uauth, doc);
+  if (err) {
+    return login_guard_->Reject(identity, password, err);
+  }
+
+  login_guard_->Accept(identity);
+  err = CheckDeviceConnection(uid, dev);
   if (err) {
     return err;
   }
 
   *ser = base::ServerDBAuthInfo(uid, uauth);
+  auth_cache_->Insert(uid, password, dev, *ser, generation);
   return common::Error();
 }
 
 common::Error SubscribersManager::ClientLogin(const fastotv::commands_info::AuthInfo& uauth,
+                                              const std::string& peer_host,
                                               base::ServerDBAuthInfo* ser) {
   if (!uauth.IsValid() || !ser) {
     return common::make_error_inval();
   }
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
+  const std::string login = uauth.GetLogin();
+  const std::string password = uauth.GetPassword();
+  const base::LoginGuard::Identity identity = base::LoginGuard::MakeIdentity(peer_host, login, uauth.GetDeviceID());
+  common::Error err = login_guard_->Check(identity, password);
+  if (err) {
+    return err;
+  }
+
+  ClientPool::client_t db;
+  err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
-  const std::string login = uauth.GetLogin();
   const unique_ptr_bson_t query(bson_new());
   BSON_APPEND_UTF8(query.get(), "email", login.c_str());
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> cursor(
-      mongoc_collection_find(subscribers_, MONGOC_QUERY_NONE, 0, 0, 0, query.get(), NULL, NULL));
-  const bson_t* doc;
-  if (!cursor || !mongoc_cursor_next(cursor.get(), &doc)) {
-    return common::make_error("User not found");
+  const unique_ptr_bson_t fields(MakeAuthProjection());
+  document_t user;
+  err = FindDocument(db.get(), "subscribers.find_login", SUBSCRIBERS_COLLECTION, query.get(), fields.get(),
+                     ReadPreferences::USER_READS, &user);
+  if (err) {
+    return err;
+  }
+
+  if (!user) {
+    return login_guard_->Reject(identity, password, common::make_error("User not found"));
   }
 
+  const bson_t* doc = user.get();
+
   bson_iter_t buid;
   if (!bson_iter_init_find(&buid, doc, "_id") || !BSON_ITER_HOLDS_OID(&buid)) {
-    return common::make_error("Not found _id field");
+    return login_guard_->Reject(identity, password, common::make_error("Not found _id field"));
   }
 
   bson_iter_t bexp_date;
-  if (!bson_iter_init_find(&bexp_date, doc, "exp_date") || !BSON_ITER_HOLDS_DATE_TIME(&bexp_date)) {
-    return common::make_error("Not exp_date field");
+  if (!bson_iter_init_find(&bexp_date, doc, USER_EXP_DATE_FIELD) || !BSON_ITER_HOLDS_DATE_TIME(&bexp_date)) {
+    return login_guard_->Reject(identity, password, common::make_error("Not exp_date field"));
   }
 
   const bson_oid_t* uid = bson_iter_oid(&buid);
@@ -749,7 +1900,13 @@ common::Error SubscribersManager::ClientLogin(const fastotv::commands_info::Auth
 
   const fastotv::timestamp_t exp_date = bson_iter_date_time(&bexp_date);
   fastotv::commands_info::ServerAuthInfo suauth(uauth, exp_date);
-  common::Error err = ClientLoginImpl(uid_str, suauth, doc);
+  err = ClientLoginImpl(db.get(), suauth, doc);
+  if (err) {
+    return login_guard_->Reject(identity, password, err);
+  }
+
+  login_guard_->Accept(identity);
+  err = CheckDeviceConnection(uid_str, uauth.GetDeviceID());
   if (err) {
     return err;
   }
@@ -758,11 +1915,13 @@ common::Error SubscribersManager::ClientLogin(const fastotv::commands_info::Auth
   return common::Error();
 }
 
-common::Error SubscribersManager::ClientLoginImpl(fastotv::user_id_t uid,
+common::Error SubscribersManager::ClientLoginImpl(ClientPool::Client* db,
                                                   const fastotv::commands_info::ServerAuthInfo& uauth,
                                                   const bson_t* doc) {
+  mongoc_collection_t* subscribers = db->GetCollection(SUBSCRIBERS_COLLECTION);
+
   bson_iter_t bstatus;
-  if (!bson_iter_init_find(&bstatus, doc, "status") || !BSON_ITER_HOLDS_INT32(&bstatus)) {
+  if (!bson_iter_init_find(&bstatus, doc, USER_STATUS_FIELD) || !BSON_ITER_HOLDS_INT32(&bstatus)) {
     return common::make_error("Not found status field");
   }
 
@@ -776,7 +1935,7 @@ common::Error SubscribersManager::ClientLoginImpl(fastotv::user_id_t uid,
   }
 
   bson_iter_t bpassword;
-  if (!bson_iter_init_find(&bpassword, doc, "password") || !BSON_ITER_HOLDS_UTF8(&bpassword)) {
+  if (!bson_iter_init_find(&bpassword, doc, USER_PASSWORD_FIELD) || !BSON_ITER_HOLDS_UTF8(&bpassword)) {
     return common::make_error("Not found password field");
   }
 
@@ -791,7 +1950,7 @@ common::Error SubscribersManager::ClientLoginImpl(fastotv::user_id_t uid,
   }
 
   bson_iter_t bdevices;
-  if (!bson_iter_init_find(&bdevices, doc, "devices") || !BSON_ITER_HOLDS_ARRAY(&bdevices)) {
+  if (!bson_iter_init_find(&bdevices, doc, USER_DEVICES_FIELD) || !BSON_ITER_HOLDS_ARRAY(&bdevices)) {
     return common::make_error("Please create device in your profile page");
   }
 
@@ -815,19 +1974,6 @@ common::Error SubscribersManager::ClientLoginImpl(fastotv::user_id_t uid,
               return common::make_error("Device banned");
             }
 
-            {
-              std::unique_lock<std::mutex> lock(connections_mutex_);
-              const auto hs = connections_.find(uid);
-              if (hs != connections_.end()) {
-                for (auto connection : hs->second) {
-                  const auto login = connection->GetLogin();
-                  if (login && login->GetDeviceID() == uauth.GetDeviceID()) {
-                    return common::make_error("Limit connection reject");
-                  }
-                }
-              }
-            }
-
             if (device_status == DEVICE_NOT_ACTIVE) {
               const unique_ptr_bson_t uquery(BCON_NEW("email", login.c_str(), "devices._id", BCON_OID(oid)));
               const unique_ptr_bson_t update_query(
@@ -835,8 +1981,8 @@ common::Error SubscribersManager::ClientLoginImpl(fastotv::user_id_t uid,
               // update({"email":"test@gmail.com", "devices._id": ObjectId("5d9c57ae9303fc2a7b2ad571")}, {"$set": {
               // "devices.$.status": NumberInt(1) }})
               bson_error_t error;
-              if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, uquery.get(), update_query.get(), NULL,
-                                            &error)) {
+              if (!TrackedUpdate("subscribers.activate_device", subscribers, MONGOC_UPDATE_NONE, uquery.get(),
+                                 update_query.get(), &error)) {
                 DEBUG_LOG() << "Failed to activate device error: " << error.message;
               }
             }
@@ -855,6 +2001,23 @@ common::Error SubscribersManager::ClientLoginImpl(fastotv::user_id_t uid,
   return common::make_error("Device not found");
 }
 
+common::Error SubscribersManager::CheckDeviceConnection(const fastotv::user_id_t& uid,
+                                                        const fastotv::device_id_t& dev) {
+  std::unique_lock<std::mutex> lock(connections_mutex_);
+  const auto hs = connections_.find(uid);
+  if (hs == connections_.end()) {
+    return common::Error();
+  }
+
+  for (auto connection : hs->second) {
+    const auto login = connection->GetLogin();
+    if (login && login->GetDeviceID() == dev) {
+      return common::make_error("Limit connection reject");
+    }
+  }
+  return common::Error();
+}
+
 common::Error SubscribersManager::ClientGetChannels(const fastotv::commands_info::AuthInfo& auth,
                                                     fastotv::commands_info::ChannelsInfo* chans,
                                                     fastotv::commands_info::VodsInfo* vods,
@@ -867,210 +2030,209 @@ common::Error SubscribersManager::ClientGetChannels(const fastotv::commands_info
     return common::make_error_inval();
   }
 
-  if (!subscribers_ || !streams_ || !series_ || !requests_) {
-    return common::make_error("Not conencted to DB");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
+  uint64_t versions_seq;
+  uint64_t entitlements_generation;
+  GetEntitlementsStamp(&versions_seq, &entitlements_generation);
+
   const std::string login = auth.GetLogin();
   const unique_ptr_bson_t query(bson_new());
   BSON_APPEND_UTF8(query.get(), "email", login.c_str());
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> cursor(
-      mongoc_collection_find(subscribers_, MONGOC_QUERY_NONE, 0, 0, 0, query.get(), NULL, NULL));
-  const bson_t* doc;
-  if (!cursor || !mongoc_cursor_next(cursor.get(), &doc)) {
+  document_t user;
+  err = FindDocument(db.get(), "subscribers.find_channels", SUBSCRIBERS_COLLECTION, query.get(), nullptr,
+                     ReadPreferences::USER_READS, &user);
+  if (err) {
+    return err;
+  }
+
+  if (!user) {
     return common::make_error("User not found");
   }
 
-  bson_iter_t bstreams;
+  const bson_t* doc = user.get();
+
+  user_streams_t user_streams;
+  GetUserStreamsFromArray(doc, USER_STREAMS_FIELD, &user_streams);
+  user_streams_t user_vods;
+  GetUserStreamsFromArray(doc, USER_VODS_FIELD, &user_vods);
+  user_streams_t user_catchups;
+  GetUserStreamsFromArray(doc, USER_CATCHUPS_FIELD, &user_catchups);
+
+  // not yet flushed favorite/recent/interruption writes of this user
+  bson_iter_t buid;
+  const bool has_uid = bson_iter_init_find(&buid, doc, "_id") && BSON_ITER_HOLDS_OID(&buid);
+  const fastotv::user_id_t uid = has_uid ? common::ConvertToString(bson_iter_oid(&buid)) : fastotv::user_id_t();
+  base::UserStreamsWriteBuffer::updates_t buffered;
+  if (has_uid && write_buffer_->FindUser(uid, &buffered)) {
+    ApplyBufferedUpdates(buffered, base::UserStreamsWriteBuffer::USER_STREAMS, &user_streams);
+    ApplyBufferedUpdates(buffered, base::UserStreamsWriteBuffer::USER_VODS, &user_vods);
+    ApplyBufferedUpdates(buffered, base::UserStreamsWriteBuffer::USER_CATCHUPS, &user_catchups);
+  }
+
+  // the full arrays were read anyway, entitlement lookups of the session start from them
+  if (has_uid) {
+    std::vector<UserEntitlements::Entry> entries;
+    entries.reserve(user_streams.size() + user_vods.size() + user_catchups.size());
+    AppendEntitlements(user_streams, base::UserStreamsWriteBuffer::USER_STREAMS, &entries);
+    AppendEntitlements(user_vods, base::UserStreamsWriteBuffer::USER_VODS, &entries);
+    AppendEntitlements(user_catchups, base::UserStreamsWriteBuffer::USER_CATCHUPS, &entries);
+    UserEntitlements entitlements;
+    entitlements.Assign(std::move(entries));
+    StoreUserEntitlements(uid, versions_seq, entitlements_generation, std::move(entitlements));
+  }
+
+  // view counter increments not yet written to the streams collection
+  for (user_streams_t* entries : {&user_streams, &user_vods, &user_catchups}) {
+    for (auto& entry : *entries) {
+      entry.uinf.pending_views = view_counters_->GetPending(common::ConvertToString(&entry.sid));
+    }
+  }
+
+  std::vector<bson_oid_t> user_series;
+  GetOidsFromArray(doc, SERIES_FIELD, &user_series);
+  std::vector<bson_oid_t> user_requests;
+  GetOidsFromArray(doc, REQUESTS_FIELD, &user_requests);
+
+  // resolve all referenced documents in batches instead of one find per entry
+  std::vector<bson_oid_t> stream_ids;
+  stream_ids.reserve(user_streams.size() + user_vods.size() + user_catchups.size());
+  for (const auto& entry : user_streams) {
+    stream_ids.push_back(entry.sid);
+  }
+  for (const auto& entry : user_vods) {
+    stream_ids.push_back(entry.sid);
+  }
+  for (const auto& entry : user_catchups) {
+    stream_ids.push_back(entry.sid);
+  }
+
+  // served from the catalog cache, only misses go to the database
+  streams_entries_t streams_entries;
+  std::vector<bson_oid_t> missed_ids;
+  for (const auto& sid : stream_ids) {
+    StreamsCache::stream_entry_t cached = streams_cache_->Find(sid);
+    if (cached) {
+      streams_entries[sid] = cached;
+    } else {
+      missed_ids.push_back(sid);
+    }
+  }
+
+  // entries of a failed batch are left out of the response instead of failing it
+  size_t skipped_batches = 0;
+  const StreamsCache::generation_t streams_generation = streams_cache_->GetGeneration();
+  documents_by_id_t streams_docs;
+  err = FindDocumentsByIDs(db.get(), "streams.find_by_ids", STREAMS_COLLECTION, ReadPreferences::CATALOG_READS,
+                           missed_ids, &streams_docs, &skipped_batches);
+  if (err) {
+    return err;
+  }
+
+  for (const auto& it : streams_docs) {
+    fastotv::StreamType st;
+    if (GetStreamTypeFromDocument(it.second.get(), stream_classes_, &st)) {
+      streams_entries[it.first] = streams_cache_->Insert(it.second.get(), st, streams_generation);
+    }
+  }
+
+  documents_by_id_t series_docs;
+  err = FindDocumentsByIDs(db.get(), "series.find_by_ids", SERIES_COLLECTION, ReadPreferences::CATALOG_READS,
+                           user_series, &series_docs, &skipped_batches);
+  if (err) {
+    return err;
+  }
+
+  documents_by_id_t requests_docs;
+  err = FindDocumentsByIDs(db.get(), "requests.find_by_ids", REQUESTS_COLLECTION, ReadPreferences::CATALOG_READS,
+                           user_requests, &requests_docs, &skipped_batches);
+  if (err) {
+    return err;
+  }
+
   fastotv::commands_info::ChannelsInfo lchans;
   fastotv::commands_info::ChannelsInfo lpchans;
-  if (bson_iter_init_find(&bstreams, doc, USER_STREAMS_FIELD) && BSON_ITER_HOLDS_ARRAY(&bstreams)) {
-    bson_iter_t ar;
-    if (bson_iter_recurse(&bstreams, &ar)) {
-      while (bson_iter_next(&ar)) {
-        if (BSON_ITER_HOLDS_DOCUMENT(&ar)) {
-          uint32_t len;
-          const uint8_t* buf;
-          bson_iter_document(&ar, &len, &buf);
-          bson_t rec;
-          bson_init_static(&rec, buf, len);
-          {
-            bson_iter_t iter;
-            bson_iter_init(&iter, &rec);
-            if (bson_iter_find(&iter, USER_STREAM_ID_FIELD)) {
-              const bson_oid_t* oid = bson_iter_oid(&iter);
-              const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(oid)));
-              const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-                  mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-              const bson_t* sdoc;
-              if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-                bson_iter_t bcls;
-                if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-                  continue;
-                }
-
-                UserStreamInfo uinf = makeUserStreamInfo(&iter);
-                fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-                fastotv::commands_info::ChannelInfo ch;
-                bool visible = false;
-                if (MakeChannelInfo(sdoc, st, uinf, &ch, &visible) && visible) {
-                  if (uinf.priv) {
-                    lpchans.Add(ch);
-                  } else {
-                    lchans.Add(ch);
-                  }
-                }
-              }
-            }
-          }
-          bson_destroy(&rec);
-        }
+  for (const auto& entry : user_streams) {
+    const StreamsCache::StreamEntry* stream = FindStreamEntryByID(streams_entries, entry.sid);
+    if (!stream) {
+      continue;
+    }
+
+    fastotv::commands_info::ChannelInfo ch;
+    bool visible = false;
+    if (MakeChannelInfo(stream->doc.get(), stream->type, entry.uinf, &ch, &visible) && visible) {
+      if (entry.uinf.priv) {
+        lpchans.Add(ch);
+      } else {
+        lchans.Add(ch);
       }
     }
   }
 
   fastotv::commands_info::VodsInfo lvods;
   fastotv::commands_info::VodsInfo lpvods;
-  if (bson_iter_init_find(&bstreams, doc, USER_VODS_FIELD) && BSON_ITER_HOLDS_ARRAY(&bstreams)) {
-    bson_iter_t ar;
-    if (bson_iter_recurse(&bstreams, &ar)) {
-      while (bson_iter_next(&ar)) {
-        if (BSON_ITER_HOLDS_DOCUMENT(&ar)) {
-          uint32_t len;
-          const uint8_t* buf;
-          bson_iter_document(&ar, &len, &buf);
-          bson_t rec;
-          bson_init_static(&rec, buf, len);
-          {
-            bson_iter_t iter;
-            bson_iter_init(&iter, &rec);
-            if (bson_iter_find(&iter, USER_STREAM_ID_FIELD)) {
-              const bson_oid_t* oid = bson_iter_oid(&iter);
-              const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(oid)));
-              const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-                  mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-              const bson_t* sdoc;
-              if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-                bson_iter_t bcls;
-                if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-                  continue;
-                }
-
-                UserStreamInfo uinf = makeUserStreamInfo(&iter);
-                fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-                fastotv::commands_info::VodInfo ch;
-                bool visible = false;
-                if (MakeVodInfo(sdoc, st, uinf, &ch, &visible)) {
-                  if (uinf.priv) {
-                    lpvods.Add(ch);
-                  } else {
-                    lvods.Add(ch);
-                  }
-                }
-              }
-            }
-          }
-          bson_destroy(&rec);
-        }
+  episodes_views_t episodes_views;
+  for (const auto& entry : user_vods) {
+    const StreamsCache::StreamEntry* stream = FindStreamEntryByID(streams_entries, entry.sid);
+    if (!stream) {
+      continue;
+    }
+
+    fastotv::commands_info::VodInfo ch;
+    bool visible = false;
+    if (MakeVodInfo(stream->doc.get(), stream->type, entry.uinf, &ch, &visible)) {
+      if (entry.uinf.priv) {
+        lpvods.Add(ch);
+      } else {
+        AddEpisodeViews(ch, &episodes_views);
+        lvods.Add(ch);
       }
     }
   }
 
   fastotv::commands_info::CatchupsInfo lcatchups;
-  if (bson_iter_init_find(&bstreams, doc, USER_CATCHUPS_FIELD) && BSON_ITER_HOLDS_ARRAY(&bstreams)) {
-    bson_iter_t ar;
-    if (bson_iter_recurse(&bstreams, &ar)) {
-      while (bson_iter_next(&ar)) {
-        if (BSON_ITER_HOLDS_DOCUMENT(&ar)) {
-          uint32_t len;
-          const uint8_t* buf;
-          bson_iter_document(&ar, &len, &buf);
-          bson_t rec;
-          bson_init_static(&rec, buf, len);
-          {
-            bson_iter_t iter;
-            bson_iter_init(&iter, &rec);
-            if (bson_iter_find(&iter, USER_STREAM_ID_FIELD)) {
-              const bson_oid_t* oid = bson_iter_oid(&iter);
-              const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(oid)));
-              const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-                  mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-              const bson_t* sdoc;
-              if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-                bson_iter_t bcls;
-                if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-                  continue;
-                }
-
-                UserStreamInfo uinf = makeUserStreamInfo(&iter);
-                fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-                fastotv::commands_info::CatchupInfo ch;
-                bool visible = false;
-                if (MakeCatchupInfo(sdoc, st, uinf, &ch, &visible)) {
-                  lcatchups.Add(ch);
-                }
-              }
-            }
-          }
-          bson_destroy(&rec);
-        }
-      }
+  for (const auto& entry : user_catchups) {
+    const StreamsCache::StreamEntry* stream = FindStreamEntryByID(streams_entries, entry.sid);
+    if (!stream) {
+      continue;
+    }
+
+    fastotv::commands_info::CatchupInfo ch;
+    bool visible = false;
+    if (MakeCatchupInfo(stream->doc.get(), stream->type, entry.uinf, &ch, &visible)) {
+      lcatchups.Add(ch);
     }
   }
 
   fastotv::commands_info::SeriesInfo lseries;
-  bson_iter_t bseries;
-  if (bson_iter_init_find(&bseries, doc, SERIES_FIELD) && BSON_ITER_HOLDS_ARRAY(&bseries)) {
-    bson_iter_t ar;
-    if (bson_iter_recurse(&bseries, &ar)) {
-      while (bson_iter_next(&ar)) {
-        const bson_oid_t* sid = bson_iter_oid(&ar);
-        const unique_ptr_bson_t series_query(BCON_NEW("_id", BCON_OID(sid)));
-        const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-            mongoc_collection_find(series_, MONGOC_QUERY_NONE, 0, 0, 0, series_query.get(), NULL, NULL));
-        const bson_t* sdoc;
-        if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-          fastotv::commands_info::SerialInfo ser;
-          bool visible = false;
-          if (MakeSerialInfo(sdoc, &ser, &visible)) {
-            // stable views
-            auto episodes = ser.GetEpisodes();
-            auto vods_array = lvods.Get();
-            size_t view_counts = 0;
-            for (auto episode : episodes) {
-              for (auto serial : vods_array) {
-                if (serial.IsSerial() && serial.GetStreamID() == episode) {
-                  view_counts += serial.GetViewCount();
-                  break;
-                }
-              }
-            }
-            ser.SetViewCount(view_counts);
-            lseries.Add(ser);
-          }
-        }
-      }
+  for (const auto& sid : user_series) {
+    const bson_t* sdoc = FindDocumentByID(series_docs, sid);
+    if (!sdoc) {
+      continue;
+    }
+
+    fastotv::commands_info::SerialInfo ser;
+    bool visible = false;
+    if (MakeSerialInfo(sdoc, &ser, &visible)) {
+      ser.SetViewCount(GetSerialViews(ser, episodes_views));
+      lseries.Add(ser);
     }
   }
 
   fastotv::commands_info::ContentRequestsInfo lcreq;
-  bson_iter_t brequests;
-  if (bson_iter_init_find(&brequests, doc, REQUESTS_FIELD) && BSON_ITER_HOLDS_ARRAY(&brequests)) {
-    bson_iter_t ar;
-    if (bson_iter_recurse(&brequests, &ar)) {
-      while (bson_iter_next(&ar)) {
-        const bson_oid_t* sid = bson_iter_oid(&ar);
-        const unique_ptr_bson_t requests_query(BCON_NEW("_id", BCON_OID(sid)));
-        const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-            mongoc_collection_find(requests_, MONGOC_QUERY_NONE, 0, 0, 0, requests_query.get(), NULL, NULL));
-        const bson_t* sdoc;
-        if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-          fastotv::commands_info::ContentRequestInfo cont;
-          if (MakeContentRequestInfo(sdoc, &cont)) {
-            lcreq.Add(cont);
-          }
-        }
-      }
+  for (const auto& rid : user_requests) {
+    const bson_t* sdoc = FindDocumentByID(requests_docs, rid);
+    if (!sdoc) {
+      continue;
+    }
+
+    fastotv::commands_info::ContentRequestInfo cont;
+    if (MakeContentRequestInfo(sdoc, &cont)) {
+      lcreq.Add(cont);
     }
   }
 
@@ -1084,10 +2246,14 @@ common::Error SubscribersManager::ClientGetChannels(const fastotv::commands_info
   DEBUG_LOG() << "Vods: " << lvods.Size() << " Channels: " << lchans.Size() << " PChannels: " << lpchans.Size()
               << " PVods: " << lpvods.Size() << " Catchups: " << lcatchups.Size() << " Series: " << lseries.Size()
               << " Content requests: " << lcreq.Size();
+  if (skipped_batches && has_uid) {
+    // a new version keeps the partial response out of the channels cache, the missing entries are pushed once read
+    BumpChannelsVersion(uid);
+  }
   return common::Error();
 }
 
-common::Error SubscribersManager::ClientFindHttpDirectoryOrUrlForChannel(const fastotv::commands_info::AuthInfo& auth,
+common::Error SubscribersManager::ClientFindHttpDirectoryOrUrlForChannel(const base::ServerDBAuthInfo& auth,
                                                                          fastotv::stream_id_t sid,
                                                                          fastotv::channel_id_t cid,
                                                                          http_directory_t* directory,
@@ -1096,414 +2262,143 @@ common::Error SubscribersManager::ClientFindHttpDirectoryOrUrlForChannel(const f
     return common::make_error_inval();
   }
 
-  if (!subscribers_ || !streams_) {
-    return common::make_error("Not conencted to DB");
-  }
-
-  const std::string login = auth.GetLogin();
-  const unique_ptr_bson_t query(bson_new());
-  BSON_APPEND_UTF8(query.get(), "email", login.c_str());
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> cursor(
-      mongoc_collection_find(subscribers_, MONGOC_QUERY_NONE, 0, 0, 0, query.get(), NULL, NULL));
-  const bson_t* doc;
-  if (!cursor || !mongoc_cursor_next(cursor.get(), &doc)) {
-    return common::make_error("User not found");
-  }
-
-  {
-    bson_iter_t bstreams;
-    if (bson_iter_init_find(&bstreams, doc, USER_STREAMS_FIELD) && BSON_ITER_HOLDS_ARRAY(&bstreams)) {
-      bson_iter_t ar;
-      if (bson_iter_recurse(&bstreams, &ar)) {
-        while (bson_iter_next(&ar)) {
-          if (BSON_ITER_HOLDS_DOCUMENT(&ar)) {
-            uint32_t len;
-            const uint8_t* buf;
-            bson_iter_document(&ar, &len, &buf);
-            bson_t rec;
-            bson_init_static(&rec, buf, len);
-            {
-              bson_iter_t iter;
-              bson_iter_init(&iter, &rec);
-              if (bson_iter_find(&iter, USER_STREAM_ID_FIELD)) {
-                const bson_oid_t* oid = bson_iter_oid(&iter);
-                std::string sid_str = common::ConvertToString(oid);
-                if (sid_str == sid) {
-                  const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(oid)));
-                  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-                      mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-                  const bson_t* sdoc;
-                  if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-                    bson_iter_t bcls;
-                    if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-                      return common::make_error("Invalid stream");
-                    }
-
-                    fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-                    bool is_proxy = st == fastotv::PROXY;
-
-                    if (is_proxy) {
-                      common::uri::GURL lurl;
-                      if (GetUrlFromStream(sdoc, st, cid, &lurl)) {
-                        *url = lurl;
-                        return common::Error();
-                      }
-                    } else {
-                      http_directory_t ldir;
-                      if (GetHttpRootFromStream(sdoc, st, cid, &ldir)) {
-                        if (common::file_system::is_directory_exist(ldir.GetPath())) {
-                          *directory = ldir;
-                          return common::Error();
-                        }
-
-                        common::uri::GURL lurl;
-                        if (GetUrlFromStream(sdoc, st, cid, &lurl)) {
-                          *url = lurl;
-                          return common::Error();
-                        }
-                      }
-                    }
-                    return common::make_error("Cant parse stream urls");
-                  }
-                  return common::make_error("Stream type not supported");
-                }
-              }
-            }
-            bson_destroy(&rec);
-          }
-        }
-      }
-    }
-  }
-
-  {
-    bson_iter_t bvods;
-    if (bson_iter_init_find(&bvods, doc, USER_VODS_FIELD) && BSON_ITER_HOLDS_ARRAY(&bvods)) {
-      bson_iter_t ar;
-      if (bson_iter_recurse(&bvods, &ar)) {
-        while (bson_iter_next(&ar)) {
-          if (BSON_ITER_HOLDS_DOCUMENT(&ar)) {
-            uint32_t len;
-            const uint8_t* buf;
-            bson_iter_document(&ar, &len, &buf);
-            bson_t rec;
-            bson_init_static(&rec, buf, len);
-            {
-              bson_iter_t iter;
-              bson_iter_init(&iter, &rec);
-              if (bson_iter_find(&iter, USER_STREAM_ID_FIELD)) {
-                const bson_oid_t* oid = bson_iter_oid(&iter);
-                std::string sid_str = common::ConvertToString(oid);
-                if (sid_str == sid) {
-                  const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(oid)));
-                  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-                      mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-                  const bson_t* sdoc;
-                  if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-                    bson_iter_t bcls;
-                    if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-                      return common::make_error("Invalid stream");
-                    }
-
-                    fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-                    bool is_proxy = st == fastotv::VOD_PROXY;
-
-                    if (is_proxy) {
-                      common::uri::GURL lurl;
-                      if (GetUrlFromStream(sdoc, st, cid, &lurl)) {
-                        *url = lurl;
-                        return common::Error();
-                      }
-                    } else {
-                      http_directory_t ldir;
-                      if (GetHttpRootFromStream(sdoc, st, cid, &ldir)) {
-                        if (common::file_system::is_directory_exist(ldir.GetPath())) {
-                          *directory = ldir;
-                          return common::Error();
-                        }
-
-                        common::uri::GURL lurl;
-                        if (GetUrlFromStream(sdoc, st, cid, &lurl)) {
-                          *url = lurl;
-                          return common::Error();
-                        }
-                      }
-                    }
-                    return common::make_error("Cant parse stream urls");
-                  }
-                  return common::make_error("Stream type not supported");
-                }
-              }
-            }
-            bson_destroy(&rec);
-          }
-        }
-      }
-    }
-  }
-
-  {
-    bson_iter_t bcatchups;
-    if (bson_iter_init_find(&bcatchups, doc, USER_CATCHUPS_FIELD) && BSON_ITER_HOLDS_ARRAY(&bcatchups)) {
-      bson_iter_t ar;
-      if (bson_iter_recurse(&bcatchups, &ar)) {
-        while (bson_iter_next(&ar)) {
-          if (BSON_ITER_HOLDS_DOCUMENT(&ar)) {
-            uint32_t len;
-            const uint8_t* buf;
-            bson_iter_document(&ar, &len, &buf);
-            bson_t rec;
-            bson_init_static(&rec, buf, len);
-            {
-              bson_iter_t iter;
-              bson_iter_init(&iter, &rec);
-              if (bson_iter_find(&iter, USER_STREAM_ID_FIELD)) {
-                const bson_oid_t* oid = bson_iter_oid(&iter);
-                std::string sid_str = common::ConvertToString(oid);
-                if (sid_str == sid) {
-                  const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(oid)));
-                  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-                      mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-                  const bson_t* sdoc;
-                  if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-                    bson_iter_t bcls;
-                    if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-                      return common::make_error("Invalid stream");
-                    }
-
-                    fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-                    bool is_proxy = (st == fastotv::PROXY || st == fastotv::VOD_PROXY);
-
-                    if (is_proxy) {
-                      common::uri::GURL lurl;
-                      if (GetUrlFromStream(sdoc, st, cid, &lurl)) {
-                        *url = lurl;
-                        return common::Error();
-                      }
-                    } else {
-                      bool is_requst_streams = st == fastotv::COD_RELAY || st == fastotv::COD_ENCODE ||
-                                               st == fastotv::VOD_ENCODE || st == fastotv::VOD_RELAY;
-                      if (!is_requst_streams) {
-                        http_directory_t ldir;
-                        if (GetHttpRootFromStream(sdoc, st, cid, &ldir)) {
-                          if (common::file_system::is_directory_exist(ldir.GetPath())) {
-                            *directory = ldir;
-                            return common::Error();
-                          }
-                        }
-                      }
-                      common::uri::GURL lurl;
-                      if (GetUrlFromStream(sdoc, st, cid, &lurl)) {
-                        *url = lurl;
-                        return common::Error();
-                      }
-                    }
-                    return common::make_error("Cant parse stream urls");
-                  }
-                  return common::make_error("Stream type not supported");
-                }
-              }
-            }
-            bson_destroy(&rec);
-          }
-        }
-      }
-    }
-  }
-
-  return common::make_error("Stream not found");
-}
-
-common::Error SubscribersManager::SetFavorite(const base::ServerDBAuthInfo& auth,
-                                              const fastotv::commands_info::FavoriteInfo& favorite) {
-  if (!favorite.IsValid()) {
-    return common::make_error_inval();
-  }
-
-  if (!subscribers_ || !streams_) {
-    return common::make_error("Not conencted to DB");
-  }
-
-  bson_oid_t sid;
-  if (!common::ConvertFromString(favorite.GetChannel(), &sid)) {
-    return common::make_error("Invalid stream id");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
-  const bson_t* sdoc;
-  const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&sid)));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-      mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-  if (!stream_cursor || !mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
+  bson_oid_t bsid;
+  if (!common::ConvertFromString(sid, &bsid)) {
     return common::make_error("Stream not found");
   }
 
-  bson_iter_t bcls;
-  if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-    return common::make_error("Invalid stream");
-  }
-
-  bson_oid_t oid;
-  if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
-    return common::make_error("Invalid user id");
-  }
-
-  fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-  if (IsVod(st)) {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_VODS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_VODS_FIELD ".$." FAVORITE_FIELD, BCON_BOOL(favorite.GetFavorite()), "}"));
-    bson_error_t error;
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set favorite error: " << error.message;
-    }
-  } else if (st == fastotv::CATCHUP) {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_CATCHUPS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_CATCHUPS_FIELD ".$." FAVORITE_FIELD, BCON_BOOL(favorite.GetFavorite()), "}"));
-    bson_error_t error;
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set favorite error: " << error.message;
-    }
-  } else {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_STREAMS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_STREAMS_FIELD ".$." FAVORITE_FIELD, BCON_BOOL(favorite.GetFavorite()), "}"));
-    bson_error_t error;
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set favorite error: " << error.message;
-    }
-  }
-
-  return common::Error();
-}
-
-common::Error SubscribersManager::SetRecent(const base::ServerDBAuthInfo& auth,
-                                            const fastotv::commands_info::RecentStreamTimeInfo& recent) {
-  if (!recent.IsValid()) {
-    return common::make_error_inval();
-  }
-
-  if (!subscribers_ || !streams_) {
-    return common::make_error("Not conencted to DB");
-  }
-
-  bson_oid_t sid;
-  if (!common::ConvertFromString(recent.GetChannel(), &sid)) {
-    return common::make_error("Invalid stream id");
-  }
-
-  const bson_t* sdoc;
-  const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&sid)));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-      mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-  if (!stream_cursor || !mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-    return common::make_error("Stream not found");
+  UserEntitlements::Entry user_stream;
+  err = FindUserStream(db.get(), auth.GetUserID(), bsid, kAllUserArrays, &user_stream);
+  if (err) {
+    return err;
   }
 
-  bson_iter_t bcls;
-  if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-    return common::make_error("Invalid stream");
+  StreamsCache::stream_entry_t stream;
+  err = FindStreamEntry(db.get(), bsid, &stream);
+  if (err) {
+    return err;
   }
 
-  bson_oid_t oid;
-  if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
-    return common::make_error("Invalid user id");
+  const fastotv::StreamType st = stream->type;
+  if (user_stream.array == base::UserStreamsWriteBuffer::USER_CATCHUPS) {
+    bool is_proxy = (st == fastotv::PROXY || st == fastotv::VOD_PROXY);
+    if (is_proxy) {
+      common::uri::GURL lurl;
+      if (GetUrlFromOutput(stream->output, cid, &lurl)) {
+        *url = lurl;
+        return common::Error();
+      }
+    } else {
+      bool is_requst_streams = st == fastotv::COD_RELAY || st == fastotv::COD_ENCODE || st == fastotv::VOD_ENCODE ||
+                               st == fastotv::VOD_RELAY;
+      if (!is_requst_streams) {
+        http_directory_t ldir;
+        if (GetHttpRootFromOutput(stream->output, cid, &ldir)) {
+          if (common::file_system::is_directory_exist(ldir.GetPath())) {
+            *directory = ldir;
+            return common::Error();
+          }
+        }
+      }
+      common::uri::GURL lurl;
+      if (GetUrlFromOutput(stream->output, cid, &lurl)) {
+        *url = lurl;
+        return common::Error();
+      }
+    }
+    return common::make_error("Cant parse stream urls");
   }
 
-  fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-  bson_error_t error;
-  if (IsVod(st)) {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_VODS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_VODS_FIELD ".$." RECENT_FIELD, BCON_DATE_TIME(recent.GetTimestamp()), "}"));
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set recent error: " << error.message;
-    }
-  } else if (st == fastotv::CATCHUP) {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_CATCHUPS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_CATCHUPS_FIELD ".$." RECENT_FIELD, BCON_DATE_TIME(recent.GetTimestamp()), "}"));
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set recent error: " << error.message;
+  bool is_proxy = user_stream.array == base::UserStreamsWriteBuffer::USER_VODS ? st == fastotv::VOD_PROXY
+                                                                               : st == fastotv::PROXY;
+  if (is_proxy) {
+    common::uri::GURL lurl;
+    if (GetUrlFromOutput(stream->output, cid, &lurl)) {
+      *url = lurl;
+      return common::Error();
     }
   } else {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_STREAMS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_STREAMS_FIELD ".$." RECENT_FIELD, BCON_DATE_TIME(recent.GetTimestamp()), "}"));
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set recent error: " << error.message;
-    }
-  }
+    http_directory_t ldir;
+    if (GetHttpRootFromOutput(stream->output, cid, &ldir)) {
+      if (common::file_system::is_directory_exist(ldir.GetPath())) {
+        *directory = ldir;
+        return common::Error();
+      }
 
-  const unique_ptr_bson_t inc_query(BCON_NEW("$inc", "{", STREAM_VIEW_COUNT_FIELD, BCON_INT32(1), "}"));
-  if (!mongoc_collection_update(streams_, MONGOC_UPDATE_NONE, stream_query.get(), inc_query.get(), NULL, &error)) {
-    DEBUG_LOG() << "Can't increment view count: " << error.message;
+      common::uri::GURL lurl;
+      if (GetUrlFromOutput(stream->output, cid, &lurl)) {
+        *url = lurl;
+        return common::Error();
+      }
+    }
   }
-
-  return common::Error();
+  return common::make_error("Cant parse stream urls");
 }
 
-common::Error SubscribersManager::SetInterruptTime(const base::ServerDBAuthInfo& auth,
-                                                   const fastotv::commands_info::InterruptStreamTimeInfo& inter) {
-  if (!inter.IsValid()) {
+common::Error SubscribersManager::SetFavorite(const base::ServerDBAuthInfo& auth,
+                                              const fastotv::commands_info::FavoriteInfo& favorite) {
+  if (!favorite.IsValid()) {
     return common::make_error_inval();
   }
 
-  if (!subscribers_ || !streams_) {
-    return common::make_error("Not conencted to DB");
+  base::UserStreamsWriteBuffer::UserArray array;
+  common::Error err = FindUserArray(auth, favorite.GetChannel(), &array);
+  if (err) {
+    return err;
   }
 
-  bson_oid_t sid;
-  if (!common::ConvertFromString(inter.GetChannel(), &sid)) {
-    return common::make_error("Invalid stream id");
-  }
+  const bool value = favorite.GetFavorite();
+  write_buffer_->SetFavorite(auth.GetUserID(), favorite.GetChannel(), array, value);
+  BumpChannelsVersion(auth.GetUserID(),
+                      MakeUserStreamUpdate(favorite.GetChannel(), array,
+                                           [value](UserStreamInfo* uinf) { uinf->favorite = value; }));
+  return common::Error();
+}
 
-  const bson_t* sdoc;
-  const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&sid)));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-      mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-  if (!stream_cursor || !mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-    return common::make_error("Stream not found");
+common::Error SubscribersManager::SetRecent(const base::ServerDBAuthInfo& auth,
+                                            const fastotv::commands_info::RecentStreamTimeInfo& recent) {
+  if (!recent.IsValid()) {
+    return common::make_error_inval();
   }
 
-  bson_iter_t bcls;
-  if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-    return common::make_error("Invalid stream");
+  base::UserStreamsWriteBuffer::UserArray array;
+  common::Error err = FindUserArray(auth, recent.GetChannel(), &array);
+  if (err) {
+    return err;
   }
 
-  bson_oid_t oid;
-  if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
-    return common::make_error("Invalid user id");
-  }
+  const fastotv::timestamp_t value = recent.GetTimestamp();
+  write_buffer_->SetRecent(auth.GetUserID(), recent.GetChannel(), array, value);
+  view_counters_->Increment(recent.GetChannel());
+  BumpChannelsVersion(auth.GetUserID(),
+                      MakeUserStreamUpdate(recent.GetChannel(), array,
+                                           [value](UserStreamInfo* uinf) { uinf->recent = value; }));
+  return common::Error();
+}
 
-  fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
+common::Error SubscribersManager::SetInterruptTime(const base::ServerDBAuthInfo& auth,
+                                                   const fastotv::commands_info::InterruptStreamTimeInfo& inter) {
+  if (!inter.IsValid()) {
+    return common::make_error_inval();
+  }
 
-  if (IsVod(st)) {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_VODS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_VODS_FIELD ".$." INTERRUPTION_TIME_FIELD, BCON_INT32(inter.GetTime()), "}"));
-    bson_error_t error;
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set interrupt time error: " << error.message;
-    }
-  } else if (st == fastotv::CATCHUP) {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_CATCHUPS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_CATCHUPS_FIELD ".$." INTERRUPTION_TIME_FIELD, BCON_INT32(inter.GetTime()), "}"));
-    bson_error_t error;
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set interrupt time error: " << error.message;
-    }
-  } else {
-    const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_STREAMS_FIELD ".sid", BCON_OID(&sid)));
-    const unique_ptr_bson_t update_query(
-        BCON_NEW("$set", "{", USER_STREAMS_FIELD ".$." INTERRUPTION_TIME_FIELD, BCON_INT32(inter.GetTime()), "}"));
-    bson_error_t error;
-    if (!mongoc_collection_update(subscribers_, MONGOC_UPDATE_NONE, query.get(), update_query.get(), NULL, &error)) {
-      DEBUG_LOG() << "Failed to set interrupt time error: " << error.message;
-    }
+  base::UserStreamsWriteBuffer::UserArray array;
+  common::Error err = FindUserArray(auth, inter.GetChannel(), &array);
+  if (err) {
+    return err;
   }
 
+  const fastotv::timestamp_t value = inter.GetTime();
+  write_buffer_->SetInterruptTime(auth.GetUserID(), inter.GetChannel(), array, value);
+  BumpChannelsVersion(auth.GetUserID(),
+                      MakeUserStreamUpdate(inter.GetChannel(), array,
+                                           [value](UserStreamInfo* uinf) { uinf->interruption_time = value; }));
   return common::Error();
 }
 
@@ -1514,13 +2409,10 @@ common::Error SubscribersManager::FindStream(const base::ServerDBAuthInfo& auth,
     return common::make_error_inval();
   }
 
-  if (!subscribers_ || !streams_) {
-    return common::make_error("Not conencted to DB");
-  }
-
-  bson_oid_t oid;
-  if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
-    return common::make_error("Invalid user id");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
   bson_oid_t bsid;
@@ -1528,34 +2420,33 @@ common::Error SubscribersManager::FindStream(const base::ServerDBAuthInfo& auth,
     return common::make_error("Invalid stream id");
   }
 
-  const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_STREAMS_FIELD ".sid", BCON_OID(&bsid)));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_user_cursor(
-      mongoc_collection_find(subscribers_, MONGOC_QUERY_NONE, 0, 0, 0, query.get(), NULL, NULL));
-  const bson_t* sdoc;
-  if (stream_user_cursor && mongoc_cursor_next(stream_user_cursor.get(), &sdoc)) {
-    bson_iter_t iter;
-    bson_iter_init(&iter, sdoc);
-    UserStreamInfo uinf = makeUserStreamInfo(&iter);
-
-    const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&bsid)));
-    const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-        mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-    if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-      bson_iter_t bcls;
-      if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-        return common::make_error("Invalid stream");
-      }
+  UserEntitlements::Entry user_stream;
+  err = FindUserStream(db.get(), auth.GetUserID(), bsid, {base::UserStreamsWriteBuffer::USER_STREAMS}, &user_stream);
+  if (err) {
+    return err;
+  }
 
-      fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-      if (IsVod(st)) {
-      } else {
-        fastotv::commands_info::ChannelInfo ch;
-        bool visible = false;
-        if (MakeChannelInfo(sdoc, st, uinf, &ch, &visible)) {
-          *chan = ch;
-          return common::Error();
-        }
-      }
+  UserStreamInfo uinf = user_stream.uinf;
+  base::UserStreamsWriteBuffer::Update buffered;
+  if (write_buffer_->Find(auth.GetUserID(), sid, &buffered)) {
+    ApplyBufferedUpdate(buffered, &uinf);
+  }
+  uinf.pending_views = view_counters_->GetPending(sid);
+
+  StreamsCache::stream_entry_t stream;
+  err = FindStreamEntry(db.get(), bsid, &stream);
+  if (err) {
+    return err;
+  }
+
+  const fastotv::StreamType st = stream->type;
+  if (IsVod(st)) {
+  } else {
+    fastotv::commands_info::ChannelInfo ch;
+    bool visible = false;
+    if (MakeChannelInfo(stream->doc.get(), st, uinf, &ch, &visible)) {
+      *chan = ch;
+      return common::Error();
     }
   }
   return common::make_error("Stream not found");
@@ -1568,13 +2459,10 @@ common::Error SubscribersManager::FindVod(const base::ServerDBAuthInfo& auth,
     return common::make_error_inval();
   }
 
-  if (!subscribers_ || !streams_) {
-    return common::make_error("Not conencted to DB");
-  }
-
-  bson_oid_t oid;
-  if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
-    return common::make_error("Invalid user id");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
   bson_oid_t bsid;
@@ -1582,33 +2470,32 @@ common::Error SubscribersManager::FindVod(const base::ServerDBAuthInfo& auth,
     return common::make_error("Invalid stream id");
   }
 
-  const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_VODS_FIELD ".sid", BCON_OID(&bsid)));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_user_cursor(
-      mongoc_collection_find(subscribers_, MONGOC_QUERY_NONE, 0, 0, 0, query.get(), NULL, NULL));
-  const bson_t* sdoc;
-  if (stream_user_cursor && mongoc_cursor_next(stream_user_cursor.get(), &sdoc)) {
-    bson_iter_t iter;
-    bson_iter_init(&iter, sdoc);
-    UserStreamInfo uinf = makeUserStreamInfo(&iter);
-
-    const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&bsid)));
-    const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-        mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-    if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-      bson_iter_t bcls;
-      if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-        return common::make_error("Invalid stream");
-      }
+  UserEntitlements::Entry user_stream;
+  err = FindUserStream(db.get(), auth.GetUserID(), bsid, {base::UserStreamsWriteBuffer::USER_VODS}, &user_stream);
+  if (err) {
+    return err;
+  }
 
-      fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-      if (IsVod(st)) {
-        fastotv::commands_info::VodInfo ch;
-        bool visible = false;
-        if (MakeVodInfo(sdoc, st, uinf, &ch, &visible)) {
-          *vod = ch;
-          return common::Error();
-        }
-      }
+  UserStreamInfo uinf = user_stream.uinf;
+  base::UserStreamsWriteBuffer::Update buffered;
+  if (write_buffer_->Find(auth.GetUserID(), sid, &buffered)) {
+    ApplyBufferedUpdate(buffered, &uinf);
+  }
+  uinf.pending_views = view_counters_->GetPending(sid);
+
+  StreamsCache::stream_entry_t stream;
+  err = FindStreamEntry(db.get(), bsid, &stream);
+  if (err) {
+    return err;
+  }
+
+  const fastotv::StreamType st = stream->type;
+  if (IsVod(st)) {
+    fastotv::commands_info::VodInfo ch;
+    bool visible = false;
+    if (MakeVodInfo(stream->doc.get(), st, uinf, &ch, &visible)) {
+      *vod = ch;
+      return common::Error();
     }
   }
   return common::make_error("Stream not found");
@@ -1621,13 +2508,10 @@ common::Error SubscribersManager::FindCatchup(const base::ServerDBAuthInfo& auth
     return common::make_error_inval();
   }
 
-  if (!subscribers_ || !streams_) {
-    return common::make_error("Not conencted to DB");
-  }
-
-  bson_oid_t oid;
-  if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
-    return common::make_error("Invalid user id");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
   bson_oid_t bsid;
@@ -1635,34 +2519,33 @@ common::Error SubscribersManager::FindCatchup(const base::ServerDBAuthInfo& auth
     return common::make_error("Invalid stream id");
   }
 
-  const unique_ptr_bson_t query(BCON_NEW("_id", BCON_OID(&oid), USER_CATCHUPS_FIELD ".sid", BCON_OID(&bsid)));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_user_cursor(
-      mongoc_collection_find(subscribers_, MONGOC_QUERY_NONE, 0, 0, 0, query.get(), NULL, NULL));
-  const bson_t* sdoc;
-  if (stream_user_cursor && mongoc_cursor_next(stream_user_cursor.get(), &sdoc)) {
-    bson_iter_t iter;
-    bson_iter_init(&iter, sdoc);
-    UserStreamInfo uinf = makeUserStreamInfo(&iter);
-
-    const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&bsid)));
-    const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-        mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-    if (stream_cursor && mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-      bson_iter_t bcls;
-      if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-        return common::make_error("Invalid stream");
-      }
+  UserEntitlements::Entry user_stream;
+  err = FindUserStream(db.get(), auth.GetUserID(), bsid, {base::UserStreamsWriteBuffer::USER_CATCHUPS}, &user_stream);
+  if (err) {
+    return err;
+  }
 
-      fastotv::StreamType st = MongoStreamType2StreamType(bson_iter_utf8(&bcls, NULL));
-      if (IsVod(st)) {
-      } else {
-        fastotv::commands_info::CatchupInfo ch;
-        bool visible = false;
-        if (MakeCatchupInfo(sdoc, st, uinf, &ch, &visible)) {
-          *cat = ch;
-          return common::Error();
-        }
-      }
+  UserStreamInfo uinf = user_stream.uinf;
+  base::UserStreamsWriteBuffer::Update buffered;
+  if (write_buffer_->Find(auth.GetUserID(), sid, &buffered)) {
+    ApplyBufferedUpdate(buffered, &uinf);
+  }
+  uinf.pending_views = view_counters_->GetPending(sid);
+
+  StreamsCache::stream_entry_t stream;
+  err = FindStreamEntry(db.get(), bsid, &stream);
+  if (err) {
+    return err;
+  }
+
+  const fastotv::StreamType st = stream->type;
+  if (IsVod(st)) {
+  } else {
+    fastotv::commands_info::CatchupInfo ch;
+    bool visible = false;
+    if (MakeCatchupInfo(stream->doc.get(), st, uinf, &ch, &visible)) {
+      *cat = ch;
+      return common::Error();
     }
   }
   return common::make_error("Stream not found");
@@ -1680,23 +2563,30 @@ common::Error SubscribersManager::CreateCatchup(const base::ServerDBAuthInfo& au
     return common::make_error_inval();
   }
 
-  if (!subscribers_ || !streams_ || !servers_) {
-    return common::make_error("Not conencted to DB");
-  }
-
   fastotv::commands_info::ChannelInfo ch;
   common::Error err = FindStream(auth, sid, &ch);
   if (err) {
     return err;
   }
 
-  fastotv::commands_info::CatchupInfo catchup;
-  err = CreateOrFindCatchup(ch, title, start, stop, serverid, &catchup, is_created);
+  // title last, stream id and times have no '/'
+  const std::string key = sid + "/" + std::to_string(start) + "/" + std::to_string(stop) + "/" + title;
+  CatchupFlightResult result;
+  bool leader = false;
+  err = catchups_flight_.Do(key,
+                            [this, &ch, &title, start, stop](CatchupFlightResult* created) {
+                              return CreateOrFindCatchup(ch, title, start, stop, &created->serverid,
+                                                         &created->catchup, &created->is_created);
+                            },
+                            &result, &leader);
   if (err) {
     return err;
   }
 
-  *cat = catchup;
+  *serverid = result.serverid;
+  *cat = result.catchup;
+  // only the caller that created it announces the catchup
+  *is_created = leader && result.is_created;
   return common::Error();
 }
 
@@ -1705,10 +2595,14 @@ common::Error SubscribersManager::RemoveUserStream(const base::ServerDBAuthInfo&
     return common::make_error_inval();
   }
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
+  mongoc_collection_t* subscribers = db->GetCollection(SUBSCRIBERS_COLLECTION);
+
   bson_oid_t oid;
   if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
     return common::make_error("Invalid user id");
@@ -1719,11 +2613,15 @@ common::Error SubscribersManager::RemoveUserStream(const base::ServerDBAuthInfo&
     return common::make_error("Invalid stream id");
   }
 
-  common::Error err = RemoveStreamFromUserStreamsArray(subscribers_, &oid, &bsid);
+  err = RemoveStreamFromUserStreamsArray(subscribers, &oid, &bsid);
   if (err) {
     return err;
   }
 
+  OnUserWritten(auth.GetUserID());
+  BumpChannelsVersion(auth.GetUserID(), [bsid](UserEntitlements* entitlements) {
+    entitlements->Remove(bsid, base::UserStreamsWriteBuffer::USER_STREAMS);
+  });
   return common::Error();
 }
 
@@ -1732,10 +2630,14 @@ common::Error SubscribersManager::AddUserStream(const base::ServerDBAuthInfo& au
     return common::make_error_inval();
   }
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
+  mongoc_collection_t* subscribers = db->GetCollection(SUBSCRIBERS_COLLECTION);
+
   bson_oid_t oid;
   if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
     return common::make_error("Invalid user id");
@@ -1746,11 +2648,15 @@ common::Error SubscribersManager::AddUserStream(const base::ServerDBAuthInfo& au
     return common::make_error("Invalid stream id");
   }
 
-  common::Error err = AddStreamToUserStreamsArray(subscribers_, &oid, &oid);
+  err = AddStreamToUserStreamsArray(subscribers, &oid, &bsid);
   if (err) {
     return err;
   }
 
+  OnUserWritten(auth.GetUserID());
+  BumpChannelsVersion(auth.GetUserID(), [bsid](UserEntitlements* entitlements) {
+    entitlements->Insert({bsid, base::UserStreamsWriteBuffer::USER_STREAMS, UserStreamInfo()});
+  });
   return common::Error();
 }
 
@@ -1759,10 +2665,14 @@ common::Error SubscribersManager::RemoveUserVod(const base::ServerDBAuthInfo& au
     return common::make_error_inval();
   }
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
+  mongoc_collection_t* subscribers = db->GetCollection(SUBSCRIBERS_COLLECTION);
+
   bson_oid_t oid;
   if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
     return common::make_error("Invalid user id");
@@ -1773,11 +2683,15 @@ common::Error SubscribersManager::RemoveUserVod(const base::ServerDBAuthInfo& au
     return common::make_error("Invalid stream id");
   }
 
-  common::Error err = RemoveStreamFromUserVodsArray(subscribers_, &oid, &bsid);
+  err = RemoveStreamFromUserVodsArray(subscribers, &oid, &bsid);
   if (err) {
     return err;
   }
 
+  OnUserWritten(auth.GetUserID());
+  BumpChannelsVersion(auth.GetUserID(), [bsid](UserEntitlements* entitlements) {
+    entitlements->Remove(bsid, base::UserStreamsWriteBuffer::USER_VODS);
+  });
   return common::Error();
 }
 
@@ -1786,10 +2700,14 @@ common::Error SubscribersManager::AddUserVod(const base::ServerDBAuthInfo& auth,
     return common::make_error_inval();
   }
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
+  mongoc_collection_t* subscribers = db->GetCollection(SUBSCRIBERS_COLLECTION);
+
   bson_oid_t oid;
   if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
     return common::make_error("Invalid user id");
@@ -1800,11 +2718,15 @@ common::Error SubscribersManager::AddUserVod(const base::ServerDBAuthInfo& auth,
     return common::make_error("Invalid stream id");
   }
 
-  common::Error err = AddStreamToUserVodsArray(subscribers_, &oid, &bsid);
+  err = AddStreamToUserVodsArray(subscribers, &oid, &bsid);
   if (err) {
     return err;
   }
 
+  OnUserWritten(auth.GetUserID());
+  BumpChannelsVersion(auth.GetUserID(), [bsid](UserEntitlements* entitlements) {
+    entitlements->Insert({bsid, base::UserStreamsWriteBuffer::USER_VODS, UserStreamInfo()});
+  });
   return common::Error();
 }
 
@@ -1813,10 +2735,14 @@ common::Error SubscribersManager::RemoveUserCatchup(const base::ServerDBAuthInfo
     return common::make_error_inval();
   }
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
+  mongoc_collection_t* subscribers = db->GetCollection(SUBSCRIBERS_COLLECTION);
+
   bson_oid_t oid;
   if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
     return common::make_error("Invalid user id");
@@ -1827,11 +2753,15 @@ common::Error SubscribersManager::RemoveUserCatchup(const base::ServerDBAuthInfo
     return common::make_error("Invalid stream id");
   }
 
-  common::Error err = RemoveStreamFromUserCatchupsArray(subscribers_, &oid, &bsid);
+  err = RemoveStreamFromUserCatchupsArray(subscribers, &oid, &bsid);
   if (err) {
     return err;
   }
 
+  OnUserWritten(auth.GetUserID());
+  BumpChannelsVersion(auth.GetUserID(), [bsid](UserEntitlements* entitlements) {
+    entitlements->Remove(bsid, base::UserStreamsWriteBuffer::USER_CATCHUPS);
+  });
   return common::Error();
 }
 
@@ -1840,10 +2770,14 @@ common::Error SubscribersManager::AddUserCatchup(const base::ServerDBAuthInfo& a
     return common::make_error_inval();
   }
 
-  if (!subscribers_) {
-    return common::make_error("Not conencted to DB");
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
   }
 
+  mongoc_collection_t* subscribers = db->GetCollection(SUBSCRIBERS_COLLECTION);
+
   bson_oid_t oid;
   if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
     return common::make_error("Invalid user id");
@@ -1854,11 +2788,15 @@ common::Error SubscribersManager::AddUserCatchup(const base::ServerDBAuthInfo& a
     return common::make_error("Invalid stream id");
   }
 
-  common::Error err = AddStreamToUserCatchupsArray(subscribers_, &oid, &bsid);
+  err = AddStreamToUserCatchupsArray(subscribers, &oid, &bsid);
   if (err) {
     return err;
   }
 
+  OnUserWritten(auth.GetUserID());
+  BumpChannelsVersion(auth.GetUserID(), [bsid](UserEntitlements* entitlements) {
+    entitlements->Insert({bsid, base::UserStreamsWriteBuffer::USER_CATCHUPS, UserStreamInfo()});
+  });
   return common::Error();
 }
 
@@ -1869,6 +2807,12 @@ common::Error SubscribersManager::CreateRequestContent(const base::ServerDBAuthI
     return common::make_error_inval();
   }
 
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
+  }
+
   bson_oid_t oid;
   if (!common::ConvertFromString(auth.GetUserID(), &oid)) {
     return common::make_error("Invalid user id");
@@ -1886,22 +2830,60 @@ common::Error SubscribersManager::CreateRequestContent(const base::ServerDBAuthI
   BSON_APPEND_INT32(doc.get(), CONTENT_REQUEST_STATUS_FIELD, request.GetStatus());
   BSON_APPEND_INT32(doc.get(), CONTENT_REQUEST_TYPE_FIELD, request.GetType());
 
-  bson_error_t error;
-  if (!mongoc_collection_insert(requests_, MONGOC_INSERT_NONE, doc.get(), NULL, &error)) {
-    DEBUG_LOG() << "Failed create content request error: " << error.message;
-    return common::make_error(error.message);
-  }
-
-  common::Error err = AddContentRequestToUserArray(subscribers_, &oid, &requestid);
+  WriteBatch batch(db.get());
+  batch.Insert(REQUESTS_COLLECTION, doc.get());
+  AddContentRequestToUserArray(&batch, &oid, &requestid);
+  err = batch.Execute();
   if (err) {
+    DEBUG_LOG() << "Failed create content request error: " << err->GetDescription();
     return err;
   }
 
+  OnUserWritten(auth.GetUserID());
+  BumpChannelsVersion(auth.GetUserID());
   *cont =
       fastotv::commands_info::ContentRequestInfo(cid_str, request.GetText(), request.GetType(), request.GetStatus());
   return common::Error();
 }
 
+common::Error SubscribersManager::FindStreamEntry(ClientPool::Client* db,
+                                                  const bson_oid_t& sid,
+                                                  StreamsCache::stream_entry_t* entry) const {
+  StreamsCache::stream_entry_t cached = streams_cache_->Find(sid);
+  if (cached) {
+    *entry = cached;
+    return common::Error();
+  }
+
+  const StreamsCache::generation_t generation = streams_cache_->GetGeneration();
+  const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&sid)));
+  document_t stream;
+  common::Error err = FindDocument(db, "streams.find_by_id", STREAMS_COLLECTION, stream_query.get(), nullptr,
+                                   ReadPreferences::CATALOG_READS, &stream);
+  if (err) {
+    return err;
+  }
+
+  if (!stream) {
+    return common::make_error("Stream not found");
+  }
+
+  const bson_t* sdoc = stream.get();
+
+  fastotv::StreamType st;
+  if (!GetStreamTypeFromDocument(sdoc, stream_classes_, &st)) {
+    return common::make_error("Invalid stream");
+  }
+
+  cached = streams_cache_->Insert(sdoc, st, generation);
+  if (!cached) {
+    return common::make_error("Invalid stream");
+  }
+
+  *entry = cached;
+  return common::Error();
+}
+
 common::Error SubscribersManager::CreateOrFindCatchup(const fastotv::commands_info::ChannelInfo& based_on,
                                                       const std::string& title,
                                                       fastotv::timestamp_t start,
@@ -1909,6 +2891,15 @@ common::Error SubscribersManager::CreateOrFindCatchup(const fastotv::commands_in
                                                       std::string* serverid,
                                                       fastotv::commands_info::CatchupInfo* cat,
                                                       bool* is_created) {
+  ClientPool::client_t db;
+  common::Error err = PopClient(&db);
+  if (err) {
+    return err;
+  }
+
+  mongoc_collection_t* servers = db->GetCollection(SERVERS_COLLECTION);
+  mongoc_collection_t* streams = db->GetCollection(STREAMS_COLLECTION);
+
   auto epg = based_on.GetEpg();
   epg.ClearPrograms();
   epg.SetDisplayName(title);
@@ -1918,79 +2909,73 @@ common::Error SubscribersManager::CreateOrFindCatchup(const fastotv::commands_in
                                            epg, based_on.IsEnableAudio(), based_on.IsEnableVideo(), based_on.GetParts(),
                                            0, false, based_on.GetMetaUrls(), start, stop);
 
-  const auto parts = based_on.GetParts();
-  if (!parts.empty()) {
-    for (size_t i = 0; i < parts.size(); ++i) {
-      bson_oid_t sid;
-      fastotv::stream_id_t chan = parts[i];
-      if (!common::ConvertFromString(chan, &sid)) {
-        continue;
-      }
-
-      const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&sid)));
-      const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-          mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-      const bson_t* sdoc;
-      if (!stream_cursor || !mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-        continue;
-      }
-
-      bson_iter_t bname;
-      if (!bson_iter_init_find(&bname, sdoc, STREAM_NAME_FIELD) || !BSON_ITER_HOLDS_UTF8(&bname)) {
-        continue;
-      }
-
-      bson_iter_t bstart;
-      if (!bson_iter_init_find(&bstart, sdoc, CATCHUP_START_FIELD) || !BSON_ITER_HOLDS_DATE_TIME(&bstart)) {
-        continue;
-      }
+  const std::string sid = based_on.GetStreamID();
+  bson_oid_t bsid;
+  if (!common::ConvertFromString(sid, &bsid)) {
+    return common::make_error("Invalid stream id");
+  }
 
-      bson_iter_t bstop;
-      if (!bson_iter_init_find(&bstop, sdoc, CATCHUP_STOP_FIELD) || !BSON_ITER_HOLDS_DATE_TIME(&bstop)) {
-        continue;
-      }
+  // parts of based_on come from catalog reads, they may miss a catchup just created for the same program
+  const unique_ptr_bson_t base_query(BCON_NEW("_id", BCON_OID(&bsid)));
+  const unique_ptr_bson_t base_fields(BCON_NEW(STREAM_PARTS_FIELD, BCON_INT32(1)));
+  TrackedCursor base_cursor("streams.find_catchup_base", streams, base_query.get(), base_fields.get(),
+                            read_prefs_->Get(ReadPreferences::USER_READS));
+  const bson_t* base_doc;
+  if (!base_cursor.Next(&base_doc)) {
+    bson_error_t error;
+    if (base_cursor.GetError(&error)) {
+      return common::make_error(error.message);
+    }
+    return common::make_error("Stream not found");
+  }
 
-      const char* stream_name = bson_iter_utf8(&bname, NULL);
-      fastotv::timestamp_t stream_start = bson_iter_date_time(&bstart);
-      fastotv::timestamp_t stream_stop = bson_iter_date_time(&bstop);
-      if (stream_name == title && stream_start == start && stop == stream_stop) {
-        UserStreamInfo uinf;
-        fastotv::commands_info::CatchupInfo orig;
-        bool visible = false;
-        if (MakeCatchupInfo(sdoc, fastotv::CATCHUP, uinf, &orig, &visible)) {
-          INFO_LOG() << "Cached catchup: " << orig.GetStreamID();
-          *cat = orig;
-          *is_created = false;
-          return common::Error();
-        }
+  std::vector<bson_oid_t> part_oids;
+  GetOidsFromArray(base_doc, STREAM_PARTS_FIELD, &part_oids);
+  fastotv::commands_info::StreamBaseInfo::parts_t parts;
+  for (const auto& part : part_oids) {
+    parts.push_back(common::ConvertToString(&part));
+  }
+
+  const unique_ptr_bson_t parts_query(bson_new());
+  if (MakeFindCatchupInPartsQuery(parts, title, start, stop, parts_query.get())) {
+    TrackedCursor parts_cursor("streams.find_catchup_parts", streams, parts_query.get(), nullptr,
+                               read_prefs_->Get(ReadPreferences::USER_READS));
+    const bson_t* sdoc;
+    while (parts_cursor.Next(&sdoc)) {
+      UserStreamInfo uinf;
+      fastotv::commands_info::CatchupInfo orig;
+      bool visible = false;
+      if (MakeCatchupInfo(sdoc, fastotv::CATCHUP, uinf, &orig, &visible)) {
+        INFO_LOG() << "Cached catchup: " << orig.GetStreamID();
+        *cat = orig;
+        *is_created = false;
+        return common::Error();
       }
     }
   }
 
-  if (!catchup_endpoint_.IsValid()) {
-    return common::make_error("Service not prepared for catchups, skiping request");
+  // the daemon loop updates the endpoint while subscriber loops and workers create catchups
+  base::CatchupEndpointInfo endpoint;
+  {
+    std::unique_lock<std::mutex> lock(catchup_endpoint_mutex_);
+    endpoint = catchup_endpoint_;
   }
-
-  const std::string sid = based_on.GetStreamID();
-  bson_oid_t bsid;
-  if (!common::ConvertFromString(sid, &bsid)) {
-    return common::make_error("Invalid stream id");
+  if (!endpoint.IsValid()) {
+    return common::make_error("Service not prepared for catchups, skiping request");
   }
 
-  const unique_ptr_bson_t stream_query(BCON_NEW("_id", BCON_OID(&bsid)));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_cursor(
-      mongoc_collection_find(streams_, MONGOC_QUERY_NONE, 0, 0, 0, stream_query.get(), NULL, NULL));
-  const bson_t* sdoc;
-  if (!stream_cursor || !mongoc_cursor_next(stream_cursor.get(), &sdoc)) {
-    return common::make_error("Stream not found");
+  StreamsCache::stream_entry_t stream;
+  err = FindStreamEntry(db.get(), bsid, &stream);
+  if (err) {
+    return err;
   }
 
   const unique_ptr_bson_t server_stream_query(
       BCON_NEW(SERVER_STREAMS_FIELD, "{", "$elemMatch", "{", "$eq", BCON_OID(&bsid), "}", "}"));
-  const std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> stream_server_cursor(
-      mongoc_collection_find(servers_, MONGOC_QUERY_NONE, 0, 0, 0, server_stream_query.get(), NULL, NULL));
+  TrackedCursor stream_server_cursor("servers.find_by_stream", servers, server_stream_query.get(), nullptr,
+                                     read_prefs_->Get(ReadPreferences::USER_READS));
   const bson_t* server_sdoc;
-  if (!stream_server_cursor || !mongoc_cursor_next(stream_server_cursor.get(), &server_sdoc)) {
+  if (!stream_server_cursor.Next(&server_sdoc)) {
     return common::make_error("Server not found");
   }
 
@@ -1999,18 +2984,8 @@ common::Error SubscribersManager::CreateOrFindCatchup(const fastotv::commands_in
     return common::make_error("Invalid stream");
   }
 
-  bson_iter_t bcls;
-  if (!bson_iter_init_find(&bcls, sdoc, STREAM_CLS_FIELD) || !BSON_ITER_HOLDS_UTF8(&bcls)) {
-    return common::make_error("Invalid stream");
-  }
-
-  bson_iter_t sdoc_iter;
-  if (!bson_iter_init_find(&sdoc_iter, sdoc, STREAM_OUTPUT_FIELD) || !BSON_ITER_HOLDS_ARRAY(&sdoc_iter)) {
-    return common::make_error("Invalid stream");
-  }
-
-  std::vector<fastotv::OutputUri> output_urls;
-  if (!GetOutputUrlData(&sdoc_iter, &output_urls)) {
+  const std::vector<fastotv::OutputUri>& output_urls = stream->output;
+  if (output_urls.empty()) {
     return common::make_error("Invalid stream");
   }
 
@@ -2051,8 +3026,8 @@ common::Error SubscribersManager::CreateOrFindCatchup(const fastotv::commands_in
   BSON_APPEND_INT32(doc.get(), STREAM_VIEW_COUNT_FIELD, 0);
   const unique_ptr_bson_t bparts(bson_new());
   BSON_APPEND_ARRAY(doc.get(), STREAM_PARTS_FIELD, bparts.get());
-  const auto caturls = CreateCatchupOutputUrl(doc.get(), output_urls, cid_str, catchup_endpoint_.catchups_host,
-                                              catchup_endpoint_.catchups_http_root);
+  const auto caturls = CreateCatchupOutputUrl(doc.get(), output_urls, cid_str, endpoint.catchups_host,
+                                              endpoint.catchups_http_root);
   std::vector<common::uri::GURL> true_catchups_urls = details::MakeUrlsFromOutput(caturls);
   int log_level = common::logging::LOG_LEVEL_INFO;
   BSON_APPEND_INT32(doc.get(), STREAM_LOG_LEVEL_FIELD, log_level);
@@ -2086,27 +3061,21 @@ common::Error SubscribersManager::CreateOrFindCatchup(const fastotv::commands_in
   BSON_APPEND_DATE_TIME(doc.get(), CATCHUP_START_FIELD, start);
   BSON_APPEND_DATE_TIME(doc.get(), CATCHUP_STOP_FIELD, stop);
 
-  bson_error_t error;
-  if (!mongoc_collection_insert(streams_, MONGOC_INSERT_NONE, doc.get(), NULL, &error)) {
-    DEBUG_LOG() << "Failed create catchup error: " << error.message;
-    return common::make_error(error.message);
-  }
-
-  // link catchup to stream parts array
+  // catchup, link from the stream parts array and from the server streams array, one unit
+  const bson_oid_t* server_oid = bson_iter_oid(&server_id);
   const unique_ptr_bson_t query_main_stream(BCON_NEW("_id", BCON_OID(&bsid)));
   const unique_ptr_bson_t update_main_stream(BCON_NEW("$push", "{", STREAM_PARTS_FIELD, BCON_OID(&catchupid), "}"));
-  if (!mongoc_collection_update(streams_, MONGOC_UPDATE_NONE, stream_query.get(), update_main_stream.get(), NULL,
-                                &error)) {
-    DEBUG_LOG() << "Failed to add stream to parts stream array: " << error.message;
-    return common::make_error(error.message);
-  }
-
-  const bson_oid_t* server_oid = bson_iter_oid(&server_id);
-  common::Error err = AddStreamToServer(servers_, server_oid, &catchupid);
+  WriteBatch batch(db.get());
+  batch.Insert(STREAMS_COLLECTION, doc.get());
+  batch.UpdateOne(STREAMS_COLLECTION, query_main_stream.get(), update_main_stream.get());
+  AddStreamToServer(&batch, server_oid, &catchupid);
+  err = batch.Execute();
   if (err) {
-    DEBUG_LOG() << "Failed to add stream to server array: " << err->GetDescription();
+    DEBUG_LOG() << "Failed create catchup error: " << err->GetDescription();
     return err;
   }
+  // next requests must see the new part without waiting for the change stream
+  streams_cache_->Remove(bsid, true);
 
   *serverid = common::ConvertToString(server_oid);
   epg.SetUrls(true_catchups_urls);
@@ -14,6 +14,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -21,11 +25,21 @@
 
 #include <common/net/types.h>
 
+#include "base/auth_cache.h"
 #include "base/isubscribers_manager.h"
+#include "base/login_guard.h"
+#include "base/single_flight.h"
+#include "base/user_streams_write_buffer.h"
+#include "base/view_counters.h"
 
-typedef struct _mongoc_client_t mongoc_client_t;
-typedef struct _mongoc_collection_t mongoc_collection_t;
-typedef struct _bson_t bson_t;
+#include "mongo/change_stream_watcher.h"
+#include "mongo/client_pool.h"
+#include "mongo/mongo_engine.h"
+#include "mongo/query_shapes.h"
+#include "mongo/read_preferences.h"
+#include "mongo/stream_class.h"
+#include "mongo/streams_cache.h"
+#include "mongo/user_entitlements.h"
 
 namespace fastocloud {
 namespace server {
@@ -33,22 +47,44 @@ namespace mongo {
 
 class SubscribersManager : public base::ISubscribersManager {
  public:
+  enum { warm_up_enable_wait_msec = 3000, warm_up_poll_msec = 50 };
   typedef base::ISubscribersManager base_class;
   typedef std::unordered_map<fastotv::user_id_t, std::vector<base::SubscriberInfo*>> inner_connections_t;
+  typedef std::unique_ptr<bson_t, MongoQueryDeleter> document_t;
+  typedef std::unordered_map<bson_oid_t, document_t, BsonOidHash, BsonOidEqual> documents_by_id_t;
   explicit SubscribersManager(base::ISubscribersObserver* observer);
+  ~SubscribersManager() override;
 
   void SetupCatchupsEndpoint(const base::CatchupEndpointInfo& info) override;
+  // should be called before ConnectToDatabase
+  void SetupViewCountersJournal(const std::string& path);
+  // database operations slower than msec are logged with their query plan, 0 disables
+  void SetupSlowQueryThreshold(uint32_t msec);
+  // should be called before ConnectToDatabase, max_staleness_seconds <= 0 is unbounded
+  void SetupReadPreferences(const std::string& catalog_mode,
+                            const std::string& user_mode,
+                            int64_t max_staleness_seconds);
+  // should be called before ConnectToDatabase, mode is check, create or require
+  void SetupIndexes(const std::string& mode);
   common::Error SendSubscriberNotification(const fastotv::user_id_t& uid,
                                            const fastotv::device_id_t& device,
                                            const fastotv::commands_info::NotificationTextInfo& notify) override;
 
   std::vector<base::FrontSubscriberInfo> GetOnlineSubscribers() override;
+  base::SubscribersManagerStats GetStats() const override;
 
-  common::ErrnoError ConnectToDatabase(const std::string& mongodb_url,
-                                       const std::string& db_name,
-                                       bool lazy) WARN_UNUSED_RESULT;
-  common::ErrnoError Disconnect() WARN_UNUSED_RESULT;
+  virtual common::ErrnoError ConnectToDatabase(const std::string& mongodb_url,
+                                               const std::string& db_name,
+                                               bool lazy,
+                                               size_t pool_size,
+                                               uint32_t pool_wait_timeout_msec) WARN_UNUSED_RESULT;
+  virtual common::ErrnoError Disconnect() WARN_UNUSED_RESULT;
+  // fills the auth cache with the logins of active devices and the streams cache, reads series into the database
+  // server memory; collections are split by _id over up to connections parallel reads, stops after budget_msec
+  base::WarmUpStats WarmUp(size_t connections, uint32_t budget_msec);
+  void CancelWarmUp();
 
+  // fails if another connection of the user holds the device, the check and the registration are one step
   common::Error RegisterInnerConnectionByHost(base::SubscriberInfo* client,
                                               const base::ServerDBAuthInfo& info) override WARN_UNUSED_RESULT;
   common::Error UnRegisterInnerConnectionByHost(base::SubscriberInfo* client) override WARN_UNUSED_RESULT;
@@ -56,14 +92,18 @@ class SubscribersManager : public base::ISubscribersManager {
   common::Error CheckIsLoginClient(base::SubscriberInfo* client,
                                    base::ServerDBAuthInfo* ser) const override WARN_UNUSED_RESULT;
   size_t GetAndUpdateOnlineUserByStreamID(fastotv::stream_id_t sid) override;
+  bool GetChannelsVersion(const fastotv::user_id_t& uid, base::ChannelsVersion* version) const override;
 
   common::Error ClientActivate(const fastotv::commands_info::LoginInfo& uauth,
+                               const std::string& peer_host,
                                fastotv::commands_info::DevicesInfo* dev) override WARN_UNUSED_RESULT;
   common::Error ClientLogin(fastotv::user_id_t uid,
                             const std::string& password,
                             fastotv::device_id_t dev,
+                            const std::string& peer_host,
                             base::ServerDBAuthInfo* ser) override WARN_UNUSED_RESULT;
   common::Error ClientLogin(const fastotv::commands_info::AuthInfo& uauth,
+                            const std::string& peer_host,
                             base::ServerDBAuthInfo* ser) override WARN_UNUSED_RESULT;
   common::Error ClientGetChannels(const fastotv::commands_info::AuthInfo& auth,
                                   fastotv::commands_info::ChannelsInfo* chans,
@@ -75,7 +115,7 @@ class SubscribersManager : public base::ISubscribersManager {
                                   fastotv::commands_info::ContentRequestsInfo* content_requests) override
       WARN_UNUSED_RESULT;
 
-  common::Error ClientFindHttpDirectoryOrUrlForChannel(const fastotv::commands_info::AuthInfo& auth,
+  common::Error ClientFindHttpDirectoryOrUrlForChannel(const base::ServerDBAuthInfo& auth,
                                                        fastotv::stream_id_t sid,
                                                        fastotv::channel_id_t cid,
                                                        http_directory_t* directory,
@@ -124,30 +164,130 @@ class SubscribersManager : public base::ISubscribersManager {
                                      const fastotv::commands_info::CreateContentRequestInfo& request,
                                      fastotv::commands_info::ContentRequestInfo* cont) override WARN_UNUSED_RESULT;
 
+ protected:
+  // one document of the collection by _id or by email, doc stays empty if there is none
+  virtual common::Error FindDocument(ClientPool::Client* db,
+                                     const char* operation,
+                                     const char* collection,
+                                     const bson_t* query,
+                                     const bson_t* fields,
+                                     ReadPreferences::ReadClass rclass,
+                                     document_t* doc) const WARN_UNUSED_RESULT;
+  // {"_id": {"$in": [...]}} queries, one round trip per batch of ids, a failed batch is
+  // logged, skipped and counted
+  virtual common::Error FindDocumentsByIDs(ClientPool::Client* db,
+                                           const char* operation,
+                                           const char* collection,
+                                           ReadPreferences::ReadClass rclass,
+                                           const std::vector<bson_oid_t>& oids,
+                                           documents_by_id_t* docs,
+                                           size_t* skipped_batches) const WARN_UNUSED_RESULT;
+  // the user document was written by this service
+  virtual void OnUserWritten(const fastotv::user_id_t& uid);
+  // existing catchup of the program among the parts of based_on or a new one, run once per concurrent requests
+  virtual common::Error CreateOrFindCatchup(const fastotv::commands_info::ChannelInfo& based_on,
+                                            const std::string& title,
+                                            fastotv::timestamp_t start,
+                                            fastotv::timestamp_t stop,
+                                            std::string* serverid,
+                                            fastotv::commands_info::CatchupInfo* cat,
+                                            bool* is_created) WARN_UNUSED_RESULT;
+
+  bool HandleSubscribersChange(const bson_t* event);
+  void InvalidateStream(const bson_oid_t& sid);
+
  private:
-  common::Error CreateOrFindCatchup(const fastotv::commands_info::ChannelInfo& based_on,
-                                    const std::string& title,
-                                    fastotv::timestamp_t start,
-                                    fastotv::timestamp_t stop,
-                                    std::string* serverid,
-                                    fastotv::commands_info::CatchupInfo* cat,
-                                    bool* is_created) WARN_UNUSED_RESULT;
-
-  common::Error ClientLoginImpl(fastotv::user_id_t uid,
+  common::Error PopClient(ClientPool::client_t* client) const WARN_UNUSED_RESULT;
+  typedef std::function<void(UserEntitlements* entitlements)> entitlements_update_t;
+
+  // should be called after the user document was written, update keeps a loaded entitlements index current
+  void BumpChannelsVersion(const fastotv::user_id_t& uid);
+  void BumpChannelsVersion(const fastotv::user_id_t& uid, entitlements_update_t update);
+  // sid in the first of arrays it is found in, "Stream not found" if the user isn't entitled to it
+  common::Error FindUserStream(ClientPool::Client* db,
+                               const fastotv::user_id_t& uid,
+                               const bson_oid_t& sid,
+                               const std::vector<UserEntitlements::array_t>& arrays,
+                               UserEntitlements::Entry* entry) const WARN_UNUSED_RESULT;
+  // only the entries of sid if it is set
+  common::Error LoadUserEntitlements(ClientPool::Client* db,
+                                     const fastotv::user_id_t& uid,
+                                     const bson_oid_t* sid,
+                                     UserEntitlements* entitlements) const WARN_UNUSED_RESULT;
+  // versions_seq/generation are taken before the user document was read, stale indexes are not stored
+  void StoreUserEntitlements(const fastotv::user_id_t& uid,
+                             uint64_t versions_seq,
+                             uint64_t generation,
+                             UserEntitlements entitlements) const;
+  void GetEntitlementsStamp(uint64_t* versions_seq, uint64_t* generation) const;
+  common::Error FindUserArray(const base::ServerDBAuthInfo& auth,
+                              fastotv::stream_id_t sid,
+                              base::UserStreamsWriteBuffer::UserArray* array) const WARN_UNUSED_RESULT;
+  bool FlushUserStreams(const base::UserStreamsWriteBuffer::updates_t& updates);
+  bool FlushViewCounts(const std::string& batch_id, const base::ViewCounters::deltas_t& deltas);
+  common::Error FindStreamEntry(ClientPool::Client* db,
+                                const bson_oid_t& sid,
+                                StreamsCache::stream_entry_t* entry) const WARN_UNUSED_RESULT;
+
+  // every error is a rejection of the credentials by the user document
+  common::Error ClientLoginImpl(ClientPool::Client* db,
                                 const fastotv::commands_info::ServerAuthInfo& auth,
                                 const bson_t* doc) WARN_UNUSED_RESULT;
+  common::Error CheckDeviceConnection(const fastotv::user_id_t& uid,
+                                      const fastotv::device_id_t& dev) WARN_UNUSED_RESULT;
+  void SetSubscribersWatchHealthy(bool healthy);
+  void ResetSubscribersState();
+  // false if a lookup isn't served by an index and the indexes mode requires it
+  bool CheckQueryShapes(ClientPool::Client* db);
+  // false if stopped by the deadline or CancelWarmUp
+  bool WarmUpCollection(ClientPool::Client* db,
+                        const char* collection,
+                        const bson_t* query,
+                        std::chrono::steady_clock::time_point deadline,
+                        base::WarmUpStats* stats);
 
   std::mutex connections_mutex_;
   inner_connections_t connections_;
 
-  mongoc_client_t* client_;
-  mongoc_collection_t* subscribers_;
-  mongoc_collection_t* servers_;
-  mongoc_collection_t* streams_;
-  mongoc_collection_t* series_;
-  mongoc_collection_t* requests_;
+  ClientPool* pool_;
+  ReadPreferences* read_prefs_;
+  QueryShapeChecker::Mode indexes_mode_;
+  std::vector<base::QueryPlanStats> query_plans_;  // written by ConnectToDatabase
+
+  StreamsCache* streams_cache_;
+  StreamClassResolver* stream_classes_;
+  base::UserStreamsWriteBuffer* write_buffer_;
+  base::ViewCounters* view_counters_;
+  std::string view_counters_journal_;
+  base::AuthCache* auth_cache_;
+  base::LoginGuard* login_guard_;
+  ChangeStreamWatcher subscribers_watcher_;
+
+  mutable std::mutex channels_versions_mutex_;
+  std::unordered_map<fastotv::user_id_t, uint64_t> channels_versions_;
+  uint64_t channels_versions_seq_;
+  bool subscribers_watch_healthy_;
+  uint64_t subscribers_generation_;
+
+  struct EntitlementsEntry {
+    uint64_t version;
+    uint64_t generation;
+    UserEntitlements entitlements;
+  };
+  // users with connections, served while their channels version is unchanged
+  mutable std::unordered_map<fastotv::user_id_t, EntitlementsEntry> entitlements_;
+
+  struct CatchupFlightResult {
+    std::string serverid;
+    fastotv::commands_info::CatchupInfo catchup;
+    bool is_created = false;
+  };
+  // identical catchup requests of many subscribers create one catchup
+  base::SingleFlight<CatchupFlightResult> catchups_flight_;
 
+  std::mutex catchup_endpoint_mutex_;
   base::CatchupEndpointInfo catchup_endpoint_;
+  std::atomic<bool> warm_up_cancelled_;
 };
 
 }  // namespace mongo
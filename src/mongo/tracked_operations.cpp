@@ -0,0 +1,240 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/tracked_operations.h"
+
+#include <string>
+
+#include <common/logger.h>
+
+#define EXPLAIN_VERBOSITY "queryPlanner"
+#define EXPLAIN_WINNING_PLAN_FIELD "queryPlanner.winningPlan"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+namespace {
+
+const uint64_t kQueryPlanIntervalMsec = 60000;
+
+uint64_t ToUsec(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+uint64_t NowMsec() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::string ToJson(const bson_t* doc) {
+  char* json = bson_as_json(doc, NULL);
+  if (!json) {
+    return std::string();
+  }
+  const std::string result(json);
+  bson_free(json);
+  return result;
+}
+
+// records the sample, true if it is slow and its query plan should be logged now
+bool RecordOperation(const char* operation,
+                     mongoc_collection_t* collection,
+                     const bson_t* query,
+                     base::OperationMetrics::Sample sample) {
+  MongoEngine& engine = MongoEngine::GetInstance();
+  const uint64_t slow_msec = engine.GetSlowOperationThreshold();
+  sample.slow = slow_msec && sample.usec >= slow_msec * 1000;
+  base::OperationMetrics* metrics = engine.GetOperationMetrics();
+  metrics->Record(operation, sample);
+  if (!sample.slow) {
+    return false;
+  }
+
+  const std::string filter = query ? ToJson(query) : "none";
+  WARNING_LOG() << "Slow database operation " << operation << ": " << sample.usec / 1000
+                << " msec, documents: " << sample.documents << ", filter: " << filter;
+  return collection && metrics->TryAcquireDiagnostics(operation, NowMsec(), kQueryPlanIntervalMsec);
+}
+
+void LogQueryPlan(const char* operation,
+                  mongoc_collection_t* collection,
+                  const bson_t* command,
+                  const mongoc_read_prefs_t* read_prefs) {
+  bson_t reply;
+  bson_error_t error;
+  if (!mongoc_collection_command_simple(collection, command, read_prefs, &reply, &error)) {
+    WARNING_LOG() << "Can't explain database operation " << operation << ", error: " << error.message;
+    bson_destroy(&reply);
+    return;
+  }
+
+  bson_iter_t iter;
+  bson_iter_t bplan;
+  if (bson_iter_init(&iter, &reply) && bson_iter_find_descendant(&iter, EXPLAIN_WINNING_PLAN_FIELD, &bplan) &&
+      BSON_ITER_HOLDS_DOCUMENT(&bplan)) {
+    uint32_t len = 0;
+    const uint8_t* data = nullptr;
+    bson_iter_document(&bplan, &len, &data);
+    bson_t plan;
+    if (bson_init_static(&plan, data, len)) {
+      WARNING_LOG() << "Query plan of " << operation << ": " << ToJson(&plan);
+    }
+  }
+  bson_destroy(&reply);
+}
+
+}  // namespace
+
+TrackedCursor::TrackedCursor(const char* operation,
+                             mongoc_collection_t* collection,
+                             const bson_t* query,
+                             const bson_t* fields,
+                             const mongoc_read_prefs_t* read_prefs)
+    : operation_(operation),
+      collection_(collection),
+      query_(query),
+      fields_(fields),
+      read_prefs_(read_prefs),
+      cursor_(),
+      elapsed_(),
+      documents_(0),
+      bytes_(0),
+      error_(false) {
+  const auto start = std::chrono::steady_clock::now();
+  cursor_.reset(mongoc_collection_find(collection, MONGOC_QUERY_NONE, 0, 0, 0, query, fields, read_prefs));
+  elapsed_ += std::chrono::steady_clock::now() - start;
+  error_ = !cursor_;
+}
+
+TrackedCursor::~TrackedCursor() {
+  base::OperationMetrics::Sample sample;
+  sample.usec = ToUsec(elapsed_);
+  sample.documents = documents_;
+  sample.bytes = bytes_;
+  sample.error = error_;
+  if (!RecordOperation(operation_, collection_, query_, sample)) {
+    return;
+  }
+
+  bson_t command;
+  bson_t find;
+  bson_init(&command);
+  BSON_APPEND_DOCUMENT_BEGIN(&command, "explain", &find);
+  BSON_APPEND_UTF8(&find, "find", mongoc_collection_get_name(collection_));
+  if (query_) {
+    BSON_APPEND_DOCUMENT(&find, "filter", query_);
+  }
+  if (fields_) {
+    BSON_APPEND_DOCUMENT(&find, "projection", fields_);
+  }
+  bson_append_document_end(&command, &find);
+  BSON_APPEND_UTF8(&command, "verbosity", EXPLAIN_VERBOSITY);
+  LogQueryPlan(operation_, collection_, &command, read_prefs_);
+  bson_destroy(&command);
+}
+
+bool TrackedCursor::Next(const bson_t** doc) {
+  if (!cursor_) {
+    return false;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const bool is_ok = mongoc_cursor_next(cursor_.get(), doc);
+  elapsed_ += std::chrono::steady_clock::now() - start;
+  if (is_ok) {
+    documents_++;
+    bytes_ += (*doc)->len;
+    return true;
+  }
+
+  bson_error_t error;
+  if (mongoc_cursor_error(cursor_.get(), &error)) {
+    error_ = true;
+  }
+  return false;
+}
+
+bool TrackedCursor::GetError(bson_error_t* error) const {
+  if (!cursor_) {
+    bson_set_error(error, MONGOC_ERROR_CURSOR, MONGOC_ERROR_CURSOR_INVALID_CURSOR, "Failed to create cursor");
+    return true;
+  }
+  return mongoc_cursor_error(cursor_.get(), error);
+}
+
+bool TrackedUpdate(const char* operation,
+                   mongoc_collection_t* collection,
+                   mongoc_update_flags_t flags,
+                   const bson_t* query,
+                   const bson_t* update,
+                   bson_error_t* error) {
+  const auto start = std::chrono::steady_clock::now();
+  const bool is_ok = mongoc_collection_update(collection, flags, query, update, NULL, error);
+  base::OperationMetrics::Sample sample;
+  sample.usec = ToUsec(std::chrono::steady_clock::now() - start);
+  sample.error = !is_ok;
+  if (!RecordOperation(operation, collection, query, sample)) {
+    return is_ok;
+  }
+
+  bson_t command;
+  bson_t updates;
+  bson_t statement;
+  bson_init(&command);
+  BSON_APPEND_DOCUMENT_BEGIN(&command, "explain", &updates);
+  BSON_APPEND_UTF8(&updates, "update", mongoc_collection_get_name(collection));
+  bson_t array;
+  BSON_APPEND_ARRAY_BEGIN(&updates, "updates", &array);
+  BSON_APPEND_DOCUMENT_BEGIN(&array, "0", &statement);
+  BSON_APPEND_DOCUMENT(&statement, "q", query);
+  BSON_APPEND_DOCUMENT(&statement, "u", update);
+  bson_append_document_end(&array, &statement);
+  bson_append_array_end(&updates, &array);
+  bson_append_document_end(&command, &updates);
+  BSON_APPEND_UTF8(&command, "verbosity", EXPLAIN_VERBOSITY);
+  LogQueryPlan(operation, collection, &command, nullptr);
+  bson_destroy(&command);
+  return is_ok;
+}
+
+bool TrackedBulkExecute(const char* operation, mongoc_bulk_operation_t* bulk, bson_error_t* error, bson_t* out_reply) {
+  const auto start = std::chrono::steady_clock::now();
+  bson_t reply;
+  const bool is_ok = mongoc_bulk_operation_execute(bulk, &reply, error);
+  base::OperationMetrics::Sample sample;
+  sample.usec = ToUsec(std::chrono::steady_clock::now() - start);
+  sample.error = !is_ok;
+
+  bson_iter_t iter;
+  const char* counters[] = {"nInserted", "nMatched", "nUpserted"};
+  for (const char* counter : counters) {
+    if (bson_iter_init_find(&iter, &reply, counter) && BSON_ITER_HOLDS_INT32(&iter)) {
+      sample.documents += bson_iter_int32(&iter);
+    }
+  }
+  if (out_reply) {
+    bson_copy_to(&reply, out_reply);
+  }
+  bson_destroy(&reply);
+
+  // a bulk mixes statements, it has no single filter to explain
+  RecordOperation(operation, nullptr, nullptr, sample);
+  return is_ok;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,78 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+
+#include <mongoc.h>
+
+#include "mongo/mongo_engine.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Database calls recorded in MongoEngine operation metrics under a caller chosen operation name.
+// Slow finds and updates are logged with their filter and, at most once a minute per operation, the query plan.
+
+// Find whose latency is the time spent creating the cursor and fetching documents, not processing them.
+// nullptr read_prefs reads from the primary.
+class TrackedCursor {
+ public:
+  TrackedCursor(const char* operation,
+                mongoc_collection_t* collection,
+                const bson_t* query,
+                const bson_t* fields,
+                const mongoc_read_prefs_t* read_prefs);
+  ~TrackedCursor();
+
+  // false at the end of results or on error
+  bool Next(const bson_t** doc);
+  bool GetError(bson_error_t* error) const;
+
+ private:
+  const char* const operation_;
+  mongoc_collection_t* const collection_;
+  const bson_t* const query_;
+  const bson_t* const fields_;
+  const mongoc_read_prefs_t* const read_prefs_;
+  std::unique_ptr<mongoc_cursor_t, MongoCursorDeleter> cursor_;
+  std::chrono::steady_clock::duration elapsed_;
+  uint64_t documents_;
+  uint64_t bytes_;
+  bool error_;
+};
+
+bool TrackedUpdate(const char* operation,
+                   mongoc_collection_t* collection,
+                   mongoc_update_flags_t flags,
+                   const bson_t* query,
+                   const bson_t* update,
+                   bson_error_t* error) WARN_UNUSED_RESULT;
+
+// reply, if not nullptr, is initialized with the server reply, its errorLabels drive the retries of transactions;
+// the caller destroys it
+bool TrackedBulkExecute(const char* operation,
+                        mongoc_bulk_operation_t* bulk,
+                        bson_error_t* error,
+                        bson_t* reply = nullptr) WARN_UNUSED_RESULT;
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
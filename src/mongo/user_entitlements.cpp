@@ -0,0 +1,88 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/user_entitlements.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+namespace {
+bool EntryLess(const UserEntitlements::Entry& lhs, const UserEntitlements::Entry& rhs) {
+  const int cmp = bson_oid_compare(&lhs.sid, &rhs.sid);
+  return cmp < 0 || (cmp == 0 && lhs.array < rhs.array);
+}
+
+bool EntryEqual(const UserEntitlements::Entry& lhs, const UserEntitlements::Entry& rhs) {
+  return bson_oid_equal(&lhs.sid, &rhs.sid) && lhs.array == rhs.array;
+}
+}  // namespace
+
+UserEntitlements::UserEntitlements() : entries_() {}
+
+void UserEntitlements::Assign(std::vector<Entry> entries) {
+  std::stable_sort(entries.begin(), entries.end(), EntryLess);
+  entries.erase(std::unique(entries.begin(), entries.end(), EntryEqual), entries.end());
+  entries.shrink_to_fit();
+  entries_ = std::move(entries);
+}
+
+void UserEntitlements::Insert(const Entry& entry) {
+  const auto it = LowerBound(entry.sid, entry.array);
+  if (it != entries_.end() && EntryEqual(*it, entry)) {
+    *it = entry;
+    return;
+  }
+  entries_.insert(it, entry);
+}
+
+bool UserEntitlements::Remove(const bson_oid_t& sid, array_t array) {
+  const auto it = LowerBound(sid, array);
+  if (it == entries_.end() || !bson_oid_equal(&it->sid, &sid) || it->array != array) {
+    return false;
+  }
+  entries_.erase(it);
+  return true;
+}
+
+UserEntitlements::Entry* UserEntitlements::Find(const bson_oid_t& sid, array_t array) {
+  const auto it = LowerBound(sid, array);
+  if (it == entries_.end() || !bson_oid_equal(&it->sid, &sid) || it->array != array) {
+    return nullptr;
+  }
+  return &(*it);
+}
+
+const UserEntitlements::Entry* UserEntitlements::Find(const bson_oid_t& sid, array_t array) const {
+  return const_cast<UserEntitlements*>(this)->Find(sid, array);
+}
+
+size_t UserEntitlements::GetSize() const {
+  return entries_.size();
+}
+
+std::vector<UserEntitlements::Entry>::iterator UserEntitlements::LowerBound(const bson_oid_t& sid, array_t array) {
+  Entry key;
+  bson_oid_copy(&sid, &key.sid);
+  key.array = array;
+  return std::lower_bound(entries_.begin(), entries_.end(), key, EntryLess);
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,62 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <vector>
+
+#include <bson.h>
+
+#include "base/user_streams_write_buffer.h"
+
+#include "mongo/mongo2info.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Streams, vods and catchups a user is entitled to, sorted by binary stream id.
+// Lookups compare 12 byte ids, no hex strings are built per array element.
+class UserEntitlements {
+ public:
+  typedef base::UserStreamsWriteBuffer::UserArray array_t;
+
+  struct Entry {
+    bson_oid_t sid;
+    array_t array;
+    UserStreamInfo uinf;
+  };
+
+  UserEntitlements();
+
+  void Assign(std::vector<Entry> entries);
+  // replaces the entry of the same stream and array
+  void Insert(const Entry& entry);
+  bool Remove(const bson_oid_t& sid, array_t array);
+
+  Entry* Find(const bson_oid_t& sid, array_t array);
+  const Entry* Find(const bson_oid_t& sid, array_t array) const;
+
+  size_t GetSize() const;
+
+ private:
+  std::vector<Entry>::iterator LowerBound(const bson_oid_t& sid, array_t array);
+
+  std::vector<Entry> entries_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
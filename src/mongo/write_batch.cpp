@@ -0,0 +1,145 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "mongo/write_batch.h"
+
+#include <common/logger.h>
+
+#include "mongo/tracked_operations.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+namespace {
+
+bool RunSteps(mongoc_client_session_t* session, void* ctx, bson_t** reply, bson_error_t* error) {
+  const transaction_steps_t* steps = static_cast<const transaction_steps_t*>(ctx);
+  return (*steps)(session, reply, error);
+}
+
+}  // namespace
+
+common::Error RunTransaction(ClientPool::Client* db, transaction_steps_t steps) {
+  if (!db || !steps) {
+    return common::make_error_inval();
+  }
+
+  // not sent at all rather than sent without the atomicity of a transaction
+  bool transactions = false;
+  common::Error err = db->IsTransactionsSupported(&transactions);
+  if (err) {
+    return err;
+  }
+
+  bson_error_t error;
+  if (!transactions) {
+    bson_t* reply = nullptr;
+    const bool is_ok = steps(nullptr, &reply, &error);
+    if (reply) {
+      bson_destroy(reply);
+    }
+    if (!is_ok) {
+      return common::make_error(error.message);
+    }
+    return common::Error();
+  }
+
+  mongoc_client_session_t* session = mongoc_client_start_session(db->GetClient(), NULL, &error);
+  if (!session) {
+    return common::make_error(error.message);
+  }
+
+  const bool is_ok = mongoc_client_session_with_transaction(session, &RunSteps, NULL, &steps, NULL, &error);
+  mongoc_client_session_destroy(session);
+  if (!is_ok) {
+    return common::make_error(error.message);
+  }
+  return common::Error();
+}
+
+WriteBatch::WriteBatch(ClientPool::Client* db) : db_(db), steps_() {}
+
+void WriteBatch::Insert(const char* collection, const bson_t* doc) {
+  Step step;
+  step.collection = collection;
+  step.doc.reset(bson_copy(doc));
+  steps_.push_back(std::move(step));
+}
+
+void WriteBatch::UpdateOne(const char* collection, const bson_t* query, const bson_t* update) {
+  Step step;
+  step.collection = collection;
+  step.query.reset(bson_copy(query));
+  step.doc.reset(bson_copy(update));
+  steps_.push_back(std::move(step));
+}
+
+common::Error WriteBatch::Execute() {
+  if (!db_) {
+    return common::make_error_inval();
+  }
+
+  if (steps_.empty()) {
+    return common::Error();
+  }
+
+  return RunTransaction(db_, [this](mongoc_client_session_t* session, bson_t** reply, bson_error_t* error) {
+    return ExecuteSteps(session, reply, error);
+  });
+}
+
+bool WriteBatch::ExecuteSteps(mongoc_client_session_t* session, bson_t** reply, bson_error_t* error) {
+  for (size_t i = 0; i < steps_.size();) {
+    mongoc_collection_t* collection = db_->GetCollection(steps_[i].collection.c_str());
+    if (!collection) {
+      bson_set_error(error, MONGOC_ERROR_CLIENT, MONGOC_ERROR_CLIENT_NOT_READY, "Can't get collection: %s",
+                     steps_[i].collection.c_str());
+      return false;
+    }
+
+    const std::unique_ptr<bson_t, MongoQueryDeleter> opts(bson_new());
+    if (session && !mongoc_client_session_append(session, opts.get(), error)) {
+      return false;
+    }
+
+    const std::unique_ptr<mongoc_bulk_operation_t, MongoBulkDeleter> bulk(
+        mongoc_collection_create_bulk_operation_with_opts(collection, opts.get()));
+    const std::string& name = steps_[i].collection;
+    for (; i < steps_.size() && steps_[i].collection == name; ++i) {
+      const Step& step = steps_[i];
+      if (step.query) {
+        mongoc_bulk_operation_update_one(bulk.get(), step.query.get(), step.doc.get(), false);
+      } else {
+        mongoc_bulk_operation_insert(bulk.get(), step.doc.get());
+      }
+    }
+
+    const std::string operation = "write_batch." + name;
+    bson_t* step_reply = bson_new();
+    if (!TrackedBulkExecute(operation.c_str(), bulk.get(), error, step_reply)) {
+      DEBUG_LOG() << "Failed write batch step on " << name << " error: " << error->message;
+      *reply = step_reply;
+      return false;
+    }
+    bson_destroy(step_reply);
+  }
+
+  return true;
+}
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -0,0 +1,72 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <mongoc.h>
+
+#include <common/error.h>
+
+#include "mongo/client_pool.h"
+#include "mongo/mongo_engine.h"
+
+namespace fastocloud {
+namespace server {
+namespace mongo {
+
+// Steps of a transaction, session is nullptr on a standalone server. On failure reply gets the server reply of the
+// failed step, allocated with bson_new, so the driver sees its error labels.
+typedef std::function<bool(mongoc_client_session_t* session, bson_t** reply, bson_error_t* error)> transaction_steps_t;
+
+// Runs the steps in a transaction on a replica set or mongos, with the retries of the driver: the whole transaction
+// again on TransientTransactionError, the commit on UnknownTransactionCommitResult. A standalone server runs them
+// once without a session. Fails without running them while the topology is unknown.
+common::Error RunTransaction(ClientPool::Client* db, transaction_steps_t steps) WARN_UNUSED_RESULT;
+
+// Writes of one multi-step mutation (insert a document, link it from others), sent together.
+// Consecutive steps on the same collection go out as one ordered bulk, one round trip per group of steps.
+// On a replica set or mongos the groups run in a transaction, so either every step is applied or none;
+// a standalone server has no transactions and an ordered bulk stops at the first failed step.
+class WriteBatch {
+ public:
+  explicit WriteBatch(ClientPool::Client* db);
+
+  // documents are copied
+  void Insert(const char* collection, const bson_t* doc);
+  void UpdateOne(const char* collection, const bson_t* query, const bson_t* update);
+
+  common::Error Execute() WARN_UNUSED_RESULT;
+
+ private:
+  struct Step {
+    std::string collection;
+    std::unique_ptr<bson_t, MongoQueryDeleter> query;  // nullptr for inserts
+    std::unique_ptr<bson_t, MongoQueryDeleter> doc;
+  };
+
+  bool ExecuteSteps(mongoc_client_session_t* session, bson_t** reply, bson_error_t* error);
+
+  ClientPool::Client* const db_;
+  std::vector<Step> steps_;
+};
+
+}  // namespace mongo
+}  // namespace server
+}  // namespace fastocloud
@@ -14,6 +14,10 @@
 
 #include "process_slave_wrapper.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -33,9 +37,12 @@
 #include "daemon/commands_info/sync_info.h"
 #include "daemon/server.h"
 
+#include "base/db_worker_pool.h"
+
 #include "http/handler.h"
 #include "http/server.h"
 
+#include "mongo/snapshot_subscribers_manager.h"
 #include "mongo/subscribers_manager.h"
 
 #include "subscribers/handler.h"
@@ -65,30 +72,69 @@ struct ProcessSlaveWrapper::NodeStats {
   fastotv::timestamp_t timestamp;
 };
 
+struct ProcessSlaveWrapper::WarmUpState {
+  WarmUpState() : mutex(), cond(), finished(false), stopped(false), stats() {}
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool finished;
+  bool stopped;
+  base::WarmUpStats stats;
+};
+
 ProcessSlaveWrapper::ProcessSlaveWrapper(const Config& config)
     : config_(config),
       loop_(nullptr),
       subscribers_server_(nullptr),
+      subscribers_loops_(),
       subscribers_handler_(nullptr),
       http_server_(nullptr),
       http_handler_(nullptr),
+      db_workers_(nullptr),
       ping_client_timer_(INVALID_TIMER_ID),
       node_stats_timer_(INVALID_TIMER_ID),
       check_license_timer_(INVALID_TIMER_ID),
-      node_stats_(new NodeStats) {
+      node_stats_(new NodeStats),
+      warm_up_(new WarmUpState) {
   loop_ = new DaemonServer(config.host, this);
   loop_->SetName("client_server");
 
-  mongo::SubscribersManager* sub_manager = new mongo::SubscribersManager(this);
+  mongo::SubscribersManager* sub_manager = nullptr;
+  if (config.subscribers_backend == SUBSCRIBERS_BACKEND_SNAPSHOT) {
+    mongo::SnapshotSubscribersManager* snapshot_manager = new mongo::SnapshotSubscribersManager(this);
+    snapshot_manager->SetupSnapshot(config.subscribers_snapshot);
+    sub_manager = snapshot_manager;
+  } else {
+    sub_manager = new mongo::SubscribersManager(this);
+  }
+  sub_manager->SetupViewCountersJournal(config.view_counters_journal);
+  sub_manager->SetupSlowQueryThreshold(config.mongodb_slow_query);
+  sub_manager->SetupReadPreferences(config.mongodb_catalog_read_preference, config.mongodb_user_read_preference,
+                                    config.mongodb_max_staleness);
+  sub_manager->SetupIndexes(config.mongodb_indexes);
   sub_manager_ = sub_manager;
 
-  subscribers_handler_ =
-      new subscribers::SubscribersHandler(this, sub_manager_, config.epg_url, config.locked_stream_text);
-  subscribers_server_ = new subscribers::SubscribersServer(
+  db_workers_ = new base::DbWorkerPool(config.db_workers, base::DbWorkerPool::default_queue_size);
+
+  subscribers_handler_ = new subscribers::SubscribersHandler(this, sub_manager_, db_workers_, config.epg_url,
+                                                             config.locked_stream_text);
+  subscribers::SubscribersServer* subscribers_server = new subscribers::SubscribersServer(
       config.subscribers_host, subscribers::SubscribersServer::C_STANDART, subscribers_handler_);
-  subscribers_server_->SetName("subscribers_server");
+  subscribers_server->SetName("subscribers_server");
+  // the server accepts and serves its share, the other loops serve connections handed out to them
+  size_t subscribers_loops = config.subscribers_loops;
+  if (!subscribers_loops) {
+    subscribers_loops = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  for (size_t i = 1; i < subscribers_loops; ++i) {
+    subscribers::SubscribersLoop* subscribers_loop = new subscribers::SubscribersLoop(subscribers_handler_);
+    subscribers_loop->SetName("subscribers_loop_" + std::to_string(i));
+    subscribers_loops_.push_back(subscribers_loop);
+  }
+  subscribers_server->SetLoops(subscribers_loops_);
+  subscribers_server_ = subscribers_server;
 
-  http_handler_ = new http::HttpHandler(sub_manager_);
+  http_handler_ = new http::HttpHandler(sub_manager_, db_workers_);
   http_server_ = new http::HttpServer(config.http_host, http_handler_);
   http_server_->SetName("http_server");
 }
@@ -121,26 +167,63 @@ common::ErrnoError ProcessSlaveWrapper::SendStopDaemonRequest(const Config& conf
 }
 
 ProcessSlaveWrapper::~ProcessSlaveWrapper() {
+  destroy(&db_workers_);
   ignore_result((static_cast<mongo::SubscribersManager*>(sub_manager_))->Disconnect());
   destroy(&http_server_);
   destroy(&http_handler_);
   destroy(&subscribers_server_);
+  for (size_t i = 0; i < subscribers_loops_.size(); ++i) {
+    destroy(&subscribers_loops_[i]);
+  }
   destroy(&subscribers_handler_);
   destroy(&sub_manager_);
   destroy(&loop_);
   destroy(&node_stats_);
+  destroy(&warm_up_);
 }
 
 int ProcessSlaveWrapper::Exec() {
-  common::ErrnoError err = static_cast<mongo::SubscribersManager*>(sub_manager_)
-                               ->ConnectToDatabase(config_.mongodb_url, MONGODB_DATABASE_NAME, true);
+  mongo::SubscribersManager* sub_manager = static_cast<mongo::SubscribersManager*>(sub_manager_);
+  common::ErrnoError err = sub_manager->ConnectToDatabase(config_.mongodb_url, MONGODB_DATABASE_NAME, true,
+                                                          config_.mongodb_pool_size, config_.mongodb_pool_wait_timeout);
   if (err) {
     DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
     return EXIT_FAILURE;
   }
 
+  db_workers_->Start();
+
+  // subscribers reconnecting after a restart find the caches filled, the daemon server answers meanwhile
+  std::thread warm_up_thread = std::thread([this, sub_manager] {
+    base::WarmUpStats stats;
+    if (config_.warm_up_budget) {
+      stats = sub_manager->WarmUp(config_.mongodb_pool_size, config_.warm_up_budget);
+    }
+
+    std::unique_lock<std::mutex> lock(warm_up_->mutex);
+    warm_up_->finished = true;
+    warm_up_->stats = stats;
+    warm_up_->cond.notify_all();
+  });
+
+  std::vector<std::thread> subs_loops_threads;
+  for (size_t i = 0; i < subscribers_loops_.size(); ++i) {
+    subscribers::SubscribersLoop* subs_loop = subscribers_loops_[i];
+    subs_loops_threads.push_back(std::thread([this, subs_loop] {
+      if (WaitWarmUp()) {
+        ignore_result(subs_loop->Exec());
+      }
+      // connections handed out after the last iteration aren't served by anyone
+      subs_loop->ClosePending();
+    }));
+  }
+
   subscribers::SubscribersServer* subs_server = static_cast<subscribers::SubscribersServer*>(subscribers_server_);
-  std::thread subs_thread = std::thread([subs_server] {
+  std::thread subs_thread = std::thread([this, subs_server] {
+    if (!WaitWarmUp()) {
+      return;
+    }
+
     common::ErrnoError err = subs_server->Bind(true);
     if (err) {
       DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
@@ -157,7 +240,11 @@ int ProcessSlaveWrapper::Exec() {
   });
 
   http::HttpServer* http_server = static_cast<http::HttpServer*>(http_server_);
-  std::thread http_thread = std::thread([http_server] {
+  std::thread http_thread = std::thread([this, http_server] {
+    if (!WaitWarmUp()) {
+      return;
+    }
+
     common::ErrnoError err = http_server->Bind(true);
     if (err) {
       DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
@@ -193,8 +280,13 @@ int ProcessSlaveWrapper::Exec() {
   res = server->Exec();
 
 finished:
+  warm_up_thread.join();
   subs_thread.join();
+  for (size_t i = 0; i < subs_loops_threads.size(); ++i) {
+    subs_loops_threads[i].join();
+  }
   http_thread.join();
+  db_workers_->Stop();
   return res;
 }
 
@@ -287,11 +379,26 @@ void ProcessSlaveWrapper::ChildStatusChanged(common::libev::IoChild* child, int
 }
 
 void ProcessSlaveWrapper::StopImpl() {
+  static_cast<mongo::SubscribersManager*>(sub_manager_)->CancelWarmUp();
+  {
+    std::unique_lock<std::mutex> lock(warm_up_->mutex);
+    warm_up_->stopped = true;
+    warm_up_->cond.notify_all();
+  }
   subscribers_server_->Stop();
+  for (size_t i = 0; i < subscribers_loops_.size(); ++i) {
+    subscribers_loops_[i]->Stop();
+  }
   http_server_->Stop();
   loop_->Stop();
 }
 
+bool ProcessSlaveWrapper::WaitWarmUp() {
+  std::unique_lock<std::mutex> lock(warm_up_->mutex);
+  warm_up_->cond.wait(lock, [this] { return warm_up_->finished || warm_up_->stopped; });
+  return !warm_up_->stopped;
+}
+
 void ProcessSlaveWrapper::BroadcastClients(const fastotv::protocol::request_t& req) {
   std::vector<common::libev::IoClient*> clients = loop_->GetClients();
   for (size_t i = 0; i < clients.size(); ++i) {
@@ -453,6 +560,27 @@ common::ErrnoError ProcessSlaveWrapper::HandleRequestClientGetLogService(Protoco
   return common::make_errno_error_inval();
 }
 
+common::ErrnoError ProcessSlaveWrapper::HandleRequestClientGetDbStatsService(ProtocoledDaemonClient* dclient,
+                                                                           const fastotv::protocol::request_t* req) {
+  CHECK(loop_->IsLoopThread());
+  if (!dclient->IsVerified()) {
+    const auto info = dclient->GetInfo();
+    common::net::HostAndPort host(info.host(), info.port());
+    if (!host.IsLocalHost()) {
+      return common::make_errno_error_inval();
+    }
+  }
+
+  std::string db_stats;
+  common::Error err_ser = MakeDbStats().SerializeToString(&db_stats);
+  if (err_ser) {
+    const std::string err_str = err_ser->GetDescription();
+    return common::make_errno_error(err_str, EAGAIN);
+  }
+
+  return dclient->GetDbStatsServiceSuccess(req->id, db_stats);
+}
+
 common::ErrnoError ProcessSlaveWrapper::HandleRequestClientSendMessageForSubscriber(
     ProtocoledDaemonClient* dclient,
     const fastotv::protocol::request_t* req) {
@@ -513,6 +641,11 @@ common::ErrnoError ProcessSlaveWrapper::HandleRequestClientPrepareService(Protoc
 
     service::StateInfo state;
     state.SetOnlineClients(sub_manager_->GetOnlineSubscribers());
+    {
+      std::unique_lock<std::mutex> lock(warm_up_->mutex);
+      state.SetReady(warm_up_->finished);
+      state.SetWarmUp(warm_up_->stats);
+    }
     return dclient->PrepareServiceSuccess(req->id, state);
   }
 
@@ -692,6 +825,8 @@ common::ErrnoError ProcessSlaveWrapper::HandleRequestServiceCommand(ProtocoledDa
     return HandleRequestClientSyncService(dclient, req);
   } else if (req->method == DAEMON_GET_LOG_SERVICE) {
     return HandleRequestClientGetLogService(dclient, req);
+  } else if (req->method == DAEMON_GET_DB_STATS_SERVICE) {
+    return HandleRequestClientGetDbStatsService(dclient, req);
   } else if (req->method == DAEMON_CLIENT_SEND_MESSAGE) {
     return HandleRequestClientSendMessageForSubscriber(dclient, req);
   }
@@ -773,6 +908,15 @@ void ProcessSlaveWrapper::CheckLicenseExpired() {
   }
 }
 
+service::DbStatsInfo ProcessSlaveWrapper::MakeDbStats() const {
+  base::SubscribersManagerStats db_stats = sub_manager_->GetStats();
+  db_stats.channels_cache =
+      static_cast<subscribers::SubscribersHandler*>(subscribers_handler_)->GetChannelsCacheStats();
+  db_stats.channels_push = static_cast<subscribers::SubscribersHandler*>(subscribers_handler_)->GetChannelsPushStats();
+  db_stats.paths_cache = static_cast<http::HttpHandler*>(http_handler_)->GetPathsCacheStats();
+  return service::DbStatsInfo(db_stats);
+}
+
 std::string ProcessSlaveWrapper::MakeServiceStats(common::time64_t expiration_time) const {
   service::CpuShot next = service::GetMachineCpuShot();
   double cpu_load = service::GetCpuMachineLoad(node_stats_->prev, next);
@@ -808,6 +952,7 @@ std::string ProcessSlaveWrapper::MakeServiceStats(common::time64_t expiration_ti
                            hdd_shot.hdd_bytes_total, hdd_shot.hdd_bytes_free, bytes_recv / ts_diff,
                            bytes_send / ts_diff, sshot.uptime, current_time, online, next_nshot.bytes_recv,
                            next_nshot.bytes_send);
+  stat.SetDbStats(MakeDbStats());
 
   std::string node_stats;
   if (expiration_time != 0) {
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <common/libev/io_loop_observer.h>
 
@@ -25,6 +26,8 @@
 
 #include "base/isubscribers_observer.h"
 
+#include "daemon/commands_info/db_stats_info.h"
+
 #include "config.h"
 
 namespace fastocloud {
@@ -33,9 +36,14 @@ namespace server {
 class ProtocoledDaemonClient;
 
 namespace base {
+class DbWorkerPool;
 class ISubscribersManager;
 }
 
+namespace subscribers {
+class SubscribersLoop;
+}
+
 class ProcessSlaveWrapper : public common::libev::IoLoopObserver,
                             public subscribers::ISubscribersHandlerObserver,
                             public base::ISubscribersObserver {
@@ -83,6 +91,8 @@ class ProcessSlaveWrapper : public common::libev::IoLoopObserver,
 
  private:
   void StopImpl();
+  // false if the service stopped during the warm-up
+  bool WaitWarmUp();
 
   void BroadcastClients(const fastotv::protocol::request_t& req);
 
@@ -101,6 +111,8 @@ class ProcessSlaveWrapper : public common::libev::IoLoopObserver,
                                                     const fastotv::protocol::request_t* req) WARN_UNUSED_RESULT;
   common::ErrnoError HandleRequestClientGetLogService(ProtocoledDaemonClient* dclient,
                                                       const fastotv::protocol::request_t* req) WARN_UNUSED_RESULT;
+  common::ErrnoError HandleRequestClientGetDbStatsService(ProtocoledDaemonClient* dclient,
+                                                          const fastotv::protocol::request_t* req) WARN_UNUSED_RESULT;
   common::ErrnoError HandleRequestClientSendMessageForSubscriber(ProtocoledDaemonClient* dclient,
                                                                  const fastotv::protocol::request_t* req)
       WARN_UNUSED_RESULT;
@@ -116,18 +128,21 @@ class ProcessSlaveWrapper : public common::libev::IoLoopObserver,
   void CheckLicenseExpired();
 
   std::string MakeServiceStats(common::time64_t expiration_time) const;
+  service::DbStatsInfo MakeDbStats() const;
 
   const Config config_;
 
   common::libev::IoLoop* loop_;
   // subscribers
   common::libev::IoLoop* subscribers_server_;
+  std::vector<subscribers::SubscribersLoop*> subscribers_loops_;  // served connections handed out by the server
   common::libev::IoLoopObserver* subscribers_handler_;
   // http
   common::libev::IoLoop* http_server_;
   common::libev::IoLoopObserver* http_handler_;
 
   base::ISubscribersManager* sub_manager_;
+  base::DbWorkerPool* db_workers_;
 
   common::libev::timer_id_t ping_client_timer_;
   common::libev::timer_id_t node_stats_timer_;
@@ -135,6 +150,8 @@ class ProcessSlaveWrapper : public common::libev::IoLoopObserver,
 
   struct NodeStats;
   NodeStats* node_stats_;
+  struct WarmUpState;
+  WarmUpState* warm_up_;
 };
 
 }  // namespace server
@@ -0,0 +1,117 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "subscribers/channels_cache.h"
+
+#include <iterator>
+#include <string>
+
+#include <common/time.h>
+
+namespace fastocloud {
+namespace server {
+namespace subscribers {
+
+namespace {
+template <typename T>
+size_t GetSerializedSizeOf(const T& info) {
+  std::string serialized;
+  common::Error err = info.SerializeToString(&serialized);
+  if (err) {
+    return 0;
+  }
+  return serialized.size();
+}
+}  // namespace
+
+size_t ChannelsPayload::GetSerializedSize() const {
+  return GetSerializedSizeOf(channels) + GetSerializedSizeOf(vods) + GetSerializedSizeOf(private_channels) +
+         GetSerializedSizeOf(private_vods) + GetSerializedSizeOf(catchups) + GetSerializedSizeOf(series) +
+         GetSerializedSizeOf(requests);
+}
+
+ChannelsCache::ChannelsCache(size_t max_entries, size_t max_bytes, time_t max_age_sec)
+    : max_entries_(max_entries),
+      max_bytes_(max_bytes),
+      max_age_msec_(max_age_sec * 1000),
+      mutex_(),
+      entries_(),
+      index_(),
+      stats_() {}
+
+ChannelsCache::payload_t ChannelsCache::Find(const fastotv::user_id_t& uid, const base::ChannelsVersion& version) {
+  const fastotv::timestamp_t now = common::time::current_utc_mstime();
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto it = index_.find(uid);
+  if (it == index_.end()) {
+    stats_.misses++;
+    return nullptr;
+  }
+
+  const entries_t::iterator entry = it->second;
+  if (entry->version != version || now - entry->created > max_age_msec_) {
+    EraseLocked(entry);
+    stats_.misses++;
+    return nullptr;
+  }
+
+  entries_.splice(entries_.begin(), entries_, entry);
+  stats_.hits++;
+  stats_.bytes_saved += entry->bytes;
+  return entry->payload;
+}
+
+void ChannelsCache::Insert(const fastotv::user_id_t& uid, const base::ChannelsVersion& version, payload_t payload) {
+  if (!payload || max_entries_ == 0) {
+    return;
+  }
+
+  const size_t bytes = payload->GetSerializedSize();
+  if (bytes > max_bytes_) {
+    return;
+  }
+
+  const fastotv::timestamp_t now = common::time::current_utc_mstime();
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto it = index_.find(uid);
+  if (it != index_.end()) {
+    EraseLocked(it->second);
+  }
+
+  entries_.push_front({uid, version, payload, bytes, now});
+  index_[uid] = entries_.begin();
+  stats_.bytes += bytes;
+  while (entries_.size() > max_entries_ || stats_.bytes > max_bytes_) {
+    EraseLocked(std::prev(entries_.end()));
+    stats_.evictions++;
+  }
+}
+
+base::ChannelsCacheStats ChannelsCache::GetStats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  base::ChannelsCacheStats stats = stats_;
+  stats.entries = entries_.size();
+  return stats;
+}
+
+void ChannelsCache::EraseLocked(entries_t::iterator it) {
+  stats_.bytes -= it->bytes;
+  index_.erase(it->uid);
+  entries_.erase(it);
+}
+
+}  // namespace subscribers
+}  // namespace server
+}  // namespace fastocloud
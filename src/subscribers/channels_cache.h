@@ -0,0 +1,88 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <fastotv/commands_info/catchups_info.h>
+#include <fastotv/commands_info/channels_info.h>
+#include <fastotv/commands_info/content_requests_info.h>
+#include <fastotv/commands_info/series_info.h>
+#include <fastotv/commands_info/vods_info.h>
+
+#include "base/isubscribers_manager.h"
+
+namespace fastocloud {
+namespace server {
+namespace subscribers {
+
+class ChannelsDigest;
+
+struct ChannelsPayload {
+  size_t GetSerializedSize() const;
+
+  fastotv::commands_info::ChannelsInfo channels;
+  fastotv::commands_info::VodsInfo vods;
+  fastotv::commands_info::ChannelsInfo private_channels;
+  fastotv::commands_info::VodsInfo private_vods;
+  fastotv::commands_info::CatchupsInfo catchups;
+  fastotv::commands_info::SeriesInfo series;
+  fastotv::commands_info::ContentRequestsInfo requests;
+  std::shared_ptr<const ChannelsDigest> digest;  // made once with the lists, nullptr if it couldn't be made
+};
+
+// Per-user get_channels results, an entry is served only while the user channels version is unchanged.
+// Bounded by entries count and serialized bytes, least recently used entries are evicted first.
+class ChannelsCache {
+ public:
+  enum { default_max_entries = 10000, default_max_bytes = 256 * 1024 * 1024, default_max_age_sec = 300 };
+  typedef std::shared_ptr<const ChannelsPayload> payload_t;
+
+  ChannelsCache(size_t max_entries, size_t max_bytes, time_t max_age_sec);
+
+  payload_t Find(const fastotv::user_id_t& uid, const base::ChannelsVersion& version);
+  void Insert(const fastotv::user_id_t& uid, const base::ChannelsVersion& version, payload_t payload);
+
+  base::ChannelsCacheStats GetStats() const;
+
+ private:
+  struct Entry {
+    fastotv::user_id_t uid;
+    base::ChannelsVersion version;
+    payload_t payload;
+    size_t bytes;
+    fastotv::timestamp_t created;
+  };
+  typedef std::list<Entry> entries_t;
+
+  void EraseLocked(entries_t::iterator it);
+
+  const size_t max_entries_;
+  const size_t max_bytes_;
+  const fastotv::timestamp_t max_age_msec_;
+
+  mutable std::mutex mutex_;
+  entries_t entries_;  // most recently used first
+  std::unordered_map<fastotv::user_id_t, entries_t::iterator> index_;
+  base::ChannelsCacheStats stats_;
+};
+
+}  // namespace subscribers
+}  // namespace server
+}  // namespace fastocloud
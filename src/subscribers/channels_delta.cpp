@@ -0,0 +1,243 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "subscribers/channels_delta.h"
+
+#include <algorithm>
+#include <functional>
+
+#define ENTRY_ID_FIELD "id"
+
+#define DELTA_ADDED_FIELD "added"
+#define DELTA_UPDATED_FIELD "updated"
+#define DELTA_REMOVED_FIELD "removed"
+
+namespace fastocloud {
+namespace server {
+namespace subscribers {
+
+namespace {
+const char* const kListsFields[] = {"channels", "vods",   "private_channels", "private_vods",
+                                    "catchups", "series", "content_requests"};
+
+bool EntryLess(const ListDigest::Entry& left, const ListDigest::Entry& right) {
+  return left.id < right.id;
+}
+
+bool GetEntryID(json_object* entry, std::string* id) {
+  json_object* jid = nullptr;
+  json_bool jid_exists = json_object_object_get_ex(entry, ENTRY_ID_FIELD, &jid);
+  if (!jid_exists || !json_object_is_type(jid, json_type_string)) {
+    return false;
+  }
+
+  *id = json_object_get_string(jid);
+  return true;
+}
+
+size_t HashEntry(json_object* entry) {
+  return std::hash<std::string>()(json_object_to_json_string_ext(entry, JSON_C_TO_STRING_PLAIN));
+}
+}  // namespace
+
+ListDigest::ListDigest() : entries_() {}
+
+common::Error ListDigest::Make(json_object* list, ListDigest* digest) {
+  if (!list || !json_object_is_type(list, json_type_array) || !digest) {
+    return common::make_error_inval();
+  }
+
+  std::vector<Entry> entries;
+  const size_t len = json_object_array_length(list);
+  entries.reserve(len);
+  for (size_t i = 0; i < len; ++i) {
+    json_object* jentry = json_object_array_get_idx(list, i);
+    Entry entry;
+    if (!GetEntryID(jentry, &entry.id)) {
+      continue;
+    }
+    entry.hash = HashEntry(jentry);
+    entries.push_back(entry);
+  }
+
+  std::sort(entries.begin(), entries.end(), EntryLess);
+  digest->entries_.swap(entries);
+  return common::Error();
+}
+
+size_t ListDigest::GetSize() const {
+  return entries_.size();
+}
+
+common::Error ListDigest::MakeDelta(const ListDigest& previous,
+                                    json_object* list,
+                                    ListDigest* current,
+                                    json_object** delta,
+                                    size_t* changes) {
+  if (!current || !delta || !changes) {
+    return common::make_error_inval();
+  }
+
+  ListDigest lcurrent;
+  common::Error err = Make(list, &lcurrent);
+  if (err) {
+    return err;
+  }
+
+  json_object* jadded = json_object_new_array();
+  json_object* jupdated = json_object_new_array();
+  json_object* jremoved = json_object_new_array();
+  size_t lchanges = 0;
+  const size_t len = json_object_array_length(list);
+  for (size_t i = 0; i < len; ++i) {
+    json_object* jentry = json_object_array_get_idx(list, i);
+    Entry entry;
+    if (!GetEntryID(jentry, &entry.id)) {
+      continue;
+    }
+
+    const auto it = std::lower_bound(previous.entries_.begin(), previous.entries_.end(), entry, EntryLess);
+    if (it == previous.entries_.end() || it->id != entry.id) {
+      json_object_array_add(jadded, json_object_get(jentry));
+      lchanges++;
+    } else if (it->hash != HashEntry(jentry)) {
+      json_object_array_add(jupdated, json_object_get(jentry));
+      lchanges++;
+    }
+  }
+
+  for (const Entry& entry : previous.entries_) {
+    const auto it = std::lower_bound(lcurrent.entries_.begin(), lcurrent.entries_.end(), entry, EntryLess);
+    if (it == lcurrent.entries_.end() || it->id != entry.id) {
+      json_object_array_add(jremoved, json_object_new_string(entry.id.c_str()));
+      lchanges++;
+    }
+  }
+
+  json_object* ldelta = nullptr;
+  if (lchanges) {
+    ldelta = json_object_new_object();
+    json_object_object_add(ldelta, DELTA_ADDED_FIELD, jadded);
+    json_object_object_add(ldelta, DELTA_UPDATED_FIELD, jupdated);
+    json_object_object_add(ldelta, DELTA_REMOVED_FIELD, jremoved);
+  } else {
+    json_object_put(jadded);
+    json_object_put(jupdated);
+    json_object_put(jremoved);
+  }
+
+  current->entries_.swap(lcurrent.entries_);
+  *delta = ldelta;
+  *changes = lchanges;
+  return common::Error();
+}
+
+ChannelsDigest::ChannelsDigest() : lists_() {}
+
+common::Error ChannelsDigest::SerializeLists(const ChannelsPayload& payload, json_object* lists[lists_count]) {
+  for (size_t i = 0; i < lists_count; ++i) {
+    lists[i] = nullptr;
+  }
+
+  common::Error errs[lists_count] = {payload.channels.Serialize(&lists[0]),
+                                     payload.vods.Serialize(&lists[1]),
+                                     payload.private_channels.Serialize(&lists[2]),
+                                     payload.private_vods.Serialize(&lists[3]),
+                                     payload.catchups.Serialize(&lists[4]),
+                                     payload.series.Serialize(&lists[5]),
+                                     payload.requests.Serialize(&lists[6])};
+  for (size_t i = 0; i < lists_count; ++i) {
+    if (errs[i]) {
+      for (size_t j = 0; j < lists_count; ++j) {
+        if (lists[j]) {
+          json_object_put(lists[j]);
+          lists[j] = nullptr;
+        }
+      }
+      return errs[i];
+    }
+  }
+  return common::Error();
+}
+
+common::Error ChannelsDigest::Make(const ChannelsPayload& payload, ChannelsDigest* digest) {
+  if (!digest) {
+    return common::make_error_inval();
+  }
+
+  json_object* lists[lists_count];
+  common::Error err = SerializeLists(payload, lists);
+  if (err) {
+    return err;
+  }
+
+  ChannelsDigest ldigest;
+  for (size_t i = 0; i < lists_count && !err; ++i) {
+    err = ListDigest::Make(lists[i], &ldigest.lists_[i]);
+  }
+  for (size_t i = 0; i < lists_count; ++i) {
+    json_object_put(lists[i]);
+  }
+  if (err) {
+    return err;
+  }
+
+  *digest = ldigest;
+  return common::Error();
+}
+
+common::Error ChannelsDigest::MakeDelta(const ChannelsPayload& payload,
+                                        ChannelsDigest* current,
+                                        std::string* delta,
+                                        size_t* changes) const {
+  if (!current || !delta || !changes) {
+    return common::make_error_inval();
+  }
+
+  json_object* lists[lists_count];
+  common::Error err = SerializeLists(payload, lists);
+  if (err) {
+    return err;
+  }
+
+  ChannelsDigest lcurrent;
+  json_object* jdelta = json_object_new_object();
+  size_t lchanges = 0;
+  for (size_t i = 0; i < lists_count && !err; ++i) {
+    json_object* jlist_delta = nullptr;
+    size_t list_changes = 0;
+    err = ListDigest::MakeDelta(lists_[i], lists[i], &lcurrent.lists_[i], &jlist_delta, &list_changes);
+    if (!err && jlist_delta) {
+      json_object_object_add(jdelta, kListsFields[i], jlist_delta);
+      lchanges += list_changes;
+    }
+  }
+  for (size_t i = 0; i < lists_count; ++i) {
+    json_object_put(lists[i]);
+  }
+  if (err) {
+    json_object_put(jdelta);
+    return err;
+  }
+
+  *delta = json_object_to_json_string_ext(jdelta, JSON_C_TO_STRING_PLAIN);
+  json_object_put(jdelta);
+  *current = lcurrent;
+  *changes = lchanges;
+  return common::Error();
+}
+
+}  // namespace subscribers
+}  // namespace server
+}  // namespace fastocloud
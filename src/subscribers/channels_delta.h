@@ -0,0 +1,80 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <common/serializer/json_serializer.h>
+
+#include "subscribers/channels_cache.h"
+
+namespace fastocloud {
+namespace server {
+namespace subscribers {
+
+// Ids and content hashes of the entries of one get_channels list, sorted by id.
+class ListDigest {
+ public:
+  struct Entry {
+    std::string id;
+    size_t hash;
+  };
+
+  ListDigest();
+
+  // entries without an id are skipped
+  static common::Error Make(json_object* list, ListDigest* digest) WARN_UNUSED_RESULT;
+
+  size_t GetSize() const;
+
+  // delta is {"added": [entries], "updated": [entries], "removed": [ids]}, nullptr if the lists are equal,
+  // current gets the digest of the list
+  static common::Error MakeDelta(const ListDigest& previous,
+                                 json_object* list,
+                                 ListDigest* current,
+                                 json_object** delta,
+                                 size_t* changes) WARN_UNUSED_RESULT;
+
+ private:
+  std::vector<Entry> entries_;
+};
+
+// What a client holds after get_channels or the last pushed update, deltas are computed against it.
+// Only ids and hashes are kept, a connection doesn't pin the payload.
+class ChannelsDigest {
+ public:
+  ChannelsDigest();
+
+  static common::Error Make(const ChannelsPayload& payload, ChannelsDigest* digest) WARN_UNUSED_RESULT;
+
+  // serialized delta has a member per changed list: channels, vods, private_channels, private_vods, catchups,
+  // series and content_requests, current gets the digest of payload
+  common::Error MakeDelta(const ChannelsPayload& payload,
+                          ChannelsDigest* current,
+                          std::string* delta,
+                          size_t* changes) const WARN_UNUSED_RESULT;
+
+ private:
+  enum { lists_count = 7 };
+
+  static common::Error SerializeLists(const ChannelsPayload& payload, json_object* lists[lists_count]);
+
+  ListDigest lists_[lists_count];
+};
+
+}  // namespace subscribers
+}  // namespace server
+}  // namespace fastocloud
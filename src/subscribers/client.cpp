@@ -14,6 +14,8 @@
 
 #include "subscribers/client.h"
 
+#include <common/libev/io_loop.h>
+
 #define NOTIFY_MESSAGE "send_message"
 
 namespace fastotv {
@@ -38,6 +40,31 @@ common::Error NotifyRequest(protocol::sequance_id_t id,
   *req = lreq;
   return common::Error();
 }
+
+common::Error ChannelsUpdateRequest(protocol::sequance_id_t id, const std::string& delta, protocol::request_t* req) {
+  if (!req) {
+    return common::make_error_inval();
+  }
+
+  protocol::request_t lreq;
+  lreq.id = id;
+  lreq.method = SERVER_CHANNELS_UPDATE;
+  lreq.params = delta;
+  *req = lreq;
+  return common::Error();
+}
+
+common::Error UserWriteResponseFail(protocol::sequance_id_t id,
+                                    const std::string& error_text,
+                                    protocol::response_t* resp) {
+  if (!resp) {
+    return common::make_error_inval();
+  }
+
+  const auto error = common::protocols::json_rpc::JsonRPCError::MakeServerErrorFromText(error_text);
+  *resp = protocol::response_t::MakeError(id, error);
+  return common::Error();
+}
 }  // namespace
 }  // namespace fastotv
 
@@ -48,7 +75,16 @@ namespace subscribers {
 SubscriberClient::SubscriberClient(common::libev::IoLoop* server,
                                    const common::net::socket_info& info,
                                    compressor_t compressor)
-    : base_class(server, info, compressor), client_info_() {}
+    : base_class(server, info, compressor),
+      client_info_(),
+      channels_version_(),
+      channels_digest_(),
+      channels_update_pending_(false),
+      channels_updates_disabled_(false),
+      user_write_pending_(false),
+      queued_user_writes_() {
+  GetServingLoop()->Arrive(server);
+}
 
 const char* SubscriberClient::ClassName() const {
   return "SubscriberClient";
@@ -62,6 +98,82 @@ SubscriberClient::client_info_t SubscriberClient::GetClInfo() const {
   return client_info_;
 }
 
+void SubscriberClient::SetChannels(const base::ChannelsVersion& version, channels_digest_t digest) {
+  if (channels_updates_disabled_) {
+    return;
+  }
+
+  channels_version_ = version;
+  channels_digest_ = digest;
+}
+
+SubscriberClient::channels_digest_t SubscriberClient::GetChannels(base::ChannelsVersion* version) const {
+  if (version) {
+    *version = channels_version_;
+  }
+  return channels_digest_;
+}
+
+void SubscriberClient::SkipChannelsVersion(const base::ChannelsVersion& from, const base::ChannelsVersion& to) {
+  if (!channels_digest_ || channels_version_ != from) {
+    return;
+  }
+
+  channels_version_ = to;
+}
+
+void SubscriberClient::DisableChannelsUpdates() {
+  channels_updates_disabled_ = true;
+  channels_version_ = base::ChannelsVersion();
+  channels_digest_.reset();
+}
+
+void SubscriberClient::SetChannelsUpdatePending(bool pending) {
+  channels_update_pending_ = pending;
+}
+
+bool SubscriberClient::IsChannelsUpdatePending() const {
+  return channels_update_pending_;
+}
+
+bool SubscriberClient::IsUserWritePending() const {
+  return user_write_pending_;
+}
+
+void SubscriberClient::SetUserWritePending(bool pending) {
+  user_write_pending_ = pending;
+}
+
+bool SubscriberClient::QueueUserWrite(user_write_t write) {
+  if (queued_user_writes_.size() >= max_queued_user_writes) {
+    return false;
+  }
+
+  queued_user_writes_.push_back(write);
+  return true;
+}
+
+bool SubscriberClient::PopQueuedUserWrite(user_write_t* write) {
+  if (!write || queued_user_writes_.empty()) {
+    return false;
+  }
+
+  *write = queued_user_writes_.front();
+  queued_user_writes_.pop_front();
+  return true;
+}
+
+common::ErrnoError SubscriberClient::UserWriteFail(fastotv::protocol::sequance_id_t id, common::Error err) {
+  const std::string error_str = err->GetDescription();
+  fastotv::protocol::response_t resp;
+  common::Error err_ser = fastotv::UserWriteResponseFail(id, error_str, &resp);
+  if (err_ser) {
+    return common::make_errno_error(err_ser->GetDescription(), EAGAIN);
+  }
+
+  return WriteResponse(resp);
+}
+
 common::Optional<base::FrontSubscriberInfo> SubscriberClient::MakeFrontSubscriberInfo() const {
   const auto login = GetLogin();
   if (!login) {
@@ -73,13 +185,36 @@ common::Optional<base::FrontSubscriberInfo> SubscriberClient::MakeFrontSubscribe
 }
 
 common::ErrnoError SubscriberClient::SendNotification(const fastotv::commands_info::NotificationTextInfo& notify) {
-  fastotv::protocol::request_t notify_request;
-  common::Error err_ser = fastotv::NotifyRequest(NextRequestID(), notify, &notify_request);
+  // called from the daemon loop, the request is written by the loop owning the connection
+  const life_token_t token = GetLifeToken();
+  GetServingLoop()->Exec([this, token, notify]() {
+    if (token.expired()) {
+      return;
+    }
+
+    fastotv::protocol::request_t notify_request;
+    common::Error err_ser = fastotv::NotifyRequest(NextRequestID(), notify, &notify_request);
+    if (err_ser) {
+      DEBUG_MSG_ERROR(err_ser, common::logging::LOG_LEVEL_ERR);
+      return;
+    }
+
+    common::ErrnoError errn = WriteRequest(notify_request);
+    if (errn) {
+      DEBUG_MSG_ERROR(errn, common::logging::LOG_LEVEL_ERR);
+    }
+  });
+  return common::ErrnoError();
+}
+
+common::ErrnoError SubscriberClient::ChannelsUpdate(const std::string& delta) {
+  fastotv::protocol::request_t update_request;
+  common::Error err_ser = fastotv::ChannelsUpdateRequest(NextRequestID(), delta, &update_request);
   if (err_ser) {
     return common::make_errno_error(err_ser->GetDescription(), EAGAIN);
   }
 
-  return WriteRequest(notify_request);
+  return WriteRequest(update_request);
 }
 
 }  // namespace subscribers
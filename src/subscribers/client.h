@@ -14,19 +14,32 @@
 
 #pragma once
 
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
 #include <fastotv/commands_info/client_info.h>
 #include <fastotv/server/client.h>
 
+#include "base/isubscribers_manager.h"
 #include "base/subscriber_info.h"
 
+#define SERVER_CHANNELS_UPDATE "channels_update"
+
 namespace fastocloud {
 namespace server {
 namespace subscribers {
 
+class ChannelsDigest;
+
 class SubscriberClient : public fastotv::server::Client, public base::SubscriberInfo {
  public:
   typedef common::Optional<fastotv::commands_info::ClientInfo> client_info_t;
   typedef fastotv::server::Client base_class;
+  typedef std::shared_ptr<const ChannelsDigest> channels_digest_t;
+  typedef std::function<void()> user_write_t;
+  enum { max_queued_user_writes = 64 };
 
   SubscriberClient(common::libev::IoLoop* server, const common::net::socket_info& info, compressor_t compressor);
 
@@ -39,8 +52,34 @@ class SubscriberClient : public fastotv::server::Client, public base::Subscriber
   void SetClInfo(const client_info_t& info);
   client_info_t GetClInfo() const;
 
+  // channels the client holds, set by get_channels and pushed updates, nullptr before the first get_channels
+  void SetChannels(const base::ChannelsVersion& version, channels_digest_t digest);
+  channels_digest_t GetChannels(base::ChannelsVersion* version) const;
+  // version moved by the client's own write, it has the change already and nothing is pushed back
+  void SkipChannelsVersion(const base::ChannelsVersion& from, const base::ChannelsVersion& to);
+  // client doesn't support channels_update, it keeps polling get_channels
+  void DisableChannelsUpdates();
+  void SetChannelsUpdatePending(bool pending);
+  bool IsChannelsUpdatePending() const;
+
+  common::ErrnoError ChannelsUpdate(const std::string& delta) WARN_UNUSED_RESULT;
+
+  // favorite, recent and interruption writes are recorded one at a time in request order,
+  // the ones received while a write is on a database worker wait here
+  bool IsUserWritePending() const;
+  void SetUserWritePending(bool pending);
+  bool QueueUserWrite(user_write_t write) WARN_UNUSED_RESULT;
+  bool PopQueuedUserWrite(user_write_t* write);
+  common::ErrnoError UserWriteFail(fastotv::protocol::sequance_id_t id, common::Error err) WARN_UNUSED_RESULT;
+
  private:
   client_info_t client_info_;
+  base::ChannelsVersion channels_version_;
+  channels_digest_t channels_digest_;
+  bool channels_update_pending_;
+  bool channels_updates_disabled_;
+  bool user_write_pending_;
+  std::deque<user_write_t> queued_user_writes_;
 };
 
 }  // namespace subscribers
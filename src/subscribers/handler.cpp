@@ -14,6 +14,7 @@
 
 #include "subscribers/handler.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -26,10 +27,13 @@
 #include <fastotv/commands_info/favorite_info.h>
 #include <fastotv/commands_info/recent_stream_time_info.h>
 
+#include "base/db_worker_pool.h"
 #include "base/isubscribers_manager.h"
 
+#include "subscribers/channels_delta.h"
 #include "subscribers/client.h"
 #include "subscribers/handler_observer.h"
+#include "subscribers/server.h"
 
 namespace fastocloud {
 namespace server {
@@ -37,22 +41,38 @@ namespace subscribers {
 
 SubscribersHandler::SubscribersHandler(ISubscribersHandlerObserver* observer,
                                        base::ISubscribersManager* manager,
+                                       base::DbWorkerPool* db_workers,
                                        const common::uri::GURL& epg_url,
                                        const std::string& locked_text)
     : base_class(),
       epg_url_(epg_url),
       locked_text_(locked_text),
-      ping_client_id_timer_(INVALID_TIMER_ID),
+      timers_mutex_(),
+      timers_(),
       manager_(manager),
+      db_workers_(db_workers),
+      channels_cache_(ChannelsCache::default_max_entries,
+                      ChannelsCache::default_max_bytes,
+                      ChannelsCache::default_max_age_sec),
+      channels_push_mutex_(),
+      channels_push_stats_(),
       observer_(observer) {}
 
 void SubscribersHandler::PreLooped(common::libev::IoLoop* server) {
-  UNUSED(server);
-  ping_client_id_timer_ = server->CreateTimer(ping_timeout_clients, true);
+  LoopTimers timers;
+  timers.ping_client = server->CreateTimer(ping_timeout_clients, true);
+  timers.channels_push = server->CreateTimer(channels_push_interval, true);
+  std::unique_lock<std::mutex> lock(timers_mutex_);
+  timers_[server] = timers;
 }
 
 void SubscribersHandler::Accepted(common::libev::IoClient* client) {
   base_class::Accepted(client);
+  // the accepting server spreads connections over the loops, Moved and Accepted of the new loop follow later
+  SubscribersServer* acceptor = dynamic_cast<SubscribersServer*>(client->GetServer());
+  if (acceptor) {
+    acceptor->HandOut(static_cast<SubscriberClient*>(client));
+  }
 }
 
 void SubscribersHandler::Moved(common::libev::IoLoop* server, common::libev::IoClient* client) {
@@ -71,7 +91,17 @@ void SubscribersHandler::Closed(common::libev::IoClient* client) {
 }
 
 void SubscribersHandler::TimerEmited(common::libev::IoLoop* server, common::libev::timer_id_t id) {
-  if (ping_client_id_timer_ == id) {
+  LoopTimers timers;
+  {
+    std::unique_lock<std::mutex> lock(timers_mutex_);
+    const auto it = timers_.find(server);
+    if (it == timers_.end()) {
+      return;
+    }
+    timers = it->second;
+  }
+
+  if (timers.ping_client == id) {
     std::vector<common::libev::IoClient*> online_clients = server->GetClients();
     for (size_t i = 0; i < online_clients.size(); ++i) {
       common::libev::IoClient* client = online_clients[i];
@@ -95,6 +125,8 @@ void SubscribersHandler::TimerEmited(common::libev::IoLoop* server, common::libe
         }
       }
     }
+  } else if (timers.channels_push == id) {
+    PushChannelsUpdates(server);
   }
 }
 
@@ -132,9 +164,209 @@ void SubscribersHandler::DataReadyToWrite(common::libev::IoClient* client) {
 }
 
 void SubscribersHandler::PostLooped(common::libev::IoLoop* server) {
-  if (ping_client_id_timer_ != INVALID_TIMER_ID) {
-    server->RemoveTimer(ping_client_id_timer_);
-    ping_client_id_timer_ = INVALID_TIMER_ID;
+  LoopTimers timers;
+  {
+    std::unique_lock<std::mutex> lock(timers_mutex_);
+    const auto it = timers_.find(server);
+    if (it == timers_.end()) {
+      return;
+    }
+    timers = it->second;
+    timers_.erase(it);
+  }
+
+  if (timers.ping_client != INVALID_TIMER_ID) {
+    server->RemoveTimer(timers.ping_client);
+  }
+  if (timers.channels_push != INVALID_TIMER_ID) {
+    server->RemoveTimer(timers.channels_push);
+  }
+}
+
+base::ChannelsCacheStats SubscribersHandler::GetChannelsCacheStats() const {
+  return channels_cache_.GetStats();
+}
+
+base::ChannelsPushStats SubscribersHandler::GetChannelsPushStats() const {
+  std::unique_lock<std::mutex> lock(channels_push_mutex_);
+  return channels_push_stats_;
+}
+
+common::Error SubscribersHandler::LoadChannels(const base::ServerDBAuthInfo& auth,
+                                               base::ChannelsVersion* version,
+                                               ChannelsCache::payload_t* payload) {
+  const fastotv::user_id_t uid = auth.GetUserID();
+  base::ChannelsVersion lversion;
+  const bool cacheable = manager_->GetChannelsVersion(uid, &lversion);
+  ChannelsCache::payload_t lpayload = cacheable ? channels_cache_.Find(uid, lversion) : nullptr;
+  if (!lpayload) {
+    auto loaded = std::make_shared<ChannelsPayload>();
+    common::Error err = manager_->ClientGetChannels(auth, &loaded->channels, &loaded->vods, &loaded->private_channels,
+                                                    &loaded->private_vods, &loaded->catchups, &loaded->series,
+                                                    &loaded->requests);
+    if (err) {
+      return err;
+    }
+
+    // cache hits reuse it, get_channels doesn't serialize the lists again
+    auto digest = std::make_shared<ChannelsDigest>();
+    common::Error err_digest = ChannelsDigest::Make(*loaded, digest.get());
+    if (err_digest) {
+      DEBUG_MSG_ERROR(err_digest, common::logging::LOG_LEVEL_WARNING);
+    } else {
+      loaded->digest = digest;
+    }
+    if (cacheable) {
+      channels_cache_.Insert(uid, lversion, loaded);
+    }
+    lpayload = loaded;
+  }
+
+  *version = lversion;
+  *payload = lpayload;
+  return common::Error();
+}
+
+void SubscribersHandler::PushChannelsUpdates(common::libev::IoLoop* server) {
+  // versions follow the subscribers and streams change streams, only clients whose version moved are read again,
+  // the rest are picked up on the next intervals if a catalog change touches everyone at once
+  size_t posted = 0;
+  std::vector<common::libev::IoClient*> online_clients = server->GetClients();
+  for (size_t i = 0; i < online_clients.size() && posted < channels_push_batch; ++i) {
+    SubscriberClient* iclient = static_cast<SubscriberClient*>(online_clients[i]);
+    base::ChannelsVersion held;
+    if (!iclient->GetChannels(&held) || iclient->IsChannelsUpdatePending()) {
+      continue;
+    }
+
+    const auto login = iclient->GetLogin();
+    if (!login) {
+      continue;
+    }
+
+    base::ChannelsVersion version;
+    if (!manager_->GetChannelsVersion(login->GetUserID(), &version) || version == held) {
+      continue;
+    }
+
+    common::Error err = PostChannelsUpdate(iclient, *login);
+    if (err) {  // workers are busy
+      return;
+    }
+    posted++;
+  }
+}
+
+common::Error SubscribersHandler::PostChannelsUpdate(SubscriberClient* client, const base::ServerDBAuthInfo& auth) {
+  const SubscriberClient::channels_digest_t held = client->GetChannels(nullptr);
+  common::Error err = db_workers_->PostForClient<SubscriberClient>(client, [this, auth, held]() -> db_completion_t {
+    base::ChannelsVersion version;
+    ChannelsCache::payload_t payload;
+    auto digest = std::make_shared<ChannelsDigest>();
+    std::string delta;
+    size_t changes = 0;
+    common::Error err = LoadChannels(auth, &version, &payload);
+    if (!err) {
+      err = held->MakeDelta(*payload, digest.get(), &delta, &changes);
+    }
+
+    return [this, version, digest, delta, changes, err](SubscriberClient* client) {
+      client->SetChannelsUpdatePending(false);
+      if (err) {
+        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+        std::unique_lock<std::mutex> lock(channels_push_mutex_);
+        channels_push_stats_.failures++;
+        return;
+      }
+
+      if (changes) {
+        // added and updated entries are whole, a delta crossing a get_channels response applies cleanly
+        common::ErrnoError errn = client->ChannelsUpdate(delta);
+        if (errn) {
+          DEBUG_MSG_ERROR(errn, common::logging::LOG_LEVEL_ERR);
+          std::unique_lock<std::mutex> lock(channels_push_mutex_);
+          channels_push_stats_.failures++;
+          return;
+        }
+      }
+
+      client->SetChannels(version, digest);
+      std::unique_lock<std::mutex> lock(channels_push_mutex_);
+      if (changes) {
+        channels_push_stats_.updates++;
+        channels_push_stats_.changes += changes;
+      } else {
+        channels_push_stats_.unchanged++;
+      }
+    };
+  });
+  if (err) {
+    return err;
+  }
+
+  client->SetChannelsUpdatePending(true);
+  return common::Error();
+}
+
+common::ErrnoError SubscribersHandler::EnqueueUserWrite(SubscriberClient* client,
+                                                        fastotv::protocol::sequance_id_t id,
+                                                        user_write_t write,
+                                                        user_write_reply_t reply) {
+  // two writes of one stream on different workers would reach the write buffer in any order
+  if (client->IsUserWritePending()) {
+    if (!client->QueueUserWrite([this, client, id, write, reply]() { StartUserWrite(client, id, write, reply); })) {
+      return client->UserWriteFail(id, common::make_error("Too many pending writes"));
+    }
+    return common::ErrnoError();
+  }
+
+  StartUserWrite(client, id, write, reply);
+  return common::ErrnoError();
+}
+
+void SubscribersHandler::StartUserWrite(SubscriberClient* client,
+                                        fastotv::protocol::sequance_id_t id,
+                                        user_write_t write,
+                                        user_write_reply_t reply) {
+  const auto login = client->GetLogin();
+  const fastotv::user_id_t uid = login ? login->GetUserID() : fastotv::user_id_t();
+  auto task = [this, id, uid, write, reply]() -> db_completion_t {
+    // a write of another device landing between the two reads is picked up with the next change
+    base::ChannelsVersion before;
+    const bool tracked = !uid.empty() && manager_->GetChannelsVersion(uid, &before);
+    common::Error err = write();
+    base::ChannelsVersion after;
+    const bool own = tracked && !err && manager_->GetChannelsVersion(uid, &after) && after.catalog == before.catalog &&
+                     after.subscribers == before.subscribers;
+    return [this, id, reply, err, own, before, after](SubscriberClient* client) {
+      common::ErrnoError errn = err ? client->UserWriteFail(id, err) : reply(client);
+      if (errn) {
+        DEBUG_MSG_ERROR(errn, common::logging::LOG_LEVEL_ERR);
+      }
+      if (own) {
+        client->SkipChannelsVersion(before, after);
+      }
+      FinishUserWrite(client);
+    };
+  };
+  common::Error err = db_workers_->PostForClient<SubscriberClient>(client, task);
+  if (err) {
+    common::ErrnoError errn = client->UserWriteFail(id, err);
+    if (errn) {
+      DEBUG_MSG_ERROR(errn, common::logging::LOG_LEVEL_ERR);
+    }
+    FinishUserWrite(client);
+    return;
+  }
+
+  client->SetUserWritePending(true);
+}
+
+void SubscribersHandler::FinishUserWrite(SubscriberClient* client) {
+  client->SetUserWritePending(false);
+  SubscriberClient::user_write_t next;
+  if (client->PopQueuedUserWrite(&next)) {
+    next();
   }
 }
 
@@ -218,6 +450,8 @@ common::ErrnoError SubscribersHandler::HandleResponceCommand(SubscriberClient* c
       return HandleResponceServerGetClientInfo(sclient, resp);
     } else if (req.method == SERVER_TEXT_NOTIFICATION) {
       return HandleResponceServerTextNotification(sclient, resp);
+    } else if (req.method == SERVER_CHANNELS_UPDATE) {
+      return HandleResponceServerChannelsUpdate(sclient, resp);
     } else {
       WARNING_LOG() << "HandleResponceCommand not handled command: " << req.method;
     }
@@ -243,15 +477,27 @@ common::ErrnoError SubscribersHandler::HandleRequestClientActivate(SubscriberCli
       return common::make_errno_error(err->GetDescription(), EINVAL);
     }
 
-    fastotv::commands_info::DevicesInfo devices;
-    err = manager_->ClientActivate(uauth, &devices);
+    const fastotv::protocol::sequance_id_t id = req->id;
+    const std::string peer_host = client->GetInfo().host();
+    err = db_workers_->PostForClient<SubscriberClient>(client, [this, uauth, peer_host, id]() -> db_completion_t {
+      fastotv::commands_info::DevicesInfo devices;
+      common::Error err = manager_->ClientActivate(uauth, peer_host, &devices);
+      return [uauth, id, devices, err](SubscriberClient* client) {
+        if (err) {
+          DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+          ignore_result(client->ActivateDeviceFail(id, err));
+          return;
+        }
+
+        ignore_result(client->ActivateDeviceSuccess(id, devices));
+        INFO_LOG() << "Active registered user: " << uauth.GetLogin();
+      };
+    });
     if (err) {
       ignore_result(client->ActivateDeviceFail(req->id, err));
-      return common::make_errno_error(err->GetDescription(), EINVAL);
+      return common::make_errno_error(err->GetDescription(), EAGAIN);
     }
 
-    ignore_result(client->ActivateDeviceSuccess(req->id, devices));
-    INFO_LOG() << "Active registered user: " << uauth.GetLogin();
     return common::ErrnoError();
   }
 
@@ -275,20 +521,37 @@ common::ErrnoError SubscribersHandler::HandleRequestClientLogin(SubscriberClient
       return common::make_errno_error(err->GetDescription(), EINVAL);
     }
 
-    base::ServerDBAuthInfo ser;
-    err = manager_->ClientLogin(uauth, &ser);
+    const fastotv::protocol::sequance_id_t id = req->id;
+    const std::string peer_host = client->GetInfo().host();
+    err = db_workers_->PostForClient<SubscriberClient>(client, [this, uauth, peer_host, id]() -> db_completion_t {
+      base::ServerDBAuthInfo ser;
+      common::Error err = manager_->ClientLogin(uauth, peer_host, &ser);
+      return [this, id, ser, err](SubscriberClient* client) {
+        if (err) {
+          DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+          ignore_result(client->LoginFail(id, err));
+          return;
+        }
+
+        // the device limit checked by the worker holds only once the connection is registered
+        common::Error reg_err = manager_->RegisterInnerConnectionByHost(client, ser);
+        if (reg_err) {
+          DEBUG_MSG_ERROR(reg_err, common::logging::LOG_LEVEL_ERR);
+          ignore_result(client->LoginFail(id, reg_err));
+          return;
+        }
+
+        common::ErrnoError errn = client->LoginSuccess(id, ser);
+        if (errn) {
+          DEBUG_MSG_ERROR(errn, common::logging::LOG_LEVEL_ERR);
+        }
+      };
+    });
     if (err) {
       ignore_result(client->LoginFail(req->id, err));
-      return common::make_errno_error(err->GetDescription(), EINVAL);
+      return common::make_errno_error(err->GetDescription(), EAGAIN);
     }
 
-    common::ErrnoError errn = client->LoginSuccess(req->id, ser);
-    if (errn) {
-      return errn;
-    }
-
-    err = manager_->RegisterInnerConnectionByHost(client, ser);
-    DCHECK(!err) << "Register inner connection error: " << err->GetDescription();
     return common::ErrnoError();
   }
 
@@ -353,20 +616,41 @@ common::ErrnoError SubscribersHandler::HandleRequestClientGetChannels(Subscriber
     return common::make_errno_error(err->GetDescription(), EINVAL);
   }
 
-  fastotv::commands_info::ChannelsInfo chans;
-  fastotv::commands_info::VodsInfo vods;
-  fastotv::commands_info::ChannelsInfo pchans;
-  fastotv::commands_info::VodsInfo pvods;
-  fastotv::commands_info::CatchupsInfo catchups;
-  fastotv::commands_info::SeriesInfo series;
-  fastotv::commands_info::ContentRequestsInfo crequests;
-  err = manager_->ClientGetChannels(auth, &chans, &vods, &pchans, &pvods, &catchups, &series, &crequests);
+  {
+    std::unique_lock<std::mutex> lock(channels_push_mutex_);
+    channels_push_stats_.get_channels++;
+  }
+
+  const fastotv::protocol::sequance_id_t id = req->id;
+  err = db_workers_->PostForClient<SubscriberClient>(client, [this, auth, id]() -> db_completion_t {
+    base::ChannelsVersion version;
+    ChannelsCache::payload_t payload;
+    common::Error err = LoadChannels(auth, &version, &payload);
+    return [id, version, payload, err](SubscriberClient* client) {
+      if (err) {
+        DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+        ignore_result(client->GetChannelsFail(id, err));
+        return;
+      }
+
+      common::ErrnoError errn = client->GetChannelsSuccess(id, payload->channels, payload->vods,
+                                                           payload->private_channels, payload->private_vods,
+                                                           payload->catchups, payload->series, payload->requests);
+      if (errn) {
+        DEBUG_MSG_ERROR(errn, common::logging::LOG_LEVEL_ERR);
+        return;
+      }
+
+      // later changes are pushed against what the client got here
+      client->SetChannels(version, payload->digest);
+    };
+  });
   if (err) {
     ignore_result(client->GetChannelsFail(req->id, err));
-    return common::make_errno_error(err->GetDescription(), EINVAL);
+    return common::make_errno_error(err->GetDescription(), EAGAIN);
   }
 
-  return client->GetChannelsSuccess(req->id, chans, vods, pchans, pvods, catchups, series, crequests);
+  return common::ErrnoError();
 }
 
 common::ErrnoError SubscribersHandler::HandleRequestClientGetRuntimeChannelInfo(SubscriberClient* client,
@@ -431,10 +715,10 @@ common::ErrnoError SubscribersHandler::HandleRequestClientSetFavorite(Subscriber
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    // write to DB
-    auto login = client->GetLogin();
-    ignore_result(manager_->SetFavorite(*login, fav));
-    return client->GetFavoriteInfoSuccess(req->id);
+    const fastotv::protocol::sequance_id_t id = req->id;
+    return EnqueueUserWrite(
+        client, id, [this, auth, fav]() { return manager_->SetFavorite(auth, fav); },
+        [id](SubscriberClient* client) { return client->GetFavoriteInfoSuccess(id); });
   }
 
   return common::make_errno_error_inval();
@@ -466,10 +750,10 @@ common::ErrnoError SubscribersHandler::HandleRequestClientSetRecent(SubscriberCl
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    // write to DB
-    auto login = client->GetLogin();
-    manager_->SetRecent(*login, fav);
-    return client->GetRecentInfoSuccess(req->id);
+    const fastotv::protocol::sequance_id_t id = req->id;
+    return EnqueueUserWrite(
+        client, id, [this, auth, fav]() { return manager_->SetRecent(auth, fav); },
+        [id](SubscriberClient* client) { return client->GetRecentInfoSuccess(id); });
   }
 
   return common::make_errno_error_inval();
@@ -501,10 +785,10 @@ common::ErrnoError SubscribersHandler::HandleRequestInterruptStreamTime(Subscrib
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    // write to DB
-    auto login = client->GetLogin();
-    manager_->SetInterruptTime(*login, inter);
-    return client->GetInterruptStreamTimeInfoSuccess(req->id);
+    const fastotv::protocol::sequance_id_t id = req->id;
+    return EnqueueUserWrite(
+        client, id, [this, auth, inter]() { return manager_->SetInterruptTime(auth, inter); },
+        [id](SubscriberClient* client) { return client->GetInterruptStreamTimeInfoSuccess(id); });
   }
 
   return common::make_errno_error_inval();
@@ -536,32 +820,41 @@ common::ErrnoError SubscribersHandler::HandleRequestGenerateCatchup(SubscriberCl
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    bool is_created = false;
-    std::string serverid;
-    fastotv::commands_info::CatchupInfo chan;
-    common::Error err = manager_->CreateCatchup(auth, cat_gen.GetStreamID(), cat_gen.GetTitle(), cat_gen.GetStart(),
-                                                cat_gen.GetStop(), &serverid, &chan, &is_created);
-    if (err) {
-      const std::string err_str = err->GetDescription();
-      ignore_result(client->CatchupGenerateFail(req->id, err));
-      return common::make_errno_error(err_str, EAGAIN);
-    }
+    const fastotv::protocol::sequance_id_t id = req->id;
+    err = db_workers_->PostForClient<SubscriberClient>(client, [this, auth, cat_gen, id]() -> db_completion_t {
+      bool is_created = false;
+      std::string serverid;
+      fastotv::commands_info::CatchupInfo chan;
+      common::Error err = manager_->CreateCatchup(auth, cat_gen.GetStreamID(), cat_gen.GetTitle(), cat_gen.GetStart(),
+                                                  cat_gen.GetStop(), &serverid, &chan, &is_created);
+      if (!err) {
+        err = manager_->AddUserCatchup(auth, chan.GetStreamID());
+      }
+
+      return [this, id, serverid, chan, is_created, err](SubscriberClient* client) {
+        if (err) {
+          DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+          ignore_result(client->CatchupGenerateFail(id, err));
+          return;
+        }
+
+        if (is_created) {
+          if (observer_) {
+            observer_->CatchupCreated(this, serverid, chan);
+          }
+        }
 
-    err = manager_->AddUserCatchup(auth, chan.GetStreamID());
+        fastotv::commands_info::CatchupQueueInfo qcatch(chan);
+        ignore_result(client->CatchupGenerateSuccess(id, qcatch));
+      };
+    });
     if (err) {
       const std::string err_str = err->GetDescription();
       ignore_result(client->CatchupGenerateFail(req->id, err));
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    if (is_created) {
-      if (observer_) {
-        observer_->CatchupCreated(this, serverid, chan);
-      }
-    }
-
-    fastotv::commands_info::CatchupQueueInfo qcatch(chan);
-    return client->CatchupGenerateSuccess(req->id, qcatch);
+    return common::ErrnoError();
   }
 
   return common::make_errno_error_inval();
@@ -593,14 +886,27 @@ common::ErrnoError SubscribersHandler::HandleRequestUndoCatchup(SubscriberClient
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    err = manager_->RemoveUserCatchup(auth, cat_undo.GetStreamID());
+    const fastotv::protocol::sequance_id_t id = req->id;
+    const fastotv::stream_id_t sid = cat_undo.GetStreamID();
+    err = db_workers_->PostForClient<SubscriberClient>(client, [this, auth, sid, id]() -> db_completion_t {
+      common::Error err = manager_->RemoveUserCatchup(auth, sid);
+      return [id, err](SubscriberClient* client) {
+        if (err) {
+          DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+          ignore_result(client->CatchupUndoFail(id, err));
+          return;
+        }
+
+        ignore_result(client->CatchupUndoSuccess(id));
+      };
+    });
     if (err) {
       const std::string err_str = err->GetDescription();
       ignore_result(client->CatchupUndoFail(req->id, err));
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    return client->CatchupUndoSuccess(req->id);
+    return common::ErrnoError();
   }
 
   return common::make_errno_error_inval();
@@ -632,18 +938,30 @@ common::ErrnoError SubscribersHandler::HandleRequestContent(SubscriberClient* cl
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    fastotv::commands_info::ContentRequestInfo cont;
-    err = manager_->CreateRequestContent(auth, request, &cont);
+    const fastotv::protocol::sequance_id_t id = req->id;
+    err = db_workers_->PostForClient<SubscriberClient>(client, [this, auth, request, id]() -> db_completion_t {
+      fastotv::commands_info::ContentRequestInfo cont;
+      common::Error err = manager_->CreateRequestContent(auth, request, &cont);
+      return [this, id, cont, err](SubscriberClient* client) {
+        if (err) {
+          DEBUG_MSG_ERROR(err, common::logging::LOG_LEVEL_ERR);
+          ignore_result(client->ContentRequestFail(id, err));
+          return;
+        }
+
+        if (observer_) {
+          observer_->ContentRequestCreated(this, cont);
+        }
+        ignore_result(client->ContentRequestSuccess(id));
+      };
+    });
     if (err) {
       const std::string err_str = err->GetDescription();
       ignore_result(client->ContentRequestFail(req->id, err));
       return common::make_errno_error(err_str, EAGAIN);
     }
 
-    if (observer_) {
-      observer_->ContentRequestCreated(this, cont);
-    }
-    return client->ContentRequestSuccess(req->id);
+    return common::ErrnoError();
   }
 
   return common::make_errno_error_inval();
@@ -702,6 +1020,16 @@ common::ErrnoError SubscribersHandler::HandleResponceServerTextNotification(Subs
   return common::ErrnoError();
 }
 
+common::ErrnoError SubscribersHandler::HandleResponceServerChannelsUpdate(SubscriberClient* client,
+                                                                          fastotv::protocol::response_t* resp) {
+  if (resp->IsMessage()) {
+    return common::ErrnoError();
+  }
+
+  client->DisableChannelsUpdates();
+  return common::ErrnoError();
+}
+
 }  // namespace subscribers
 }  // namespace server
 }  // namespace fastocloud
@@ -14,6 +14,9 @@
 
 #pragma once
 
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
 
 #include <common/uri/gurl.h>
@@ -22,9 +25,12 @@
 
 #include "base/iserver_handler.h"
 
+#include "subscribers/channels_cache.h"
+
 namespace fastocloud {
 namespace server {
 namespace base {
+class DbWorkerPool;
 class ISubscribersManager;
 }
 namespace subscribers {
@@ -32,15 +38,22 @@ namespace subscribers {
 class SubscriberClient;
 class ISubscribersHandlerObserver;
 
+// one handler observes every subscribers loop, per loop state is keyed by the loop
 class SubscribersHandler : public base::IServerHandler {
  public:
   typedef base::IServerHandler base_class;
+  typedef std::function<void(SubscriberClient* client)> db_completion_t;
+  typedef std::function<common::Error()> user_write_t;  // runs on a database worker
+  typedef std::function<common::ErrnoError(SubscriberClient* client)> user_write_reply_t;
   enum {
-    ping_timeout_clients = 60  // sec
+    ping_timeout_clients = 60,   // sec
+    channels_push_interval = 2,  // sec
+    channels_push_batch = 256    // updates posted to the database workers per interval
   };
 
   explicit SubscribersHandler(ISubscribersHandlerObserver* observer,
                               base::ISubscribersManager* manager,
+                              base::DbWorkerPool* db_workers,
                               const common::uri::GURL& epg_url,
                               const std::string& locked_text);
 
@@ -59,7 +72,27 @@ class SubscribersHandler : public base::IServerHandler {
 
   void PostLooped(common::libev::IoLoop* server) override;
 
+  base::ChannelsCacheStats GetChannelsCacheStats() const;
+  base::ChannelsPushStats GetChannelsPushStats() const;
+
  private:
+  // runs on a database worker
+  common::Error LoadChannels(const base::ServerDBAuthInfo& auth,
+                             base::ChannelsVersion* version,
+                             ChannelsCache::payload_t* payload) WARN_UNUSED_RESULT;
+  void PushChannelsUpdates(common::libev::IoLoop* server);
+  common::Error PostChannelsUpdate(SubscriberClient* client, const base::ServerDBAuthInfo& auth) WARN_UNUSED_RESULT;
+  // the reply is sent once the write is recorded, a write that can't be posted is answered with an error
+  common::ErrnoError EnqueueUserWrite(SubscriberClient* client,
+                                      fastotv::protocol::sequance_id_t id,
+                                      user_write_t write,
+                                      user_write_reply_t reply);
+  void StartUserWrite(SubscriberClient* client,
+                      fastotv::protocol::sequance_id_t id,
+                      user_write_t write,
+                      user_write_reply_t reply);
+  void FinishUserWrite(SubscriberClient* client);
+
   common::ErrnoError HandleInnerDataReceived(SubscriberClient* client, const std::string& input_command);
   common::ErrnoError HandleRequestCommand(SubscriberClient* client, fastotv::protocol::request_t* req);
   common::ErrnoError HandleResponceCommand(SubscriberClient* client, fastotv::protocol::response_t* resp);
@@ -82,13 +115,24 @@ class SubscribersHandler : public base::IServerHandler {
   common::ErrnoError HandleResponceServerGetClientInfo(SubscriberClient* client, fastotv::protocol::response_t* resp);
   common::ErrnoError HandleResponceServerTextNotification(SubscriberClient* client,
                                                           fastotv::protocol::response_t* resp);
+  common::ErrnoError HandleResponceServerChannelsUpdate(SubscriberClient* client, fastotv::protocol::response_t* resp);
 
  private:
+  struct LoopTimers {
+    common::libev::timer_id_t ping_client;
+    common::libev::timer_id_t channels_push;
+  };
+
   const common::uri::GURL epg_url_;
   const std::string locked_text_;
 
-  common::libev::timer_id_t ping_client_id_timer_;
+  mutable std::mutex timers_mutex_;
+  std::map<common::libev::IoLoop*, LoopTimers> timers_;
   base::ISubscribersManager* const manager_;
+  base::DbWorkerPool* const db_workers_;
+  ChannelsCache channels_cache_;
+  mutable std::mutex channels_push_mutex_;
+  base::ChannelsPushStats channels_push_stats_;
   ISubscribersHandlerObserver* const observer_;
 };
 
@@ -16,16 +16,109 @@
 
 #include "subscribers/client.h"
 
+#include <common/libev/event_loop.h>
 #include <common/text_decoders/none_edcoder.h>
 
 namespace fastocloud {
 namespace server {
 namespace subscribers {
 
+SubscribersLoop::SubscribersLoop(common::libev::IoLoopObserver* observer)
+    : base_class(new common::libev::LibEvLoop(ev_loop_new(0)), observer),
+      pending_mutex_(),
+      pending_(),
+      stopped_(false) {}
+
+const char* SubscribersLoop::ClassName() const {
+  return "SubscribersLoop";
+}
+
+common::libev::IoChild* SubscribersLoop::CreateChild() {
+  DNOTREACHED();
+  return nullptr;
+}
+
+bool SubscribersLoop::Adopt(SubscriberClient* client) {
+  {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    if (stopped_) {
+      return false;
+    }
+    pending_.push_back(client);
+  }
+
+  // a task queued while the loop stops may never run, ClosePending frees what it leaves behind
+  ExecInLoopThread([this]() { RegisterPending(); });
+  return true;
+}
+
+void SubscribersLoop::ClosePending() {
+  std::vector<SubscriberClient*> pending;
+  {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    stopped_ = true;
+    pending.swap(pending_);
+  }
+
+  for (size_t i = 0; i < pending.size(); ++i) {
+    ignore_result(pending[i]->Close());
+    delete pending[i];
+  }
+}
+
+void SubscribersLoop::RegisterPending() {
+  std::vector<SubscriberClient*> pending;
+  {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    pending.swap(pending_);
+  }
+
+  // the server may have read requests already, their completions waited for the connection to arrive here
+  for (size_t i = 0; i < pending.size(); ++i) {
+    RegisterClient(pending[i]);
+    pending[i]->GetServingLoop()->Arrive(this);
+  }
+}
+
 SubscribersServer::SubscribersServer(const common::net::HostAndPort& host,
                                      CompressedType compressed,
                                      common::libev::IoLoopObserver* observer)
-    : base_class(host, false, observer), compressed_(compressed) {}
+    : base_class(host, false, observer), compressed_(compressed), loops_(), next_loop_(0) {}
+
+void SubscribersServer::SetLoops(const std::vector<SubscribersLoop*>& loops) {
+  loops_ = loops;
+}
+
+void SubscribersServer::HandOut(SubscriberClient* client) {
+  if (loops_.empty() || !client || client->GetServer() != this) {
+    return;
+  }
+
+  const base::SubscriberInfo::life_token_t token = client->GetLifeToken();
+  ExecInLoopThread([this, token, client]() {
+    if (token.expired() || client->GetServer() != this) {  // closed before the task ran
+      return;
+    }
+    MoveToNextLoop(client);
+  });
+}
+
+void SubscribersServer::MoveToNextLoop(SubscriberClient* client) {
+  // only the loop thread of the server hands out, the counter isn't shared
+  const size_t slot = next_loop_++ % (loops_.size() + 1);
+  if (slot == loops_.size()) {
+    return;
+  }
+
+  // completions of requests the server already read wait until the client arrives at the new loop
+  client->GetServingLoop()->Leave();
+  UnRegisterClient(client);
+  if (!loops_[slot]->Adopt(client)) {
+    // the target loop has stopped, nobody would serve or free the connection
+    ignore_result(client->Close());
+    delete client;
+  }
+}
 
 common::libev::tcp::TcpClient* SubscribersServer::CreateClient(const common::net::socket_info& info) {
   if (compressed_ == C_STANDART) {
@@ -14,12 +14,41 @@
 
 #pragma once
 
+#include <mutex>
+#include <vector>
+
 #include <common/libev/tcp/tcp_server.h>
 
 namespace fastocloud {
 namespace server {
 namespace subscribers {
 
+class SubscriberClient;
+
+// serves the connections handed out by a SubscribersServer, it doesn't listen
+class SubscribersLoop : public common::libev::IoLoop {
+ public:
+  typedef common::libev::IoLoop base_class;
+  explicit SubscribersLoop(common::libev::IoLoopObserver* observer = nullptr);
+
+  const char* ClassName() const override;
+
+  // takes a connection unregistered from the accepting server, false if the loop has stopped and the caller
+  // still owns the client
+  bool Adopt(SubscriberClient* client) WARN_UNUSED_RESULT;
+  // called once Exec returned, connections handed out but not registered yet are closed and deleted
+  void ClosePending();
+
+ private:
+  common::libev::IoChild* CreateChild() override;
+
+  void RegisterPending();
+
+  std::mutex pending_mutex_;
+  std::vector<SubscriberClient*> pending_;
+  bool stopped_;
+};
+
 class SubscribersServer : public common::libev::tcp::TcpServer {
  public:
   enum CompressedType { C_NONE = 0, C_STANDART };
@@ -29,10 +58,21 @@ class SubscribersServer : public common::libev::tcp::TcpServer {
                              CompressedType compressed,
                              common::libev::IoLoopObserver* observer = nullptr);
 
+  // accepted connections are spread round robin over the server and the loops, set before Exec,
+  // the loops must outlive the server
+  void SetLoops(const std::vector<SubscribersLoop*>& loops);
+  // moves a connection just accepted by the server to the next loop, in a task of the server loop so the client
+  // isn't unregistered from inside the Accepted notification
+  void HandOut(SubscriberClient* client);
+
  private:
   common::libev::tcp::TcpClient* CreateClient(const common::net::socket_info& info) override;
 
+  void MoveToNextLoop(SubscriberClient* client);
+
   const CompressedType compressed_;
+  std::vector<SubscribersLoop*> loops_;
+  size_t next_loop_;
 };
 
 }  // namespace subscribers
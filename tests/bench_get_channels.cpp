@@ -0,0 +1,145 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mongo/ids_batches.h"
+
+// Database round trips of a get_channels: one find per referenced stream, serial and request that
+// ClientGetChannels issued before against the batched {"_id": {"$in": [...]}} lookups, with a collection
+// stand-in that counts round trips and waits a fixed latency for each.
+// Usage: bench_get_channels [entries] [latency_us]
+
+namespace fastocloud {
+namespace server {
+namespace {
+
+class CountingCollection {
+ public:
+  explicit CountingCollection(std::chrono::microseconds latency) : latency_(latency), docs_(), round_trips_(0) {}
+
+  void Insert(const std::string& id, const std::string& doc) { docs_[id] = doc; }
+
+  bool FindOne(const std::string& id, std::string* doc) {
+    RoundTrip();
+    const auto it = docs_.find(id);
+    if (it == docs_.end()) {
+      return false;
+    }
+    *doc = it->second;
+    return true;
+  }
+
+  void FindIn(const std::vector<std::string>& ids,
+              size_t begin,
+              size_t end,
+              std::unordered_map<std::string, std::string>* docs) {
+    RoundTrip();
+    for (size_t i = begin; i < end; ++i) {
+      const auto it = docs_.find(ids[i]);
+      if (it != docs_.end()) {
+        (*docs)[it->first] = it->second;
+      }
+    }
+  }
+
+  size_t GetRoundTrips() const { return round_trips_; }
+
+ private:
+  void RoundTrip() {
+    round_trips_++;
+    std::this_thread::sleep_for(latency_);
+  }
+
+  const std::chrono::microseconds latency_;
+  std::unordered_map<std::string, std::string> docs_;
+  size_t round_trips_;
+};
+
+std::string MakeID(size_t index) {
+  char id[25];
+  snprintf(id, sizeof(id), "5e2677ebd18029a8%08zx", index);
+  return id;
+}
+
+}  // namespace
+
+int RunBench(int argc, char** argv) {
+  const size_t entries_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000;
+  const long latency_us = argc > 2 ? strtol(argv[2], nullptr, 10) : 200;
+  if (entries_count == 0 || latency_us < 0) {
+    std::cerr << "Usage: " << argv[0] << " [entries] [latency_us]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // streams, series and requests referenced by the user document, a tenth of them were removed since
+  const std::chrono::microseconds latency(latency_us);
+  CountingCollection per_entry(latency);
+  CountingCollection batched(latency);
+  std::vector<std::string> ids;
+  for (size_t i = 0; i < entries_count; ++i) {
+    const std::string id = MakeID(i);
+    ids.push_back(id);
+    if (i % 10) {
+      per_entry.Insert(id, "{\"name\": \"Stream " + std::to_string(i) + "\"}");
+      batched.Insert(id, "{\"name\": \"Stream " + std::to_string(i) + "\"}");
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::unordered_map<std::string, std::string> per_entry_docs;
+  for (const auto& id : ids) {
+    std::string doc;
+    if (per_entry.FindOne(id, &doc)) {
+      per_entry_docs[id] = doc;
+    }
+  }
+  auto finish = std::chrono::steady_clock::now();
+  std::cout << "find per entry: " << per_entry.GetRoundTrips() << " round trips, "
+            << std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count() << " us" << std::endl;
+
+  start = std::chrono::steady_clock::now();
+  std::unordered_map<std::string, std::string> batched_docs;
+  mongo::ForEachIDsBatch(ids.size(), FIND_BY_IDS_BATCH_SIZE, [&](size_t begin, size_t end) {
+    batched.FindIn(ids, begin, end, &batched_docs);
+    return true;
+  });
+  finish = std::chrono::steady_clock::now();
+  std::cout << "batched finds: " << batched.GetRoundTrips() << " round trips, "
+            << std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count() << " us" << std::endl;
+
+  if (per_entry_docs != batched_docs) {
+    std::cerr << "Found documents differ: " << per_entry_docs.size() << " != " << batched_docs.size() << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "entries " << entries_count << ", found " << batched_docs.size() << ", latency " << latency_us
+            << " us" << std::endl;
+  return EXIT_SUCCESS;
+}
+
+}  // namespace server
+}  // namespace fastocloud
+
+int main(int argc, char** argv) {
+  return fastocloud::server::RunBench(argc, argv);
+}
@@ -0,0 +1,306 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <common/convert2string.h>
+
+#include "base/isubscribers_manager.h"
+#include "http/handler.h"
+
+// Drives the segment request path of HttpHandler (channel resolution on a db worker) with a stand-in manager that
+// emulates database round trips, once straight through the manager and once through the paths cache.
+// Usage: bench_http_paths [requests] [users] [db round trip usec] [segments per zap]
+
+namespace fastocloud {
+namespace server {
+namespace {
+
+class StandInManager : public base::ISubscribersManager {
+ public:
+  StandInManager(uint32_t round_trip_usec, size_t users)
+      : base::ISubscribersManager(nullptr), round_trip_usec_(round_trip_usec), versions_(users, 0) {}
+
+  void Zap(size_t user) { versions_[user]++; }
+
+  void SetupCatchupsEndpoint(const base::CatchupEndpointInfo& info) override { UNUSED(info); }
+  common::Error SendSubscriberNotification(const fastotv::user_id_t& uid,
+                                           const fastotv::device_id_t& device,
+                                           const fastotv::commands_info::NotificationTextInfo& notify) override {
+    UNUSED(uid);
+    UNUSED(device);
+    UNUSED(notify);
+    return NotSupported();
+  }
+  std::vector<base::FrontSubscriberInfo> GetOnlineSubscribers() override { return {}; }
+  common::Error CheckIsLoginClient(base::SubscriberInfo* client, base::ServerDBAuthInfo* ser) const override {
+    UNUSED(client);
+    UNUSED(ser);
+    return NotSupported();
+  }
+  size_t GetAndUpdateOnlineUserByStreamID(fastotv::stream_id_t sid) override {
+    UNUSED(sid);
+    return 0;
+  }
+  bool GetChannelsVersion(const fastotv::user_id_t& uid, base::ChannelsVersion* version) const override {
+    size_t user;
+    if (!common::ConvertFromString(uid, &user) || user >= versions_.size()) {
+      return false;
+    }
+    version->user = versions_[user];
+    return true;
+  }
+  common::Error ClientActivate(const fastotv::commands_info::LoginInfo& uauth,
+                               const std::string& peer_host,
+                               fastotv::commands_info::DevicesInfo* dev) override {
+    UNUSED(uauth);
+    UNUSED(peer_host);
+    UNUSED(dev);
+    return NotSupported();
+  }
+  common::Error ClientLogin(fastotv::user_id_t uid,
+                            const std::string& password,
+                            fastotv::device_id_t dev,
+                            const std::string& peer_host,
+                            base::ServerDBAuthInfo* ser) override {
+    UNUSED(uid);
+    UNUSED(password);
+    UNUSED(dev);
+    UNUSED(peer_host);
+    UNUSED(ser);
+    return NotSupported();
+  }
+  common::Error ClientLogin(const fastotv::commands_info::AuthInfo& uauth,
+                            const std::string& peer_host,
+                            base::ServerDBAuthInfo* ser) override {
+    UNUSED(uauth);
+    UNUSED(peer_host);
+    UNUSED(ser);
+    return NotSupported();
+  }
+  common::Error ClientGetChannels(const fastotv::commands_info::AuthInfo& auth,
+                                  fastotv::commands_info::ChannelsInfo* chans,
+                                  fastotv::commands_info::VodsInfo* vods,
+                                  fastotv::commands_info::ChannelsInfo* pchans,
+                                  fastotv::commands_info::VodsInfo* pvods,
+                                  fastotv::commands_info::CatchupsInfo* catchups,
+                                  fastotv::commands_info::SeriesInfo* series,
+                                  fastotv::commands_info::ContentRequestsInfo* content_requests) override {
+    UNUSED(auth);
+    UNUSED(chans);
+    UNUSED(vods);
+    UNUSED(pchans);
+    UNUSED(pvods);
+    UNUSED(catchups);
+    UNUSED(series);
+    UNUSED(content_requests);
+    return NotSupported();
+  }
+  common::Error ClientFindHttpDirectoryOrUrlForChannel(const base::ServerDBAuthInfo& auth,
+                                                       fastotv::stream_id_t sid,
+                                                       fastotv::channel_id_t cid,
+                                                       http_directory_t* directory,
+                                                       common::uri::GURL* url) override {
+    UNUSED(auth);
+    UNUSED(directory);
+    // subscriber document and stream document
+    std::this_thread::sleep_for(std::chrono::microseconds(round_trip_usec_ * 2));
+    *url = common::uri::GURL("http://127.0.0.1:8000/" + sid + "/" + common::ConvertToString(cid) + "/master.m3u8");
+    return common::Error();
+  }
+  common::Error SetFavorite(const base::ServerDBAuthInfo& auth,
+                            const fastotv::commands_info::FavoriteInfo& favorite) override {
+    UNUSED(auth);
+    UNUSED(favorite);
+    return NotSupported();
+  }
+  common::Error SetRecent(const base::ServerDBAuthInfo& auth,
+                          const fastotv::commands_info::RecentStreamTimeInfo& recent) override {
+    UNUSED(auth);
+    UNUSED(recent);
+    return NotSupported();
+  }
+  common::Error SetInterruptTime(const base::ServerDBAuthInfo& auth,
+                                 const fastotv::commands_info::InterruptStreamTimeInfo& inter) override {
+    UNUSED(auth);
+    UNUSED(inter);
+    return NotSupported();
+  }
+  common::Error FindStream(const base::ServerDBAuthInfo& auth,
+                           fastotv::stream_id_t sid,
+                           fastotv::commands_info::ChannelInfo* chan) const override {
+    UNUSED(auth);
+    UNUSED(sid);
+    UNUSED(chan);
+    return NotSupported();
+  }
+  common::Error FindVod(const base::ServerDBAuthInfo& auth,
+                        fastotv::stream_id_t sid,
+                        fastotv::commands_info::VodInfo* vod) const override {
+    UNUSED(auth);
+    UNUSED(sid);
+    UNUSED(vod);
+    return NotSupported();
+  }
+  common::Error FindCatchup(const base::ServerDBAuthInfo& auth,
+                            fastotv::stream_id_t sid,
+                            fastotv::commands_info::CatchupInfo* cat) const override {
+    UNUSED(auth);
+    UNUSED(sid);
+    UNUSED(cat);
+    return NotSupported();
+  }
+  common::Error CreateCatchup(const base::ServerDBAuthInfo& auth,
+                              fastotv::stream_id_t sid,
+                              const std::string& title,
+                              fastotv::timestamp_t start,
+                              fastotv::timestamp_t stop,
+                              std::string* serverid,
+                              fastotv::commands_info::CatchupInfo* cat,
+                              bool* is_created) override {
+    UNUSED(auth);
+    UNUSED(sid);
+    UNUSED(title);
+    UNUSED(start);
+    UNUSED(stop);
+    UNUSED(serverid);
+    UNUSED(cat);
+    UNUSED(is_created);
+    return NotSupported();
+  }
+  common::Error RemoveUserStream(const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid) override {
+    return NotSupported(auth, sid);
+  }
+  common::Error AddUserStream(const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid) override {
+    return NotSupported(auth, sid);
+  }
+  common::Error RemoveUserVod(const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid) override {
+    return NotSupported(auth, sid);
+  }
+  common::Error AddUserVod(const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid) override {
+    return NotSupported(auth, sid);
+  }
+  common::Error RemoveUserCatchup(const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid) override {
+    return NotSupported(auth, sid);
+  }
+  common::Error CreateRequestContent(const base::ServerDBAuthInfo& auth,
+                                     const fastotv::commands_info::CreateContentRequestInfo& request,
+                                     fastotv::commands_info::ContentRequestInfo* cont) override {
+    UNUSED(auth);
+    UNUSED(request);
+    UNUSED(cont);
+    return NotSupported();
+  }
+  common::Error AddUserCatchup(const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid) override {
+    return NotSupported(auth, sid);
+  }
+
+ private:
+  static common::Error NotSupported() { return common::make_error("Not supported by stand-in manager"); }
+  static common::Error NotSupported(const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid) {
+    UNUSED(auth);
+    UNUSED(sid);
+    return NotSupported();
+  }
+
+  const uint32_t round_trip_usec_;
+  std::vector<uint64_t> versions_;
+};
+
+base::ServerDBAuthInfo MakeUser(size_t user) {
+  const fastotv::login_t login = "user" + common::ConvertToString(user);
+  fastotv::commands_info::AuthInfo auth(fastotv::commands_info::LoginInfo(login, "hash"), "device");
+  return base::ServerDBAuthInfo(common::ConvertToString(user), fastotv::commands_info::ServerAuthInfo(auth, 0));
+}
+
+void Report(const std::string& name, std::vector<uint64_t>* latencies) {
+  std::sort(latencies->begin(), latencies->end());
+  const size_t count = latencies->size();
+  std::cout << name << ": requests " << count << ", p50 " << (*latencies)[count / 2] << " us, p99 "
+            << (*latencies)[count * 99 / 100] << " us, max " << latencies->back() << " us" << std::endl;
+}
+
+template <typename F>
+std::vector<uint64_t> Run(StandInManager* manager, size_t requests, size_t users, size_t segments_per_zap, F resolve) {
+  std::vector<uint64_t> latencies;
+  latencies.reserve(requests);
+  for (size_t i = 0; i < requests; ++i) {
+    const size_t user = i % users;
+    if (segments_per_zap && (i / users) % segments_per_zap == 0) {
+      manager->Zap(user);
+    }
+
+    const base::ServerDBAuthInfo auth = MakeUser(user);
+    const auto start = std::chrono::steady_clock::now();
+    common::Error err = resolve(auth, "5e2677ebd18029a897d2716c", user % 3);
+    const auto finish = std::chrono::steady_clock::now();
+    if (err) {
+      std::cerr << "Resolve error: " << err->GetDescription() << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count());
+  }
+  return latencies;
+}
+
+}  // namespace
+
+int RunBench(int argc, char** argv) {
+  const size_t requests = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+  const size_t users = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100;
+  const uint32_t round_trip_usec = argc > 3 ? strtoul(argv[3], nullptr, 10) : 300;
+  const size_t segments_per_zap = argc > 4 ? strtoul(argv[4], nullptr, 10) : 100;
+  if (requests == 0 || users == 0) {
+    std::cerr << "Usage: " << argv[0] << " [requests] [users] [db round trip usec] [segments per zap]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  StandInManager manager(round_trip_usec, users);
+  http::HttpHandler handler(&manager, nullptr);
+
+  std::vector<uint64_t> direct =
+      Run(&manager, requests, users, segments_per_zap,
+          [&manager](const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid, fastotv::channel_id_t cid) {
+            base::ISubscribersManager::http_directory_t directory;
+            common::uri::GURL url;
+            return manager.ClientFindHttpDirectoryOrUrlForChannel(auth, sid, cid, &directory, &url);
+          });
+  Report("manager", &direct);
+
+  std::vector<uint64_t> cached =
+      Run(&manager, requests, users, segments_per_zap,
+          [&handler](const base::ServerDBAuthInfo& auth, fastotv::stream_id_t sid, fastotv::channel_id_t cid) {
+            http::ResolvedPath path;
+            return handler.FindHttpDirectoryOrUrlForChannel(auth, sid, cid, &path);
+          });
+  Report("paths cache", &cached);
+
+  const base::CacheStats stats = handler.GetPathsCacheStats();
+  std::cout << "paths cache: hits " << stats.hits << ", misses " << stats.misses << std::endl;
+  return EXIT_SUCCESS;
+}
+
+}  // namespace server
+}  // namespace fastocloud
+
+int main(int argc, char** argv) {
+  return fastocloud::server::RunBench(argc, argv);
+}
@@ -0,0 +1,178 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mongo/mongo2info.h"
+
+// Decodes a corpus of stream documents shaped like the ones the admin panel writes (hardware channels and vods with
+// the keys the decoders skip, proxies without have_audio/have_video, catchups) through the Make*Info functions.
+// Built against an older tree the same file measures the previous decoders.
+// Usage: bench_mongo2info [documents] [rounds]
+
+namespace fastocloud {
+namespace server {
+namespace {
+
+enum DocumentKind { CHANNEL_DOCUMENT = 0, PROXY_DOCUMENT, VOD_DOCUMENT, CATCHUP_DOCUMENT, DOCUMENTS_KINDS };
+
+void AppendStreamBase(bson_t* doc, size_t index, bool hardware) {
+  bson_oid_t oid;
+  bson_oid_init(&oid, NULL);
+  BSON_APPEND_OID(doc, STREAM_ID_FIELD, &oid);
+  BSON_APPEND_UTF8(doc, STREAM_CLS_FIELD, hardware ? "IStream.HardwareStream.EncodeStream" : "IStream.ProxyStream");
+  BSON_APPEND_DATE_TIME(doc, STREAM_CREATE_DATE_FIELD, 1580000000000);
+  const std::string name = "Stream " + std::to_string(index);
+  BSON_APPEND_UTF8(doc, STREAM_NAME_FIELD, name.c_str());
+  BSON_APPEND_UTF8(doc, CHANNEL_TVG_ID_FIELD, name.c_str());
+  BSON_APPEND_UTF8(doc, CHANNEL_TVG_NAME_FIELD, name.c_str());
+  BSON_APPEND_UTF8(doc, CHANNEL_TVG_LOGO_FIELD, "https://fastocloud.com/images/unknown_channel.png");
+
+  bson_t groups;
+  BSON_APPEND_ARRAY_BEGIN(doc, STREAM_GROUPS_FIELD, &groups);
+  BSON_APPEND_UTF8(&groups, "0", "News");
+  BSON_APPEND_UTF8(&groups, "1", "Sport");
+  bson_append_array_end(doc, &groups);
+
+  BSON_APPEND_DOUBLE(doc, STREAM_PRICE_FIELD, 0.0);
+  BSON_APPEND_BOOL(doc, STREAM_VISIBLE_FIELD, true);
+  BSON_APPEND_INT32(doc, STREAM_IARC_FIELD, 18);
+  BSON_APPEND_INT32(doc, STREAM_VIEW_COUNT_FIELD, static_cast<int32_t>(index));
+
+  bson_t output;
+  bson_t url;
+  BSON_APPEND_ARRAY_BEGIN(doc, STREAM_OUTPUT_FIELD, &output);
+  BSON_APPEND_DOCUMENT_BEGIN(&output, "0", &url);
+  BSON_APPEND_INT32(&url, STREAM_OUTPUT_URLS_ID_FIELD, 0);
+  BSON_APPEND_UTF8(&url, STREAM_OUTPUT_URLS_URI_FIELD, "http://localhost:8000/master.m3u8");
+  BSON_APPEND_UTF8(&url, STREAM_OUTPUT_URLS_HTTP_ROOT_FIELD, "/home/fastocloud/streamer/hls/1/0");
+  BSON_APPEND_INT32(&url, STREAM_OUTPUT_URLS_HLS_TYPE_FIELD, 0);
+  bson_append_document_end(&output, &url);
+  bson_append_array_end(doc, &output);
+
+  bson_t parts;
+  BSON_APPEND_ARRAY_BEGIN(doc, STREAM_PARTS_FIELD, &parts);
+  bson_append_array_end(doc, &parts);
+  bson_t meta;
+  BSON_APPEND_ARRAY_BEGIN(doc, STREAM_META_URLS_FIELD, &meta);
+  bson_append_array_end(doc, &meta);
+
+  if (!hardware) {
+    return;
+  }
+
+  BSON_APPEND_INT32(doc, STREAM_LOG_LEVEL_FIELD, 6);
+  BSON_APPEND_BOOL(doc, STREAM_HAVE_VIDEO_FIELD, true);
+  BSON_APPEND_BOOL(doc, STREAM_HAVE_AUDIO_FIELD, true);
+  BSON_APPEND_INT32(doc, STREAM_RESTART_ATTEMPTS_FIELD, 10);
+  BSON_APPEND_INT32(doc, STREAM_AUTO_EXIT_FIELD, 0);
+  BSON_APPEND_UTF8(doc, STREAM_EXTRA_CONFIG_ARGS_FIELD, "{}");
+  BSON_APPEND_UTF8(doc, STREAM_VIDEO_PARSER_FIELD, "h264parse");
+  BSON_APPEND_UTF8(doc, STREAM_AUDIO_PARSER_FIELD, "aacparse");
+  BSON_APPEND_INT32(doc, STREAM_AUDIO_SELECT_FIELD, -1);
+  BSON_APPEND_BOOL(doc, STREAM_LOOP_FIELD, false);
+  bson_t input;
+  BSON_APPEND_ARRAY_BEGIN(doc, STREAM_INPUT_FIELD, &input);
+  bson_append_array_end(doc, &input);
+}
+
+bson_t* MakeDocument(DocumentKind kind, size_t index) {
+  bson_t* doc = bson_new();
+  AppendStreamBase(doc, index, kind != PROXY_DOCUMENT);
+  if (kind == VOD_DOCUMENT) {
+    BSON_APPEND_UTF8(doc, VOD_DESCRIPTION_FIELD, "Some movie description, a couple of sentences long.");
+    BSON_APPEND_INT32(doc, VOD_TYPE_FIELD, 0);
+    BSON_APPEND_UTF8(doc, VOD_TRAILER_URL_FIELD, "https://fastocloud.com/trailer.mp4");
+    BSON_APPEND_DOUBLE(doc, VOD_USER_SCORE_FIELD, 7.5);
+    BSON_APPEND_DATE_TIME(doc, VOD_PRIME_DATE_FIELD, 1580000000000);
+    BSON_APPEND_UTF8(doc, VOD_COUNTRY_FIELD, "USA");
+    BSON_APPEND_INT32(doc, VOD_DURATION_FIELD, 7200000);
+  } else if (kind == CATCHUP_DOCUMENT) {
+    BSON_APPEND_DATE_TIME(doc, CATCHUP_START_FIELD, 1580000000000);
+    BSON_APPEND_DATE_TIME(doc, CATCHUP_STOP_FIELD, 1580003600000);
+  } else {
+    BSON_APPEND_INT32(doc, TIMESHIFT_CHUNK_DURATION_FIELD, 120);
+    BSON_APPEND_INT32(doc, TIMESHIFT_CHUNK_LIFE_TIME_FIELD, 43200);
+  }
+  return doc;
+}
+
+bool Decode(DocumentKind kind, const bson_t* doc) {
+  const mongo::UserStreamInfo uinf;
+  bool visible = false;
+  if (kind == VOD_DOCUMENT) {
+    fastotv::commands_info::VodInfo vod;
+    return mongo::MakeVodInfo(doc, fastotv::VOD_ENCODE, uinf, &vod, &visible);
+  } else if (kind == CATCHUP_DOCUMENT) {
+    fastotv::commands_info::CatchupInfo catchup;
+    return mongo::MakeCatchupInfo(doc, fastotv::CATCHUP, uinf, &catchup, &visible);
+  }
+
+  fastotv::commands_info::ChannelInfo channel;
+  const fastotv::StreamType st = kind == PROXY_DOCUMENT ? fastotv::PROXY : fastotv::ENCODE;
+  return mongo::MakeChannelInfo(doc, st, uinf, &channel, &visible);
+}
+
+}  // namespace
+
+int RunBench(int argc, char** argv) {
+  const size_t documents = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+  const size_t rounds = argc > 2 ? strtoul(argv[2], nullptr, 10) : 20;
+  if (documents == 0 || rounds == 0) {
+    std::cerr << "Usage: " << argv[0] << " [documents] [rounds]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<bson_t*> corpus;
+  for (size_t i = 0; i < documents; ++i) {
+    corpus.push_back(MakeDocument(static_cast<DocumentKind>(i % DOCUMENTS_KINDS), i));
+  }
+
+  size_t decoded = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    for (size_t i = 0; i < corpus.size(); ++i) {
+      if (Decode(static_cast<DocumentKind>(i % DOCUMENTS_KINDS), corpus[i])) {
+        decoded++;
+      }
+    }
+  }
+  const auto finish = std::chrono::steady_clock::now();
+
+  for (bson_t* doc : corpus) {
+    bson_destroy(doc);
+  }
+
+  if (decoded != documents * rounds) {
+    std::cerr << "Decoded " << decoded << " of " << documents * rounds << " documents" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const auto nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+  std::cout << "documents " << decoded << ", " << nsec / decoded << " ns per document" << std::endl;
+  return EXIT_SUCCESS;
+}
+
+}  // namespace server
+}  // namespace fastocloud
+
+int main(int argc, char** argv) {
+  return fastocloud::server::RunBench(argc, argv);
+}
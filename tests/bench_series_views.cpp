@@ -0,0 +1,125 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mongo/mongo2info.h"
+
+// Series view counts of a get_channels response: the nested scan over a copy of the vods list per series that
+// ClientGetChannels used before against the episodes views index.
+// Usage: bench_series_views [vods] [series]
+
+namespace fastocloud {
+namespace server {
+namespace {
+
+fastotv::stream_id_t MakeStreamID(size_t index) {
+  char sid[25];
+  snprintf(sid, sizeof(sid), "5e2677ebd18029a8%08zx", index);
+  return sid;
+}
+
+fastotv::commands_info::SerialInfo::view_count_t NestedSerialViews(const fastotv::commands_info::SerialInfo& ser,
+                                                                   const fastotv::commands_info::VodsInfo& vods) {
+  auto episodes = ser.GetEpisodes();
+  auto vods_array = vods.Get();
+  size_t view_counts = 0;
+  for (auto episode : episodes) {
+    for (auto serial : vods_array) {
+      if (serial.IsSerial() && serial.GetStreamID() == episode) {
+        view_counts += serial.GetViewCount();
+        break;
+      }
+    }
+  }
+  return view_counts;
+}
+
+}  // namespace
+
+int RunBench(int argc, char** argv) {
+  const size_t vods_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+  const size_t series_count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000;
+  if (vods_count == 0 || series_count == 0) {
+    std::cerr << "Usage: " << argv[0] << " [vods] [series]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  fastotv::commands_info::VodsInfo vods;
+  for (size_t i = 0; i < vods_count; ++i) {
+    fastotv::commands_info::MovieInfo mov;
+    mov.SetName("Movie " + std::to_string(i));
+    mov.SetType(i % 2 ? fastotv::commands_info::MovieInfo::SERIES : fastotv::commands_info::MovieInfo::VODS);
+    typedef fastotv::commands_info::StreamBaseInfo StreamBaseInfo;
+    vods.Add(fastotv::commands_info::VodInfo(MakeStreamID(i), StreamBaseInfo::groups_t(), StreamBaseInfo::DEFAULT_IARC,
+                                             false, 0, 0, mov, true, true, StreamBaseInfo::parts_t(), i, false,
+                                             StreamBaseInfo::meta_urls_t()));
+  }
+
+  // episodes spread over the whole catalog, so the nested scan does not end early
+  std::vector<fastotv::commands_info::SerialInfo> series;
+  const size_t episodes_per_serial = vods_count / 2 / series_count + 1;
+  for (size_t i = 0; i < series_count; ++i) {
+    fastotv::commands_info::SerialInfo::episodes_t episodes;
+    for (size_t j = 0; j < episodes_per_serial; ++j) {
+      episodes.push_back(MakeStreamID((i + j * series_count) * 2 + 1));
+    }
+    typedef fastotv::commands_info::SerialInfo SerialInfo;
+    series.push_back(SerialInfo(MakeStreamID(vods_count + i), "Serial " + std::to_string(i), common::uri::GURL(),
+                                SerialInfo::groups_t(), std::string(), 1, episodes, 0));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t nested_total = 0;
+  for (const auto& ser : series) {
+    nested_total += NestedSerialViews(ser, vods);
+  }
+  auto finish = std::chrono::steady_clock::now();
+  std::cout << "nested scan: " << std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count()
+            << " us" << std::endl;
+
+  start = std::chrono::steady_clock::now();
+  mongo::episodes_views_t views;
+  for (const auto& vod : vods.Get()) {
+    mongo::AddEpisodeViews(vod, &views);
+  }
+  uint64_t index_total = 0;
+  for (const auto& ser : series) {
+    index_total += mongo::GetSerialViews(ser, views);
+  }
+  finish = std::chrono::steady_clock::now();
+  std::cout << "views index: " << std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count()
+            << " us" << std::endl;
+
+  if (nested_total != index_total) {
+    std::cerr << "View counts differ: " << nested_total << " != " << index_total << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "vods " << vods_count << ", series " << series_count << ", views " << index_total << std::endl;
+  return EXIT_SUCCESS;
+}
+
+}  // namespace server
+}  // namespace fastocloud
+
+int main(int argc, char** argv) {
+  return fastocloud::server::RunBench(argc, argv);
+}
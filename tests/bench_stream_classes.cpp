@@ -0,0 +1,115 @@
+/*  Copyright (C) 2014-2020 FastoGT. All right reserved.
+    This file is part of fastocloud.
+    fastocloud is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    fastocloud is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with fastocloud.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mongo/stream_class.h"
+
+// Classification throughput of stream document _cls values: the strcmp chain the manager used before against
+// StreamClassResolver, over the class mix of a typical catalog.
+// Usage: bench_stream_classes [lookups]
+
+namespace fastocloud {
+namespace server {
+namespace {
+
+fastotv::StreamType StrcmpStreamType(const char* data) {
+  if (strcmp(data, PROXY_STR) == 0) {
+    return fastotv::PROXY;
+  } else if (strcmp(data, VOD_PROXY_STR) == 0) {
+    return fastotv::VOD_PROXY;
+  } else if (strcmp(data, RELAY_STR) == 0) {
+    return fastotv::RELAY;
+  } else if (strcmp(data, ENCODE_STR) == 0) {
+    return fastotv::ENCODE;
+  } else if (strcmp(data, VOD_RELAY_STR) == 0) {
+    return fastotv::VOD_RELAY;
+  } else if (strcmp(data, VOD_ENCODE_STR) == 0) {
+    return fastotv::VOD_ENCODE;
+  } else if (strcmp(data, TIMESHIFT_RECORDER_STR) == 0) {
+    return fastotv::TIMESHIFT_RECORDER;
+  } else if (strcmp(data, TIMESHIFT_PLAYER_STR) == 0) {
+    return fastotv::TIMESHIFT_PLAYER;
+  } else if (strcmp(data, CATCHUP_STR) == 0) {
+    return fastotv::CATCHUP;
+  } else if (strcmp(data, COD_RELAY_STR) == 0) {
+    return fastotv::COD_RELAY;
+  } else if (strcmp(data, COD_ENCODE_STR) == 0) {
+    return fastotv::COD_ENCODE;
+  } else if (strcmp(data, TEST_LIFE_STR) == 0) {
+    return fastotv::TEST_LIFE;
+  }
+
+  return fastotv::PROXY;
+}
+
+template <typename F>
+void Run(const char* name, const std::vector<std::string>& classes, size_t lookups, F classify) {
+  size_t checksum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < lookups; ++i) {
+    checksum += classify(classes[i % classes.size()]);
+  }
+  const auto finish = std::chrono::steady_clock::now();
+  const auto nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+  std::cout << name << ": lookups " << lookups << ", " << static_cast<double>(nsec) / lookups << " ns per lookup"
+            << " (checksum " << checksum << ")" << std::endl;
+}
+
+}  // namespace
+
+int RunBench(int argc, char** argv) {
+  const size_t lookups = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+  if (lookups == 0) {
+    std::cerr << "Usage: " << argv[0] << " [lookups]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // catchups and vods dominate big catalogs, they are near the end of the strcmp chain
+  std::vector<std::string> classes;
+  for (size_t i = 0; i < 4; ++i) {
+    classes.push_back(CATCHUP_STR);
+    classes.push_back(VOD_ENCODE_STR);
+  }
+  classes.push_back(VOD_PROXY_STR);
+  classes.push_back(PROXY_STR);
+  classes.push_back(RELAY_STR);
+  classes.push_back(ENCODE_STR);
+  classes.push_back(VOD_RELAY_STR);
+  classes.push_back(TIMESHIFT_PLAYER_STR);
+
+  Run("strcmp chain", classes, lookups, [](const std::string& cls) { return StrcmpStreamType(cls.c_str()); });
+
+  mongo::StreamClassResolver resolver;
+  Run("resolver", classes, lookups, [&resolver](const std::string& cls) {
+    fastotv::StreamType st = fastotv::PROXY;
+    resolver.Resolve(cls.c_str(), cls.size(), &st);
+    return st;
+  });
+  return EXIT_SUCCESS;
+}
+
+}  // namespace server
+}  // namespace fastocloud
+
+int main(int argc, char** argv) {
+  return fastocloud::server::RunBench(argc, argv);
+}
@@ -1,2 +1,1187 @@
 #include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <common/time.h>
+
+#include "base/auth_cache.h"
+#include "base/db_worker_pool.h"
+#include "base/login_guard.h"
+#include "base/operation_metrics.h"
+#include "base/single_flight.h"
+#include "base/user_streams_write_buffer.h"
+#include "base/view_counters.h"
+
+#include "mongo/mongo2info.h"
+#include "mongo/query_shapes.h"
+#include "mongo/read_preferences.h"
+#include "mongo/snapshot.h"
+#include "mongo/snapshot_store.h"
+#include "mongo/stream_class.h"
+#include "mongo/subscribers_manager.h"
+#include "mongo/user_entitlements.h"
+
+#include "subscribers/channels_delta.h"
+
 TEST(Server, test) {}
+
+namespace {
+
+// stand-in for the libev loop, ExecInLoopThread only queues functions for the loop thread
+class FakeLoop {
+ public:
+  void ExecInLoopThread(std::function<void()> func) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_.push_back(func);
+    cond_.notify_all();
+  }
+
+  void WaitPending() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]() { return !pending_.empty(); });
+  }
+
+  void RunPending() {
+    std::deque<std::function<void()>> pending;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pending.swap(pending_);
+    }
+    for (const auto& func : pending) {
+      func();
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::function<void()>> pending_;
+};
+
+// connection of the fake loop, the life token is the one of the subscribers connections
+class FakeClient : public fastocloud::server::base::SubscriberInfo {
+ public:
+  explicit FakeClient(FakeLoop* loop) : loop_(loop), pongs_(0) { GetServingLoop()->Arrive(loop); }
+
+  common::Optional<fastocloud::server::base::FrontSubscriberInfo> MakeFrontSubscriberInfo() const override {
+    return common::Optional<fastocloud::server::base::FrontSubscriberInfo>();
+  }
+
+  common::ErrnoError SendNotification(const fastotv::commands_info::NotificationTextInfo& notify) override {
+    UNUSED(notify);
+    return common::ErrnoError();
+  }
+
+  // ping request read by the loop, answered without the database
+  void Ping() {
+    loop_->ExecInLoopThread([this]() { pongs_++; });
+  }
+
+  size_t GetPongs() const { return pongs_; }
+
+ private:
+  FakeLoop* const loop_;
+  size_t pongs_;
+};
+
+}  // namespace
+
+TEST(DbWorkerPool, pings_answered_while_database_is_blocked) {
+  FakeLoop loop;
+  fastocloud::server::base::DbWorkerPool pool(1, 4);
+  pool.Start();
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  FakeClient client(&loop);
+  size_t completions = 0;
+  common::Error err =
+      pool.PostForClient<FakeClient>(&client, [released, &completions]() -> std::function<void(FakeClient*)> {
+        released.wait();  // database query in flight
+        return [&completions](FakeClient* client) {
+          UNUSED(client);
+          completions++;
+        };
+      });
+  ASSERT_FALSE(err);
+
+  for (size_t i = 0; i < 16; ++i) {
+    client.Ping();
+    loop.RunPending();
+  }
+  ASSERT_EQ(client.GetPongs(), 16u);
+  ASSERT_EQ(completions, 0u);
+
+  release.set_value();
+  loop.WaitPending();
+  loop.RunPending();
+  ASSERT_EQ(completions, 1u);
+  pool.Stop();
+}
+
+TEST(DbWorkerPool, completion_of_closed_client_is_dropped) {
+  FakeLoop loop;
+  fastocloud::server::base::DbWorkerPool pool(1, 4);
+  pool.Start();
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  FakeClient* client = new FakeClient(&loop);
+  size_t completions = 0;
+  common::Error err =
+      pool.PostForClient<FakeClient>(client, [released, &completions]() -> std::function<void(FakeClient*)> {
+        released.wait();
+        return [&completions](FakeClient* client) {
+          UNUSED(client);
+          completions++;
+        };
+      });
+  ASSERT_FALSE(err);
+
+  delete client;  // closed while the request is on the worker, the token expires
+  release.set_value();
+  loop.WaitPending();
+  loop.RunPending();
+  ASSERT_EQ(completions, 0u);
+  pool.Stop();
+}
+
+TEST(DbWorkerPool, completion_follows_client_to_another_loop) {
+  FakeLoop accepting;
+  FakeLoop serving;
+  fastocloud::server::base::DbWorkerPool pool(1, 4);
+  pool.Start();
+
+  FakeClient client(&accepting);
+  size_t completions = 0;
+  common::Error err = pool.PostForClient<FakeClient>(&client, [&completions]() -> std::function<void(FakeClient*)> {
+    return [&completions](FakeClient* client) {
+      UNUSED(client);
+      completions++;
+    };
+  });
+  ASSERT_FALSE(err);
+
+  // completion queued on the accepting loop, the client is handed out before it runs
+  accepting.WaitPending();
+  client.GetServingLoop()->Leave();
+  accepting.RunPending();
+  ASSERT_EQ(completions, 0u);
+
+  client.GetServingLoop()->Arrive(&serving);
+  accepting.RunPending();
+  ASSERT_EQ(completions, 0u);
+  serving.RunPending();
+  ASSERT_EQ(completions, 1u);
+  pool.Stop();
+}
+
+TEST(DbWorkerPool, bounded_queue) {
+  fastocloud::server::base::DbWorkerPool pool(1, 1);
+  common::Error err = pool.Post([]() {});
+  ASSERT_TRUE(err);  // not started
+
+  pool.Start();
+  std::atomic<bool> started(false);
+  std::atomic<bool> release(false);
+  err = pool.Post([&started, &release]() {
+    started = true;
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  ASSERT_FALSE(err);
+  while (!started) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  err = pool.Post([]() {});
+  ASSERT_FALSE(err);
+  err = pool.Post([]() {});
+  ASSERT_TRUE(err);  // queue is full
+  ASSERT_EQ(pool.GetQueueSize(), 1u);
+
+  release = true;
+  pool.Stop();
+}
+
+TEST(UserStreamsWriteBuffer, zapping_storm_is_coalesced) {
+  typedef fastocloud::server::base::UserStreamsWriteBuffer UserStreamsWriteBuffer;
+  const size_t users = 10;
+  const size_t streams = 20;
+  const size_t zaps = 100;
+  std::mutex flushed_mutex;
+  UserStreamsWriteBuffer::updates_t flushed;
+  UserStreamsWriteBuffer buffer(60 * 1000, users * streams + 1);
+  buffer.Start([&flushed_mutex, &flushed](const UserStreamsWriteBuffer::updates_t& updates) {
+    std::unique_lock<std::mutex> lock(flushed_mutex);
+    flushed.insert(flushed.end(), updates.begin(), updates.end());
+    return true;
+  });
+
+  for (size_t z = 0; z < zaps; ++z) {
+    for (size_t u = 0; u < users; ++u) {
+      for (size_t s = 0; s < streams; ++s) {
+        const std::string uid = std::to_string(u);
+        const std::string sid = std::to_string(s);
+        buffer.SetRecent(uid, sid, UserStreamsWriteBuffer::USER_STREAMS, z);
+        buffer.SetInterruptTime(uid, sid, UserStreamsWriteBuffer::USER_STREAMS, z * 2);
+      }
+    }
+  }
+  buffer.SetFavorite("0", "0", UserStreamsWriteBuffer::USER_STREAMS, true);
+
+  // own writes are visible before the flush
+  UserStreamsWriteBuffer::Update update;
+  ASSERT_TRUE(buffer.Find("0", "0", &update));
+  ASSERT_TRUE(update.favorite);
+  ASSERT_EQ(update.recent, zaps - 1);
+  ASSERT_EQ(update.interruption_time, (zaps - 1) * 2);
+  UserStreamsWriteBuffer::updates_t user_updates;
+  ASSERT_TRUE(buffer.FindUser("1", &user_updates));
+  ASSERT_EQ(user_updates.size(), streams);
+  ASSERT_FALSE(buffer.Find("0", "unknown", &update));
+
+  buffer.Stop();
+  ASSERT_EQ(flushed.size(), users * streams);
+  for (const auto& flush : flushed) {
+    ASSERT_EQ(flush.recent, zaps - 1);
+    ASSERT_EQ(flush.interruption_time, (zaps - 1) * 2);
+  }
+
+  const auto stats = buffer.GetStats();
+  ASSERT_EQ(stats.writes, users * streams * zaps * 2 + 1);
+  ASSERT_EQ(stats.flushed, users * streams);
+  ASSERT_EQ(stats.pending, 0);
+  ASSERT_FALSE(buffer.Find("0", "0", &update));
+}
+
+TEST(UserStreamsWriteBuffer, flushes_on_size_threshold) {
+  typedef fastocloud::server::base::UserStreamsWriteBuffer UserStreamsWriteBuffer;
+  std::atomic<size_t> flushed(0);
+  UserStreamsWriteBuffer buffer(60 * 1000, 10);
+  buffer.Start([&flushed](const UserStreamsWriteBuffer::updates_t& updates) {
+    flushed += updates.size();
+    return true;
+  });
+  for (size_t i = 0; i < 10; ++i) {
+    buffer.SetFavorite("user", std::to_string(i), UserStreamsWriteBuffer::USER_VODS, true);
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (flushed != 10 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(flushed, 10);
+  buffer.Stop();
+}
+
+TEST(UserStreamsWriteBuffer, failed_flush_is_retried_under_newer_writes) {
+  typedef fastocloud::server::base::UserStreamsWriteBuffer UserStreamsWriteBuffer;
+  UserStreamsWriteBuffer buffer(60 * 1000, 1024);
+  size_t attempts = 0;
+  UserStreamsWriteBuffer::updates_t written;
+  buffer.Start([&buffer, &attempts, &written](const UserStreamsWriteBuffer::updates_t& updates) {
+    if (attempts++ == 0) {
+      // zapping goes on while the database is down
+      buffer.SetRecent("user", "stream", UserStreamsWriteBuffer::USER_STREAMS, 2);
+      return false;
+    }
+    written = updates;
+    return true;
+  });
+
+  buffer.SetRecent("user", "stream", UserStreamsWriteBuffer::USER_STREAMS, 1);
+  buffer.SetInterruptTime("user", "stream", UserStreamsWriteBuffer::USER_STREAMS, 10);
+  buffer.SetFavorite("user", "other", UserStreamsWriteBuffer::USER_STREAMS, true);
+  buffer.Flush();
+
+  auto stats = buffer.GetStats();
+  ASSERT_EQ(stats.failed_flushes, 1u);
+  ASSERT_EQ(stats.flushed, 0u);
+  ASSERT_EQ(stats.pending, 2u);
+  UserStreamsWriteBuffer::Update update;
+  ASSERT_TRUE(buffer.Find("user", "stream", &update));
+  ASSERT_EQ(update.recent, 2);
+  ASSERT_EQ(update.interruption_time, 10);
+
+  buffer.Flush();
+  ASSERT_EQ(attempts, 2u);
+  ASSERT_EQ(written.size(), 2u);
+  for (const auto& it : written) {
+    if (it.sid == "stream") {
+      ASSERT_EQ(it.recent, 2);
+      ASSERT_EQ(it.interruption_time, 10);
+    } else {
+      ASSERT_TRUE(it.favorite);
+    }
+  }
+
+  stats = buffer.GetStats();
+  ASSERT_EQ(stats.failed_flushes, 1u);
+  ASSERT_EQ(stats.flushed, 2u);
+  ASSERT_EQ(stats.pending, 0u);
+  buffer.Stop();
+}
+
+TEST(ViewCounters, concurrent_increments_are_flushed_once) {
+  typedef fastocloud::server::base::ViewCounters ViewCounters;
+  const size_t threads_count = 8;
+  const size_t increments = 10000;
+  std::mutex flushed_mutex;
+  ViewCounters::deltas_t flushed;
+  size_t flushes = 0;
+  ViewCounters counters(ViewCounters::default_shards, 60 * 1000);
+  counters.Start(std::string(), [&flushed_mutex, &flushed, &flushes](const std::string&,
+                                                                     const ViewCounters::deltas_t& deltas) {
+    std::unique_lock<std::mutex> lock(flushed_mutex);
+    for (const auto& delta : deltas) {
+      flushed[delta.first] += delta.second;
+    }
+    flushes++;
+    return true;
+  });
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < threads_count; ++t) {
+    threads.push_back(std::thread([&counters, t]() {
+      for (size_t i = 0; i < increments; ++i) {
+        counters.Increment("hot");
+        counters.Increment(std::to_string(t));
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // fresh values without a database write
+  ASSERT_EQ(counters.GetPending("hot"), threads_count * increments);
+  ASSERT_EQ(counters.GetPending("0"), increments);
+
+  counters.Stop();
+  ASSERT_EQ(flushes, 1);
+  ASSERT_EQ(flushed.size(), threads_count + 1);
+  ASSERT_EQ(flushed["hot"], threads_count * increments);
+  ASSERT_EQ(counters.GetPending("hot"), 0);
+}
+
+TEST(ViewCounters, failed_flush_is_journaled_and_replayed) {
+  typedef fastocloud::server::base::ViewCounters ViewCounters;
+  const std::string journal = "/tmp/unit_tests_view_counters.journal";
+  unlink(journal.c_str());
+
+  std::vector<std::string> failed_batches;
+  {
+    ViewCounters counters(1, 60 * 1000);
+    counters.Start(journal, [&failed_batches](const std::string& batch_id, const ViewCounters::deltas_t&) {
+      failed_batches.push_back(batch_id);
+      return false;  // database down
+    });
+    for (size_t i = 0; i < 5; ++i) {
+      counters.Increment("5e2677ebd18029a897d2716c");
+    }
+    counters.Flush();
+    counters.Increment("5e2677ebd18029a897d2716c");
+    ASSERT_EQ(counters.GetPending("5e2677ebd18029a897d2716c"), 6);
+    ASSERT_EQ(counters.GetStats().failed_flushes, 1);
+  }  // crash, the last flush failed too
+
+  // the sent batch is retried as is, the later increment goes to a batch of its own
+  ASSERT_GE(failed_batches.size(), 2);
+  for (const auto& batch_id : failed_batches) {
+    ASSERT_EQ(batch_id, failed_batches[0]);
+  }
+
+  std::vector<std::string> batches;
+  ViewCounters::deltas_t flushed;
+  ViewCounters counters(1, 60 * 1000);
+  counters.Start(journal, [&batches, &flushed](const std::string& batch_id, const ViewCounters::deltas_t& deltas) {
+    batches.push_back(batch_id);
+    for (const auto& delta : deltas) {
+      flushed[delta.first] += delta.second;
+    }
+    return true;
+  });
+  ASSERT_EQ(counters.GetPending("5e2677ebd18029a897d2716c"), 6);
+  counters.Stop();
+  ASSERT_EQ(flushed["5e2677ebd18029a897d2716c"], 6);
+  ASSERT_EQ(batches.size(), 2);
+  ASSERT_EQ(batches[0], failed_batches[0]);
+  ASSERT_NE(access(journal.c_str(), F_OK), 0);
+}
+
+TEST(ViewCounters, partly_written_batch_is_counted_once) {
+  typedef fastocloud::server::base::ViewCounters ViewCounters;
+  // database side, the batches added to every stream like the view_batches collection
+  std::map<std::string, ViewCounters::delta_t> view_counts;
+  std::map<std::string, std::set<std::string>> view_batches;
+  bool cut_short = true;
+  ViewCounters counters(ViewCounters::default_shards, 60 * 1000);
+  counters.Start(std::string(), [&](const std::string& batch_id, const ViewCounters::deltas_t& deltas) {
+    size_t applied = 0;
+    for (const auto& delta : deltas) {
+      if (cut_short && applied == deltas.size() / 2) {
+        return false;  // unordered bulk write failed half way
+      }
+      if (view_batches[delta.first].insert(batch_id).second) {
+        view_counts[delta.first] += delta.second;
+      }
+      applied++;
+    }
+    return true;
+  });
+
+  for (size_t i = 0; i < 10; ++i) {
+    for (size_t j = 0; j <= i; ++j) {
+      counters.Increment(std::to_string(i));
+    }
+  }
+  counters.Flush();
+  ASSERT_EQ(counters.GetStats().failed_flushes, 1);
+
+  counters.Increment("0");
+  cut_short = false;
+  counters.Flush();
+  counters.Stop();
+  for (size_t i = 0; i < 10; ++i) {
+    ASSERT_EQ(view_counts[std::to_string(i)], i ? i + 1 : 2);
+    ASSERT_EQ(counters.GetPending(std::to_string(i)), 0);
+  }
+}
+
+namespace {
+fastocloud::server::base::ServerDBAuthInfo MakeTestAuth(const fastotv::user_id_t& uid,
+                                                        const std::string& password,
+                                                        const fastotv::device_id_t& device,
+                                                        fastotv::timestamp_t exp_date) {
+  fastotv::commands_info::AuthInfo auth(fastotv::commands_info::LoginInfo("test@fastogt.com", password), device);
+  return fastocloud::server::base::ServerDBAuthInfo(uid, fastotv::commands_info::ServerAuthInfo(auth, exp_date));
+}
+}  // namespace
+
+TEST(AuthCache, segment_requests_hit_until_user_changes) {
+  typedef fastocloud::server::base::AuthCache AuthCache;
+  const fastotv::timestamp_t exp_date = common::time::current_utc_mstime() + 3600 * 1000;
+  const auto auth = MakeTestAuth("5e2677ebd18029a897d2716c", "hash", "5e2677ebd18029a897d2716d", exp_date);
+
+  AuthCache cache(16, 60);
+  fastocloud::server::base::ServerDBAuthInfo found;
+  // not cached while invalidation is not running
+  cache.Insert(auth.GetUserID(), "hash", auth.GetDeviceID(), auth, cache.GetGeneration());
+  ASSERT_FALSE(cache.Find(auth.GetUserID(), "hash", auth.GetDeviceID(), &found));
+
+  cache.SetEnabled(true);
+  cache.Insert(auth.GetUserID(), "hash", auth.GetDeviceID(), auth, cache.GetGeneration());
+  for (size_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(cache.Find(auth.GetUserID(), "hash", auth.GetDeviceID(), &found));
+  }
+  ASSERT_EQ(found.GetUserID(), auth.GetUserID());
+  ASSERT_FALSE(cache.Find(auth.GetUserID(), "other", auth.GetDeviceID(), &found));
+  ASSERT_FALSE(cache.Find(auth.GetUserID(), "hash", "5e2677ebd18029a897d2716e", &found));
+
+  // password changed
+  cache.RemoveUser(auth.GetUserID());
+  ASSERT_FALSE(cache.Find(auth.GetUserID(), "hash", auth.GetDeviceID(), &found));
+
+  const auto stats = cache.GetStats();
+  ASSERT_EQ(stats.hits, 100);
+  ASSERT_EQ(stats.misses, 4);
+  ASSERT_EQ(stats.entries, 0);
+}
+
+TEST(AuthCache, stale_and_expired_logins_are_not_served) {
+  typedef fastocloud::server::base::AuthCache AuthCache;
+  const fastotv::timestamp_t now = common::time::current_utc_mstime();
+  const auto auth = MakeTestAuth("5e2677ebd18029a897d2716c", "hash", "5e2677ebd18029a897d2716d", now + 3600 * 1000);
+
+  AuthCache cache(1, 60);
+  cache.SetEnabled(true);
+  fastocloud::server::base::ServerDBAuthInfo found;
+
+  // user changed while the login was checked against the database
+  const AuthCache::generation_t generation = cache.GetGeneration();
+  cache.RemoveUser(auth.GetUserID());
+  cache.Insert(auth.GetUserID(), "hash", auth.GetDeviceID(), auth, generation);
+  ASSERT_FALSE(cache.Find(auth.GetUserID(), "hash", auth.GetDeviceID(), &found));
+
+  // account expired
+  const auto expired = MakeTestAuth("5e2677ebd18029a897d2716f", "hash", "5e2677ebd18029a897d2716d", now - 1);
+  cache.Insert(expired.GetUserID(), "hash", expired.GetDeviceID(), expired, cache.GetGeneration());
+  ASSERT_FALSE(cache.Find(expired.GetUserID(), "hash", expired.GetDeviceID(), &found));
+  ASSERT_EQ(cache.GetStats().entries, 0);
+
+  // bounded by entries count
+  cache.Insert(auth.GetUserID(), "hash", auth.GetDeviceID(), auth, cache.GetGeneration());
+  cache.Insert(auth.GetUserID(), "hash", "5e2677ebd18029a897d2716e", auth, cache.GetGeneration());
+  ASSERT_EQ(cache.GetStats().entries, 1);
+  ASSERT_FALSE(cache.Find(auth.GetUserID(), "hash", auth.GetDeviceID(), &found));
+  ASSERT_TRUE(cache.Find(auth.GetUserID(), "hash", "5e2677ebd18029a897d2716e", &found));
+}
+
+TEST(LoginGuard, failing_logins_are_rejected_from_memory) {
+  typedef fastocloud::server::base::LoginGuard LoginGuard;
+  // 50 msec negative entries, one free failure, backoff from 200 msec doubling up to 800 msec, hosts unlimited
+  fastotv::timestamp_t now = 1000000;
+  LoginGuard guard(16, 50, 1, 200, 800, 0, 0, [&now]() { return now; });
+  const LoginGuard::Identity stb = LoginGuard::MakeIdentity("10.0.0.2", "user@example.com", "5e2677ebd18029a897d2716d");
+  const LoginGuard::Identity tv = LoginGuard::MakeIdentity("10.0.0.2", "user@example.com", "5e2677ebd18029a897d2716e");
+
+  ASSERT_FALSE(guard.Check(stb, "hash"));
+  guard.Reject(stb, "hash", common::make_error("Device not found"));
+  // retry loop of a broken set-top box gets the same answer
+  common::Error err = guard.Check(stb, "hash");
+  ASSERT_TRUE(err);
+  ASSERT_EQ(err->GetDescription(), "Device not found");
+  ASSERT_FALSE(guard.Check(stb, "other"));
+  ASSERT_FALSE(guard.Check(tv, "hash"));
+
+  // failures in a row block the identity, other devices of the user still log in
+  guard.Reject(stb, "other", common::make_error("Invalid password"));
+  ASSERT_TRUE(guard.Check(stb, "third"));
+  ASSERT_FALSE(guard.Check(tv, "hash"));
+  ASSERT_EQ(guard.GetStats().blocked_identities, 1);
+
+  // the first block ends after 200 msec, the next failure doubles it
+  now += 199;
+  ASSERT_TRUE(guard.Check(stb, "hash"));
+  now += 1;
+  ASSERT_FALSE(guard.Check(stb, "hash"));
+  guard.Reject(stb, "third", common::make_error("Invalid password"));
+  now += 300;
+  ASSERT_TRUE(guard.Check(stb, "fourth"));
+  now += 100;
+  ASSERT_FALSE(guard.Check(stb, "fourth"));
+
+  guard.Accept(stb);
+  ASSERT_FALSE(guard.Check(stb, "fourth"));
+
+  const auto stats = guard.GetStats();
+  ASSERT_EQ(stats.failures, 3);
+  ASSERT_EQ(stats.rejected_cached, 1);
+  ASSERT_EQ(stats.rejected_backoff, 3);
+  ASSERT_EQ(stats.blocked_identities, 0);
+}
+
+TEST(LoginGuard, failures_are_counted_per_host) {
+  typedef fastocloud::server::base::LoginGuard LoginGuard;
+  // no free failures, 1000 msec backoff, a host gets 3 failed logins per 1000 msec
+  fastotv::timestamp_t now = 1000000;
+  LoginGuard guard(16, 50, 0, 1000, 1000, 3, 1000, [&now]() { return now; });
+  const LoginGuard::Identity owner = LoginGuard::MakeIdentity("10.0.0.2", "user@example.com", std::string());
+  const LoginGuard::Identity other = LoginGuard::MakeIdentity("10.0.0.3", "user@example.com", std::string());
+
+  // wrong passwords from another host don't lock the owner out
+  guard.Reject(other, "guess", common::make_error("Invalid password"));
+  ASSERT_TRUE(guard.Check(other, "hash"));
+  ASSERT_FALSE(guard.Check(owner, "hash"));
+
+  // stuffing from one host, one attempt per email, stops after 3 failures
+  for (int i = 0; i < 3; ++i) {
+    const std::string login = std::to_string(i) + "@example.com";
+    const LoginGuard::Identity email = LoginGuard::MakeIdentity("10.0.0.4", login, std::string());
+    ASSERT_FALSE(guard.Check(email, "hash"));
+    guard.Reject(email, "hash", common::make_error("User not found"));
+  }
+  const LoginGuard::Identity next = LoginGuard::MakeIdentity("10.0.0.4", "3@example.com", std::string());
+  ASSERT_TRUE(guard.Check(next, "hash"));
+  ASSERT_FALSE(guard.Check(owner, "hash"));
+  now += 1000;
+  ASSERT_FALSE(guard.Check(next, "hash"));
+
+  const auto stats = guard.GetStats();
+  ASSERT_EQ(stats.failures, 4);
+  ASSERT_EQ(stats.rejected_address, 1);
+  ASSERT_EQ(stats.rejected_backoff, 1);
+}
+
+TEST(UserEntitlements, lookup_by_binary_id) {
+  typedef fastocloud::server::mongo::UserEntitlements UserEntitlements;
+  typedef fastocloud::server::base::UserStreamsWriteBuffer UserStreamsWriteBuffer;
+  static const size_t kStreamsCount = 1000;
+
+  std::vector<UserEntitlements::Entry> entries;
+  for (size_t i = 0; i < kStreamsCount; ++i) {
+    char sid_str[25];
+    snprintf(sid_str, sizeof(sid_str), "5e2677ebd18029a8%08zx", kStreamsCount - i);
+    UserEntitlements::Entry entry;
+    bson_oid_init_from_string(&entry.sid, sid_str);
+    entry.array = i % 2 ? UserStreamsWriteBuffer::USER_VODS : UserStreamsWriteBuffer::USER_STREAMS;
+    entry.uinf.recent = i;
+    entries.push_back(entry);
+    // duplicates in the document are collapsed
+    entries.push_back(entry);
+  }
+
+  UserEntitlements entitlements;
+  entitlements.Assign(entries);
+  ASSERT_EQ(entitlements.GetSize(), kStreamsCount);
+  for (size_t i = 0; i < kStreamsCount; ++i) {
+    const UserEntitlements::Entry& entry = entries[i * 2];
+    const UserEntitlements::Entry* found = entitlements.Find(entry.sid, entry.array);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(found->uinf.recent, entry.uinf.recent);
+    // the same stream in another array is not an entitlement
+    ASSERT_FALSE(entitlements.Find(entry.sid, UserStreamsWriteBuffer::USER_CATCHUPS));
+  }
+
+  UserEntitlements::Entry catchup = entries[0];
+  catchup.array = UserStreamsWriteBuffer::USER_CATCHUPS;
+  catchup.uinf.favorite = true;
+  entitlements.Insert(catchup);
+  entitlements.Insert(catchup);
+  ASSERT_EQ(entitlements.GetSize(), kStreamsCount + 1);
+  ASSERT_TRUE(entitlements.Find(catchup.sid, UserStreamsWriteBuffer::USER_CATCHUPS)->uinf.favorite);
+  ASSERT_TRUE(entitlements.Find(catchup.sid, UserStreamsWriteBuffer::USER_STREAMS));
+
+  ASSERT_TRUE(entitlements.Remove(catchup.sid, UserStreamsWriteBuffer::USER_STREAMS));
+  ASSERT_FALSE(entitlements.Remove(catchup.sid, UserStreamsWriteBuffer::USER_STREAMS));
+  ASSERT_FALSE(entitlements.Find(catchup.sid, UserStreamsWriteBuffer::USER_STREAMS));
+  ASSERT_TRUE(entitlements.Find(catchup.sid, UserStreamsWriteBuffer::USER_CATCHUPS));
+  ASSERT_EQ(entitlements.GetSize(), kStreamsCount);
+}
+
+TEST(StreamClassResolver, known_and_unknown_classes) {
+  fastocloud::server::mongo::StreamClassResolver resolver;
+  const struct {
+    const char* cls;
+    fastotv::StreamType type;
+  } known[] = {{PROXY_STR, fastotv::PROXY},
+               {VOD_PROXY_STR, fastotv::VOD_PROXY},
+               {RELAY_STR, fastotv::RELAY},
+               {ENCODE_STR, fastotv::ENCODE},
+               {VOD_RELAY_STR, fastotv::VOD_RELAY},
+               {VOD_ENCODE_STR, fastotv::VOD_ENCODE},
+               {TIMESHIFT_RECORDER_STR, fastotv::TIMESHIFT_RECORDER},
+               {TIMESHIFT_PLAYER_STR, fastotv::TIMESHIFT_PLAYER},
+               {CATCHUP_STR, fastotv::CATCHUP},
+               {COD_RELAY_STR, fastotv::COD_RELAY},
+               {COD_ENCODE_STR, fastotv::COD_ENCODE},
+               {TEST_LIFE_STR, fastotv::TEST_LIFE}};
+  for (const auto& cls : known) {
+    fastotv::StreamType st;
+    ASSERT_TRUE(resolver.Resolve(cls.cls, strlen(cls.cls), &st));
+    ASSERT_EQ(st, cls.type);
+  }
+  ASSERT_EQ(resolver.GetUnknownCount(), 0);
+
+  const std::string unknown[] = {STREAM_CLASS_PREFIX "ProxyStreams", STREAM_CLASS_PREFIX "XroxyStream",
+                                 STREAM_CLASS_PREFIX, "pyfastocloud_models.stream.entry", "ProxyStream",
+                                 STREAM_CLASS_PREFIX "VodProxyStream"};
+  for (const auto& cls : unknown) {
+    fastotv::StreamType st;
+    ASSERT_FALSE(resolver.Resolve(cls.c_str(), cls.size(), &st));
+  }
+  ASSERT_EQ(resolver.GetUnknownCount(), sizeof(unknown) / sizeof(unknown[0]));
+}
+
+TEST(CreateOrFindCatchup, parts_lookup_is_one_query) {
+  static const size_t kPartsCount = 1000;
+  fastotv::commands_info::StreamBaseInfo::parts_t parts;
+  for (size_t i = 0; i < kPartsCount; ++i) {
+    char sid_str[25];
+    snprintf(sid_str, sizeof(sid_str), "5e2677ebd18029a8%08zx", i);
+    parts.push_back(sid_str);
+  }
+
+  bson_t query;
+  bson_init(&query);
+  ASSERT_TRUE(fastocloud::server::mongo::MakeFindCatchupInPartsQuery(parts, "Final", 1000, 2000, &query));
+
+  bson_iter_t iter;
+  bson_iter_t ids;
+  ASSERT_TRUE(bson_iter_init(&iter, &query) && bson_iter_find_descendant(&iter, STREAM_ID_FIELD ".$in", &ids));
+  ASSERT_TRUE(BSON_ITER_HOLDS_ARRAY(&ids));
+  bson_iter_t id;
+  ASSERT_TRUE(bson_iter_recurse(&ids, &id));
+  size_t count = 0;
+  while (bson_iter_next(&id)) {
+    ASSERT_TRUE(BSON_ITER_HOLDS_OID(&id));
+    count++;
+  }
+  ASSERT_EQ(count, kPartsCount);
+
+  bson_iter_t name;
+  ASSERT_TRUE(bson_iter_init_find(&name, &query, STREAM_NAME_FIELD));
+  ASSERT_STREQ(bson_iter_utf8(&name, NULL), "Final");
+  bson_iter_t stop;
+  ASSERT_TRUE(bson_iter_init_find(&stop, &query, CATCHUP_STOP_FIELD));
+  ASSERT_EQ(bson_iter_date_time(&stop), 2000);
+  bson_destroy(&query);
+
+  // no parts, nothing to look for
+  bson_init(&query);
+  ASSERT_FALSE(fastocloud::server::mongo::MakeFindCatchupInPartsQuery({}, "Final", 1000, 2000, &query));
+  bson_destroy(&query);
+}
+
+TEST(SingleFlight, identical_catchup_requests_share_one_creation) {
+  struct Created {
+    std::string id;
+    bool is_created = false;
+  };
+  static const size_t kRequestsCount = 1000;
+  fastocloud::server::base::SingleFlight<Created> flight;
+  std::atomic<size_t> executions(0);
+  const auto create = [&flight, &executions](Created* created) {
+    executions++;
+    // hold the creation until every other request is waiting for it
+    for (size_t i = 0; i < 1000 && flight.GetStats().shared != kRequestsCount - 1; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    created->id = "5e2677ebd18029a897d2716c";
+    created->is_created = true;
+    return common::Error();
+  };
+
+  std::atomic<size_t> announced(0);
+  std::atomic<size_t> same(0);
+  std::vector<std::thread> requests;
+  for (size_t i = 0; i < kRequestsCount; ++i) {
+    requests.push_back(std::thread([&flight, &create, &announced, &same]() {
+      Created created;
+      bool leader = false;
+      common::Error err = flight.Do("5e2677ebd18029a897d2716d/1000/2000/Final", create, &created, &leader);
+      if (!err && created.id == "5e2677ebd18029a897d2716c") {
+        same++;
+      }
+      if (leader && created.is_created) {
+        announced++;
+      }
+    }));
+  }
+  for (auto& request : requests) {
+    request.join();
+  }
+
+  ASSERT_EQ(executions, 1);
+  ASSERT_EQ(same, kRequestsCount);
+  ASSERT_EQ(announced, 1);
+  const fastocloud::server::base::SingleFlightStats stats = flight.GetStats();
+  ASSERT_EQ(stats.shared, kRequestsCount - 1);
+  ASSERT_EQ(stats.in_flight, 0);
+
+  // finished creations are not remembered
+  Created created;
+  bool leader = false;
+  ASSERT_FALSE(flight.Do("5e2677ebd18029a897d2716d/1000/2000/Final", create, &created, &leader));
+  ASSERT_TRUE(leader);
+  ASSERT_EQ(executions, 2);
+}
+
+namespace {
+// CreateCatchup of the manager with the database stubbed: the first creation inserts the catchup,
+// later ones find it among the parts of the base stream
+class CatchupsManager : public fastocloud::server::mongo::SubscribersManager {
+ public:
+  CatchupsManager() : SubscribersManager(nullptr), executions(0), overlapped(false), running_(0), created_(false) {}
+
+  common::Error FindStream(const fastocloud::server::base::ServerDBAuthInfo& auth,
+                           fastotv::stream_id_t sid,
+                           fastotv::commands_info::ChannelInfo* chan) const override {
+    UNUSED(auth);
+    UNUSED(sid);
+    *chan = fastotv::commands_info::ChannelInfo();
+    return common::Error();
+  }
+
+  std::atomic<size_t> executions;
+  std::atomic<bool> overlapped;
+
+ protected:
+  common::Error CreateOrFindCatchup(const fastotv::commands_info::ChannelInfo& based_on,
+                                    const std::string& title,
+                                    fastotv::timestamp_t start,
+                                    fastotv::timestamp_t stop,
+                                    std::string* serverid,
+                                    fastotv::commands_info::CatchupInfo* cat,
+                                    bool* is_created) override {
+    UNUSED(based_on);
+    UNUSED(title);
+    UNUSED(start);
+    UNUSED(stop);
+    executions++;
+    if (running_++) {
+      overlapped = true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    *serverid = "5e2677ebd18029a897d2716e";
+    *cat = fastotv::commands_info::CatchupInfo();
+    cat->SetStreamID("5e2677ebd18029a897d2716c");
+    *is_created = !created_.exchange(true);
+    running_--;
+    return common::Error();
+  }
+
+ private:
+  std::atomic<size_t> running_;
+  std::atomic<bool> created_;
+};
+}  // namespace
+
+TEST(SubscribersManager, concurrent_identical_catchups_are_created_once) {
+  static const size_t kRequestsCount = 1000;
+  const fastotv::timestamp_t exp_date = common::time::current_utc_mstime() + 3600 * 1000;
+  const auto auth = MakeTestAuth("5e2677ebd18029a897d2716c", "hash", "5e2677ebd18029a897d2716d", exp_date);
+  CatchupsManager manager;
+
+  // the subscribers handler announces CatchupCreated for the requests answered with is_created
+  std::atomic<size_t> announced(0);
+  std::atomic<size_t> same(0);
+  std::vector<std::thread> requests;
+  for (size_t i = 0; i < kRequestsCount; ++i) {
+    requests.push_back(std::thread([&manager, &auth, &announced, &same]() {
+      std::string serverid;
+      fastotv::commands_info::CatchupInfo cat;
+      bool is_created = false;
+      common::Error err = manager.CreateCatchup(auth, "5e2677ebd18029a897d2716f", "Final", 1000, 2000, &serverid,
+                                                &cat, &is_created);
+      if (!err && cat.GetStreamID() == "5e2677ebd18029a897d2716c") {
+        same++;
+      }
+      if (is_created) {
+        announced++;
+      }
+    }));
+  }
+  for (auto& request : requests) {
+    request.join();
+  }
+
+  ASSERT_FALSE(manager.overlapped);
+  ASSERT_GE(manager.executions, 1);
+  ASSERT_LT(manager.executions, kRequestsCount);
+  ASSERT_EQ(same, kRequestsCount);
+  ASSERT_EQ(announced, 1);
+}
+
+TEST(LatencyHistogram, buckets_keep_relative_precision) {
+  typedef fastocloud::server::base::LatencyHistogram LatencyHistogram;
+  for (uint64_t value = 0; value < 8; ++value) {
+    ASSERT_EQ(LatencyHistogram::GetBucketUpperBound(LatencyHistogram::GetBucketIndex(value)), value);
+  }
+
+  const uint64_t values[] = {8, 9, 15, 16, 17, 1000, 1023, 1024, 123456789, UINT64_MAX};
+  for (uint64_t value : values) {
+    const size_t index = LatencyHistogram::GetBucketIndex(value);
+    ASSERT_LT(index, static_cast<size_t>(LatencyHistogram::bucket_count));
+    const uint64_t upper = LatencyHistogram::GetBucketUpperBound(index);
+    ASSERT_GE(upper, value);
+    ASSERT_LE(upper - value, value / 8);
+  }
+
+  LatencyHistogram histogram;
+  ASSERT_EQ(histogram.GetPercentile(50), 0);
+  // 1..1000 usec, one sample each
+  for (uint64_t usec = 1; usec <= 1000; ++usec) {
+    histogram.Record(usec);
+  }
+  ASSERT_EQ(histogram.GetCount(), 1000);
+  ASSERT_EQ(histogram.GetMax(), 1000);
+  const uint64_t p50 = histogram.GetPercentile(50);
+  ASSERT_GE(p50, 500);
+  ASSERT_LE(p50, 500 + 500 / 8);
+  const uint64_t p99 = histogram.GetPercentile(99);
+  ASSERT_GE(p99, 990);
+  ASSERT_LE(p99, 1000);
+  ASSERT_EQ(histogram.GetPercentile(100), 1000);
+}
+
+TEST(OperationMetrics, per_operation_counters) {
+  fastocloud::server::base::OperationMetrics metrics;
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < 8; ++i) {
+    workers.push_back(std::thread([&metrics]() {
+      for (size_t j = 0; j < 1000; ++j) {
+        fastocloud::server::base::OperationMetrics::Sample sample;
+        sample.usec = 100 + j % 10;
+        sample.documents = 1;
+        sample.bytes = 512;
+        sample.error = j % 100 == 0;
+        metrics.Record("subscribers.find_login", sample);
+      }
+    }));
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  fastocloud::server::base::OperationMetrics::Sample slow;
+  slow.usec = 250000;
+  slow.slow = true;
+  metrics.Record("streams.find_by_ids", slow);
+
+  const std::vector<fastocloud::server::base::OperationStats> stats = metrics.GetStats();
+  ASSERT_EQ(stats.size(), 2);
+  ASSERT_EQ(stats[0].name, "streams.find_by_ids");
+  ASSERT_EQ(stats[0].calls, 1);
+  ASSERT_EQ(stats[0].slow, 1);
+  ASSERT_EQ(stats[0].max_usec, 250000);
+  ASSERT_EQ(stats[1].name, "subscribers.find_login");
+  ASSERT_EQ(stats[1].calls, 8000);
+  ASSERT_EQ(stats[1].errors, 80);
+  ASSERT_EQ(stats[1].documents, 8000);
+  ASSERT_EQ(stats[1].bytes, 8000 * 512);
+  ASSERT_GE(stats[1].p50_usec, 100);
+  ASSERT_LE(stats[1].p99_usec, 109);
+
+  // query plans of slow operations are logged at most once per interval
+  ASSERT_TRUE(metrics.TryAcquireDiagnostics("streams.find_by_ids", 1000, 60000));
+  ASSERT_FALSE(metrics.TryAcquireDiagnostics("streams.find_by_ids", 2000, 60000));
+  ASSERT_TRUE(metrics.TryAcquireDiagnostics("streams.find_by_ids", 61000, 60000));
+}
+
+TEST(ReadPreferences, catalog_reads_leave_the_primary) {
+  typedef fastocloud::server::mongo::ReadPreferences ReadPreferences;
+  ReadPreferences prefs;
+  ASSERT_EQ(prefs.Get(ReadPreferences::CATALOG_READS), nullptr);
+  ASSERT_EQ(prefs.GetLagWindow(ReadPreferences::CATALOG_READS), 0);
+
+  // staleness below the driver minimum is raised to it
+  prefs.Setup(ReadPreferences::CATALOG_READS, "nearest", 30);
+  const mongoc_read_prefs_t* catalog = prefs.Get(ReadPreferences::CATALOG_READS);
+  ASSERT_TRUE(catalog);
+  ASSERT_EQ(mongoc_read_prefs_get_mode(catalog), MONGOC_READ_NEAREST);
+  ASSERT_EQ(mongoc_read_prefs_get_max_staleness_seconds(catalog), ReadPreferences::min_max_staleness_seconds);
+  ASSERT_EQ(prefs.GetLagWindow(ReadPreferences::CATALOG_READS), ReadPreferences::min_max_staleness_seconds * 1000);
+
+  prefs.Setup(ReadPreferences::CATALOG_READS, "secondaryPreferred", 120);
+  catalog = prefs.Get(ReadPreferences::CATALOG_READS);
+  ASSERT_EQ(mongoc_read_prefs_get_mode(catalog), MONGOC_READ_SECONDARY_PREFERRED);
+  ASSERT_EQ(mongoc_read_prefs_get_max_staleness_seconds(catalog), 120);
+  ASSERT_EQ(prefs.GetLagWindow(ReadPreferences::CATALOG_READS), 120000);
+
+  prefs.Setup(ReadPreferences::CATALOG_READS, "closest", 120);
+  ASSERT_EQ(prefs.Get(ReadPreferences::CATALOG_READS), nullptr);
+  ASSERT_EQ(prefs.GetLagWindow(ReadPreferences::CATALOG_READS), 0);
+
+  // user reads never go to secondaries while there is a primary
+  prefs.Setup(ReadPreferences::USER_READS, "secondary", 120);
+  ASSERT_EQ(prefs.Get(ReadPreferences::USER_READS), nullptr);
+  prefs.Setup(ReadPreferences::USER_READS, "primaryPreferred", -1);
+  const mongoc_read_prefs_t* user = prefs.Get(ReadPreferences::USER_READS);
+  ASSERT_TRUE(user);
+  ASSERT_EQ(mongoc_read_prefs_get_mode(user), MONGOC_READ_PRIMARY_PREFERRED);
+  ASSERT_EQ(mongoc_read_prefs_get_max_staleness_seconds(user), MONGOC_NO_MAX_STALENESS);
+}
+
+TEST(QueryShapeChecker, winning_plan_stages) {
+  typedef fastocloud::server::mongo::QueryShapeChecker QueryShapeChecker;
+  ASSERT_EQ(QueryShapeChecker::ParseMode("check"), QueryShapeChecker::CHECK);
+  ASSERT_EQ(QueryShapeChecker::ParseMode("require"), QueryShapeChecker::REQUIRE);
+  ASSERT_EQ(QueryShapeChecker::ParseMode("unknown"), QueryShapeChecker::CREATE);
+
+  // rejected plans aren't run
+  bson_t* indexed = BCON_NEW("queryPlanner", "{", "winningPlan", "{", "stage", BCON_UTF8("FETCH"), "inputStage", "{",
+                             "stage", BCON_UTF8("IXSCAN"), "indexName", BCON_UTF8("email_1"), "}", "}",
+                             "rejectedPlans", "[", "{", "stage", BCON_UTF8("COLLSCAN"), "}", "]", "}");
+  std::vector<std::string> stages = QueryShapeChecker::GetWinningPlanStages(indexed);
+  ASSERT_EQ(stages.size(), 2);
+  ASSERT_EQ(stages[0], "FETCH");
+  ASSERT_EQ(stages[1], "IXSCAN email_1");
+  bson_destroy(indexed);
+
+  // every shard has its own plan, one scanning shard is enough to scan the collection
+  bson_t* sharded = BCON_NEW("queryPlanner", "{", "winningPlan", "{", "stage", BCON_UTF8("SHARD_MERGE"), "shards", "[",
+                             "{", "shardName", BCON_UTF8("s0"), "winningPlan", "{", "stage", BCON_UTF8("COLLSCAN"), "}",
+                             "}", "{", "shardName", BCON_UTF8("s1"), "winningPlan", "{", "queryPlan", "{", "stage",
+                             BCON_UTF8("IDHACK"), "}", "}", "}", "]", "}", "}");
+  stages = QueryShapeChecker::GetWinningPlanStages(sharded);
+  ASSERT_EQ(stages.size(), 3);
+  ASSERT_EQ(stages[0], "SHARD_MERGE");
+  ASSERT_EQ(stages[1], "COLLSCAN");
+  ASSERT_EQ(stages[2], "IDHACK");
+  bson_destroy(sharded);
+
+  bson_t* failed = BCON_NEW("ok", BCON_DOUBLE(0));
+  ASSERT_TRUE(QueryShapeChecker::GetWinningPlanStages(failed).empty());
+  bson_destroy(failed);
+
+  fastocloud::server::base::QueryPlanStats plan;
+  plan.index_state = INDEX_STATE_CREATED;
+  ASSERT_FALSE(QueryShapeChecker::IsUnserved(plan));
+  plan.collection_scan = true;
+  ASSERT_TRUE(QueryShapeChecker::IsUnserved(plan));
+  plan.collection_scan = false;
+  plan.index_state = INDEX_STATE_NO_PERMISSION;
+  ASSERT_TRUE(QueryShapeChecker::IsUnserved(plan));
+}
+
+TEST(Snapshot, lookups_by_id_and_email) {
+  using namespace fastocloud::server::mongo;
+  const std::string path = "/tmp/unit_tests_subscribers.snapshot";
+  unlink(path.c_str());
+
+  bson_oid_t users[3];
+  SnapshotWriter writer;
+  for (size_t i = 0; i < 3; ++i) {
+    bson_oid_init(&users[i], NULL);
+    const std::string email = "user" + std::to_string(i) + "@fastogt.com";
+    bson_t* user = BCON_NEW("_id", BCON_OID(&users[i]), "email", BCON_UTF8(email.c_str()));
+    ASSERT_TRUE(writer.Add(SNAPSHOT_SUBSCRIBERS, user));
+    bson_destroy(user);
+  }
+  bson_t* renamed = BCON_NEW("_id", BCON_OID(&users[1]), "email", BCON_UTF8("renamed@fastogt.com"));
+  ASSERT_TRUE(writer.Add(SNAPSHOT_SUBSCRIBERS, renamed));
+  bson_destroy(renamed);
+  bson_t* no_id = BCON_NEW("email", BCON_UTF8("no_id@fastogt.com"));
+  ASSERT_FALSE(writer.Add(SNAPSHOT_SUBSCRIBERS, no_id));
+  bson_destroy(no_id);
+  bson_t* token = BCON_NEW("_data", BCON_UTF8("8263"));
+  writer.SetResumeToken(token);
+  ASSERT_FALSE(writer.Write(path));
+
+  Snapshot snapshot;
+  ASSERT_FALSE(snapshot.Open(path));
+  ASSERT_EQ(snapshot.GetCount(SNAPSHOT_SUBSCRIBERS), 3);
+  ASSERT_EQ(snapshot.GetCount(SNAPSHOT_STREAMS), 0);
+
+  bson_t doc;
+  bson_iter_t iter;
+  ASSERT_TRUE(snapshot.Find(SNAPSHOT_SUBSCRIBERS, users[2], &doc));
+  ASSERT_TRUE(bson_iter_init_find(&iter, &doc, "email"));
+  ASSERT_STREQ(bson_iter_utf8(&iter, NULL), "user2@fastogt.com");
+  ASSERT_FALSE(snapshot.Find(SNAPSHOT_STREAMS, users[2], &doc));
+
+  // the last added of equal ids is kept
+  ASSERT_TRUE(snapshot.FindUserByEmail("renamed@fastogt.com", &doc));
+  ASSERT_TRUE(bson_iter_init_find(&iter, &doc, "_id"));
+  ASSERT_TRUE(bson_oid_equal(bson_iter_oid(&iter), &users[1]));
+  ASSERT_FALSE(snapshot.FindUserByEmail("user1@fastogt.com", &doc));
+  ASSERT_TRUE(snapshot.FindUserByEmail("user0@fastogt.com", &doc));
+
+  bson_t stored_token;
+  ASSERT_TRUE(snapshot.GetResumeToken(&stored_token));
+  ASSERT_TRUE(bson_equal(&stored_token, token));
+  bson_destroy(token);
+
+  // a file cut short is not a snapshot
+  ASSERT_EQ(truncate(path.c_str(), snapshot.GetSize() - 1), 0);
+  Snapshot truncated;
+  ASSERT_FALSE(truncated.Open(path));
+  truncated.Close();
+  ASSERT_EQ(truncate(path.c_str(), 16), 0);
+  ASSERT_TRUE(truncated.Open(path));
+  unlink(path.c_str());
+}
+
+TEST(SnapshotStore, changes_on_top_of_snapshot) {
+  using namespace fastocloud::server::mongo;
+  const std::string path = "/tmp/unit_tests_store.snapshot";
+  unlink(path.c_str());
+
+  bson_oid_t user;
+  bson_oid_init(&user, NULL);
+  bson_oid_t stream;
+  bson_oid_init(&stream, NULL);
+  SnapshotWriter writer;
+  bson_t* user_doc = BCON_NEW("_id", BCON_OID(&user), "email", BCON_UTF8("test@fastogt.com"));
+  writer.Add(SNAPSHOT_SUBSCRIBERS, user_doc);
+  bson_destroy(user_doc);
+  bson_t* stream_doc = BCON_NEW("_id", BCON_OID(&stream), "name", BCON_UTF8("first"));
+  writer.Add(SNAPSHOT_STREAMS, stream_doc);
+  bson_destroy(stream_doc);
+  ASSERT_FALSE(writer.Write(path));
+
+  SnapshotStore store;
+  ASSERT_FALSE(store.IsLoaded());
+  ASSERT_FALSE(store.Load(path));
+  SnapshotStore::document_t doc;
+  ASSERT_TRUE(store.FindUserByEmail("test@fastogt.com", &doc));
+
+  // email changed, the old one doesn't find the user any more
+  bson_t* update = BCON_NEW("operationType", BCON_UTF8("update"), "documentKey", "{", "_id", BCON_OID(&user), "}",
+                            "fullDocument", "{", "_id", BCON_OID(&user), "email", BCON_UTF8("new@fastogt.com"), "}");
+  bson_oid_t changed;
+  ASSERT_EQ(store.Apply(SNAPSHOT_SUBSCRIBERS, update, &changed), SnapshotStore::CHANGE_APPLIED);
+  ASSERT_TRUE(bson_oid_equal(&changed, &user));
+  bson_destroy(update);
+  ASSERT_FALSE(store.FindUserByEmail("test@fastogt.com", &doc));
+  ASSERT_TRUE(store.FindUserByEmail("new@fastogt.com", &doc));
+
+  bson_t* remove = BCON_NEW("operationType", BCON_UTF8("delete"), "documentKey", "{", "_id", BCON_OID(&stream), "}");
+  ASSERT_EQ(store.Apply(SNAPSHOT_STREAMS, remove, &changed), SnapshotStore::CHANGE_APPLIED);
+  bson_destroy(remove);
+  ASSERT_FALSE(store.Find(SNAPSHOT_STREAMS, stream, &doc));
+
+  bson_t* drop = BCON_NEW("operationType", BCON_UTF8("drop"));
+  ASSERT_EQ(store.Apply(SNAPSHOT_STREAMS, drop, &changed), SnapshotStore::STREAM_ENDED);
+  bson_destroy(drop);
+  ASSERT_EQ(store.GetChangesCount(), 2);
+
+  // compacted into the file with the position of the last change
+  bson_t* token = BCON_NEW("_data", BCON_UTF8("8264"));
+  store.SetResumeToken(token);
+  ASSERT_FALSE(store.Compact(path));
+  ASSERT_EQ(store.GetChangesCount(), 0);
+  ASSERT_TRUE(store.FindUserByEmail("new@fastogt.com", &doc));
+  ASSERT_FALSE(store.Find(SNAPSHOT_STREAMS, stream, &doc));
+
+  SnapshotStore restarted;
+  ASSERT_FALSE(restarted.Load(path));
+  ASSERT_TRUE(restarted.GetResumeToken(&doc));
+  ASSERT_TRUE(bson_equal(doc.get(), token));
+  ASSERT_TRUE(restarted.Find(SNAPSHOT_SUBSCRIBERS, user, &doc));
+  bson_destroy(token);
+  unlink(path.c_str());
+}
+
+TEST(ListDigest, delta_of_changed_entries) {
+  using namespace fastocloud::server::subscribers;
+  json_object* jprevious = json_tokener_parse(
+      "[{\"id\": \"a\", \"name\": \"A\"}, {\"id\": \"b\", \"name\": \"B\"}, {\"id\": \"c\", \"name\": \"C\"}]");
+  ListDigest previous;
+  ASSERT_FALSE(ListDigest::Make(jprevious, &previous));
+  ASSERT_EQ(previous.GetSize(), 3);
+
+  ListDigest current;
+  json_object* jdelta = nullptr;
+  size_t changes = 0;
+  ASSERT_FALSE(ListDigest::MakeDelta(previous, jprevious, &current, &jdelta, &changes));
+  ASSERT_EQ(jdelta, nullptr);
+  ASSERT_EQ(changes, 0);
+  json_object_put(jprevious);
+
+  // b renamed, c removed, d added, an entry without id is not tracked
+  json_object* jlist = json_tokener_parse(
+      "[{\"id\": \"d\", \"name\": \"D\"}, {\"id\": \"b\", \"name\": \"B2\"}, {\"id\": \"a\", \"name\": \"A\"}, "
+      "{\"name\": \"no id\"}]");
+  ASSERT_FALSE(ListDigest::MakeDelta(previous, jlist, &current, &jdelta, &changes));
+  ASSERT_EQ(changes, 3);
+  ASSERT_EQ(current.GetSize(), 3);
+  json_object_put(jlist);
+
+  json_object* jadded = nullptr;
+  ASSERT_TRUE(json_object_object_get_ex(jdelta, "added", &jadded));
+  ASSERT_EQ(json_object_array_length(jadded), 1);
+  json_object* jid = nullptr;
+  ASSERT_TRUE(json_object_object_get_ex(json_object_array_get_idx(jadded, 0), "id", &jid));
+  ASSERT_STREQ(json_object_get_string(jid), "d");
+
+  json_object* jupdated = nullptr;
+  ASSERT_TRUE(json_object_object_get_ex(jdelta, "updated", &jupdated));
+  ASSERT_EQ(json_object_array_length(jupdated), 1);
+  json_object* jname = nullptr;
+  ASSERT_TRUE(json_object_object_get_ex(json_object_array_get_idx(jupdated, 0), "name", &jname));
+  ASSERT_STREQ(json_object_get_string(jname), "B2");
+
+  json_object* jremoved = nullptr;
+  ASSERT_TRUE(json_object_object_get_ex(jdelta, "removed", &jremoved));
+  ASSERT_EQ(json_object_array_length(jremoved), 1);
+  ASSERT_STREQ(json_object_get_string(json_object_array_get_idx(jremoved, 0)), "c");
+  json_object_put(jdelta);
+}